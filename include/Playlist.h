@@ -7,6 +7,10 @@
 
 #include <wx/treectrl.h>
 #include <wx/dnd.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "common/tagindex.h"
 
 
 class MainFrame;
@@ -14,6 +18,7 @@ class PSFFileDropTarget;
 class SoundLoader;
 class SoundData;
 class PSFPlaylistItem;
+class PlaylistTagScanner;
 
 
 class PSFPlaylist: public wxTreeCtrl
@@ -24,7 +29,11 @@ public:
 
     wxTreeItemId AppendItem(const wxString& text, int image = -1, int selImage = -1, PSFPlaylistItem* data = 0);
     PSFPlaylistItem* GetSelectedItem() const;
+    //! Full paths of the selected item and of every item after it.
+    wxArrayString GetPathsFromSelection() const;
 
+    //! Append a file or every PSF file below a directory.
+    //! Tags are filled in from the index or by the background scanner.
     bool Append(const wxString& file_name);
 
 protected:
@@ -32,12 +41,23 @@ protected:
     void Activated(wxTreeEvent &event);
     void OnDropFiles(wxDropFilesEvent& event);
 
+    //! Called on the main thread for every scanned file.
+    void OnTagsScanned(const TrackTags& tags);
+    void OnScanFinished();
+
 	wxDECLARE_EVENT_TABLE();
 
 private:
+    bool AppendFile(const wxString& path);
+
 	wxTreeItemId rootId;
 	PSFFileDropTarget *fdt;
 
+    TagIndex tag_index_;
+    std::unique_ptr<PlaylistTagScanner> scanner_;
+    std::unordered_map<std::string, wxTreeItemId> items_;   // by UTF-8 path
+
+    friend class PlaylistTagScanner;
 };
 
 
@@ -49,12 +69,13 @@ public:
     ~PSFPlaylistItem();
 
     SoundData* GetSound() const;
-	const wxString& GetFullPath() const;
+	const wxString& GetFullPath() const { return m_fullpath; }
 	const wxString& GetFileName() const;
 	const wxString& GetExt() const;
 
     bool IsAvailable() const;
 
+    //! Load the sound on first use; the playlist itself never does.
     SoundData* LoadSound();
 
     friend class PSFPlaylist;
@@ -64,7 +85,7 @@ protected:
 
 private:
     SoundLoader *m_loader;
-    // wxString fullpath;
+    wxString m_fullpath;
     wxString m_filename;
     wxString m_ext;
     SoundData *m_sound;
@@ -14,17 +14,37 @@ private:
 };
 
 #include "common/SoundManager.h"
+#include "common/taskpool.h"
+#include <wx/arrstr.h>
+#include <wx/sharedptr.h>
+#include <wx/vector.h>
 class SoundData;
+class SoundInfo;
+class SoundLoader;
 
 class RennyPlayer {
 public:
   RennyPlayer();
   ~RennyPlayer();
 
-  bool Play(SoundData* p_sound, SoundDevice* p_device);
+  //! Play a sound which is already loaded; the player takes it over.
+  bool Play(SoundData* p_sound, SoundDevice* p_device, const SoundInfo* p_info = nullptr);
+  //! Play files one after another without gaps between them.
+  /*!
+   Each file is loaded, booted and run up to its first sample on the
+   TaskPool while the previous one plays. When a sound reaches
+   the end of its 'length' and 'fade' tags, the player thread switches to
+   the warmed-up one between two blocks. Sounds without a 'length' tag
+   play until Play() or Stop() is called.
+  */
+  bool Play(const wxArrayString& paths, SoundDevice* p_device);
   bool Stop();
   bool IsPlaying() const;
 
+  //! Append a file to the files played after the current one.
+  void Enqueue(const wxString& path);
+  void ClearQueue();
+
   bool Mute(int ch);
   bool Unmute(int ch);
   bool IsMuted(int ch) const;
@@ -41,10 +61,57 @@ private:
   };
   friend class RennyPlayerThread;
 
+  SoundBlock& block() { return blocks_[block_index_]; }
+  const SoundBlock& block() const { return blocks_[block_index_]; }
+
+  bool StartThread(SoundDevice* p_device);
+  void StopThread();
+  //! Called with mutex_ locked; schedules WarmUpTask() unless it is scheduled already.
+  void StartWarmUp();
+  void StopWarmUp();
+  //! Loads and opens queued files, and closes finished sounds, until there are none left.
+  void WarmUpTask();
+  //! Called with mutex_ locked; unlocks it while the file is loaded.
+  void WarmUp(const wxString& path);
+  //! Hand a sound over to the warm-up task to be closed and deleted.
+  void Retire(SoundData* p_sound, SoundLoader* p_loader);
+  void DeleteRetired();
+
+  // on the player thread
+  bool HasEnded() const;
+  bool SwitchToNext();
+  //! Wait until the next sound is warmed up. False if none is coming.
+  bool WaitForNext();
+  //! Fades out the block and cuts it off where the sound ends.
+  void Fade(SoundBlock* p_block);
+
   RennyPlayerThread* thread_;
   SoundDevice* p_device_;
   SoundData* p_sound_;
-  SoundBlock block_;
+  SoundLoader* p_loader_;   // nullptr if p_sound_ came from Play(SoundData*)
+  SoundBlock blocks_[2];    // the current sound's and the next one's
+  int block_index_;
+  size_t played_frames_;
+  size_t end_frames_;       // 0 if the sound does not end
+  size_t fade_frames_;
+  bool ended_;
+
+  // shared with the warm-up task, guarded by mutex_
+  TaskGroup warm_up_;
+  bool warm_up_scheduled_;
+  wxMutex mutex_;
+  wxCondition next_ready_;    // signaled when WarmUp() or ClearQueue() is done
+  wxArrayString queue_;
+  unsigned int generation_;   // incremented by ClearQueue()
+  bool warming_up_;
+  bool exiting_;
+  bool stopping_;             // the player thread is being deleted
+  SoundData* next_sound_;
+  SoundLoader* next_loader_;
+  size_t next_end_frames_;
+  size_t next_fade_frames_;
+  wxVector<SoundData*> retired_sounds_;
+  wxVector<SoundLoader*> retired_loaders_;
 };
 
 
@@ -69,6 +136,7 @@ public:
 #endif  // USE_GUI
 
   bool Play(SoundData*);
+  bool Play(const wxArrayString& paths);
   bool Stop();
 
   bool Mute(int ch);
@@ -44,7 +44,6 @@ public:
 
 protected:
   void paintEvent(wxPaintEvent&);
-  void OnChangeVelocity(const NoteInfo& note);
 
 private:
   wxOrientation orientation_;
@@ -79,6 +78,8 @@ public:
   bool PressKey(double pitch);
   void ReleaseKey();
   void ReleaseKey(int keyIndex);
+  //! Press the key of pitch, releasing the one shown before, unless it is the same.
+  void ShowNote(bool on, double pitch);
 
 protected:
   void paintEvent(wxPaintEvent&);
@@ -91,10 +92,7 @@ protected:
 
 protected:
   int calcKeyboardWidth();
-
-  void OnNoteOn(wxCommandEvent& event);
-  void OnNoteOff(wxCommandEvent& event);
-  void OnChangePitch(wxCommandEvent& event);
+  static int KeyIndex(double pitch);
 
 private:
   int keyWidth_, keyHeight_;
@@ -105,6 +103,7 @@ private:
   wxVector<int> keys_to_press_;
   wxVector<int> keys_to_release_;
   bool update_key_;
+  int shown_key_;   // -1 if none
 
   static const int defaultOctaveMin = -1;
   static const int defaultOctaveMax = 9;
@@ -119,7 +118,9 @@ inline float VolumeBar::GetValue() const {
 }
 
 inline void VolumeBar::SetValue(float value) {
+  if (value_ == value) return;
   value_ = value;
+  Refresh(false);
 }
 
 
@@ -130,9 +131,10 @@ class RateText : public wxStaticText {
 public:
   RateText(wxWindow* parent, int ch);
 
+  void SetRate(int rate);
+
 protected:
   // void OnPaint(wxPaintEvent &event);
-  void OnChangePitch(const NoteInfo& note);
 
 private:
   int rate_;
@@ -143,6 +145,7 @@ private:
 
 #include <wx/event.h>
 #include <wx/scrolwin.h>
+#include <wx/timer.h>
 
 class ChannelPanel: public wxScrolledWindow
 {
@@ -154,6 +157,9 @@ public:
   // void onChangeLoopIndex(wxCommandEvent& event);
 
 private:
+  //! Shows the latest VoiceFeed snapshot, at about the display refresh rate.
+  void OnTimer(wxTimerEvent& event);
+
   struct ChannelElement {
     int ich;
     wxBoxSizer* channelSizer;
@@ -164,9 +170,11 @@ private:
     VolumeBar *volumeLeft;
     wxStaticText* textToneOffset;
     wxStaticText* textToneLoop;
-    wxStaticText* rate_text;
+    RateText* rate_text;
   };
 
   wxBoxSizer* wholeSizer;
+  VolumeBar* master_bars_[2];   // the peaks of the mix, left and right
   wxVector<ChannelElement> elements;
+  wxTimer timer_;
 };
@@ -1,8 +1,10 @@
 #pragma once
 
-#include <wx/vector.h>
-#include <wx/file.h>
-#include "SoundFormatInfo.h"
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 
 
@@ -65,7 +67,7 @@ private:
   bool muted_;
   bool enables_envelope_;
 
-  wxVector<ISampleListener*> listeners_;
+  std::vector<ISampleListener*> listeners_;
 };
 
 
@@ -127,6 +129,8 @@ public:
   ~SampleSequence() = default;
 
   void ClearData();
+  //! Drop the samples from length on.
+  void Truncate(size_t length);
 
   size_t sample_length() const {
     return samples_.size();
@@ -157,15 +161,18 @@ public:
   void Unmute() { muted_ = false; }
   bool IsMuted() const { return muted_; }
 
-private:
+  //! Getf() of a sample is sample_ * vol_left_ and sample_ * vol_right_.
   struct SampleEx {
     float sample_;
     float vol_left_;
     float vol_right_;
     int env_;
   };
+  //! The stored samples, sample_length() of them.
+  const SampleEx* data() const { return samples_.data(); }
 
-  wxVector<SampleEx> samples_;
+private:
+  std::vector<SampleEx> samples_;
   float vol_left_;
   float vol_right_;
   bool muted_;
@@ -179,11 +186,6 @@ private:
 ////////////////////////////////////////////////////////////////////////
 
 
-class SoundDevice;
-
-#include <wx/sharedptr.h>
-#include <wx/weakref.h>
-
 class SoundBlock {
 public:
   SoundBlock(int channel_number = 2);
@@ -241,27 +243,26 @@ public:
 
   void GetStereo16(int seq_no, short*) const;
 
+  //! Every channel, then the reverb bus if it is enabled.
+  unsigned int stem_count() const {
+    return channel_count() + (rvb_is_enabled_ ? 1 : 0);
+  }
+  //! The contribution of one stem to GetStereo16().
+  void GetStemStereo16(int stem, int seq_no, short* dest) const;
+
   void Clear();
   void Reset();
-
-  SoundDevice* output();
-  void set_output(SoundDevice*);
-
-  bool NotifyDevice();
+  //! Drop every sequence's samples from length on.
+  void Truncate(size_t length);
 
 private:
-  // wxVector<Sample16> samples_;  // TODO: support changing sample type
-  wxVector<SampleSequence> samples_;  // TODO: support changing sample type
+  std::vector<SampleSequence> samples_;  // TODO: support changing sample type
   // Sample16 rvb_sample_[2];
   SampleSequence rvb_sample_[2];
   bool rvb_is_enabled_;
-  wxWeakRef<SoundDevice> output_;
 };
 
 
-#include "note.h"
-
-
 class SoundData;
 /*
 class SoundFormatListener {
@@ -277,60 +278,60 @@ protected:
 */
 
 class Soundbank;
+class LoopDetector;
+class VoiceFeed;
 
 
 ////////////////////////////////////////////////////////////////////////
 // SoundInfo classes
 ////////////////////////////////////////////////////////////////////////
 
-#include <wx/tracker.h>
-#include <wx/hashmap.h>
-
-class SoundInfo : public wxTrackable {
+//! Tags of a sound; every string is UTF-8.
+class SoundInfo {
 public:
-  WX_DECLARE_STRING_HASH_MAP(wxString, Tag);
+  typedef std::unordered_map<std::string, std::string> Tag;
 
   SoundInfo();
   ~SoundInfo();
 
-  const wxString& title() const { return title_; }
-  void set_title(const wxString& title) { title_ = title; }
+  const std::string& title() const { return title_; }
+  void set_title(const std::string& title) { title_ = title; }
 
-  const wxString& artist() const { return artist_; }
-  void set_artist(const wxString& artist) { artist_ = artist; }
+  const std::string& artist() const { return artist_; }
+  void set_artist(const std::string& artist) { artist_ = artist; }
 
-  const wxString& album() const { return album_; }
-  void set_album(const wxString& album) { album_ = album; }
+  const std::string& album() const { return album_; }
+  void set_album(const std::string& album) { album_ = album; }
 
-  const wxString& year() const { return year_; }
-  void set_year(const wxString& year) { year_ = year; }
+  const std::string& year() const { return year_; }
+  void set_year(const std::string& year) { year_ = year; }
 
-  const wxString& genre() const { return genre_; }
-  void set_genre(const wxString& genre) { genre_ = genre; }
+  const std::string& genre() const { return genre_; }
+  void set_genre(const std::string& genre) { genre_ = genre; }
 
-  const wxString& comment() const { return comment_; }
-  void set_comment(const wxString& comment) { comment_ = comment; }
+  const std::string& comment() const { return comment_; }
+  void set_comment(const std::string& comment) { comment_ = comment; }
 
-  const wxString& copyright() const { return copyright_; }
-  void set_copyright(const wxString& copyright) { copyright_ = copyright; }
+  const std::string& copyright() const { return copyright_; }
+  void set_copyright(const std::string& copyright) { copyright_ = copyright; }
 
-  const wxString& length() const { return length_; }
-  void set_length(const wxString& length) { length_ = length; }
+  const std::string& length() const { return length_; }
+  void set_length(const std::string& length) { length_ = length; }
 
   const Tag& others() const { return others_; }
   void set_tags(const Tag& tags);
 
 private:
-  wxString title_;
-  wxString artist_;
-  wxString album_;
-  wxString year_;
-  wxString genre_;
-  wxString comment_;
-  wxString copyright_;
+  std::string title_;
+  std::string artist_;
+  std::string album_;
+  std::string year_;
+  std::string genre_;
+  std::string comment_;
+  std::string copyright_;
   // int len_minutes_;
   // int len_seconds_;
-  wxString length_;
+  std::string length_;
 
   Tag others_;
 };
@@ -343,10 +344,12 @@ private:
 /*!
  @brief A base class for Sound Format (?sf).
 */
-class SoundData : public wxTrackable
+class SoundData
 {
 public:
-  SoundData() : infoLoaded_(false), repeated_(true), pos_(0) {}
+  SoundData()
+    : infoLoaded_(false), repeated_(true), synchronized_(false), pos_(0),
+      loop_detector_(nullptr), voice_feed_(nullptr), streaming_(false), stream_pos_(0) {}
   //! A virtual desctructor.
   virtual ~SoundData() = default;
 
@@ -358,9 +361,6 @@ public:
   //! Check if the sound is loaded.
   bool IsLoaded() const;
 
-  // void GetTag(const wxString &key, wxString *value) const;
-  // void SetTag(const wxString &key, const wxString &value);
-
   //! Play the sound.
   // bool Play(SoundDevice*);
   //! Stop the sound if it is playing.
@@ -371,16 +371,65 @@ public:
   bool Advance(SoundBlock* dest);
   bool IsRepeated() const { return repeated_; }
   void Repeat(bool b = true) { repeated_ = b; }
+  //! Render on the caller's thread instead of a helper thread. Set before Open().
+  bool IsSynchronized() const { return synchronized_; }
+  void Synchronize(bool b = true) { synchronized_ = b; }
+
+  //! Open the sound for Render(). It is synchronized and owns its block.
+  bool OpenStream();
+  bool CloseStream();
+  bool IsStreaming() const { return streaming_; }
+  //! Write exactly 'frames' interleaved 16-bit stereo frames.
+  /*!
+   Pull interface for host audio callbacks. The emulator is advanced on the
+   caller's thread only as far as needed; samples left over from the last
+   SoundBlock are carried over to the next call. No helper thread is
+   involved and nothing waits on another thread. Frames which cannot be
+   produced (not streaming or the sound has ended) are filled with silence.
+   @return the number of frames actually rendered.
+  */
+  size_t Render(int16_t* interleaved, size_t frames);
+  //! Render() which also splits every frame into its stems.
+  /*!
+   stems holds stem_count() planes of 'frames' interleaved stereo frames;
+   each voice and the reverb bus is written exactly as it is mixed into
+   'interleaved', so the stems sum up to the mix (before clipping).
+  */
+  size_t RenderStems(int16_t* interleaved, int16_t* stems, size_t frames);
+  //! Voices of the stream, plus its reverb bus; valid after OpenStream().
+  unsigned int voice_count() const { return stream_block_.channel_count(); }
+  unsigned int stem_count() const { return stream_block_.stem_count(); }
+
+  //! Watch Render() output, and the emulator if it can, for loops and silence.
+  /*!
+   Set before OpenStream(); the detector is not owned and must outlive the
+   stream. Render() hands every rendered frame to it, and formats which
+   know their key-on events report them through LoopDetector::AddEvent().
+  */
+  void set_loop_detector(LoopDetector* detector) { loop_detector_ = detector; }
+  LoopDetector* loop_detector() const { return loop_detector_; }
+
+  //! Publish the state of the voices to feed once per block, if the format knows
+  //! its voices; nullptr stops. Set and cleared on the thread calling Advance().
+  void set_voice_feed(VoiceFeed* feed) { voice_feed_ = feed; }
+  VoiceFeed* voice_feed() const { return voice_feed_; }
+
+  //! Record what drives the sound chip into a log which plays back without
+  //! emulating the CPU. Call before Open(); false if it is not supported.
+  virtual bool StartCapture(const std::string& /*path*/) { return false; }
+
+  //! Sample where the emulated CPU spends its cycles, one sample every
+  //! interval cycles, and write a hot-spot report to path when the stream
+  //! is closed. Call before Open(); false if there is no CPU to profile.
+  virtual bool StartProfile(const std::string& /*path*/, unsigned int /*interval*/) { return false; }
 
   //! Returns the reference of Soundbank.
   virtual Soundbank& soundbank() = 0;
 
-  const wxString& GetFileName() const;
+  const std::string& GetFileName() const;
   virtual unsigned int GetSamplingRate() const = 0;
   virtual bool ChangeOutputSamplingRate(uint32_t rate) = 0;
 
-  Note GetNote(int ch) const;
-
   // const Wavetable& wavetable() const;
 
 protected:
@@ -397,12 +446,19 @@ protected:
 
   virtual bool DoAdvance(SoundBlock* dest) = 0;
 
-  wxFile file_;
-  wxString path_;
+  std::string path_;
   bool infoLoaded_;
   bool repeated_;
+  bool synchronized_;
 
   size_t pos_;
+  LoopDetector* loop_detector_;
+  VoiceFeed* voice_feed_;
+
+private:
+  SoundBlock stream_block_;
+  bool streaming_;
+  size_t stream_pos_;   // next unread sample in stream_block_
 };
 
 
@@ -410,7 +466,7 @@ inline bool SoundData::IsLoaded() const {
   return infoLoaded_;
 }
 
-inline const wxString& SoundData::GetFileName() const {
+inline const std::string& SoundData::GetFileName() const {
   return path_;
 }
 
@@ -1,23 +1,26 @@
 #pragma once
-#include <wx/tracker.h>
+#include <string>
 
 class SoundInfo;
 class SoundData;
-class wxString;
 
-class SoundLoader: public wxTrackable
+class SoundLoader
 {
 public:
   SoundLoader();
   virtual ~SoundLoader() = default;
 
-  static SoundLoader* Instance(const wxString& filename);
+  //! The loader for the format of the file, chosen by its signature.
+  static SoundLoader* Instance(const std::string& filename);
 
-  // virtual const wxString &GetPath() const = 0;
+  // virtual const std::string &GetPath() const = 0;
 
+  //! Owned by the loader, and loaded only once.
   virtual SoundInfo* LoadInfo() = 0;
+  //! A new sound every call; the caller owns it.
   virtual SoundData* LoadData() = 0;
 
-  typedef SoundLoader* (*InstanceFunc)(int fd, const wxString& filename);
+  //! Takes over fd, which is open for reading.
+  typedef SoundLoader* (*InstanceFunc)(int fd, const std::string& filename);
   static bool RegisterInstanceFunc(InstanceFunc func, const char* signature);
 };
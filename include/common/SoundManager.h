@@ -13,16 +13,6 @@
 #include <wx/msgqueue.h>
 
 
-struct NoteInfo {
-  int ch;
-  bool is_on;
-  int tone_number_;
-  float pitch;
-  int rate;
-  float velocity;
-};
-
-
 struct ToneInfo {
   int number;
   int length;
@@ -34,12 +24,6 @@ struct ToneInfo {
 
 
 
-wxDECLARE_EXPORTED_EVENT(WXDLLIMPEXP_CORE, wxEVT_NOTE_ON, wxCommandEvent);
-wxDECLARE_EXPORTED_EVENT(WXDLLIMPEXP_CORE, wxEVT_NOTE_OFF, wxCommandEvent);
-wxDECLARE_EXPORTED_EVENT(WXDLLIMPEXP_CORE, wxEVT_CHANGE_TONE_NUMBER, wxCommandEvent);
-wxDECLARE_EXPORTED_EVENT(WXDLLIMPEXP_CORE, wxEVT_CHANGE_PITCH, wxCommandEvent);
-wxDECLARE_EXPORTED_EVENT(WXDLLIMPEXP_CORE, wxEVT_CHANGE_VELOCITY, wxCommandEvent);
-
 wxDECLARE_EXPORTED_EVENT(WXDLLIMPEXP_CORE, wxEVT_ADD_TONE, wxCommandEvent);
 wxDECLARE_EXPORTED_EVENT(WXDLLIMPEXP_CORE, wxEVT_CHANGE_TONE, wxCommandEvent);
 wxDECLARE_EXPORTED_EVENT(WXDLLIMPEXP_CORE, wxEVT_REMOVE_TONE, wxCommandEvent);
@@ -93,7 +77,6 @@ protected:
   static const int kDefaultBufferLength = 90;
 
 private:
-  wxVector<NoteInfo> notes_, next_notes_;
   // wxVector<ToneInfo> tones_;
 
   wxScopedArray<short> buffer_;
@@ -163,11 +146,12 @@ protected:
 private:
   // bool is_multithreading_; // force
 
-  static ALCdevice *device_;
-  static ALCcontext *context_;
-  static int source_number_;
+  // Each instance owns its device, context and thread, so that several
+  // players can coexist in one process.
+  ALCdevice *device_;
+  ALCcontext *context_;
 
-  static WaveOutALThread* thread_;
+  WaveOutALThread* thread_;
 
   ALuint buffer_, source_;
   wxMutex mutex_, mutex2_;
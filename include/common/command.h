@@ -2,7 +2,7 @@
 #define COMMAND_H_
 
 #include <string>
-#include <wx/vector.h>
+#include <vector>
 
 class Command {
 
@@ -13,12 +13,12 @@ public:
   virtual bool Execute() = 0;
 
 protected:
-  const wxVector<std::string>& params() const {
+  const std::vector<std::string>& params() const {
     return params_;
   }
 
 private:
-  wxVector<std::string> params_;
+  std::vector<std::string> params_;
 };
 
 
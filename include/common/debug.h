@@ -1,78 +1,105 @@
 #pragma once
 
-#include <wx/string.h>
-#include <wx/weakref.h>
-#include <wx/file.h>
 #include <stdint.h>
+#include <atomic>
+#include <ctime>
 
-class wxFrame;
-class RennyDebugListCtrl;
-class wxCloseEvent;
-
-class RennyDebug {
-  
-protected:
-  RennyDebug(wxWindow* parent);
-  ~RennyDebug();
-  
-public:
-  static RennyDebug* Instance();
-  static void CreateWindow(wxWindow* parent);
-  static void DestroyWindow();
-
-  bool IsWindowCreated() const;
-  void ShowWindow();
-  void HideWindow();
-
-  void OnClose(wxCloseEvent& event);
-
-  enum LogLevel {
-    kLogLevelNone = 0,
-    kLogLevelDebug,
-    kLogLevelInfo,
-    kLogLevelNotice,
-    kLogLevelWarning,
-    kLogLevelError,
-    kLogLevelCritical,
-    kLogLevelAlert,
-    kLogLevelEmergency,
-    kLogLevelMax
-  };
-
-  void Log(LogLevel log_level, const wxString& instance_name, const wxString& msg);
-  
-  void LogError(const wxString& instance_name, const wxString& msg);
-  void LogWarning(const wxString& instance_name, const wxString& msg);
-  void LogInfo(const wxString& instance_name, const wxString& msg);
+/*
+ * Logging
+ *
+ * rennyLogError/Warning/Info/Debug(instance_name, printf format, ...) are
+ * macros which test the level before anything else: messages below
+ * RENNY_LOG_LEVEL are compiled out, and messages below the runtime level
+ * (rennySetLogLevel()) cost one relaxed load, without evaluating their
+ * arguments. Every call site may log a burst of messages per second;
+ * further ones are only counted and reported with the next message which
+ * gets through. Messages are formatted into a fixed-size slot of a
+ * lock-free queue and handed to the log sink by a background thread, so
+ * logging from the audio path never waits for the log file or the debug
+ * window. Nothing is formatted until a sink has been set, e.g. when
+ * rendering without the GUI.
+ */
+#define RENNY_LOG_LEVEL_DEBUG   1
+#define RENNY_LOG_LEVEL_INFO    2
+#define RENNY_LOG_LEVEL_WARNING 4
+#define RENNY_LOG_LEVEL_ERROR   5
+#define RENNY_LOG_LEVEL_NONE    9
+
+#ifndef RENNY_LOG_LEVEL
 #ifndef NDEBUG
-  void LogDebug(const wxString& instance_name, const wxString& msg);
+#define RENNY_LOG_LEVEL RENNY_LOG_LEVEL_DEBUG
+#else
+#define RENNY_LOG_LEVEL RENNY_LOG_LEVEL_INFO
+#endif
 #endif
 
-private:
-  static RennyDebug* instance_;
-  wxFile log_file_;
-
-  wxWeakRef<wxFrame> frame_;
-  wxWeakRef<RennyDebugListCtrl> list_ctrl_;
+//! Per call site state for rate limiting; zero-initialized as a static.
+struct RennyLogSite {
+  std::atomic<uint32_t> window;       // steady clock seconds of the current window
+  std::atomic<uint32_t> count;        // messages in the current window
+  std::atomic<uint32_t> suppressed;
 };
 
+extern std::atomic<int> renny_log_level;
+
+inline bool rennyLogIsEnabled(int level) {
+  return level >= renny_log_level.load(std::memory_order_relaxed);
+}
+
+#define RENNY_LOG_(level, ...) \
+  do { \
+    if (rennyLogIsEnabled(level)) { \
+      static RennyLogSite renny_log_site; \
+      rennyLogAt(&renny_log_site, (level), __VA_ARGS__); \
+    } \
+  } while (0)
+
+// compiled out: the arguments are not even compiled
+#define RENNY_LOG_NOTHING_(...) do {} while (0)
+
+#if RENNY_LOG_LEVEL <= RENNY_LOG_LEVEL_ERROR
+#define rennyLogError(...)   RENNY_LOG_(RENNY_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define rennyLogError(...)   RENNY_LOG_NOTHING_(__VA_ARGS__)
+#endif
+#if RENNY_LOG_LEVEL <= RENNY_LOG_LEVEL_WARNING
+#define rennyLogWarning(...) RENNY_LOG_(RENNY_LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define rennyLogWarning(...) RENNY_LOG_NOTHING_(__VA_ARGS__)
+#endif
+#if RENNY_LOG_LEVEL <= RENNY_LOG_LEVEL_INFO
+#define rennyLogInfo(...)    RENNY_LOG_(RENNY_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define rennyLogInfo(...)    RENNY_LOG_NOTHING_(__VA_ARGS__)
+#endif
+#if RENNY_LOG_LEVEL <= RENNY_LOG_LEVEL_DEBUG
+#define rennyLogDebug(...)   RENNY_LOG_(RENNY_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define rennyLogDebug(...)   RENNY_LOG_NOTHING_(__VA_ARGS__)
+#endif
+
 extern "C" {
 
-void rennyCreateDebugWindow(wxWindow* parent);
-void rennyDestroyDebugWindow();
-void rennyShowDebugWindow();
-void rennyHideDebugWindow();
+//! Receives every message on the log writer thread, in the logged order.
+typedef void (*RennyLogSink)(int level, const char* instance_name, const char* message, time_t created_on);
+
+//! Messages are dropped while no sink (nullptr) is set.
+void rennySetLogSink(RennyLogSink sink);
+//! A sink for the command line tools: writes one line per message to stderr.
+void rennyStderrLogSink(int level, const char* instance_name, const char* message, time_t created_on);
+
+//! Messages below level are dropped from now on.
+void rennySetLogLevel(int level);
+int rennyGetLogLevel();
+//! Wait until the messages logged so far have been written.
+void rennyFlushLog();
 
-void rennyLogError(const char* instance_name, const char* msg_format, ...);
-void rennyLogWarning(const char* instance_name, const char* msg_format, ...);
-void rennyLogInfo(const char* instance_name, const char* msg_format, ...);
+void rennyLogAt(RennyLogSite* site, int level, const char* instance_name, const char* msg_format, ...);
 
 #ifndef NDEBUG
-void rennyLogDebug(const char* instance_name, const char* msg_format, ...);
 #include <assert.h>
 #define rennyAssert(expr) assert(expr)
 #else
-#define rennyLogDebug(instance_name, msg_format, ...)
 #define rennyAssert(expr)
 #endif
 
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+/*!
+ * @class FilePath
+ * @brief Path and directory helpers on UTF-8 std::string paths.
+ *
+ * Both '/' and, on Windows, '\\' separate the components of a path.
+ */
+class FilePath {
+public:
+  //! Everything before the last separator, or "" if there is none.
+  static std::string Directory(const std::string& path);
+  //! The last component, e.g. "song.minipsf".
+  static std::string FullName(const std::string& path);
+  //! The last component without its extension, e.g. "song".
+  static std::string Name(const std::string& path);
+  //! The extension without the dot, in lower case, e.g. "minipsf".
+  static std::string Extension(const std::string& path);
+  //! dir and name with one separator between them.
+  static std::string Join(const std::string& dir, const std::string& name);
+  //! An absolute path without "." or ".." components and symbolic links.
+  static std::string Absolute(const std::string& path);
+
+  static bool IsDirectory(const std::string& path);
+  //! Modification time in seconds since the epoch and size in bytes; either may be null.
+  static bool Stat(const std::string& path, int64_t* mtime, uint64_t* size);
+  //! The regular files in dir, or also below it if recursive, sorted by path.
+  static bool ListFiles(const std::string& dir, std::vector<std::string>* files, bool recursive = false);
+  //! Create dir and its missing parents.
+  static bool MakeDirectories(const std::string& dir);
+  //! The directory for temporary files, e.g. $TMPDIR or /tmp.
+  static std::string TempDirectory();
+  static bool Remove(const std::string& path);
+  //! Move from to to, replacing to if it exists.
+  static bool Rename(const std::string& from, const std::string& to);
+
+private:
+  FilePath();
+};
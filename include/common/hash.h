@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+
+/*!
+ * @class Fnv1a
+ * @brief The 64-bit FNV-1a hash.
+ *
+ * Start from kOffsetBasis and fold the data in with the Add functions. The
+ * hash tells data apart cheaply; it is no defence against crafted input.
+ */
+class Fnv1a {
+public:
+  static const uint64_t kOffsetBasis = 0xcbf29ce484222325ULL;
+  static const uint64_t kPrime = 0x100000001b3ULL;
+
+  //! One octet.
+  static uint64_t AddByte(uint64_t hash, uint8_t v) { return (hash ^ v) * kPrime; }
+  //! The octets of v, least significant first.
+  static uint64_t Add16(uint64_t hash, uint16_t v) {
+    return AddByte(AddByte(hash, v & 0xff), v >> 8);
+  }
+  static uint64_t Add32(uint64_t hash, uint32_t v) {
+    return Add16(Add16(hash, v & 0xffff), v >> 16);
+  }
+  //! v as a whole, in one step: faster, but not the FNV-1a of its octets.
+  static uint64_t AddWord(uint64_t hash, uint64_t v) { return (hash ^ v) * kPrime; }
+
+private:
+  Fnv1a();
+};
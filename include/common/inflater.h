@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <zlib.h>
+
+
+/*!
+ * @class Inflater
+ * @brief Incremental zlib decompression from memory into caller buffers.
+ *
+ * Unlike wxZlibInputStream, the input is a plain byte range (typically a
+ * MappedFile) and every Read() inflates straight into the destination,
+ * so no intermediate stream or heap buffer is involved.
+ */
+class Inflater {
+public:
+  Inflater(const uint8_t* src, size_t src_length);
+  ~Inflater();
+
+  bool IsOk() const { return ok_; }
+  //! True once the end of the zlib stream has been reached.
+  bool IsEnd() const { return end_; }
+
+  //! Inflate up to length bytes into dest. Returns the inflated count.
+  size_t Read(void* dest, size_t length);
+  //! Discard up to length bytes. Returns the skipped count.
+  size_t Skip(size_t length);
+
+  size_t total_out() const { return stream_.total_out; }
+
+private:
+  Inflater(const Inflater&);
+  Inflater& operator=(const Inflater&);
+
+  z_stream stream_;
+  bool ok_;
+  bool end_;
+};
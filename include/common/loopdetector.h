@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+
+/*!
+ * @class LoopDetector
+ * @brief Finds where a song loops or falls silent while it is rendered.
+ *
+ * The emulator reports one fingerprint per key-on event (which voices
+ * were started and with which sample address, pitch and volume) together
+ * with the output frame it happened on. Once the event sequence, including
+ * the gaps between events, repeats itself for a whole period of at least
+ * min_loop_length() milliseconds, the song is considered looped: the first
+ * period is [loop_start(), loop_end()) and the second has just finished.
+ *
+ * Independently, AddFrames() watches the rendered PCM and reports a run of
+ * silence_length() milliseconds below silence_threshold() after the song
+ * has produced sound, e.g. for songs which end instead of looping.
+ */
+class LoopDetector {
+public:
+  explicit LoopDetector(uint32_t sampling_rate = 44100);
+
+  //! Forget everything seen so far, e.g. before rendering the next song.
+  void Reset(uint32_t sampling_rate);
+
+  //! Record a key-on event on the given output frame.
+  void AddEvent(uint64_t frame, uint64_t fingerprint);
+  //! Watch interleaved 16-bit stereo frames for silence.
+  void AddFrames(const int16_t* interleaved, size_t frames);
+
+  bool HasLooped() const { return looped_; }
+  bool IsSilent() const { return silent_; }
+  bool IsFinished() const { return looped_ || silent_; }
+
+  //! Output frames of the first loop period; valid if HasLooped().
+  uint64_t loop_start() const { return loop_start_; }
+  uint64_t loop_end() const { return loop_end_; }
+  //! First frame of the silence; valid if IsSilent().
+  uint64_t silence_start() const { return silence_start_; }
+
+  //! Shorter repetitions (a bar, a drum pattern) are not loops.
+  int min_loop_length() const { return min_loop_length_; }
+  void set_min_loop_length(int ms) { min_loop_length_ = ms; }
+  int silence_length() const { return silence_length_; }
+  void set_silence_length(int ms) { silence_length_ = ms; }
+  int silence_threshold() const { return silence_threshold_; }
+  void set_silence_threshold(int amplitude) { silence_threshold_ = amplitude; }
+
+private:
+  struct Event {
+    uint64_t frame;
+    uint64_t fingerprint;
+  };
+  struct Candidate {
+    size_t period;    // in events
+    size_t first;     // first event known to repeat
+    size_t matched;   // events matched so far
+  };
+
+  uint64_t FramesOf(int ms) const;
+  uint64_t WindowHash(size_t last) const;
+  //! True if events_[i] repeats events_[i - period], gap included.
+  bool Repeats(size_t i, size_t period) const;
+  void Found(const Candidate& candidate);
+
+  uint32_t sampling_rate_;
+  int min_loop_length_;
+  int silence_length_;
+  int silence_threshold_;
+
+  std::vector<Event> events_;
+  //! Window hash -> the last events of every window with that hash.
+  std::unordered_map<uint64_t, std::vector<size_t> > windows_;
+  std::vector<Candidate> candidates_;
+  bool looped_;
+  uint64_t loop_start_;
+  uint64_t loop_end_;
+
+  uint64_t frame_count_;
+  uint64_t quiet_frames_;
+  bool audible_;
+  bool silent_;
+  uint64_t silence_start_;
+};
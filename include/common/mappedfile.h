@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory>
+
+
+/*!
+ * @class MappedFile
+ * @brief A read-only view of a whole file.
+ *
+ * On POSIX systems the file is mmap()ed, so parsing it touches the page
+ * cache directly; elsewhere it falls back to reading the file into a
+ * private buffer. The file descriptor is not owned and may be closed
+ * once Map() has returned.
+ */
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+
+  bool Map(int fd);
+  void Unmap();
+  bool IsMapped() const { return data_ != nullptr; }
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  //! Returns false if [offset, offset + length) is not inside the file.
+  bool Contains(size_t offset, size_t length) const {
+    return offset <= size_ && length <= size_ - offset;
+  }
+  //! Little-endian 32-bit value at offset, which must be inside the file.
+  uint32_t GetLE32(size_t offset) const;
+
+private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const uint8_t* data_;
+  size_t size_;
+  std::unique_ptr<uint8_t[]> buffer_;   // used only without mmap()
+};
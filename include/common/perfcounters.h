@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+/*!
+ * @class PerfCounters
+ * @brief Always-on counters showing where playback spends its time.
+ *
+ * Every thread accumulates into its own slot, so Add() and PerfTimer never
+ * take a lock: the owning thread is the only writer of a slot, and Read()
+ * only loads the values. A slot is folded into the totals when its thread
+ * exits. Gauges hold the latest value of a queue depth and its peak.
+ *
+ * Counters only grow; to measure an interval, subtract two snapshots as
+ * Rows() does.
+ */
+class PerfCounters {
+public:
+  enum Counter {
+    kInstructions = 0,
+    kCycles,
+    kInterpreterTime,     // ns, emulating the R3000A
+    kSPUStepTime,         // ns, SPUStepRequest::Execute()
+    kReverbTime,          // ns, REVERBInfo::Mix()
+    kDeviceUpdateTime,    // ns, SoundDevice::OnUpdate()
+    kDeviceWriteTime,     // ns, WaveOutAL::WriteToDevice()
+    kSPUQueueWaitTime,    // ns, waiting for SPUThread's request queue
+    kVoiceWaitTime,       // ns, waiting in SPUVoice::Get()
+    kDecodedInstruments,
+    kDecodedSamples,
+    kCounterCount
+  };
+
+  enum Gauge {
+    kSPURequestQueue = 0,
+    kDecodingInstruments,
+    kOpenALBuffers,
+    kPooledTasks,         // queued in TaskPool
+    kGaugeCount
+  };
+
+  struct Snapshot {
+    uint64_t time;    // ns, steady clock
+    uint64_t counters[kCounterCount];
+    int64_t gauges[kGaugeCount];
+    int64_t gauge_peaks[kGaugeCount];
+  };
+
+  //! One line of a report: what, how much in total, and how much per second.
+  struct Row {
+    std::string name;
+    std::string total;
+    std::string rate;
+  };
+
+  static void Add(Counter counter, uint64_t n);
+  static void SetGauge(Gauge gauge, int64_t value);
+
+  static Snapshot Read();
+  //! All zero, taken when the counters were first used.
+  static Snapshot Start();
+  //! The counters between two snapshots and the gauges of now.
+  static std::vector<Row> Rows(const Snapshot& now, const Snapshot& since);
+  //! Rows() as a text table for the console.
+  static std::string Report(const Snapshot& now, const Snapshot& since);
+
+  static const char* CounterName(Counter counter);
+  static const char* GaugeName(Gauge gauge);
+  //! True if the counter holds nanoseconds.
+  static bool IsTime(Counter counter);
+
+  //! Steady clock in nanoseconds.
+  static uint64_t Now();
+};
+
+
+/*!
+ * @class PerfTimer
+ * @brief Adds the lifetime of a scope to a time counter.
+ *
+ * Timers nest per thread and count self time: the time of an inner timer
+ * is charged to its own counter only, so an interpreter timer around the
+ * emulation loop does not count the SPU steps run inside it.
+ */
+class PerfTimer {
+public:
+  explicit PerfTimer(PerfCounters::Counter counter);
+  ~PerfTimer();
+
+private:
+  PerfTimer(const PerfTimer&);
+  PerfTimer& operator=(const PerfTimer&);
+
+  const PerfCounters::Counter counter_;
+  PerfTimer* const parent_;
+  const uint64_t start_;
+  uint64_t children_;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/*!
+ * @class RenderFarm
+ * @brief Renders many sound files in parallel, one emulator per worker.
+ *
+ * Jobs are queued with AddJob() or AddDirectory() and consumed by up to
+ * worker_count() tasks on the TaskPool, each of which owns its own
+ * SoundRenderer and therefore its own SoundData (PSF + PSX). Run() blocks
+ * until the queue is empty and leaves one Result per job, in the order
+ * they were queued.
+ */
+class RenderFarm {
+public:
+  struct Result {
+    std::string src_path;
+    std::string dest_path;
+    bool succeeded;
+    uint32_t sampling_rate;
+    size_t frames;
+    double rendered_seconds;
+    double elapsed_seconds;
+    double realtime_ratio;
+    uint64_t pcm_hash;
+    double loop_start;    // seconds, negative if no loop was found
+    double loop_end;
+  };
+
+  //! worker_count <= 0 uses every worker of the pool.
+  explicit RenderFarm(int worker_count = 0);
+  virtual ~RenderFarm() {}
+
+  void AddJob(const std::string& src_path, const std::string& dest_path);
+  //! Queue every PSF file in src_dir, writing <name>.wav into dest_dir.
+  //! An empty dest_dir renders without writing files. Returns the count.
+  int AddDirectory(const std::string& src_dir, const std::string& dest_dir);
+
+  //! Returns true if every job succeeded.
+  bool Run();
+
+  int worker_count() const { return worker_count_; }
+  size_t job_count() const { return results_.size(); }
+  const std::vector<Result>& results() const { return results_; }
+
+  //! Totals of the last Run() call.
+  double rendered_seconds() const;
+  double elapsed_seconds() const { return elapsed_seconds_; }
+  double realtime_ratio() const;
+
+  int default_length() const { return default_length_; }
+  void set_default_length(int ms) { default_length_ = ms; }
+  int default_fade() const { return default_fade_; }
+  void set_default_fade(int ms) { default_fade_ = ms; }
+
+protected:
+  //! Called on a worker thread, serialized with the other workers.
+  virtual void OnTrackFinished(const Result& /*result*/) {}
+
+private:
+  //! Renders jobs until the queue is empty.
+  void RenderJobs();
+  bool NextJob(size_t* index);
+  void FinishJob(size_t index);
+
+  const int worker_count_;
+  int default_length_;
+  int default_fade_;
+
+  std::vector<Result> results_;
+  size_t next_job_;
+  std::mutex mutex_;
+  double elapsed_seconds_;
+};
+
+
+/*!
+ * @class ConsoleRenderFarm
+ * @brief RenderFarm which prints one line per finished track to stdout.
+ */
+class ConsoleRenderFarm : public RenderFarm {
+public:
+  explicit ConsoleRenderFarm(int worker_count = 0) : RenderFarm(worker_count) {}
+  void PrintSummary() const;
+
+protected:
+  void OnTrackFinished(const Result& result);
+};
@@ -1,5 +1,7 @@
 #ifndef SOUNDBANK_H_
-#include <wx/hashmap.h>
+#define SOUNDBANK_H_
+#include <atomic>
+#include <unordered_map>
 
 
 class Instrument;
@@ -42,12 +44,16 @@ class Instrument {
   InstrumentDataIterator Iterator(bool is_loop) const;
 
   // int sampling_rate() const;
+  //! The fundamental frequency at the native sampling rate; 0 if unknown,
+  //! negative if the instrument has been analyzed and has no pitch.
   double freq() const;
   void set_freq(double);
+  //! freq(), looked up first if it is still unknown; 0 if there is none (yet).
+  virtual double FindFreq();
 
  private:
   bool is_muted_;
-  double freq_;
+  std::atomic<double> freq_;   // read by the GUI and the render thread
 };
 
 
@@ -63,7 +69,7 @@ class SoundbankObserver {
 
 class Soundbank {
  public:
-  WX_DECLARE_HASH_MAP(int, Instrument*, wxIntegerHash, wxIntegerEqual, InstrumentMap);
+  typedef std::unordered_map<int, Instrument*> InstrumentMap;
 
   Soundbank();
   ~Soundbank();
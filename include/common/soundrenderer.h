@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+
+/*!
+ * @class SoundRenderer
+ * @brief Renders a sound file to a WAV file as fast as the CPU allows.
+ *
+ * The sound is loaded through SoundLoader::Instance() and pulled with
+ * SoundData::Render() on the caller's thread, so no playback device and no
+ * event loop are involved. The output length honors the 'length' and
+ * 'fade' tags; files without them use default_length() and default_fade().
+ * Unless set_detect_end(false) is called, files without a 'length' tag end
+ * earlier once LoopDetector finds that they have looped (then fade out) or
+ * fallen silent (then stop at once).
+ * An empty dest_path renders without writing a file, e.g. for hashing.
+ * With set_capture_path(), what drives the sound chip is also recorded into
+ * an SPU log (see SPULogWriter) which replays without the CPU.
+ * With set_profile_path(), the emulated CPU is sampled every
+ * profile_interval() cycles and a hot-spot report is written there.
+ * With set_stem_dir(), every voice and the reverb bus are also written to
+ * their own WAV files ("<name>.voiceNN.wav", "<name>.reverb.wav") from the
+ * same emulation pass, faded like the mix.
+ * set_fixed_length() renders exactly that long instead, without fade or end
+ * detection, so that outputs of different builds can be compared.
+ */
+class SoundRenderer {
+public:
+  SoundRenderer();
+  virtual ~SoundRenderer() {}
+
+  bool Render(const std::string& src_path, const std::string& dest_path);
+
+  //! Fallback length and fade in milliseconds.
+  int default_length() const { return default_length_; }
+  void set_default_length(int ms) { default_length_ = ms; }
+  int default_fade() const { return default_fade_; }
+  void set_default_fade(int ms) { default_fade_ = ms; }
+  bool detects_end() const { return detect_end_; }
+  void set_detect_end(bool detect) { detect_end_ = detect; }
+  //! Length in milliseconds which overrides the tags, or -1 (default) for none.
+  int fixed_length() const { return fixed_length_; }
+  void set_fixed_length(int ms) { fixed_length_ = ms; }
+  const std::string& capture_path() const { return capture_path_; }
+  void set_capture_path(const std::string& path) { capture_path_ = path; }
+  const std::string& profile_path() const { return profile_path_; }
+  void set_profile_path(const std::string& path) { profile_path_ = path; }
+  unsigned int profile_interval() const { return profile_interval_; }
+  void set_profile_interval(unsigned int cycles) { profile_interval_ = cycles; }
+  const std::string& stem_dir() const { return stem_dir_; }
+  void set_stem_dir(const std::string& dir) { stem_dir_ = dir; }
+
+  //! Results of the current or last Render() call.
+  const std::string& path() const { return path_; }
+  uint32_t sampling_rate() const { return sampling_rate_; }
+  size_t rendered_frames() const { return rendered_frames_; }
+  size_t total_frames() const { return total_frames_; }
+  double rendered_seconds() const;
+  double elapsed_seconds() const { return elapsed_seconds_; }
+  //! Rendered audio time divided by wall-clock time.
+  double realtime_ratio() const;
+  //! 64-bit FNV-1a hash of the rendered 16-bit little-endian PCM.
+  uint64_t pcm_hash() const { return pcm_hash_; }
+  //! The first loop period in seconds, or negative values if none was found.
+  double loop_start() const;
+  double loop_end() const;
+  //! True if the song was cut short because it fell silent.
+  bool ended_by_silence() const { return ended_by_silence_; }
+
+  //! Parse a PSF time tag ("[[h:]m:]s[.fff]") into milliseconds, or -1.
+  static int ParseTime(const std::string& str);
+
+protected:
+  //! Called about once per second of rendered audio and once at the end.
+  virtual void OnProgress(bool /*finished*/) {}
+
+private:
+  int default_length_;
+  int default_fade_;
+  bool detect_end_;
+  int fixed_length_;
+  std::string capture_path_;
+  std::string profile_path_;
+  unsigned int profile_interval_;
+  std::string stem_dir_;
+
+  std::string path_;
+  uint32_t sampling_rate_;
+  size_t rendered_frames_;
+  size_t total_frames_;
+  double elapsed_seconds_;
+  uint64_t pcm_hash_;
+  int64_t loop_start_;  // in frames, or -1
+  int64_t loop_end_;
+  bool ended_by_silence_;
+};
+
+
+/*!
+ * @class ConsoleSoundRenderer
+ * @brief SoundRenderer which reports its progress to stderr.
+ */
+class ConsoleSoundRenderer : public SoundRenderer {
+protected:
+  void OnProgress(bool finished);
+};
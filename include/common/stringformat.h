@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+
+//! printf into a new string, of any length.
+std::string StringFormat(const char* format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 1, 2)))
+#endif
+    ;
+
+//! printf at the end of dest.
+void AppendFormat(std::string* dest, const char* format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
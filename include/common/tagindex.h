@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common/taskpool.h"
+
+
+//! Playlist metadata of one PSF file.
+struct TrackTags {
+  TrackTags() : mtime(0), size(0), length_ms(-1), fade_ms(-1) {}
+
+  std::string path;
+  int64_t mtime;        // seconds since the epoch
+  uint64_t size;
+  std::string title;
+  std::string artist;
+  std::string game;
+  int length_ms;        // -1 if the tag is missing
+  int fade_ms;
+  std::vector<std::string> libs;  // _lib, _lib2, ... in order
+};
+
+
+/*!
+ * @class TagIndex
+ * @brief Persistent, thread-safe map from PSF files to their tags.
+ *
+ * Entries are keyed by path and are only valid while the file's mtime and
+ * size are unchanged. The index is stored as UTF-8 text, one tab-separated
+ * record per file.
+ */
+class TagIndex {
+public:
+  TagIndex() : modified_(false) {}
+
+  //! Read the tags from the PSF header and [TAG] section only.
+  static bool ScanFile(const std::string& path, TrackTags* tags);
+  static bool GetFileStat(const std::string& path, int64_t* mtime, uint64_t* size);
+
+  bool Load(const std::string& index_path);
+  bool Save(const std::string& index_path);
+  bool IsModified() const;
+
+  //! Returns false if the file is unknown or has changed since its scan.
+  bool Find(const std::string& path, int64_t mtime, uint64_t size, TrackTags* tags) const;
+  void Store(const TrackTags& tags);
+  size_t size() const;
+
+private:
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, TrackTags> tracks_;   // by path
+  bool modified_;
+};
+
+
+/*!
+ * @class TagScanner
+ * @brief Fills a TagIndex on the TaskPool.
+ *
+ * Files still matching their index entry are reported without being
+ * opened. OnScanned() and OnFinished() are called on worker threads, so
+ * GUI subclasses have to forward them to the main thread.
+ */
+class TagScanner {
+public:
+  //! At most worker_count files are scanned at once; <= 0 for every worker of the pool.
+  explicit TagScanner(TagIndex* index, int worker_count = 0);
+  virtual ~TagScanner();
+
+  void Add(const std::string& path);
+  //! Queue every PSF file below dir. Returns the number of files queued.
+  int AddDirectory(const std::string& dir);
+  void Start();
+  //! Drop the queued files; files being scanned are still reported.
+  void Cancel();
+  void Wait();
+  bool IsRunning() const { return running_workers_ > 0; }
+
+  static bool IsPSFFile(const std::string& path);
+
+protected:
+  virtual void OnScanned(const TrackTags& /*tags*/) {}
+  virtual void OnFinished() {}
+
+private:
+  void Entry();
+  //! Sets *last for the worker which finds the queue empty last.
+  bool NextPath(std::string* path, bool* last);
+
+  TagIndex* const index_;
+  const int worker_count_;
+  std::mutex mutex_;
+  std::deque<std::string> queue_;
+  TaskGroup tasks_;
+  std::atomic<int> running_workers_;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+/*!
+ * @class TaskPool
+ * @brief The worker threads which run all background work of the process.
+ *
+ * Every worker owns one deque per priority. A task submitted on a worker
+ * goes to the back of that worker's deque and is taken from there again;
+ * idle workers steal from the front of the others' deques. A worker
+ * always takes the most urgent task it can find, so decoding instruments
+ * is never queued behind a directory scan.
+ *
+ * A worker only takes a new task once its current one has finished, so
+ * one more worker is kept for kPriorityPlayback alone: warming up the next
+ * track does not wait until a RenderFarm or a scan frees a worker. Tasks
+ * which it submits itself are shared with the others as usual.
+ *
+ * The real-time audio path (the player, SPU and OpenAL threads) keeps its
+ * own threads: they wait on the device and must never wait for a worker.
+ *
+ * The number of workers is fixed on first use: SetWorkerCount(), else the
+ * RENNYPSF_THREADS environment variable, else one worker per CPU. The
+ * playback worker comes on top of them.
+ */
+class TaskPool {
+public:
+  enum Priority {
+    kPriorityPlayback = 0,  // the next track of the playing queue
+    kPriorityDecode,        // instruments, PSF2 blocks
+    kPriorityAnalysis,      // offline rendering, spectra
+    kPriorityScan,          // tags
+    kPriorityCount
+  };
+
+  typedef std::function<void()> Task;
+
+  static TaskPool& Instance();
+  //! Only effective before the first Instance() call; count <= 0 uses one worker per CPU.
+  static void SetWorkerCount(int count);
+
+  void Submit(Priority priority, const Task& task);
+
+  //! The workers which take every priority, without the playback worker.
+  int worker_count() const { return static_cast<int>(workers_.size()) - 1; }
+
+private:
+  explicit TaskPool(int worker_count);
+  TaskPool(const TaskPool&);
+  TaskPool& operator=(const TaskPool&);
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks[kPriorityCount];
+  };
+
+  void Entry(int index);
+  //! Take the most urgent task below priority_count; *priority is set to its priority.
+  bool Pop(int index, int priority_count, Task* task, int* priority);
+
+  std::vector<std::unique_ptr<Worker> > workers_;   // the playback worker last
+  std::atomic<unsigned int> next_worker_;   // for tasks from other threads
+
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cond_;
+  std::condition_variable playback_cond_;   // for the playback worker
+  int pending_;             // guarded by sleep_mutex_
+  int pending_playback_;    // of them at kPriorityPlayback
+};
+
+
+/*!
+ * @class TaskGroup
+ * @brief Tasks submitted to the TaskPool together, and waited for together.
+ *
+ * Wait() runs the tasks of the group which no worker has started yet on
+ * the calling thread before it waits for the rest, so a task may wait for
+ * a group of its own without a free worker. The pool only refers to the
+ * group's state, which outlives the group until every task has been taken.
+ */
+class TaskGroup {
+public:
+  explicit TaskGroup(TaskPool::Priority priority);
+  //! Waits for the tasks.
+  ~TaskGroup();
+
+  void Run(const TaskPool::Task& task);
+  //! Run a task which no worker has started yet. Returns false if there is none.
+  bool RunOne();
+  void Wait();
+
+private:
+  TaskGroup(const TaskGroup&);
+  TaskGroup& operator=(const TaskGroup&);
+
+  struct State;
+  static bool RunOne(const std::shared_ptr<State>& state);
+
+  const TaskPool::Priority priority_;
+  const std::shared_ptr<State> state_;
+};
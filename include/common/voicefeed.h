@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+
+/*!
+ * @class TripleBuffer
+ * @brief Hands the latest value from one writer thread to one reader thread.
+ *
+ * The writer fills back() and publishes it; the reader takes the latest
+ * published value into front(). The three buffers are swapped through one
+ * atomic index, so neither side ever waits for the other, and a slow
+ * reader only skips values.
+ */
+template<typename T>
+class TripleBuffer {
+public:
+  TripleBuffer() : buffers_(), back_(0), middle_(1), front_(2) {}
+
+  //! Writer side.
+  T& back() { return buffers_[back_]; }
+  void Publish() {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  //! Reader side: take the latest value. Returns false if none was published since.
+  bool Update() {
+    if ((middle_.load(std::memory_order_relaxed) & kFresh) == 0) return false;
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+  const T& front() const { return buffers_[front_]; }
+
+private:
+  TripleBuffer(const TripleBuffer&);
+  TripleBuffer& operator=(const TripleBuffer&);
+
+  static const int kIndexMask = 3;
+  static const int kFresh = 4;
+
+  T buffers_[3];
+  int back_;                  // writer only
+  std::atomic<int> middle_;   // the index, and kFresh if it was published
+  int front_;                 // reader only
+};
+
+
+class SampleSequence;
+
+/*!
+ * @class LevelMeter
+ * @brief Peak and RMS of a stereo signal, accumulated over several blocks.
+ *
+ * Add() reads the samples of a voice where the SampleSequence stores them
+ * and runs SSE max/abs and multiply-add over them, four samples at a time.
+ * A compiler does not vectorize those float reductions by itself without
+ * -ffast-math, which the Debug build lacks. The integer ones of
+ * AddStereo16() it does.
+ */
+class LevelMeter {
+public:
+  LevelMeter() { Clear(); }
+
+  //! The first frames samples of seq, with their volumes.
+  void Add(const SampleSequence& seq, size_t frames);
+  //! Interleaved left and right frames, as SoundBlock::GetStereo16() writes them.
+  void AddStereo16(const short* samples, size_t frames);
+  void Clear();
+
+  float peak(int side) const { return peak_[side]; }
+  float rms(int side) const;
+
+private:
+  float peak_[2];
+  double sum_squares_[2];
+  size_t frames_;
+};
+
+
+//! What a voice was doing at the end of a block.
+struct VoiceState {
+  bool on;
+  float pitch;          // Hz, 0 if unknown
+  int rate;             // the pitch register
+  float envelope;       // 0 - 1
+  float volume_left;    // -1 - 1
+  float volume_right;
+  int instrument;       // -1 if none
+  float peak;           // of the output since the last snapshot, both sides
+  float rms;
+};
+
+
+struct VoiceSnapshot {
+  static const unsigned int kMaxVoices = 48;
+
+  uint64_t block;       // the number of snapshots published before this one
+  unsigned int voice_count;
+  VoiceState voices[kMaxVoices];
+  float peak[2];        // of the output, left and right
+  float rms[2];
+};
+
+
+class SoundBlock;
+
+/*!
+ * @class VoiceFeed
+ * @brief The voices of the playing sound, for display.
+ *
+ * The render thread passes every block to Meter(); when that returns true,
+ * it fills Write() and publishes it, at most once per block and about
+ * every kSnapshotFrames frames. The GUI polls Read() at its refresh rate.
+ * This keeps the traffic between them constant, however many notes are
+ * played.
+ */
+class VoiceFeed {
+public:
+  VoiceFeed() : block_(0), frames_(0) {}
+
+  //! The feed of the sound which is played.
+  static VoiceFeed& Instance();
+
+  //! Writer side: meter the output of a block. True if a snapshot is due.
+  bool Meter(const SoundBlock& block);
+  VoiceSnapshot& Write() { return buffer_.back(); }
+  //! Copies the meters into the snapshot and starts them over.
+  void Publish();
+
+  //! Reader side: the latest snapshot. Returns false if it has not changed since the last call.
+  bool Read(const VoiceSnapshot** snapshot);
+
+  // 5.8 ms at 44.1 kHz, more often than a display refreshes
+  static const size_t kSnapshotFrames = 256;
+
+private:
+  TripleBuffer<VoiceSnapshot> buffer_;
+
+  // writer only
+  uint64_t block_;
+  size_t frames_;     // metered since the last snapshot
+  LevelMeter voice_meters_[VoiceSnapshot::kMaxVoices];
+  LevelMeter mix_meter_;
+  std::vector<short> mix_;    // GetStereo16() of the block being metered
+};
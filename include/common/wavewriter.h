@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+
+/*!
+ * @class WaveWriter
+ * @brief A buffered writer of 16-bit linear PCM RIFF/WAVE files.
+ *
+ * Samples are accumulated in memory and written in large chunks; the
+ * RIFF and data sizes are patched into the header on Close().
+ */
+class WaveWriter {
+public:
+  static const size_t kDefaultBufferFrames = 16384;
+
+  explicit WaveWriter(size_t buffer_frames = kDefaultBufferFrames);
+  ~WaveWriter();
+
+  bool Open(const std::string& path, uint32_t sampling_rate, int channel_count = 2);
+  bool Close();
+  bool IsOpened() const;
+
+  //! Append interleaved frames. Returns false on an I/O error.
+  bool Write(const short* samples, size_t frame_count);
+
+  size_t frame_count() const { return frame_count_; }
+  uint32_t sampling_rate() const { return sampling_rate_; }
+  int channel_count() const { return channel_count_; }
+
+protected:
+  bool Flush();
+  bool WriteHeader();
+
+private:
+  std::FILE* file_;
+  std::unique_ptr<short[]> buffer_;
+  const size_t buffer_frames_;
+  size_t buffer_index_;   // in frames
+
+  size_t frame_count_;
+  uint32_t sampling_rate_;
+  int channel_count_;
+};
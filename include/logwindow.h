@@ -0,0 +1,17 @@
+#pragma once
+
+class wxWindow;
+
+/*
+ * The debug window shows the log of the core (see common/debug.h) and the
+ * PerfCounters, and copies the log to rennypsf_log.txt. Creating it makes
+ * it the log sink; nothing is logged before.
+ */
+extern "C" {
+
+void rennyCreateDebugWindow(wxWindow* parent);
+void rennyDestroyDebugWindow();
+void rennyShowDebugWindow();
+void rennyHideDebugWindow();
+
+}
@@ -1,12 +1,18 @@
 #pragma once
 #include "common/SoundFormat.h"
+#include "common/mappedfile.h"
 #include "psf/psx/psx.h"
+#include "psf/psflibcache.h"
 #include <stdint.h>
-#include <wx/file.h>
-#include <wx/ptr_scpd.h>
-#include <wx/weakref.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 
+class SPULogWriter;
+namespace psx { namespace mips { class Profiler; } }
+
 class PSF: public SoundData
 {
 public:
@@ -30,6 +36,11 @@ public:
 
   bool ChangeOutputSamplingRate(uint32_t rate);
 
+  //! The log is written by the next Open() and finished by Close().
+  bool StartCapture(const std::string& path);
+  //! The profiler runs from the next Open() and reports on Close().
+  bool StartProfile(const std::string& path, unsigned int interval);
+
   friend class PSFLoader;
 
 protected:
@@ -37,6 +48,11 @@ protected:
 
 private:
   uint32_t unprocessed_cycles_;
+  std::string capture_path_;
+  std::unique_ptr<SPULogWriter> capture_;
+  std::string profile_path_;
+  unsigned int profile_interval_;
+  std::unique_ptr<psx::mips::Profiler> profiler_;
 };
 
 
@@ -50,14 +66,17 @@ public:
 
 protected:
   void PSXMemCpy(psx::PSXAddr dest, void* src, int length);
+  //! Guest RAM at dest, for inflating a program in place.
+  void* PSXMemPtr(psx::PSXAddr dest, uint32_t* available);
+  //! Share a cached user RAM image copy-on-write.
+  bool PSXMapImage(int image_fd);
 };
 
 
-class wxFileInputStream;
 class PSF2File;
 class PSF2Directory;
 
-class PSF2Entry : public wxTrackable {
+class PSF2Entry {
 public:
   PSF2Entry(PSF2Directory* parent, const char* name);
 
@@ -79,21 +98,30 @@ public:
   virtual PSF2Directory* directory() = 0;
 
   PSF2Directory* Parent();
-  const wxString& GetName() const;
-  const wxString GetFullPath() const;
-  PSF2Entry* Find(const wxString& path, bool case_insensitive = true);
+  const std::string& GetName() const;
+  const std::string GetFullPath() const;
+  PSF2Entry* Find(const std::string& path, bool case_insensitive = true);
   PSF2Directory* GetRoot();
 
 protected:
   PSF2Directory* parent_;
-  wxString name_;
+  std::string name_;
 };
 
 
+/*!
+ * A file of the PSF2 virtual filesystem.
+ *
+ * Only the block table is located at load time. The blocks are inflated
+ * on the first GetData(), in parallel when the file is large; files of
+ * libraries are shared through PSFLibraryCache under cache_key.
+ */
 class PSF2File : public PSF2Entry {
 public:
   PSF2File(PSF2Directory *parent, const char* name);
-  PSF2File(PSF2Directory *parent, const char* name, wxScopedArray<unsigned char>& data, int size);
+  PSF2File(PSF2Directory *parent, const char* name,
+           const std::shared_ptr<const MappedFile>& map, size_t table_ofs,
+           size_t size, size_t block_size, const std::string& cache_key);
   virtual bool IsFile() const { return true; }
   virtual bool IsDirectory() const { return false; }
 
@@ -101,11 +129,19 @@ public:
   PSF2Directory* directory() { return nullptr; }
 
   const unsigned char* GetData() const;
+  //! Known without inflating the file.
   size_t GetSize() const;
+  bool IsLoaded() const { return data_ != nullptr; }
 
 private:
-  wxScopedArray<unsigned char> data_;
+  bool Load() const;
+
+  mutable PSFLibraryCache::Image data_;
   size_t size_;
+  mutable std::shared_ptr<const MappedFile> map_;  // released by Load()
+  size_t table_ofs_;
+  size_t block_size_;
+  std::string cache_key_;   // empty if not shared
 };
 
 
@@ -122,11 +158,23 @@ public:
 
   void AddEntry(PSF2Entry* entry);
 
-  bool LoadFile(wxFileInputStream* stream, const char *filename, int uncompressed_size, int block_size);
-  bool LoadEntries(wxFileInputStream* stream, wxFileOffset offset);
+  //! Index the directory at base_ofs + offset of a mapped reserved area.
+  bool LoadEntries(const std::shared_ptr<const MappedFile>& map, size_t base_ofs, size_t offset,
+                   const std::string& cache_prefix);
+
+  //! Map the case-folded path of every entry below the root to the entry.
+  /*!
+   Called once all files are loaded; root Find()s are then a single hash
+   lookup. Entries added later drop the index until it is rebuilt.
+  */
+  void BuildIndex();
 
 private:
-  wxVector<PSF2Entry*> children_;
+  void IndexEntries(const std::string& prefix, PSF2Directory* dir);
+  static std::string FoldPath(const std::string& path);
+
+  std::vector<PSF2Entry*> children_;   // in filesystem order
+  std::unordered_map<std::string, PSF2Entry*> index_;   // root only
 
   friend class PSF2Entry;
 };
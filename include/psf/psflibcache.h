@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/*!
+ * @class PSFRAMImage
+ * @brief A complete user RAM image held in an unlinked shared-memory file.
+ *
+ * psx::Memory::MapUserImage() maps it copy-on-write, so every PSF built
+ * on the same libraries shares its clean pages.
+ */
+class PSFRAMImage {
+public:
+  //! Returns null where shared-memory files are not available.
+  static std::shared_ptr<const PSFRAMImage> Create(const uint8_t* ram, size_t size);
+  ~PSFRAMImage();
+
+  int fd() const { return fd_; }
+  size_t size() const { return size_; }
+
+private:
+  PSFRAMImage(int fd, size_t size) : fd_(fd), size_(size) {}
+  PSFRAMImage(const PSFRAMImage&);
+  PSFRAMImage& operator=(const PSFRAMImage&);
+
+  const int fd_;
+  const size_t size_;
+};
+
+
+/*!
+ * @class PSFLibraryCache
+ * @brief Process-wide LRU cache of decompressed psflib programs.
+ *
+ * Images are keyed by the canonical path of the library and the CRC32 of
+ * its compressed program, so a library edited on disk is never mixed up
+ * with a stale image. Images are shared and immutable: evicting one only
+ * drops the cache's reference, and loaders still holding it keep it
+ * alive. The sum of cached images is kept under budget().
+ *
+ * Merged RAM images of whole library sets are kept in the same LRU list
+ * under a key made of the Key() of every library in load order.
+ */
+class PSFLibraryCache {
+public:
+  typedef std::shared_ptr<const std::vector<uint8_t> > Image;
+  typedef std::shared_ptr<const PSFRAMImage> RAMImage;
+
+  static const size_t kDefaultBudget = 64 * 1024 * 1024;
+
+  static PSFLibraryCache* GetInstance();
+
+  //! Returns an empty Image on a miss.
+  Image Find(const std::string& path, uint32_t crc32);
+  //! Returns the cached image, which may be one inserted concurrently.
+  Image Insert(const std::string& path, uint32_t crc32, std::vector<uint8_t>* image);
+  //! The same for keys made by the caller, e.g. files inside a library.
+  Image Find(const std::string& key);
+  Image Insert(const std::string& key, std::vector<uint8_t>* image);
+  RAMImage FindRAMImage(const std::string& key);
+  RAMImage InsertRAMImage(const std::string& key, const RAMImage& image);
+  void Clear();
+
+  //! Identifies one version of one library file.
+  static std::string Key(const std::string& path, uint32_t crc32);
+
+  size_t budget() const;
+  //! Evicts least recently used images until the new budget is met.
+  void set_budget(size_t bytes);
+  size_t used_bytes() const;
+  size_t hits() const;
+  size_t misses() const;
+
+private:
+  PSFLibraryCache();
+
+  struct Entry {
+    std::string key;
+    Image image;
+    RAMImage ram_image;
+    size_t size;
+  };
+
+  //! Both must be called with mutex_ locked.
+  Entry* Lookup(const std::string& key);
+  bool Store(const Entry& entry);
+  void Evict(size_t budget);
+
+  typedef std::list<Entry> LRUList;   // most recently used first
+
+  mutable std::mutex mutex_;
+  LRUList lru_;
+  std::unordered_map<std::string, LRUList::iterator> index_;
+  size_t budget_;
+  size_t used_bytes_;
+  size_t hits_;
+  size_t misses_;
+};
@@ -1,16 +1,16 @@
 #pragma once
 
 #include "common/SoundLoader.h"
+#include "common/SoundFormat.h"
+#include "common/mappedfile.h"
+#include "common/inflater.h"
+#include "psf/psflibcache.h"
 // #include "PSF.h"
 
-#include <wx/string.h>
-#include <wx/file.h>
-#include <wx/wfstream.h>
-#include <wx/scopedptr.h>
-#include <wx/scopedarray.h>
-#include <wx/weakref.h>
-#include <wx/vector.h>
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 
 class SoundInfo;
 class SoundData;
@@ -22,15 +22,25 @@ class SoundData;
 class PSFLoader : public SoundLoader {
 
 public:
+  ~PSFLoader();
   SoundInfo* LoadInfo();
 
+  //! Parse the lines following "[TAG]" without copying them first.
+  static void ParseTags(const char* begin, const char* end, SoundInfo::Tag* tag);
+
 protected:
-  PSFLoader(int fd, const wxString& filename);
+  PSFLoader(int fd, const std::string& filename);
 
   bool LoadLibraries();
+  //! True if this file was loaded as a _lib of another one.
+  bool is_library() const { return is_library_; }
 
-  wxFile& file();
-  const wxString& path() const;
+  int fd() const { return fd_; }
+  const std::string& path() const;
+  //! The whole file, mapped by LoadInfo().
+  const MappedFile& map() const { return *map_; }
+  //! For entries which read the file after the loader has gone.
+  std::shared_ptr<const MappedFile> shared_map() const { return map_; }
 
   //! Parameter Accessors
   uint32_t reserved_area_len() const;
@@ -40,14 +50,15 @@ protected:
   uint32_t binary_ofs() const;
 
   //! PSF Library Loader Accessors
-  wxVector<PSFLoader*>::iterator psflib_begin();
-  wxVector<PSFLoader*>::const_iterator psflib_begin() const;
-  wxVector<PSFLoader*>::const_iterator psflib_end() const;
+  std::vector<PSFLoader*>::iterator psflib_begin();
+  std::vector<PSFLoader*>::const_iterator psflib_begin() const;
+  std::vector<PSFLoader*>::const_iterator psflib_end() const;
 
 private:
-  wxFile file_;
-  wxString path_;
-  wxWeakRef<SoundInfo> ref_info_;
+  const int fd_;
+  std::shared_ptr<MappedFile> map_;
+  std::string path_;
+  std::unique_ptr<SoundInfo> info_;
 
   //! PSF records
   uint32_t reserved_area_len_;
@@ -58,8 +69,10 @@ private:
   uint32_t reserved_area_ofs_;
   uint32_t binary_ofs_;
 
+  bool is_library_;
+
   //! PSF Library Loaders
-  wxVector<PSFLoader*> psflibs_;
+  std::vector<PSFLoader*> psflibs_;
 };
 
 
@@ -76,10 +89,10 @@ public:
   SoundData* LoadData();
   PSF1* LoadDataEx();
 
-  static PSF1Loader* Instance(int fd, const wxString& filename);
+  static PSF1Loader* Instance(int fd, const std::string& filename);
 
 protected:
-  PSF1Loader(int fd, const wxString& filename);
+  PSF1Loader(int fd, const std::string& filename);
 
   bool LoadEXE();
   bool LoadText(PSF1* p_psf);
@@ -115,9 +128,20 @@ protected:
 
   // friend class PSF1;
 private:
-  wxWeakRef<PSF1> ref_data_;
-  wxScopedPtr<PSXEXEHeader> header_;
-  wxScopedArray<char> text_;
+  //! Start inflating the program; the stream is left at the text section.
+  Inflater* OpenEXE(PSXEXEHeader* header) const;
+  //! The whole program of a library, shared through PSFLibraryCache.
+  PSFLibraryCache::Image LoadImage() const;
+  //! User RAM with every library loaded, shared through PSFLibraryCache.
+  PSFLibraryCache::RAMImage LoadLibraryRAMImage() const;
+  void AppendLibraryKeys(std::string* key) const;
+  //! Write the libraries and then this program into a user RAM image.
+  bool WriteText(uint8_t* ram) const;
+  bool WriteOwnText(uint8_t* ram) const;
+
+  std::unique_ptr<PSXEXEHeader> header_;
+  mutable std::unique_ptr<Inflater> text_;  // inflated straight into guest RAM by LoadText()
+  PSFLibraryCache::Image image_;  // used instead of text_ by libraries
 };
 
 
@@ -134,15 +158,13 @@ public:
   SoundData* LoadData();
   PSF2* LoadDataEx();
 
-  static PSF2Loader* Instance(int fd, const wxString& filename);
+  static PSF2Loader* Instance(int fd, const std::string& filename);
 
 protected:
-  PSF2Loader(int fd, const wxString& filename);
+  PSF2Loader(int fd, const std::string& filename);
 
   bool LoadPSF2Entries(PSF2Directory* root);
-
-private:
-  wxWeakRef<PSF2> ref_data_;
-  // wxScopedArray<char> text_;
+  //! Key of this version of the file in PSFLibraryCache.
+  std::string CacheKey() const;
 };
 
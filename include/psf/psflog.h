@@ -0,0 +1,120 @@
+#pragma once
+
+#include "common/SoundLoader.h"
+#include "common/SoundFormat.h"
+#include "common/mappedfile.h"
+#include "psf/psf.h"
+#include <stdint.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/*!
+ * @class SPULogWriter
+ * @brief Records everything the CPU feeds into the SPU.
+ *
+ * The output of the SPU depends only on its register writes, its DMA
+ * uploads and the sample clock, so these are all a log has to hold:
+ *
+ *   header  "RSPL", u8 format version (1), u8 PSF version (1 or 2), u16 0,
+ *           u32 sampling rate, u32 frame count (written by Close())
+ *   records u8 opcode and its operands, little-endian
+ *     0x00  end
+ *     0x01  wait   varint frames
+ *     0x02  write  u16 register address & 0xffff, u16 value
+ *     0x03  dma    u8 core, varint size, the data
+ *     0x04  step   varint steps without output
+ *
+ * Frames are the SPU output samples counted by SPUBase::sample_count(),
+ * so every event lands between the same two samples when replayed.
+ */
+class SPULogWriter {
+public:
+  SPULogWriter();
+  ~SPULogWriter();
+
+  //! version is that of the PSF played, 1 or 2; PSFLog replays on a PSX of it.
+  bool Open(const std::string& path, int version, uint32_t sampling_rate);
+  //! Terminate the log after frame_count frames.
+  bool Close(uint64_t frame_count);
+  bool IsOpened() const { return file_ != nullptr; }
+
+  void WriteRegister(uint64_t frame, uint32_t reg, uint16_t value);
+  void WriteDMA(uint64_t frame, int core, const void* data, uint32_t size);
+  void Step(uint64_t frame, int step_count);
+
+private:
+  void Wait(uint64_t frame);
+  void Put8(uint8_t v) { buffer_.push_back(v); }
+  void Put16(uint16_t v);
+  void PutVarint(uint64_t v);
+  bool Flush();
+
+  std::FILE* file_;
+  std::vector<uint8_t> buffer_;
+  uint64_t frame_;
+  bool failed_;
+};
+
+
+/*!
+ * @class PSFLog
+ * @brief Plays back an SPU log without emulating the CPU.
+ *
+ * The SPU of a fresh psx::PSX is driven directly: the records due before
+ * each output frame are applied, then one sample is rendered. DMA data is
+ * staged at the bottom of guest RAM so that the SPU transfer code runs as
+ * it did when recording. The output rate may differ from the recorded
+ * one; event times are scaled to it.
+ */
+class PSFLog : public PSF {
+public:
+  PSFLog(const std::shared_ptr<const MappedFile>& map, uint32_t version,
+         uint32_t sampling_rate, uint32_t frame_count);
+
+  unsigned int GetSamplingRate() const;
+
+  bool Open(SoundBlock* block);
+  bool Close();
+  bool DoAdvance(SoundBlock* dest);
+
+  //! A log is not captured again.
+  bool StartCapture(const std::string& /*path*/) { return false; }
+  //! There is no CPU to profile.
+  bool StartProfile(const std::string& /*path*/, unsigned int /*interval*/) { return false; }
+
+  static const size_t kHeaderSize = 16;
+
+private:
+  //! Apply one record; false at the end of the log or if it is broken.
+  bool ApplyNext();
+  bool GetVarint(uint64_t* v);
+
+  const std::shared_ptr<const MappedFile> map_;
+  const uint32_t capture_rate_;
+  const uint64_t frame_count_;
+  size_t read_pos_;
+  uint64_t event_frame_;    // in recorded frames
+  uint64_t output_frames_;
+  bool ended_;
+};
+
+
+class PSFLogLoader : public SoundLoader {
+public:
+  PSFLogLoader(int fd, const std::string& filename);
+  ~PSFLogLoader();
+
+  static PSFLogLoader* Instance(int fd, const std::string& filename);
+
+  SoundInfo* LoadInfo();
+  SoundData* LoadData();
+
+private:
+  const int fd_;
+  std::string path_;
+  std::shared_ptr<MappedFile> map_;
+  std::unique_ptr<SoundInfo> info_;
+};
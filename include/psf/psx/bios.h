@@ -19,6 +19,7 @@ class BIOS : public Component, /*private mips::RegisterAccessor, */private UserM
   static void (BIOS::*biosA0[256])();
   static void (BIOS::*biosB0[256])();
   static void (BIOS::*biosC0[256])();
+  static bool InitTables();
 
   // BIOS functions
   void nop();
@@ -1,13 +1,10 @@
 #pragma once
 #include "common.h"
 #include "memory.h"
+#include <cstdio>
 #include <set>
-
-#include <wx/string.h>
-#include <wx/vector.h>
-#include <wx/file.h>
-
-class wxOutputStream;
+#include <string>
+#include <vector>
 
 namespace psx {
 namespace mips {
@@ -15,21 +12,25 @@ namespace mips {
 class Disassembler : private UserMemoryAccessor {
  public:
   Disassembler(PSX *composite);
+  ~Disassembler();
 
   bool Parse(u32 code);
-  void PrintCode(wxOutputStream* out = nullptr);
-  void PrintChangedRegisters(wxOutputStream* out);
+  //! Parse an instruction located at pc rather than the current one.
+  bool Parse(u32 code, u32 pc);
+  //! Print to out, or to the debug log if out is null.
+  void PrintCode(std::FILE* out = nullptr);
+  //! One line of disassembly of the instruction at addr, e.g. for reports.
+  std::string Disassemble(u32 addr);
+  void PrintChangedRegisters(std::FILE* out);
 
   void StartOutputToFile();
   bool OutputCodeToFile();
   bool OutputChangeRegistersToFile();
-  bool OutputStringToFile(const wxString&);
+  bool OutputStringToFile(const std::string&);
   void StopOutputToFile();
 
   void DumpRegisters();
 
-  static Disassembler& GetInstance();
-
  private:
   bool parseNop(u32);
   bool parseLoad(u32 code);
@@ -54,14 +55,16 @@ class Disassembler : private UserMemoryAccessor {
   bool parseBcond(u32 code);
   // void HLECALL(u32);
 
+  std::string FormatCode();
+
 private:
   Registers* const regs_;
   u32 pc0;
   u32 code_;
-  wxString opcodeName;
-  wxVector<wxString> operands;
-  /*wxVector*/std::set<wxString> changedRegisters;
-  wxFile output_to_;
+  std::string opcodeName;
+  std::vector<std::string> operands;
+  std::set<std::string> changedRegisters;
+  std::FILE* output_to_;
 
 protected:
   static bool (Disassembler::*const OPCODES[64])(u32);
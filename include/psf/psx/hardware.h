@@ -66,7 +66,56 @@ class HardwareRegisters : public Component, public IRQAccessor {
   void Write16(PSXAddr addr, u16 value);
   void Write32(PSXAddr addr, u32 value);
 
+  //! Handlers of the I/O registers at 0x1f801000-0x1f802fff.
+  /*!
+   Read() and Write() look the handler of an address up in dispatch_, one
+   byte per address, and call it through the per-width tables of Handlers.
+   Everything else, e.g. the SPU2 segments, goes to the default handler.
+  */
+  enum Handler {
+    kDefault = 0,
+    kRcnt,
+    kIrqData,
+    kIrqMask,
+    kDMA4,
+    kDICR,
+    kPortStatus,
+    kDMA7,
+    kSPU,
+    kHandlerCount
+  };
+  static const PSXAddr kDispatchBase = 0x1f801000;
+  static const u32 kDispatchSize = 0x2000;
+
+  //! The handler Read() dispatches addr to.
+  Handler handler(PSXAddr addr) const {
+    const u32 offset = addr - kDispatchBase;
+    return (offset < kDispatchSize) ? static_cast<Handler>(dispatch_[offset]) : kDefault;
+  }
+
  private:
+  template<typename T> struct Handlers;
+
+  //! Fill dispatch_ for the PS1 or the PS2 IOP layout.
+  void BuildDispatchTable();
+  void SetHandler(PSXAddr begin, PSXAddr end, Handler handler);
+
+  template<typename T> T ReadDefault(PSXAddr addr) const;
+  template<typename T> void WriteDefault(PSXAddr addr, T value);
+  template<typename T> T ReadRcnt(PSXAddr addr) const;
+  template<typename T> void WriteRcnt(PSXAddr addr, T value);
+  template<typename T> T ReadIrqData(PSXAddr addr) const;
+  template<typename T> void WriteIrqData(PSXAddr addr, T value);
+  template<typename T> T ReadIrqMask(PSXAddr addr) const;
+  template<typename T> void WriteIrqMask(PSXAddr addr, T value);
+  template<typename T> T ReadDMA4(PSXAddr addr) const;
+  template<typename T> void WriteDMA4(PSXAddr addr, T value);
+  template<typename T> T ReadDICR(PSXAddr addr) const;
+  template<typename T> void WriteDICR(PSXAddr addr, T value);
+  template<typename T> T ReadPortStatus(PSXAddr addr) const;
+  template<typename T> T ReadDMA7(PSXAddr addr) const;
+  template<typename T> void WriteDMA7(PSXAddr addr, T value);
+
   // Root Counter accessor
   template<typename T> T ReadRcnt(int index, int offset) const;
   template<typename T> void WriteRcnt(int index, int offset, T value);
@@ -77,6 +126,7 @@ class HardwareRegisters : public Component, public IRQAccessor {
  private:
   u8 hw_regs_[0x3000];
   int version_;
+  u8 dispatch_[kDispatchSize];
 
   friend class IRQAccessor;
   friend class HardwareRegisterAccessor;
@@ -202,22 +202,6 @@ private:
 };
 
 inline void Interpreter::ExecuteOpcode(u32 code) {
-#if 1
-  static bool dump_regs = true;
-  if (cpu_.cycle32() == 0) {
-    dump_regs = true;
-    p_disasm_->StartOutputToFile();
-  }
-  if (cpu_.cycle32() > 10000) {
-    dump_regs = false;
-    p_disasm_->StopOutputToFile();
-  }
-  if (dump_regs) {
-    std::printf("[%08x: %08x] [SP %08x RA %08x V0 %08x V1 %08x A0 %08x S0 %08x S1 %08x]\n",
-                GPR(GPR_PC) - 4, code, GPR(GPR_SP), GPR(GPR_RA), GPR(GPR_V0), GPR(GPR_V1),
-                GPR(GPR_A0), GPR(GPR_S0), GPR(GPR_S1));
-  }
-#endif
   p_disasm_->OutputCodeToFile();
   (this->*OPCODES[Opcode(code)])(code);
   p_disasm_->OutputChangeRegistersToFile();
@@ -2,9 +2,9 @@
 #include "common.h"
 #include "memory.h"
 #include <cstdint>
-#include <wx/string.h>
-#include <wx/vector.h>
-#include <wx/hashmap.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 class PSF2File;
 class PSF2Directory;
@@ -32,7 +32,7 @@ public:
   bool modload(uint32_t call_num);
   bool ioman(uint32_t call_num);
 
-  const wxString sprintf(const wxString& format, uint32_t param1, uint32_t param2, uint32_t param3) const;
+  std::string sprintf(const char* format, uint32_t param1, uint32_t param2, uint32_t param3) const;
 
   void SetRootDirectory(const PSF2Directory* root);
   unsigned int LoadELF(PSF2File* psf2irx);
@@ -42,9 +42,9 @@ public:
 
 private:
   typedef bool (IOP::*InternalLibraryCallback)(uint32_t);
-  void RegisterInternalLibrary(const wxString& name, InternalLibraryCallback callback);
-  InternalLibraryCallback GetInternalLibraryCallback(const wxString& name);
-  bool CallExternalLibrary(const wxString& name, uint32_t call_num);
+  void RegisterInternalLibrary(const std::string& name, InternalLibraryCallback callback);
+  InternalLibraryCallback GetInternalLibraryCallback(const std::string& name);
+  bool CallExternalLibrary(const std::string& name, uint32_t call_num);
 
   const PSF2Directory* root_;
 #ifndef NDEBUG
@@ -56,16 +56,16 @@ private:
     size_t pos;
     File() : file(0), pos(0) {}
   };
-  wxVector<File> files_;
-  WX_DECLARE_STRING_HASH_MAP(InternalLibraryCallback, InternalLibraryMap);
-  InternalLibraryMap internal_lib_map_;
+  std::vector<File> files_;
+  // names are 8 bytes long, padded with '\0'
+  std::unordered_map<std::string, InternalLibraryCallback> internal_lib_map_;
   struct ExternalLibEntry {
-    wxString name_;
+    std::string name_;
     uint32_t dispatch_;
-    ExternalLibEntry(wxString name, uint32_t dispatch) :
+    ExternalLibEntry(const std::string& name, uint32_t dispatch) :
       name_(name), dispatch_(dispatch) {}
   };
-  wxVector<ExternalLibEntry> lib_entries_;
+  std::vector<ExternalLibEntry> lib_entries_;
 
   PSXAddr load_addr_;
 };
@@ -13,7 +13,10 @@ class HardwareRegisters;
 
 class Memory {
  public:
+  static const u32 kUserMemorySize = 0x200000;
+
   Memory(int version, HardwareRegisters* hw_regs);
+  ~Memory();
 
   void Init();
   void Reset();
@@ -34,13 +37,23 @@ class Memory {
 
   void Set(PSXAddr addr, int data, int length);
 
+  //! Writable user RAM from addr up to its end, for loaders.
+  u8* UserMemory(PSXAddr addr, u32* available);
+  //! Back user RAM with a private copy-on-write mapping of a RAM image.
+  /*!
+   Clean pages stay shared with every other Memory mapping the same image
+   file; only pages the guest or a loader writes to are copied. Returns
+   false if mmap() is not available, leaving the RAM untouched.
+  */
+  bool MapUserImage(int image_fd);
+
  public:
   template<typename T> T& Rref(PSXAddr addr);
   void* Rvptr(PSXAddr addr);
 
  private:
   u8* segment_LUT_[0x10000];
-  u8 mem_user_[0x200000];
+  u8* const mem_user_;  // kUserMemorySize bytes, mmap()ed where possible
   u8 mem_parallel_port_[0x10000];
   u8 mem_bios_[0x80000];
 
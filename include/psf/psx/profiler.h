@@ -0,0 +1,104 @@
+#pragma once
+
+#include "common.h"
+#include "memory.h"
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace psx {
+
+class PSX;
+
+namespace mips {
+
+/*!
+ * @class Profiler
+ * @brief Samples where guest code spends its cycles.
+ *
+ * While attached to the Processor, the PC of the running instruction is
+ * recorded every interval() cycles; cycles skipped over by DeadLoopSkip()
+ * are charged to the idle loop which caused them. Targets of jump-and-link
+ * instructions are taken as function entries, and every sample belongs to
+ * the nearest entry below it.
+ *
+ * Report() groups the samples by function, basic block and loop, and
+ * disassembles the hottest blocks and loops. Small loops which store
+ * nothing are marked as idle (polling) loops; hot functions which are
+ * called often are listed as candidates for HLE.
+ */
+class Profiler : private UserMemoryAccessor {
+public:
+  explicit Profiler(PSX* psx, u32 interval = kDefaultInterval);
+  ~Profiler();
+
+  //! Start sampling the processor of the PSX; the samples so far are kept.
+  void Attach();
+  void Detach();
+
+  u32 interval() const { return interval_; }
+  uint64_t sample_count() const { return sample_count_; }
+  void Clear();
+
+  //! Called by the Processor after executing the instruction at pc.
+  void Tick(u32 pc, u32 cycle);
+  //! Called on a jump-and-link to target.
+  void Call(u32 target);
+
+  //! The hot-spot report, top entries of each kind.
+  std::string Report(int top = 16);
+
+  // prime, so that it does not beat with the loops it samples
+  static const u32 kDefaultInterval = 97;
+
+private:
+  struct Block {
+    u32 start;
+    u32 end;      // exclusive, delay slot included
+    uint64_t samples;
+  };
+  struct Loop {
+    u32 start;    // branch target
+    u32 end;      // exclusive, delay slot included
+    uint64_t samples;
+    bool idle;
+  };
+
+  void Sample(u32 pc, u32 elapsed);
+
+  u32 Code(u32 addr) { return psxMu32val(addr); }
+  //! The function entry at or below pc, or 0 if none is known.
+  u32 FunctionOf(u32 pc) const;
+  u32 BlockStart(u32 pc);
+  u32 BlockEnd(u32 start);
+  uint64_t SamplesIn(u32 start, u32 end) const;
+  bool IsIdleLoop(u32 start, u32 end);
+
+  void FindBlocks(std::vector<Block>* blocks);
+  void FindLoops(const std::vector<Block>& blocks, std::vector<Loop>* loops);
+  void AppendCode(std::string* report, u32 start, u32 end);
+
+  PSX* const psx_;
+  const u32 interval_;
+  u32 countdown_;
+  u32 last_cycle_;
+  uint64_t sample_count_;
+
+  std::unordered_map<u32, uint64_t> histogram_;   // pc -> samples
+  std::map<u32, uint64_t> functions_;             // entry -> calls
+};
+
+
+inline void Profiler::Tick(u32 pc, u32 cycle) {
+  const u32 elapsed = cycle - last_cycle_;
+  last_cycle_ = cycle;
+  if (elapsed < countdown_) {
+    countdown_ -= elapsed;
+  } else {
+    Sample(pc, elapsed);
+  }
+}
+
+}   // namespace mips
+}   // namespace psx
@@ -65,6 +65,7 @@ public:
   void Memcpy(PSXAddr dest, const void* src, int length);
   void Memcpy(void* dest, PSXAddr src, int length) const;
   void Memset(PSXAddr dest, int data, int length);
+  u8* UserMemory(PSXAddr dest, u32* available);
 
   u32& Ru32ref(PSXAddr addr);
   void* Rvptr(PSXAddr addr);
@@ -1,6 +1,5 @@
 #pragma once
 // #include "common.h"
-#include <wx/thread.h>
 #include "common/debug.h"
 #include "memory.h"
 #include "hardware.h"
@@ -186,6 +185,7 @@ protected:
 ////////////////////////////////////////////////////////////////////////
 
 class Interpreter;
+class Profiler;
 
 // TODO: implement DelaySlot
 class Processor
@@ -197,6 +197,9 @@ public:
 
   void SetRcntReferent(RootCounterManager* p_rcnt);
   void SetBIOSReferent(BIOS* p_bios);
+  //! Sample the executed code into profiler, or stop if nullptr.
+  void SetProfiler(Profiler* profiler);
+  Profiler* profiler() const { return profiler_; }
 
   void Reset();
   void Execute();
@@ -207,6 +210,8 @@ public:
   // Conter Cycle Functions
   unsigned int cycle32() const;
   void IncreaseCycle();
+  //! Instructions executed since the processor was created.
+  uint64_t instruction_count() const { return instruction_count_; }
 
   // Execute Functions
   void Execute(Interpreter* interp, bool in_softcall = false);
@@ -253,6 +258,8 @@ public:
   void EnableEnteringRA();
 
   bool isDoingBranch() const;
+  //! Tell the profiler, if any, about a jump-and-link to target.
+  void NotifyCall(u32 target);
 
   void DeadLoopSkip();
 
@@ -260,6 +267,8 @@ public:
   GeneralPurposeRegisters& GPR;
 
 private:
+  void ProfileCall(u32 target);
+
   RootCounterManager* p_rcnt_;
   BIOS* p_bios_;
 
@@ -267,6 +276,8 @@ private:
   bool doingBranch;    // set when doBranch is called
   bool leaveRAalone;   // for LoadModuleStart
   bool interrupt_suspended_;
+  uint64_t instruction_count_;
+  Profiler* profiler_;
 
   friend class Interpreter;
   friend class Recompiler;
@@ -297,6 +308,12 @@ inline void Processor::EnableEnteringRA() {
   leaveRAalone = false;
 }
 
+inline void Processor::NotifyCall(u32 target) {
+  if (profiler_ != nullptr) {
+    ProfileCall(target);
+  }
+}
+
 inline bool Processor::isDoingBranch() const {
   return doingBranch;
 }
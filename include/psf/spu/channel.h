@@ -1,6 +1,8 @@
 #pragma once
 
-#include <wx/vector.h>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
 
 // #include "common/SoundFormat.h"
 #include "psf/spu/soundbank.h"
@@ -172,6 +174,9 @@ public:
   void Advance();
   bool Get(SampleSequence* dest) const;
 
+  //! Pitch from the raw pitch and the frequency of the instrument.
+  void UpdatePitch();
+
   SPUBase* p_spu();
   const SPUBase* p_spu() const;
 
@@ -185,8 +190,8 @@ private:
 
 public:
   // for REVERB
-  wxVector<short> lpcm_buffer_l;
-  wxVector<short> lpcm_buffer_r;
+  std::vector<short> lpcm_buffer_l;
+  std::vector<short> lpcm_buffer_r;
 
   int             iSBPos;                             // mixing stuff
   InterpolationPtr  pInterpolation;
@@ -232,12 +237,6 @@ public:
   void VoiceOff();
   void VoiceOffAndStop();
 
-  void NotifyOnNoteOn() const;
-  void NotifyOnNoteOff() const;
-  // void NotifyOnChangeToneNumber() const;
-  void NotifyOnChangePitch() const;
-  void NotifyOnChangeVelocity() const;
-
   // temporary
   int envelope() const { return env_; }
   // int envelope_max() const;
@@ -250,8 +249,8 @@ protected:
 
 private:
   mutable bool is_ready_;
-  mutable wxMutex ready_mutex_;
-  mutable wxCondition ready_cond_;
+  mutable std::mutex ready_mutex_;
+  mutable std::condition_variable ready_cond_;
 
   bool is_on_;
 
@@ -283,7 +282,7 @@ private:
   // SPUBase* const p_spu_;
   SPUCore* const p_core_;
   // int core_seq_;
-  wxVector<SPUVoice> voices_;
+  std::vector<SPUVoice> voices_;
   uint32_t new_flags_;
 };
 
@@ -1,6 +1,6 @@
 #pragma once
 #include <stdint.h>
-#include <wx/ptr_scpd.h>
+#include <memory>
 
 
 namespace SPU {
@@ -51,7 +51,7 @@ protected:
 public:
     int *sReverbPlay;
     int *sReverbEnd;
-    wxScopedArray<int> sReverbStart;
+    std::unique_ptr<int[]> sReverbStart;
     int  iReverbOff;    // reverb offset
     int  iReverbRepeat;
     int  iReverbNum;
@@ -1,18 +1,10 @@
 #pragma once
 #include <stdint.h>
-#include <deque>
-#include <set>
-#include <pthread.h>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
 
-#include <wx/event.h>
-#include <wx/vector.h>
-#include <wx/hashmap.h>
-#include <wx/thread.h>
-
-#include <wx/scopedarray.h>
-
-
-class wxEvtHandler;
 
 namespace SPU {
 
@@ -98,7 +90,7 @@ private:
   SoundBank& soundbank_;
 
   const uint8_t* const pADPCM_;
-  mutable wxVector<int32_t> LPCM_;
+  mutable std::vector<int32_t> LPCM_;
   const uint8_t* current_pointer_;
 
   mutable uint32_t loop_offset_;
@@ -122,43 +114,12 @@ private:
 
 
 
-////////////////////////////////////////////////////////////////////////
-// Fourier Transformer
-////////////////////////////////////////////////////////////////////////
-
-
-class FourierTransformer
-{
-public:
-  FourierTransformer();
-  ~FourierTransformer();
-
-  void PostTransform(SPUInstrument* tone, int sampling_rate);
-
-private:
-  static void* mainLoop(void *);
-
-  int sampling_rate_;
-
-  std::deque<SPUInstrument*> queue_;
-  pthread_t thread_;
-  pthread_mutex_t mutexQueue_;
-  pthread_cond_t condQueue_;
-  bool requiresShutdown_;
-};
-
-
-
-
-
-
-
-WX_DECLARE_HASH_MAP(uint32_t, SPUInstrument*, wxIntegerHash, wxIntegerEqual, SamplingToneMap);
+typedef std::unordered_map<uint32_t, SPUInstrument*> SamplingToneMap;
 
 
 class SPUBase;
 
-class SoundBank : public wxEvtHandler
+class SoundBank
 {
 public:
   SoundBank(SPUBase* pSPU);
@@ -178,27 +139,16 @@ public:
 
   // void FourierTransform(SPUInstrument* tone);
 
-  void AddListener(wxEvtHandler* listener);
-  void RemoveListener(wxEvtHandler* listener);
-
   // void NotifyOnAdd(SPUInstrument* tone) const;
   // void NotifyOnModify(SPUInstrument* tone) const;
   // void NotifyOnRemove(SPUInstrument* tone) const;
 
-protected:
-  // void OnMuteTone(wxCommandEvent& event);
-  // void OnUnmuteTone(wxCommandEvent& event);
-
 private:
   SPUBase* pSPU_;
 
   // mutable SamplingToneMap tones_;
 
-  // wxThread *thread;
   // int* fftBuffer_;
-  // FourierTransformer fft_;
-
-  std::set<wxEvtHandler*> listeners_;
 };
 
 
@@ -209,20 +159,31 @@ private:
 
 }
 #include "common/soundbank.h"
+#include "common/taskpool.h"
+#include <atomic>
 namespace SPU {
 
 
 class SPUInstrument_New;
 
-class PCM_Converter : public wxThread {
+//! Decodes an instrument on the TaskPool.
+class PCM_Converter {
 public:
   PCM_Converter(SPUInstrument_New*, uint8_t* p_adpcm);
+  ~PCM_Converter();
+
+  void Run();
+  //! Decode here if no worker has started yet, so that a reader never waits for a free worker.
+  void Help();
+  void Wait();
+
 protected:
-  wxThread::ExitCode Entry();
-  void OnExit();
+  void Entry();
+
 private:
   SPUInstrument_New* const p_inst_;
   const uint8_t* const p_adpcm_;
+  TaskGroup task_;
 };
 
 
@@ -242,6 +203,11 @@ public:
 
   static int CalculateId(SPUAddr addr, SPUAddr external_loop);
 
+  //! The frequency at the native sampling rate, from the SpectrumCache; 0
+  //! until it has been analyzed, or if it has no pitch. Only the first call
+  //! after the analysis looks the cache up.
+  double FindFreq();
+
 protected:
   void Init();
   void Reset();
@@ -251,7 +217,7 @@ private:
   const SPUBase& spu_;
 
   SPUAddr addr_;
-  wxVector<int> data_;
+  std::vector<int> data_;
   unsigned int length_;
   int loop_;
 
@@ -259,8 +225,9 @@ private:
 
   unsigned int read_size_;
   PCM_Converter* thread_;
-  mutable wxMutex read_mutex_;
-  mutable wxCondition read_cond_;
+  mutable std::mutex read_mutex_;
+  mutable std::condition_variable read_cond_;
+  std::atomic<uint64_t> fingerprint_;   // of the PCM once decoded, else 0
 
   friend class PCM_Converter;
 };
@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
+namespace SPU {
+
+
+/*!
+ * @class SpectrumCache
+ * @brief The fundamental frequencies of decoded instruments, by instrument id.
+ *
+ * Instruments are posted once they have been decoded, and transformed with
+ * the real-input FFT by one task at a time on the TaskPool, at analysis
+ * priority. That task takes everything posted so far as one batch, so
+ * loading a bank of hundreds of instruments costs a few tasks which share
+ * one cos/sin table. A result is kept until an instrument with the same id
+ * but different PCM is posted, so reopening a song, or another song of the
+ * same game, does not transform anything again.
+ */
+class SpectrumCache {
+public:
+  static SpectrumCache& Instance();
+
+  //! Identifies the PCM of an instrument; never 0.
+  static uint64_t Fingerprint(const std::vector<int>& pcm, int loop);
+
+  //! Analyze pcm in the background, unless it has been posted before.
+  void Post(int id, uint64_t fingerprint, const std::vector<int>& pcm, int loop, int sampling_rate);
+  //! Returns false if the PCM has not been analyzed yet.
+  bool Find(int id, uint64_t fingerprint, double* freq) const;
+
+  //! Smallest and largest number of samples transformed.
+  static const unsigned int kMinLength = 64;
+  static const unsigned int kMaxLength = 16384;
+
+private:
+  SpectrumCache() : scheduled_(false) {}
+  SpectrumCache(const SpectrumCache&);
+  SpectrumCache& operator=(const SpectrumCache&);
+
+  struct Job {
+    int id;
+    uint64_t fingerprint;
+    std::vector<int> pcm;
+    int loop;
+    int sampling_rate;
+    unsigned int n;     // the transform length
+  };
+
+  struct Entry {
+    uint64_t fingerprint;
+    double freq;
+    bool is_done;
+  };
+
+  void RunBatches();
+  //! The frequency of the strongest partial below sampling_rate / 4, or 0.
+  static double Analyze(const Job& job, double* a, int* ip, double* w);
+
+  mutable std::mutex mutex_;
+  std::unordered_map<int, Entry> entries_;
+  std::vector<Job> pending_;
+  bool scheduled_;    // a task is running RunBatches()
+};
+
+
+}   // namespace SPU
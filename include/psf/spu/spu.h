@@ -1,10 +1,13 @@
 #pragma once
 #include <stdint.h>
-#include <pthread.h>
 #include <deque>
-
-#include <wx/vector.h>
-#include <wx/thread.h>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include "channel.h"
 #include "../psx/common.h"
@@ -19,8 +22,9 @@ class PSF;
 class PSF1;
 class PSF2;
 
-class wxEvtHandler;
 class SoundDevice;
+class LoopDetector;
+class SPULogWriter;
 
 namespace SPU
 {
@@ -38,15 +42,21 @@ protected:
 public:
   virtual void Execute(SPUBase*) const = 0;
 
+  friend class SPUBase;
 };
 
 
+// Requests are immutable and reused; each SPUBase owns its own pools.
+typedef std::unordered_map<long, const SPURequest*> SPUStepRequestPool;
+typedef std::unordered_map<const SPUVoice*, const SPURequest*> SPUVoiceRequestPool;
+
+
 class SPUStepRequest : public SPURequest {
 protected:
   SPUStepRequest(int step_count) : step_count_(step_count) {}
 public:
   void Execute(SPUBase* spu) const;
-  static const SPURequest* CreateRequest(int step_count);
+  static const SPURequest* CreateRequest(SPUBase* p_spu, int step_count);
 private:
   int step_count_;
 };
@@ -93,25 +103,32 @@ private:
 
 class SPUBase;
 
-class SPUThread : public wxThread
+class SPUThread
 {
 public:
   SPUThread(SPUBase* pSPU);
+  ~SPUThread();
+
+  void Run();
+  void Wait();
+  bool IsRunning() const { return is_running_; }
 
   void PutRequest(const SPURequest* req);
   void WaitForLastStep();
 
 protected:
-  ExitCode Entry();
-  void OnExit();
+  void Entry();
 
 private:
   SPUBase* pSPU_;
   int numSamples_;
 
   std::deque<const SPURequest*> req_queue_;
-  wxMutex queue_mutex_;
-  wxCondition queue_cond_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cond_;
+
+  std::thread thread_;
+  std::atomic<bool> is_running_;
 
   friend class SPUBase;
 };
@@ -160,6 +177,7 @@ private:
 public:
   unsigned short ctrl_; // Sp0
   unsigned short stat_;
+  unsigned short transfer_ctrl_;  // 0x1dac
   unsigned int irq_;  // IRQ address
   mutable unsigned int addr_; // DMA current pointer
   // unsigned int rvb_addr_;
@@ -176,7 +194,7 @@ class SPUBase : public psx::Component, public psx::UserMemoryAccessor
 {
 public:
   SPUBase(psx::PSX* composite);
-  virtual ~SPUBase() {}
+  virtual ~SPUBase();
 
   void Init();
   void Open();
@@ -189,8 +207,22 @@ public:
   void set_output(SoundBlock* out) {
     out_ = out;
   }
+  //! Receives a fingerprint of every key-on; nullptr disables it.
+  void set_loop_detector(LoopDetector* detector) {
+    loop_detector_ = detector;
+  }
+  //! Receives every register write and DMA upload; nullptr disables it.
+  void set_log_writer(SPULogWriter* writer) {
+    log_writer_ = writer;
+  }
+  SPULogWriter* log_writer() const { return log_writer_; }
+  //! Samples output since Open().
+  uint64_t sample_count() const { return sample_count_; }
+  //! Publish the voices as they are at the end of block, which they were rendered into.
+  void PublishVoices(const SoundBlock& block, VoiceFeed* feed);
 
   bool IsAsync() const;
+  void EnableAsync(bool enable = true);
   bool (SPUBase::*Get)(SoundBlock* dest);
   bool GetSync(SoundBlock* dest);
   bool GetAsync(SoundBlock* dest);
@@ -269,6 +301,7 @@ public:
   // Notify functions
   void NotifyOnUpdateStartAddress(int ch) const;
   void NotifyOnChangeLoopIndex(SPUVoice* pChannel) const;
+  void NotifyOnKeyOn(uint64_t fingerprint) const;
 
   void NotifyOnAddTone(const SPUInstrument_New& tone) const;
   void NotifyOnChangeTone(const SPUInstrument_New& tone) const;
@@ -287,6 +320,8 @@ public:
 protected:
   void SetupStreams();
   void RemoveStreams();
+  //! Push one sample of every voice of every core, and of the reverb, into dest.
+  void GetVoices(SoundBlock* dest);
 
 private:
   psx::PSX* const p_psx_;
@@ -304,12 +339,13 @@ private:
   Soundbank soundbank_;
   NeilReverb reverb_;
   SoundBlock* out_;
+  LoopDetector* loop_detector_;
+  SPULogWriter* log_writer_;
+  uint64_t sample_count_;
 
-  wxScopedArray<uint8_t> mem8_;
+  std::unique_ptr<uint8_t[]> mem8_;
   uint16_t* p_mem16_;
 
-  // wxCriticalSection csDMAReadable_;
-  // wxCriticalSection csDMAWritable_;
 
   InterpolationType useInterpolation;
 
@@ -329,8 +365,18 @@ private:
   int m_iFMod[NSSIZE];
   int m_iCycle;
 
+  SPUStepRequestPool step_requests_;
+  SPUVoiceRequestPool note_on_requests_;
+  SPUVoiceRequestPool note_off_requests_;
+  SPUVoiceRequestPool set_offset_requests_;
+
+  friend class SPUStepRequest;
+  friend class SPUNoteOnRequest;
+  friend class SPUNoteOffRequest;
+  friend class SPUSetOffsetRequest;
+
 protected:
-  wxVector<SPUCore> cores_;
+  std::vector<SPUCore> cores_;
   SPUVoiceManager voice_manager_;
   SPUThread* thread_;
 };
@@ -438,9 +484,5 @@ inline void SPUBase::SetIRQAddress(SPUAddr addr) {
 }   // namespace SPU
 
 
-#include <wx/event.h>
-
-wxDECLARE_EXPORTED_EVENT(WXDLLIMPEXP_CORE, wxEVENT_SPU_CHANNEL_CHANGE_LOOP, wxCommandEvent);
-
 
 // extern SPU::SPU& Spu;
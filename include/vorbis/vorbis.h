@@ -1,9 +1,9 @@
 #pragma once
 #include "common/SoundLoader.h"
-#include <wx/string.h>
 #include <wx/file.h>
-#include <wx/weakref.h>
 #include <vorbis/vorbisfile.h>
+#include <memory>
+#include <string>
 
 #include "common/SoundFormat.h"
 
@@ -44,10 +44,10 @@ private:
 
 class VorbisLoader : public SoundLoader {
 public:
-  VorbisLoader(int fd, const wxString& filename);
+  VorbisLoader(int fd, const std::string& filename);
   ~VorbisLoader();
   
-  static VorbisLoader* Instance(int fd, const wxString& filename);
+  static VorbisLoader* Instance(int fd, const std::string& filename);
   
   SoundInfo* LoadInfo();
   SoundData* LoadData();
@@ -55,13 +55,12 @@ public:
   
 private:
   wxFile file_;
-  wxString path_;
+  std::string path_;
   
-  OggVorbis_File* vf_tmp_;
+  OggVorbis_File* vf_tmp_;  // handed over to the first Vorbis
   static ov_callbacks oc_;
   
-  wxWeakRef<SoundInfo> ref_info_;
-  wxWeakRef<Vorbis> ref_data_;
+  std::unique_ptr<SoundInfo> info_;
   
   long loop_start_;
   long loop_length_;
@@ -135,14 +135,11 @@ void MainFrame::OnAbout(wxCommandEvent& WXUNUSED(event))
 
 void MainFrame::OnPlay(wxCommandEvent& WXUNUSED(event))
 {
-    PSFPlaylistItem *item = file_treectrl->GetSelectedItem();
-    if (item == 0) return;
+    // the following items are warmed up in the background and played gaplessly
+    const wxArrayString paths = file_treectrl->GetPathsFromSelection();
+    if (paths.empty()) return;
 
-    SoundData *sound = item->GetSound();
-    rennyAssert(sound != nullptr);
-    //if (sound->Load() == false) return;
-
-    wxGetApp().Play(sound);
+    wxGetApp().Play(paths);
 }
 
 void MainFrame::OnStop(wxCommandEvent& WXUNUSED(event))
@@ -3,9 +3,46 @@
 #include "common/Sound.h"
 #include "common/debug.h"
 
+#include <wx/dir.h>
 #include <wx/filename.h>
 #include <wx/imaglist.h>
 #include <wx/artprov.h>
+#include <wx/stdpaths.h>
+
+
+namespace {
+
+//! ~/.rennypsf/tags.idx or the platform equivalent.
+std::string TagIndexPath()
+{
+    const wxFileName path(wxStandardPaths::Get().GetUserDataDir(), wxT("tags.idx"));
+    return std::string(path.GetFullPath().utf8_str());
+}
+
+}   // namespace
+
+
+class PlaylistTagScanner : public TagScanner {
+public:
+    PlaylistTagScanner(PSFPlaylist* playlist, TagIndex* index)
+        : TagScanner(index), playlist_(playlist) {}
+    ~PlaylistTagScanner() {
+        // no more callbacks once the playlist starts going away
+        Cancel();
+        Wait();
+    }
+
+protected:
+    void OnScanned(const TrackTags& tags) {
+        playlist_->CallAfter(&PSFPlaylist::OnTagsScanned, tags);
+    }
+    void OnFinished() {
+        playlist_->CallAfter(&PSFPlaylist::OnScanFinished);
+    }
+
+private:
+    PSFPlaylist* const playlist_;
+};
 
 
 PSFPlaylist::PSFPlaylist(wxWindow* parent, wxWindowID id)
@@ -24,10 +61,17 @@ PSFPlaylist::PSFPlaylist(wxWindow* parent, wxWindowID id)
     fdt = new PSFFileDropTarget(this);
     SetDropTarget(fdt);
 //    DragAcceptFiles(true);
+
+    tag_index_.Load(TagIndexPath());
+    scanner_.reset(new PlaylistTagScanner(this, &tag_index_));
 }
 
 PSFPlaylist::~PSFPlaylist()
 {
+    scanner_.reset();
+    if (tag_index_.IsModified()) {
+        tag_index_.Save(TagIndexPath());
+    }
 }
 
 
@@ -37,24 +81,83 @@ PSFPlaylistItem* PSFPlaylist::GetSelectedItem() const
     return item;
 }
 
+wxArrayString PSFPlaylist::GetPathsFromSelection() const
+{
+    wxArrayString paths;
+    wxTreeItemId id = GetSelection();
+    for (; id.IsOk(); id = GetNextSibling(id)) {
+        PSFPlaylistItem *item = dynamic_cast<PSFPlaylistItem*>(GetItemData(id));
+        if (item != 0) {
+            paths.push_back(item->GetFullPath());
+        }
+    }
+    return paths;
+}
+
 
 bool PSFPlaylist::Append(const wxString &file_name)
 {
+    bool ret = false;
     if (wxDirExists(file_name)) {
-        wxPuts(wxT("WARNING: we cannot open a directory yet."));
-        return false;
+        wxArrayString files;
+        wxDir::GetAllFiles(file_name, &files, wxEmptyString, wxDIR_FILES | wxDIR_DIRS);
+        files.Sort();
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (TagScanner::IsPSFFile(std::string(files[i].utf8_str())) && AppendFile(files[i])) ret = true;
+        }
+    } else {
+        ret = AppendFile(file_name);
     }
+    scanner_->Start();
+    return ret;
+}
+
+
+bool PSFPlaylist::AppendFile(const wxString &file_name)
+{
     wxString path, name, ext;
     wxFileName::SplitPath(file_name, &path, &name, &ext);
     if (ext.IsEmpty()) return false;
 
     PSFPlaylistItem *item = new PSFPlaylistItem(file_name, name, ext);
-    if (item->IsAvailable()) {
-        AppendItem(item->GetFileName(), 1, 1, item);
-        return true;
+    if (item->IsAvailable() == false) {
+        delete item;
+        return false;
+    }
+    const wxTreeItemId id = AppendItem(item->GetFileName(), 1, 1, item);
+
+    const std::string path(file_name.utf8_str());
+    if (TagScanner::IsPSFFile(path)) {
+        items_[path] = id;
+        int64_t mtime;
+        uint64_t size;
+        TrackTags tags;
+        if (TagIndex::GetFileStat(path, &mtime, &size) &&
+            tag_index_.Find(path, mtime, size, &tags)) {
+            OnTagsScanned(tags);
+        } else {
+            scanner_->Add(path);
+        }
+    }
+    return true;
+}
+
+
+void PSFPlaylist::OnTagsScanned(const TrackTags& tags)
+{
+    auto it = items_.find(tags.path);
+    if (it == items_.end() || it->second.IsOk() == false) return;
+    if (tags.title.empty() == false) {
+        SetItemText(it->second, wxString::FromUTF8(tags.title.c_str()));
+    }
+}
+
+
+void PSFPlaylist::OnScanFinished()
+{
+    if (tag_index_.IsModified()) {
+        tag_index_.Save(TagIndexPath());
     }
-    delete item;
-    return false;
 }
 
 
@@ -89,19 +192,17 @@ void PSFPlaylist::OnDropFiles(wxDropFilesEvent& WXUNUSED(event))
 
 
 PSFPlaylistItem::PSFPlaylistItem(const wxString& fullpath, const wxString& filename)
-    : m_loader(0), m_sound(0)
+    : m_loader(0), m_fullpath(fullpath), m_sound(0)
 {
     m_filename = filename;
     m_ext = filename.Mid(filename.Find(wxT('.'), true)+1);
-    LoadSound(fullpath, m_ext);
 }
 
 PSFPlaylistItem::PSFPlaylistItem(const wxString& fullpath, const wxString& name, const wxString& ext)
-    : m_loader(0), m_sound(0)
+    : m_loader(0), m_fullpath(fullpath), m_sound(0)
 {
     m_filename = name + wxT('.') + ext;
     m_ext = ext;
-    LoadSound(fullpath, ext);
 }
 
 PSFPlaylistItem::~PSFPlaylistItem()
@@ -131,7 +232,16 @@ inline const wxString& PSFPlaylistItem::GetExt() const {
 
 
 inline bool PSFPlaylistItem::IsAvailable() const {
-    return (m_sound != 0);
+    return TagScanner::IsPSFFile(std::string(m_fullpath.utf8_str())) || m_ext.Lower() == wxT("ogg");
+}
+
+
+SoundData* PSFPlaylistItem::LoadSound()
+{
+    if (m_sound == 0) {
+        LoadSound(m_fullpath, m_ext);
+    }
+    return m_sound;
 }
 
 
@@ -149,7 +259,7 @@ bool PSFPlaylistItem::LoadSound(const wxString &path, const wxString &ext)
             return false;
         }
         */
-      loader = SoundLoader::Instance(path);
+      loader = SoundLoader::Instance(std::string(path.utf8_str()));
       if (loader == nullptr) {
         return false;
       }
@@ -173,22 +283,8 @@ bool PSFFileDropTarget::OnDropFiles(wxCoord x, wxCoord y, const wxArrayString& f
     wxMessageOutputDebug().Printf("OnDropFile");
     int i = 0;
 	do {
-		if (wxDirExists(filenames[i])) {
-			wxPuts(wxT("WARNING: we cannot open a directory yet."));
-		} else {
-			// append an item to the list
-			wxString path, name, ext;
-            wxFileName::SplitPath(filenames[i], &path, &name, &ext);
-			if (ext.IsEmpty()) continue;
-            // if (ExtIsAvailable(ext) == false) continue;
-
-            PSFPlaylistItem *item = new PSFPlaylistItem(filenames[i], name, ext);
-            if (item->IsAvailable()) {
-                playlist->AppendItem(item->GetFileName(), 1, 1, item);
-            } else {
-                delete item;
-            }
-		}
+		// directories are scanned in the background
+		playlist->Append(filenames[i]);
 	} while ((++i) < (int)filenames.GetCount());
 	return true;
 }
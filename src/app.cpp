@@ -5,11 +5,42 @@
 #include "channelframe.h"
 #include "common/SoundManager.h"
 #include "common/debug.h"
+#include "logwindow.h"
+#include "common/SoundLoader.h"
+#include "common/soundrenderer.h"
+#include "common/voicefeed.h"
 
 #ifdef __WXMAC__
 #include <ApplicationServices/ApplicationServices.h>
 #endif
 
+namespace {
+
+//! Where a sound with the given tags ends, in output frames; 0 if it does not.
+void GetEndFrames(const SoundInfo* p_info, uint32_t rate, size_t* end, size_t* fade) {
+  *end = *fade = 0;
+  if (p_info == nullptr) return;
+  const int length = SoundRenderer::ParseTime(p_info->length());
+  if (length < 0) return;
+  int fade_ms = 0;
+  SoundInfo::Tag::const_iterator it = p_info->others().find("fade");
+  if (it != p_info->others().end()) {
+    fade_ms = wxMax(SoundRenderer::ParseTime(it->second), 0);
+  }
+  *fade = static_cast<uint64_t>(fade_ms) * rate / 1000;
+  *end = static_cast<uint64_t>(length) * rate / 1000 + *fade;
+}
+
+inline void ScaleVolume(SampleSequence* seq, size_t i, float gain) {
+  if (seq->sample_length() <= i) return;
+  float left, right;
+  seq->volume(i, &left, &right);
+  seq->set_volume(i, left * gain, right * gain);
+}
+
+}   // namespace
+
+
 ////////////////////////////////////////////////////////////////////////
 // RennyPlayerThread class functions
 ////////////////////////////////////////////////////////////////////////
@@ -19,12 +50,27 @@ RennyPlayer::RennyPlayerThread::RennyPlayerThread(RennyPlayer* player)
 
 wxThread::ExitCode RennyPlayer::RennyPlayerThread::Entry() {
   SoundDevice* p_device = player_->p_device_;
-  SoundData* p_sound = player_->p_sound_;
-  SoundBlock* p_block = &player_->block_;
-  p_device->SetSamplingRate(p_sound->GetSamplingRate());
-  p_device->Listen();
+  uint32_t rate = 0;
   while (!TestDestroy()) {
-    if (p_sound->Advance(p_block) == false) break;
+    SoundData* p_sound = player_->p_sound_;
+    if (p_sound == nullptr || player_->HasEnded()) {
+      if (player_->SwitchToNext()) continue;
+      // the next file is late; a short gap beats stopping
+      if (player_->WaitForNext()) continue;
+      break;
+    }
+    SoundBlock* p_block = &player_->block();
+    if (p_sound->Advance(p_block) == false) {
+      player_->ended_ = true;
+      continue;
+    }
+    if (p_sound->GetSamplingRate() != rate) {
+      if (rate != 0) p_device->Stop();
+      rate = p_sound->GetSamplingRate();
+      p_device->SetSamplingRate(rate);
+      p_device->Listen();
+    }
+    player_->Fade(p_block);
     p_device->OnUpdate(p_block);
   }
   p_device->Stop();
@@ -36,72 +82,288 @@ wxThread::ExitCode RennyPlayer::RennyPlayerThread::Entry() {
 ////////////////////////////////////////////////////////////////////////
 
 RennyPlayer::RennyPlayer()
-  : thread_(nullptr), p_device_(nullptr), p_sound_(nullptr) {}
+  : thread_(nullptr), p_device_(nullptr), p_sound_(nullptr), p_loader_(nullptr),
+    block_index_(0), played_frames_(0), end_frames_(0), fade_frames_(0), ended_(false),
+    warm_up_(TaskPool::kPriorityPlayback), warm_up_scheduled_(false), next_ready_(mutex_),
+    generation_(0), warming_up_(false), exiting_(false), stopping_(false),
+    next_sound_(nullptr), next_loader_(nullptr), next_end_frames_(0), next_fade_frames_(0) {}
 
 RennyPlayer::~RennyPlayer() {
-  if (IsPlaying()) {
+  Stop();
+  StopWarmUp();
+}
+
+bool RennyPlayer::Play(SoundData *p_sound, SoundDevice *p_device, const SoundInfo* p_info) {
+  if (p_sound == nullptr || p_device == nullptr) return false;
+  if (p_sound_ != p_sound) {
     Stop();
+  } else if (thread_ != nullptr) {
+    StopThread();
+    ClearQueue();
+    p_sound->Close();
+  }
+  if (p_sound->Open(&block()) == false) return false;
+
+  p_sound->set_voice_feed(&VoiceFeed::Instance());
+  p_sound_ = p_sound;
+  GetEndFrames(p_info, p_sound->GetSamplingRate(), &end_frames_, &fade_frames_);
+  return StartThread(p_device);
+}
+
+bool RennyPlayer::Play(const wxArrayString& paths, SoundDevice* p_device) {
+  if (paths.empty() || p_device == nullptr) return false;
+  Stop();
+  for (size_t i = 0; i < paths.size(); ++i) {
+    Enqueue(paths[i]);
+  }
+  // the thread waits for the first file to be warmed up
+  return StartThread(p_device);
+}
+
+bool RennyPlayer::StartThread(SoundDevice* p_device) {
+  p_device_ = p_device;
+  played_frames_ = 0;
+  ended_ = false;
+  {
+    wxMutexLocker locker(mutex_);
+    stopping_ = false;
   }
-  if (thread_) {
+  thread_ = new RennyPlayerThread(this);
+  if (thread_->Create() != wxTHREAD_NO_ERROR || thread_->Run() != wxTHREAD_NO_ERROR) {
+    rennyLogError("RennyPlayer", "Failed to start the player thread.");
     delete thread_;
+    thread_ = nullptr;
+    return false;
   }
-  if (p_sound_) {
-    delete p_sound_;
+  return true;
+}
+
+void RennyPlayer::StopThread() {
+  {
+    // wake it up if it waits for the next file
+    wxMutexLocker locker(mutex_);
+    stopping_ = true;
+    next_ready_.Broadcast();
   }
+  thread_->Delete();
+  thread_->Wait();
+  delete thread_;
+  thread_ = nullptr;
 }
 
-bool RennyPlayer::Play(SoundData *p_sound, SoundDevice *p_device) {
-  if (p_sound == nullptr || p_device == nullptr) return false;
-  if (thread_ == nullptr) {
-    thread_ = new RennyPlayerThread(this);
+bool RennyPlayer::Stop() {
+  if (thread_ != nullptr) {
+    StopThread();
   }
-  switch (thread_->Create()) {
-  case wxTHREAD_NO_ERROR:
-    break;
-  case wxTHREAD_NO_RESOURCE:
-    return false;
-  case wxTHREAD_RUNNING:
-    Stop();
-    return Play(p_sound, p_device);
-  default:
+  ClearQueue();
+  if (p_sound_ == nullptr) return true;
+  const bool ret = p_sound_->Close();
+  delete p_sound_;
+  delete p_loader_;
+  p_sound_ = nullptr;
+  p_loader_ = nullptr;
+  return ret;
+}
+
+bool RennyPlayer::IsPlaying() const {
+  return (thread_ && thread_->IsRunning());
+}
+
+void RennyPlayer::Enqueue(const wxString& path) {
+  wxMutexLocker locker(mutex_);
+  queue_.push_back(path);
+  StartWarmUp();
+}
+
+void RennyPlayer::ClearQueue() {
+  wxMutexLocker locker(mutex_);
+  queue_.clear();
+  ++generation_;
+  if (next_sound_ != nullptr) {
+    Retire(next_sound_, next_loader_);
+    next_sound_ = nullptr;
+    next_loader_ = nullptr;
+  }
+  next_ready_.Broadcast();
+}
+
+void RennyPlayer::StartWarmUp() {
+  if (warm_up_scheduled_ || exiting_) return;
+  warm_up_scheduled_ = true;
+  warm_up_.Run([this] { WarmUpTask(); });
+}
+
+void RennyPlayer::StopWarmUp() {
+  {
+    wxMutexLocker locker(mutex_);
+    exiting_ = true;
+  }
+  warm_up_.Wait();
+  wxMutexLocker locker(mutex_);
+  if (next_sound_ != nullptr) {
+    Retire(next_sound_, next_loader_);
+    next_sound_ = nullptr;
+    next_loader_ = nullptr;
+  }
+  DeleteRetired();
+}
+
+void RennyPlayer::WarmUpTask() {
+  wxMutexLocker locker(mutex_);
+  while (exiting_ == false) {
+    if (retired_sounds_.empty() == false || retired_loaders_.empty() == false) {
+      DeleteRetired();
+      continue;
+    }
+    if (next_sound_ == nullptr && queue_.empty() == false) {
+      const wxString path = queue_[0];
+      queue_.RemoveAt(0);
+      WarmUp(path);
+      continue;
+    }
     break;
   }
+  // the next Enqueue() or Retire() schedules a new task
+  warm_up_scheduled_ = false;
+}
+
+void RennyPlayer::WarmUp(const wxString& path) {
+  const unsigned int generation = generation_;
+  SoundBlock* p_block = &blocks_[block_index_ ^ 1];
+  warming_up_ = true;
+  mutex_.Unlock();
+
+  size_t end_frames = 0, fade_frames = 0;
+  SoundData* p_sound = nullptr;
+  SoundLoader* p_loader = SoundLoader::Instance(std::string(path.utf8_str()));
+  if (p_loader != nullptr) {
+    p_sound = p_loader->LoadData();
+  }
+  if (p_sound != nullptr) {
+    GetEndFrames(p_loader->LoadInfo(), p_sound->GetSamplingRate(), &end_frames, &fade_frames);
+    // boot up to the first sample now rather than at the track boundary
+    if (p_sound->Open(p_block) == false) {
+      delete p_sound;
+      p_sound = nullptr;
+    }
+  }
+  if (p_sound == nullptr) {
+    rennyLogError("RennyPlayer", "Failed to load '%s'.", path.utf8_str().data());
+    delete p_loader;
+  }
+
+  mutex_.Lock();
+  warming_up_ = false;
+  next_ready_.Broadcast();
+  if (p_sound == nullptr) return;
+  if (generation != generation_ || next_sound_ != nullptr) {
+    Retire(p_sound, p_loader);   // the queue was cleared meanwhile
+    return;
+  }
+  next_sound_ = p_sound;
+  next_loader_ = p_loader;
+  next_end_frames_ = end_frames;
+  next_fade_frames_ = fade_frames;
+}
 
-  if (p_sound->Open(&block_) == false) return false;
+void RennyPlayer::Retire(SoundData* p_sound, SoundLoader* p_loader) {
+  if (p_sound != nullptr) retired_sounds_.push_back(p_sound);
+  if (p_loader != nullptr) retired_loaders_.push_back(p_loader);
+  StartWarmUp();
+}
 
-  if (p_sound_) {
-    delete p_sound_;
+void RennyPlayer::DeleteRetired() {
+  const wxVector<SoundData*> sounds(retired_sounds_);
+  const wxVector<SoundLoader*> loaders(retired_loaders_);
+  retired_sounds_.clear();
+  retired_loaders_.clear();
+  mutex_.Unlock();
+  for (size_t i = 0; i < sounds.size(); ++i) {
+    sounds[i]->Close();
+    delete sounds[i];
   }
-  p_sound_ = p_sound;
-  p_device_ = p_device;
-  thread_->Run();
+  // only after the sounds, which may still read their files
+  for (size_t i = 0; i < loaders.size(); ++i) {
+    delete loaders[i];
+  }
+  mutex_.Lock();
+}
 
+bool RennyPlayer::HasEnded() const {
+  return ended_ || (end_frames_ != 0 && end_frames_ <= played_frames_);
+}
+
+bool RennyPlayer::SwitchToNext() {
+  wxMutexLocker locker(mutex_);
+  if (next_sound_ == nullptr) return false;
+
+  const SoundBlock& prev_block = block();
+  SoundBlock& next_block = blocks_[block_index_ ^ 1];
+  for (unsigned int ch = 0; ch < prev_block.channel_count() && ch < next_block.channel_count(); ++ch) {
+    if (prev_block.Ch(ch).IsMuted()) {
+      next_block.Ch(ch).Mute();
+    } else {
+      next_block.Ch(ch).Unmute();
+    }
+  }
+  block_index_ ^= 1;
+
+  // closing the old sound is left to the warm-up task, too
+  if (p_sound_ != nullptr) p_sound_->set_voice_feed(nullptr);
+  Retire(p_sound_, p_loader_);
+  next_sound_->set_voice_feed(&VoiceFeed::Instance());
+  p_sound_ = next_sound_;
+  p_loader_ = next_loader_;
+  end_frames_ = next_end_frames_;
+  fade_frames_ = next_fade_frames_;
+  played_frames_ = 0;
+  ended_ = false;
+  next_sound_ = nullptr;
+  next_loader_ = nullptr;
   return true;
 }
 
-bool RennyPlayer::Stop() {
-  if (IsPlaying()) {
-    thread_->Delete();
-    thread_->Wait();
-    delete thread_;
-    thread_ = nullptr;
+bool RennyPlayer::WaitForNext() {
+  wxMutexLocker locker(mutex_);
+  while (next_sound_ == nullptr && stopping_ == false &&
+         (warming_up_ || queue_.empty() == false)) {
+    next_ready_.Wait();
   }
-  return p_sound_->Close();
+  return next_sound_ != nullptr;
 }
 
-bool RennyPlayer::IsPlaying() const {
-  return (thread_ && thread_->IsRunning());
+void RennyPlayer::Fade(SoundBlock* p_block) {
+  size_t length = p_block->sample_length();
+  if (end_frames_ != 0) {
+    // the frames past the end are the next sound's; its first block follows this one
+    if (played_frames_ + length > end_frames_) {
+      length = (played_frames_ < end_frames_) ? end_frames_ - played_frames_ : 0;
+      p_block->Truncate(length);
+    }
+    const size_t fade_start = end_frames_ - fade_frames_;
+    for (size_t i = 0; i < length; ++i) {
+      const size_t frame = played_frames_ + i;
+      if (frame < fade_start) continue;
+      const float gain = static_cast<float>(end_frames_ - frame) / fade_frames_;
+      for (unsigned int ch = 0; ch < p_block->channel_count(); ++ch) {
+        ScaleVolume(&p_block->Ch(ch), i, gain);
+      }
+      ScaleVolume(&p_block->ReverbCh(0), i, gain);
+      ScaleVolume(&p_block->ReverbCh(1), i, gain);
+    }
+  }
+  played_frames_ += length;
 }
 
 bool RennyPlayer::Mute(int ch) {
-  if (static_cast<int>(block_.channel_count()) <= ch) return false;
-  block_.Ch(ch).Mute();
+  if (static_cast<int>(block().channel_count()) <= ch) return false;
+  block().Ch(ch).Mute();
   return true;
 }
 
 bool RennyPlayer::Unmute(int ch) {
-  if (static_cast<int>(block_.channel_count()) <= ch) return false;
-  block_.Ch(ch).Unmute();
+  if (static_cast<int>(block().channel_count()) <= ch) return false;
+  block().Ch(ch).Unmute();
   return true;
 }
 
@@ -114,8 +376,8 @@ bool RennyPlayer::Switch(int ch) {
 }
 
 bool RennyPlayer::IsMuted(int ch) const {
-  if (static_cast<int>(block_.channel_count()) <= ch) return true;
-  return block_.Ch(ch).IsMuted();
+  if (static_cast<int>(block().channel_count()) <= ch) return true;
+  return block().Ch(ch).IsMuted();
 }
 
 
@@ -248,6 +510,11 @@ bool RennypsfApp::Play(SoundData* sound)
   return player_->Play(sound, sdd_);
 }
 
+bool RennypsfApp::Play(const wxArrayString& paths)
+{
+  return player_->Play(paths, sdd_);
+}
+
 bool RennypsfApp::Stop()
 {
   /*
@@ -283,11 +550,62 @@ const wxSharedPtr<SoundData>& RennypsfApp::GetPlayingSound() const {
   return dummy;
 }
 
-#include "common/SoundLoader.h"
+#include "common/renderfarm.h"
+#include "vorbis/vorbis.h"
+#include <cstring>
+#include <cstdlib>
 
 int main(int argc, char** argv) {
   wxMessageOutputDebug().Printf(wxT("Started this application."));
 
+  // the core knows PSF only
+  SoundLoader::RegisterInstanceFunc((SoundLoader::InstanceFunc)&VorbisLoader::Instance, "OggS");
+
+  // headless mode: rennypsf --render <sound file> <wave file>
+  if (argc > 3 && std::strcmp(argv[1], "--render") == 0) {
+    rennySetLogSink(&rennyStderrLogSink);
+    ConsoleSoundRenderer renderer;
+    const bool ret = renderer.Render(argv[2], argv[3]);
+    return ret ? 0 : 1;
+  }
+
+  // headless mode: rennypsf --capture <sound file> <SPU log> [wave file]
+  if (argc > 3 && std::strcmp(argv[1], "--capture") == 0) {
+    rennySetLogSink(&rennyStderrLogSink);
+    ConsoleSoundRenderer renderer;
+    renderer.set_capture_path(argv[3]);
+    const bool ret = renderer.Render(argv[2], argc > 4 ? argv[4] : "");
+    return ret ? 0 : 1;
+  }
+
+  // headless mode: rennypsf --profile <sound file> <report file> [wave file]
+  if (argc > 3 && std::strcmp(argv[1], "--profile") == 0) {
+    rennySetLogSink(&rennyStderrLogSink);
+    ConsoleSoundRenderer renderer;
+    renderer.set_profile_path(argv[3]);
+    const bool ret = renderer.Render(argv[2], argc > 4 ? argv[4] : "");
+    return ret ? 0 : 1;
+  }
+
+  // headless mode: rennypsf --stems <sound file> <stem dir> [wave file]
+  if (argc > 3 && std::strcmp(argv[1], "--stems") == 0) {
+    rennySetLogSink(&rennyStderrLogSink);
+    ConsoleSoundRenderer renderer;
+    renderer.set_stem_dir(argv[3]);
+    const bool ret = renderer.Render(argv[2], argc > 4 ? argv[4] : "");
+    return ret ? 0 : 1;
+  }
+
+  // headless mode: rennypsf --render-dir <sound dir> <wave dir> [jobs]
+  if (argc > 3 && std::strcmp(argv[1], "--render-dir") == 0) {
+    rennySetLogSink(&rennyStderrLogSink);
+    ConsoleRenderFarm farm(argc > 4 ? std::atoi(argv[4]) : 0);
+    farm.AddDirectory(argv[2], argv[3]);
+    const bool ret = farm.Run();
+    farm.PrintSummary();
+    return ret ? 0 : 1;
+  }
+
   wxApp::SetInstance(new RennypsfApp());
   wxEntryStart(argc, argv);
 #ifdef __WXMAC__
@@ -7,6 +7,8 @@
 #include <wx/stattext.h>
 //#include <wx/gauge.h>
 #include "common/SoundManager.h"
+#include "common/voicefeed.h"
+#include <algorithm>
 #include "app.h"
 //#include "spu/spu.h"
 
@@ -120,7 +122,6 @@ VolumeBar::VolumeBar(wxWindow *parent, wxOrientation orientation, int ch)
   ch_ = ch;
   value_ = 0;
 
-  // wxEvtHandler::Bind(wxEVT_CHANGE_VELOCITY, &VolumeBar::OnChangeVelocity, this);
   // wxGetApp().GetSoundManager()->AddListener(this, ch);
 }
 
@@ -172,29 +173,6 @@ void VolumeBar::paintEvent(wxPaintEvent &)
 }
 
 
-void VolumeBar::OnChangeVelocity(const NoteInfo &note) {
-    const float prev_vel = GetValue();
-    if (note.velocity != prev_vel) {
-        SetValue(note.velocity);
-        int width, height;
-        GetSize(&width, &height);
-        wxRect rect;
-        if (prev_vel <= note.velocity) {
-            rect.SetLeft(prev_vel);
-            rect.SetRight(note.velocity);
-        } else {
-            rect.SetLeft(note.velocity);
-            rect.SetRight(prev_vel);
-        }
-        rect.SetTop(0);
-        rect.SetBottom(height);
-        // RefreshRect(rect);
-    }
-}
-
-
-
-
 ////////////////////////////////////////////////////////////////////////
 // Keyboard Widget
 ////////////////////////////////////////////////////////////////////////
@@ -218,7 +196,8 @@ int KeyboardWidget::calcKeyboardWidth()
 
 KeyboardWidget::KeyboardWidget(wxWindow* parent, int ch, int keyWidth, int keyHeight) :
   wxPanel(parent, wxID_ANY, wxDefaultPosition, wxSize(513, keyHeight)),
-  octaveMin_(defaultOctaveMin), octaveMax_(defaultOctaveMax), muted_(false), update_key_(false)
+  octaveMin_(defaultOctaveMin), octaveMax_(defaultOctaveMax), muted_(false), update_key_(false),
+  shown_key_(-1)
 {
   if (keyWidth < 7) keyWidth_ = 6;
   else keyWidth_ = 8;
@@ -230,10 +209,6 @@ KeyboardWidget::KeyboardWidget(wxWindow* parent, int ch, int keyWidth, int keyHe
 
   SetBackgroundColour(*wxWHITE);
 
-  wxEvtHandler::Bind(wxEVT_NOTE_ON, &KeyboardWidget::OnNoteOn, this);
-  wxEvtHandler::Bind(wxEVT_NOTE_OFF, &KeyboardWidget::OnNoteOff, this);
-  wxEvtHandler::Bind(wxEVT_CHANGE_PITCH, &KeyboardWidget::OnChangePitch, this);
-
   // wxGetApp().GetSoundManager()->AddListener(this, ch);
 }
 
@@ -461,11 +436,20 @@ bool KeyboardWidget::PressKey(int keyIndex)
 }
 
 
-bool KeyboardWidget::PressKey(double pitch)
+int KeyboardWidget::KeyIndex(double pitch)
 {
+  if (pitch <= 0.0) return -1;
   // A4 = 440 Hz
   int index = round( ( log(pitch/440.0)/log(2.0) + 5.75 ) * 12.0 );
-  if (index < 0 || 120 < index) return false;
+  if (index < 0 || 120 < index) return -1;
+  return index;
+}
+
+
+bool KeyboardWidget::PressKey(double pitch)
+{
+  const int index = KeyIndex(pitch);
+  if (index < 0) return false;
   return PressKey(index);
 }
 
@@ -498,25 +482,17 @@ void KeyboardWidget::ReleaseKey(int keyIndex)
 
 
 
-void KeyboardWidget::OnNoteOn(wxCommandEvent &event) {
-  const NoteInfo* note = (NoteInfo*)event.GetClientData();
-  PressKey(note->pitch);
-  delete note;
-}
-
-
-void KeyboardWidget::OnNoteOff(wxCommandEvent& event) {
-  const NoteInfo* note = (NoteInfo*)event.GetClientData();
-  ReleaseKey();
-  delete note;
-}
-
-
-void KeyboardWidget::OnChangePitch(wxCommandEvent &event) {
-  const NoteInfo* note = (NoteInfo*)event.GetClientData();
-  ReleaseKey();
-  PressKey(note->pitch);
-  delete note;
+void KeyboardWidget::ShowNote(bool on, double pitch)
+{
+  const int key = on ? KeyIndex(pitch) : -1;
+  if (key == shown_key_) return;
+  if (shown_key_ >= 0) {
+    ReleaseKey();
+  }
+  shown_key_ = key;
+  if (key >= 0) {
+    PressKey(key);
+  }
 }
 
 
@@ -527,7 +503,7 @@ void KeyboardWidget::OnChangePitch(wxCommandEvent &event) {
 
 
 RateText::RateText(wxWindow *parent, int ch)
-  : wxStaticText(parent, wxID_ANY, wxT("000000"), wxDefaultPosition)
+  : wxStaticText(parent, wxID_ANY, wxT("000000"), wxDefaultPosition), rate_(-1)
 {
   // wxEvtHandler::Bind(wxEVT_PAINT, &RateText::OnPaint, this);
 
@@ -547,10 +523,10 @@ void RateText::OnPaint(wxPaintEvent &event) {
 */
 
 
-void RateText::OnChangePitch(const NoteInfo &note) {
-  rate_ = note.rate;
-  const wxString str_rate = wxString::Format(wxT("%d"), rate_);
-  // SetLabel(str_rate);
+void RateText::SetRate(int rate) {
+  if (rate_ == rate) return;
+  rate_ = rate;
+  SetLabel(wxString::Format(wxT("%d"), rate_));
 }
 
 
@@ -562,10 +538,17 @@ void RateText::OnChangePitch(const NoteInfo &note) {
 
 ChannelPanel::ChannelPanel(wxWindow *parent)
 //  : wxPanel(parent, -1, wxDefaultPosition, wxDefaultSize, wxTAB_TRAVERSAL, "channel_panel") {
-: wxScrolledWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxTAB_TRAVERSAL) {
+: wxScrolledWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxTAB_TRAVERSAL), timer_(this) {
 
   wholeSizer = new wxStaticBoxSizer(wxVERTICAL, this, _("Channel Information"));
 
+  wxBoxSizer* master_sizer = new wxBoxSizer(wxVERTICAL);
+  for (int i = 0; i < 2; i++) {
+    master_bars_[i] = new VolumeBar(this, wxHORIZONTAL, -1);
+    master_sizer->Add(master_bars_[i], 0, wxTOP | wxFIXED_MINSIZE, 1);
+  }
+  wholeSizer->Add(master_sizer, 0, wxBOTTOM, 4);
+
   for (int i = 0; i < 24; i++) {
     ChannelElement element;
     element.ich = i;
@@ -604,4 +587,30 @@ ChannelPanel::ChannelPanel(wxWindow *parent)
   // SetScrollRate(5, 5);
 
   // Spu.AddListener(this);
+
+  Bind(wxEVT_TIMER, &ChannelPanel::OnTimer, this);
+  timer_.Start(16);   // about 60 Hz
+}
+
+
+void ChannelPanel::OnTimer(wxTimerEvent &) {
+  const VoiceSnapshot* snapshot;
+  if (VoiceFeed::Instance().Read(&snapshot) == false) return;
+
+  for (int i = 0; i < 2; i++) {
+    master_bars_[i]->SetValue(std::min(snapshot->peak[i], 1.0f));
+  }
+
+  for (unsigned int i = 0; i < elements.size(); i++) {
+    ChannelElement& element = elements[i];
+    if (i < snapshot->voice_count) {
+      const VoiceState& voice = snapshot->voices[i];
+      element.keyboard->ShowNote(voice.on, voice.pitch);
+      element.volumeLeft->SetValue(std::min(voice.peak, 1.0f));
+      element.rate_text->SetRate(voice.rate);
+    } else {
+      element.keyboard->ShowNote(false, 0.0);
+      element.volumeLeft->SetValue(0.0f);
+    }
+  }
 }
@@ -1,7 +1,7 @@
 #include "common/command.h"
 #include "common/SoundManager.h"
 #include "common/debug.h"
-#include <wx/string.h>
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <sstream>
@@ -9,6 +9,9 @@
 #include "common/Sound.h"
 #include "app.h"
 #include "common/soundbank.h"
+#include "common/soundrenderer.h"
+#include "common/renderfarm.h"
+#include "common/perfcounters.h"
 
 namespace {
 
@@ -42,18 +45,8 @@ public:
   }
 
   bool Execute() {
-    wxString ext;
-    for (std::string::const_reverse_iterator itr = file_path_.rbegin(); itr != file_path_.rend(); ++itr) {
-      if (*itr == '.') break;
-      ext.insert(ext.begin(), *itr);
-    }
-
-    wxString file_path(file_path_);
-    for (wxString::iterator it = file_path.begin(); it != file_path.end(); ++it) {
-      if (*it == '\\') {
-        file_path.erase(it, it+1);
-      }
-    }
+    std::string file_path(file_path_);
+    file_path.erase(std::remove(file_path.begin(), file_path.end(), '\\'), file_path.end());
 
     SoundLoader* loader = SoundLoader::Instance(file_path);
     if (loader == nullptr) {
@@ -127,14 +120,15 @@ public:
     }
     Soundbank& sb = sf->soundbank();
 
-    std::cout << "  id   | length | loop   " << std::endl;
-    std::cout << "-------|--------|--------" << std::endl;
+    std::cout << "  id   | length | loop   | freq    " << std::endl;
+    std::cout << "-------|--------|--------|---------" << std::endl;
 
     for (Soundbank::InstrumentMap::iterator itr = sb.begin(); itr != sb.end(); ++itr) {
       const int id = itr->first;
       const unsigned int length = itr->second->length();
       const int loop = itr->second->loop();
-      std::printf(" %5d | %6d | %6d \n", id, length, loop);
+      const double freq = itr->second->FindFreq();
+      std::printf(" %5d | %6d | %6d | %7.1f \n", id, length, loop, freq);
     }
     return true;
   }
@@ -194,6 +188,105 @@ public:
 
 
 
+class RenderCommand : public Command {
+public:
+  RenderCommand(const std::string& p) : Command(p) {}
+
+  bool Execute() {
+    if (params().size() < 2) {
+      std::cout << "Usage: render <sound file> <wave file>" << std::endl;
+      return false;
+    }
+    ConsoleSoundRenderer renderer;
+    if (renderer.Render(params().at(0), params().at(1)) == false) {
+      std::cout << "Failed to render '" << params().at(0) << "'." << std::endl;
+      return false;
+    }
+    return true;
+  }
+};
+
+
+
+class RenderDirCommand : public Command {
+public:
+  RenderDirCommand(const std::string& p) : Command(p) {}
+
+  bool Execute() {
+    if (params().size() < 2) {
+      std::cout << "Usage: render-dir <sound directory> <wave directory> [jobs]" << std::endl;
+      return false;
+    }
+    int jobs = 0;
+    if (params().size() > 2) {
+      std::istringstream(params().at(2)) >> jobs;
+    }
+    ConsoleRenderFarm farm(jobs);
+    if (farm.AddDirectory(params().at(0), params().at(1)) == 0) {
+      std::cout << "No sound files in '" << params().at(0) << "'." << std::endl;
+      return false;
+    }
+    const bool ret = farm.Run();
+    farm.PrintSummary();
+    return ret;
+  }
+};
+
+
+
+class StatsCommand : public Command {
+public:
+  StatsCommand(const std::string& p) : Command(p) {}
+
+  bool Execute() {
+    static PerfCounters::Snapshot last = PerfCounters::Start();
+    const std::string& param = params().empty() ? std::string() : params().at(0);
+    const PerfCounters::Snapshot now = PerfCounters::Read();
+    if (param == "all") {
+      std::cout << PerfCounters::Report(now, PerfCounters::Start());
+    } else if (param.empty()) {
+      std::cout << PerfCounters::Report(now, last);
+    } else {
+      std::cout << "Usage: stats [all]" << std::endl;
+      return false;
+    }
+    last = now;
+    return true;
+  }
+};
+
+
+
+class LogLevelCommand : public Command {
+public:
+  LogLevelCommand(const std::string& p) : Command(p) {}
+
+  bool Execute() {
+    static const char* const names[] = { "debug", "info", "warning", "error", "none" };
+    static const int levels[] = { RENNY_LOG_LEVEL_DEBUG, RENNY_LOG_LEVEL_INFO,
+                                  RENNY_LOG_LEVEL_WARNING, RENNY_LOG_LEVEL_ERROR,
+                                  RENNY_LOG_LEVEL_NONE };
+    if (params().empty()) {
+      for (int i = 0; i < 5; i++) {
+        if (levels[i] == rennyGetLogLevel()) {
+          std::cout << names[i] << std::endl;
+        }
+      }
+      return true;
+    }
+    for (int i = 0; i < 5; i++) {
+      if (params().at(0) == names[i]) {
+        rennySetLogLevel(levels[i]);
+        return true;
+      }
+    }
+    std::cout << "Usage: log-level [debug|info|warning|error|none]" << std::endl;
+    return false;
+  }
+};
+
+
+
 class ExitCommand : public Command {
 public:
   ExitCommand(const std::string& p) : Command(p) {}
@@ -239,6 +332,18 @@ Command* CommandFactory::CreateCommand(const std::string &line) {
   if (cmd == "mute-channel") {
       return new MuteChannel(params);
   }
+  if (cmd == "render") {
+    return new RenderCommand(params);
+  }
+  if (cmd == "render-dir") {
+    return new RenderDirCommand(params);
+  }
+  if (cmd == "stats") {
+    return new StatsCommand(params);
+  }
+  if (cmd == "log-level") {
+    return new LogLevelCommand(params);
+  }
   if (cmd == "exit") {
     return new ExitCommand(params);
   }
@@ -1,293 +1,247 @@
 #include "common/debug.h"
-#include <wx/frame.h>
-#include <wx/listctrl.h>
-#include <wx/sizer.h>
-#include <wx/event.h>
-#include <wx/thread.h>
-#include <wx/utils.h>
-#include <vector>
-#include <deque>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
 
 namespace {
 
-const wxString str_log_levels[RennyDebug::kLogLevelMax] =
-    {"", "Debug", "Info", "Notice", "Warning",
-     "Error", "Critical", "Alert", "Emergency"};
-}
+const uint32_t kBurstPerSecond = 10;  // messages per call site
 
+std::atomic<RennyLogSink> log_sink(nullptr);
 
-class RennyDebugListCtrl : public wxListCtrl {
+struct LogRecord {
+  int level;
+  time_t created_on;
+  char instance_name[32];
+  char message[472];
+};
 
-public:
-  RennyDebugListCtrl(wxWindow* parent);
 
-  void Log(const wxString& level, const wxString& instance, const wxString& msg, const wxString& created_on);
+/*!
+ * @class LogQueue
+ * @brief Bounded lock-free queue of log records, many writers and one reader.
+ *
+ * A writer claims a cell, formats its message in place and publishes it
+ * by advancing the cell's sequence number (after D. Vyukov's bounded MPMC
+ * queue). When the queue is full, messages are dropped and counted rather
+ * than waited for. The reader is a thread which hands the records to
+ * the log sink.
+ */
+class LogQueue {
+public:
+  LogQueue();
 
-protected:
-  enum Column {
-    kColumnLevel = 0,
-    kColumnInstance,
-    kColumnMessage,
-    kColumnCreatedOn
-  };
+  //! A cell to fill and then Publish(), or nullptr if the queue is full.
+  LogRecord* Claim(size_t* pos);
+  void Publish(size_t pos);
 
-  wxString OnGetItemText(long item, long column) const;
-  wxListItemAttr* OnGetItemAttr(long item) const;
+  void Flush();
 
 private:
-  struct Item {
-    wxString level;
-    wxString instance;
-    wxString message;
-    wxString created_on;
-    Item(const wxString& lvl, const wxString& ins, const wxString& msg, const wxString& crtd_on)
-      : level(lvl), instance(ins), message(msg), created_on(crtd_on) {}
+  void Entry();
+  bool Drain();
+
+  static const size_t kCapacity = 1024;   // power of 2
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    LogRecord record;
   };
-  std::deque<Item> items_;
-  std::vector<Item> item_acc_;
-  wxMutex mutex_;
-
-  mutable wxListItemAttr attr_debug_;
-  mutable wxListItemAttr attr_info_;
-  mutable wxListItemAttr attr_warning_;
-  mutable wxListItemAttr attr_error_;
+  Cell cells_[kCapacity];
+  std::atomic<size_t> enqueue_pos_;
+  std::atomic<size_t> dequeue_pos_;
+  std::atomic<uint32_t> dropped_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::thread thread_;
 };
 
 
-RennyDebugListCtrl::RennyDebugListCtrl(wxWindow *parent)
-  : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL),
-    attr_debug_(wxColour(0, 0, 0), wxColour(0x80, 0x80, 0x80), wxFont()),
-    attr_info_(wxColour(0x00, 0x52, 0x9b), wxColour(0xbd, 0xe5, 0xf8), wxFont()),
-    attr_warning_(wxColour(0x9f, 0x60, 0x00), wxColour(0xfe, 0xef, 0xb3), wxFont()),
-    attr_error_(wxColour(0xb1, 0x00, 0x09), wxColour(0xfd, 0xe4, 0xe1), wxFont())
-{
-  InsertColumn(0, wxT("Log Level"), wxLIST_FORMAT_LEFT, 64);
-  InsertColumn(1, wxT("Instance"), wxLIST_FORMAT_LEFT, 144);
-  InsertColumn(2, wxT("Message"), wxLIST_FORMAT_LEFT, 628);
-  InsertColumn(3, wxT("Created On"), wxLIST_FORMAT_LEFT, 192);
-}
-
-void RennyDebugListCtrl::Log(const wxString &level, const wxString &instance, const wxString &msg, const wxString &created_on) {
-  mutex_.Lock();
-  items_.push_back(Item(level, instance, msg, created_on));
-  if (items_.size() > 1000) {
-    item_acc_.push_back(items_.front());
-    items_.pop_front();
+LogQueue::LogQueue()
+  : enqueue_pos_(0), dequeue_pos_(0), dropped_(0) {
+  for (size_t i = 0; i < kCapacity; i++) {
+    cells_[i].sequence.store(i, std::memory_order_relaxed);
   }
-  mutex_.Unlock();
-  SetItemCount(items_.size());
+  thread_ = std::thread(&LogQueue::Entry, this);
+  thread_.detach();
 }
 
-wxString RennyDebugListCtrl::OnGetItemText(long item, long column) const {
-  switch (column) {
-  case kColumnLevel:
-    return items_.at(item).level;
-  case kColumnInstance:
-    return items_.at(item).instance;
-  case kColumnMessage:
-    return items_.at(item).message;
-  case kColumnCreatedOn:
-    return items_.at(item).created_on;
-  default:
-    return wxString("");
-  }
-}
 
-wxListItemAttr* RennyDebugListCtrl::OnGetItemAttr(long item) const {
-  const wxString& level = items_.at(item).level;
-  if (level == str_log_levels[RennyDebug::kLogLevelInfo]) {
-    return &attr_info_;
-  }
-  if (level == str_log_levels[RennyDebug::kLogLevelWarning]) {
-    return &attr_warning_;
-  }
-  if (level == str_log_levels[RennyDebug::kLogLevelError]) {
-    return &attr_error_;
-  }
-  return &attr_debug_;
+LogRecord* LogQueue::Claim(size_t* pos) {
+  size_t p = enqueue_pos_.load(std::memory_order_relaxed);
+  do {
+    Cell& cell = cells_[p & (kCapacity - 1)];
+    const size_t seq = cell.sequence.load(std::memory_order_acquire);
+    const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(p);
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(p, p + 1, std::memory_order_relaxed)) {
+        *pos = p;
+        return &cell.record;
+      }
+    } else if (diff < 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      p = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  } while (true);
 }
 
 
-RennyDebug::RennyDebug(wxWindow* parent)
-  : frame_(new wxFrame(parent, wxID_ANY, wxT("Renny Debug Window"), wxDefaultPosition, wxSize(1024, 768))),
-    log_file_("rennypsf_log.txt", wxFile::write) {
-
-  wxBoxSizer* vert_sizer = new wxBoxSizer(wxVERTICAL);
-
-  list_ctrl_ = new RennyDebugListCtrl(frame_);
-  vert_sizer->Add(list_ctrl_, 1, wxEXPAND);
-
-  frame_->Bind(wxEVT_CLOSE_WINDOW, &RennyDebug::OnClose, this);
+void LogQueue::Publish(size_t pos) {
+  cells_[pos & (kCapacity - 1)].sequence.store(pos + 1, std::memory_order_release);
+  cond_.notify_one();
 }
 
-RennyDebug::~RennyDebug() {
-  if (instance_ != nullptr) {
-    delete instance_;
-  }
-  log_file_.Close();
-}
 
-RennyDebug* RennyDebug::instance_ = nullptr;
-
-RennyDebug* RennyDebug::Instance() {
-  return instance_;
-}
+bool LogQueue::Drain() {
+  bool drained = false;
+  do {
+    const size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell& cell = cells_[pos & (kCapacity - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != pos + 1) break;
 
-void RennyDebug::CreateWindow(wxWindow* parent) {
-  if (instance_ == nullptr) {
-    instance_ = new RennyDebug(parent);
-  } else if (instance_->frame_ == nullptr) {
-    instance_->~RennyDebug();
-    instance_ = new(instance_) RennyDebug(parent);
-  }
-}
+    const LogRecord& record = cell.record;
+    const RennyLogSink sink = log_sink.load(std::memory_order_acquire);
+    if (sink != nullptr) {
+      sink(record.level, record.instance_name, record.message, record.created_on);
+    }
+    cell.sequence.store(pos + kCapacity, std::memory_order_release);
+    dequeue_pos_.store(pos + 1, std::memory_order_release);
+    drained = true;
+  } while (true);
 
-void RennyDebug::DestroyWindow() {
-  if (instance_ != nullptr && instance_->frame_ != nullptr) {
-    instance_->frame_->Destroy();
+  const uint32_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+  const RennyLogSink sink = log_sink.load(std::memory_order_acquire);
+  if (dropped && sink != nullptr) {
+    char message[64];
+    std::snprintf(message, sizeof(message), "%u messages were dropped: the log queue was full.", dropped);
+    sink(RENNY_LOG_LEVEL_WARNING, "RennyDebug", message, std::time(nullptr));
   }
+  return drained;
 }
 
-bool RennyDebug::IsWindowCreated() const {
-  return frame_ != nullptr;
-}
 
-void RennyDebug::ShowWindow() {
-  if (frame_) {
-    frame_->Show(true);
-  }
+void LogQueue::Entry() {
+  std::unique_lock<std::mutex> locker(mutex_);
+  do {
+    locker.unlock();
+    Drain();
+    locker.lock();
+    // writers notify without the lock; the timeout catches a missed wakeup
+    cond_.wait_for(locker, std::chrono::milliseconds(100));
+  } while (true);
 }
 
-void RennyDebug::HideWindow() {
-  if (frame_) {
-    frame_->Hide();
-  }
-}
 
-void RennyDebug::OnClose(wxCloseEvent &event) {
-  if (event.CanVeto() == false) {
-    frame_->Destroy();
-  } else {
-    frame_->Hide();
+void LogQueue::Flush() {
+  const size_t target = enqueue_pos_.load(std::memory_order_relaxed);
+  cond_.notify_one();
+  while (dequeue_pos_.load(std::memory_order_acquire) < target) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
   }
 }
 
 
-void RennyDebug::Log(LogLevel log_level, const wxString& instance_name, const wxString& msg) {
-  rennyAssert(log_level < kLogLevelMax);
-  const wxString& str_log_level = str_log_levels[log_level];
-
-  wxString str_print;
-  str_print.sprintf(wxT("[%s] %s: %s"), str_log_level, instance_name, msg);
-
-  if (frame_ != nullptr && list_ctrl_ != nullptr) {
-    list_ctrl_->Log(str_log_level, instance_name, msg, wxNow());
-  } else {
-    if (kLogLevelWarning <= log_level) {
-      wxMessageOutputStderr().Printf(str_print);
-    } else {
-      wxMessageOutputDebug().Printf(str_print);
-    }
-  }
-  if (log_file_.IsOpened()) {
-    log_file_.Write(str_print);
-    log_file_.Write(wxT("\n"));
-  }
+void FlushAtExit() {
+  rennyFlushLog();
 }
 
-void RennyDebug::LogError(const wxString& instance_name, const wxString& msg) {
-  Log(kLogLevelError, instance_name, msg);
+// Never destroyed: the writer thread runs until the process exits.
+LogQueue& log_queue() {
+  static LogQueue* instance = nullptr;
+  static std::once_flag once;
+  std::call_once(once, [] {
+    instance = new LogQueue;
+    std::atexit(FlushAtExit);
+  });
+  return *instance;
 }
 
-void RennyDebug::LogWarning(const wxString& instance_name, const wxString& msg) {
-  Log(kLogLevelWarning, instance_name, msg);
-}
+}   // namespace
 
-void RennyDebug::LogInfo(const wxString& instance_name, const wxString& msg) {
-  Log(kLogLevelInfo, instance_name, msg);
-}
-
-#ifndef NDEBUG
-void RennyDebug::LogDebug(const wxString& instance_name, const wxString& msg) {
-  Log(kLogLevelDebug, instance_name, msg);
-}
-#endif
 
+std::atomic<int> renny_log_level(RENNY_LOG_LEVEL);
 
-#include <wx/app.h>
 
 extern "C" {
 
-void rennyCreateDebugWindow(wxWindow* parent) {
-  RennyDebug::CreateWindow(parent);
-
+void rennySetLogSink(RennyLogSink sink) {
+  log_sink.store(sink, std::memory_order_release);
 }
 
-void rennyDestroyDebugWindow() {
-  RennyDebug::DestroyWindow();
+void rennyStderrLogSink(int level, const char* instance_name, const char* message, time_t /*created_on*/) {
+  const char* level_name = "Error";
+  if (level < RENNY_LOG_LEVEL_INFO) {
+    level_name = "Debug";
+  } else if (level < RENNY_LOG_LEVEL_WARNING) {
+    level_name = "Info";
+  } else if (level < RENNY_LOG_LEVEL_ERROR) {
+    level_name = "Warning";
+  }
+  std::fprintf(stderr, "%s: %s: %s\n", level_name, instance_name, message);
 }
 
-void rennyShowDebugWindow() {
-  RennyDebug::Instance()->ShowWindow();
+void rennySetLogLevel(int level) {
+  renny_log_level.store(level, std::memory_order_relaxed);
 }
 
-void rennyHideDebugWindow() {
-  RennyDebug::Instance()->HideWindow();
+int rennyGetLogLevel() {
+  return renny_log_level.load(std::memory_order_relaxed);
 }
 
-void rennyLogError(const char* instance_name, const char* msg_format, ...) {
-  va_list arg;
-  va_start(arg, msg_format);
-  wxString msg(msg_format);
-  msg.PrintfV(msg, arg);
-  va_end(arg);
-
-  RennyDebug* instance = RennyDebug::Instance();
-  if (instance != nullptr) {
-    RennyDebug::Instance()->LogError(instance_name, msg);
-  }
+void rennyFlushLog() {
+  log_queue().Flush();
 }
 
-void rennyLogWarning(const char* instance_name, const char* msg_format, ...) {
-  va_list arg;
-  va_start(arg, msg_format);
-  wxString msg(msg_format);
-  msg.PrintfV(msg, arg);
-  va_end(arg);
+void rennyLogAt(RennyLogSite* site, int level, const char* instance_name, const char* msg_format, ...) {
+  // nothing to write to, e.g. when rendering without the GUI
+  if (log_sink.load(std::memory_order_relaxed) == nullptr) return;
 
-  RennyDebug* instance = RennyDebug::Instance();
-  if (instance != nullptr) {
-    RennyDebug::Instance()->LogWarning(instance_name, msg);
+  const uint32_t window = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::seconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count());
+  uint32_t site_window = site->window.load(std::memory_order_relaxed);
+  if (site_window != window &&
+      site->window.compare_exchange_strong(site_window, window, std::memory_order_relaxed)) {
+    site->count.store(0, std::memory_order_relaxed);
+  }
+  if (site->count.fetch_add(1, std::memory_order_relaxed) >= kBurstPerSecond) {
+    site->suppressed.fetch_add(1, std::memory_order_relaxed);
+    return;
   }
-}
 
-void rennyLogInfo(const char* instance_name, const char* msg_format, ...) {
-  va_list arg;
-  va_start(arg, msg_format);
-  wxString msg(msg_format);
-  msg.PrintfV(msg, arg);
-  va_end(arg);
+  size_t pos;
+  LogRecord* record = log_queue().Claim(&pos);
+  if (record == nullptr) return;
 
-  RennyDebug* instance = RennyDebug::Instance();
-  if (instance != nullptr) {
-    RennyDebug::Instance()->LogInfo(instance_name, msg);
-  }
-}
+  record->level = level;
+  record->created_on = std::time(nullptr);
+  std::strncpy(record->instance_name, instance_name, sizeof(record->instance_name) - 1);
+  record->instance_name[sizeof(record->instance_name) - 1] = '\0';
 
-#ifndef NDEBUG
-void rennyLogDebug(const char* instance_name, const char* msg_format, ...) {
   va_list arg;
   va_start(arg, msg_format);
-  wxString msg(msg_format);
-  msg.PrintfV(msg, arg);
+  int len = std::vsnprintf(record->message, sizeof(record->message), msg_format, arg);
   va_end(arg);
-
-  RennyDebug* instance = RennyDebug::Instance();
-  if (instance != nullptr) {
-    RennyDebug::Instance()->LogDebug(instance_name, msg);
+  if (len < 0) {
+    record->message[0] = '\0';
+    len = 0;
+  }
+  const uint32_t suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+  if (suppressed && static_cast<size_t>(len) < sizeof(record->message)) {
+    std::snprintf(record->message + len, sizeof(record->message) - len,
+                  " (%u similar messages suppressed)", suppressed);
   }
+  log_queue().Publish(pos);
 }
 
-#endif
 }
-
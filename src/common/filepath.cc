@@ -0,0 +1,193 @@
+#include "common/filepath.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+inline bool IsSeparator(char c) {
+#ifdef _WIN32
+  return c == '/' || c == '\\';
+#else
+  return c == '/';
+#endif
+}
+
+size_t FindLastSeparator(const std::string& path) {
+  for (size_t i = path.size(); i > 0; i--) {
+    if (IsSeparator(path[i - 1])) return i - 1;
+  }
+  return std::string::npos;
+}
+
+}   // namespace
+
+
+std::string FilePath::Directory(const std::string& path) {
+  const size_t pos = FindLastSeparator(path);
+  if (pos == std::string::npos) return std::string();
+  if (pos == 0) return path.substr(0, 1);   // the root
+  return path.substr(0, pos);
+}
+
+
+std::string FilePath::FullName(const std::string& path) {
+  const size_t pos = FindLastSeparator(path);
+  if (pos == std::string::npos) return path;
+  return path.substr(pos + 1);
+}
+
+
+std::string FilePath::Name(const std::string& path) {
+  const std::string name(FullName(path));
+  const size_t dot = name.rfind('.');
+  if (dot == std::string::npos || dot == 0) return name;
+  return name.substr(0, dot);
+}
+
+
+std::string FilePath::Extension(const std::string& path) {
+  const std::string name(FullName(path));
+  const size_t dot = name.rfind('.');
+  if (dot == std::string::npos || dot == 0) return std::string();
+  std::string ext(name.substr(dot + 1));
+  for (char& c : ext) {
+    if ('A' <= c && c <= 'Z') c += 'a' - 'A';
+  }
+  return ext;
+}
+
+
+std::string FilePath::Join(const std::string& dir, const std::string& name) {
+  if (dir.empty()) return name;
+  if (IsSeparator(dir[dir.size() - 1])) return dir + name;
+  return dir + '/' + name;
+}
+
+
+std::string FilePath::Absolute(const std::string& path) {
+#ifdef _WIN32
+  char* const resolved = ::_fullpath(nullptr, path.c_str(), 0);
+#else
+  char* const resolved = ::realpath(path.c_str(), nullptr);
+#endif
+  if (resolved == nullptr) {
+    // a file which does not exist (yet) keeps its name
+    return path;
+  }
+  const std::string ret(resolved);
+  std::free(resolved);
+  return ret;
+}
+
+
+bool FilePath::IsDirectory(const std::string& path) {
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+
+bool FilePath::Stat(const std::string& path, int64_t* mtime, uint64_t* size) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0) return false;
+  if (mtime) *mtime = st.st_mtime;
+  if (size) *size = st.st_size;
+  return true;
+}
+
+
+namespace {
+
+void AppendFiles(const std::string& dir, std::vector<std::string>* files, bool recursive) {
+#ifdef _WIN32
+  struct _finddata_t data;
+  const intptr_t handle = ::_findfirst(FilePath::Join(dir, "*").c_str(), &data);
+  if (handle == -1) return;
+  do {
+    if ((data.attrib & _A_SUBDIR) == 0) {
+      files->push_back(FilePath::Join(dir, data.name));
+    } else if (recursive && ::strcmp(data.name, ".") != 0 && ::strcmp(data.name, "..") != 0) {
+      AppendFiles(FilePath::Join(dir, data.name), files, true);
+    }
+  } while (::_findnext(handle, &data) == 0);
+  ::_findclose(handle);
+#else
+  DIR* const p_dir = ::opendir(dir.c_str());
+  if (p_dir == nullptr) return;
+  while (const struct dirent* entry = ::readdir(p_dir)) {
+    if (::strcmp(entry->d_name, ".") == 0 || ::strcmp(entry->d_name, "..") == 0) continue;
+    const std::string path(FilePath::Join(dir, entry->d_name));
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) continue;
+    if ((st.st_mode & S_IFMT) == S_IFREG) {
+      files->push_back(path);
+    } else if (recursive && (st.st_mode & S_IFMT) == S_IFDIR) {
+      AppendFiles(path, files, true);
+    }
+  }
+  ::closedir(p_dir);
+#endif
+}
+
+}   // namespace
+
+
+bool FilePath::ListFiles(const std::string& dir, std::vector<std::string>* files, bool recursive) {
+  files->clear();
+  if (IsDirectory(dir) == false) return false;
+  AppendFiles(dir, files, recursive);
+  std::sort(files->begin(), files->end());
+  return true;
+}
+
+
+bool FilePath::MakeDirectories(const std::string& dir) {
+  if (dir.empty() || IsDirectory(dir)) return true;
+  const std::string parent(Directory(dir));
+  if (parent != dir && MakeDirectories(parent) == false) return false;
+#ifdef _WIN32
+  return ::_mkdir(dir.c_str()) == 0 || IsDirectory(dir);
+#else
+  return ::mkdir(dir.c_str(), 0777) == 0 || IsDirectory(dir);
+#endif
+}
+
+
+std::string FilePath::TempDirectory() {
+  const char* const names[] = { "TMPDIR", "TMP", "TEMP" };
+  for (const char* name : names) {
+    const char* const dir = std::getenv(name);
+    if (dir != nullptr && dir[0] != '\0') return dir;
+  }
+#ifdef _WIN32
+  return ".";
+#else
+  return "/tmp";
+#endif
+}
+
+
+bool FilePath::Remove(const std::string& path) {
+  return std::remove(path.c_str()) == 0;
+}
+
+
+bool FilePath::Rename(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+  // rename() does not replace an existing file on Windows
+  std::remove(to.c_str());
+#endif
+  return std::rename(from.c_str(), to.c_str()) == 0;
+}
@@ -0,0 +1,59 @@
+#include "common/inflater.h"
+#include "common/debug.h"
+#include <cstring>
+
+
+Inflater::Inflater(const uint8_t* src, size_t src_length)
+  : ok_(false), end_(false) {
+  ::memset(&stream_, 0, sizeof(stream_));
+  stream_.next_in = const_cast<Bytef*>(src);
+  stream_.avail_in = static_cast<uInt>(src_length);
+  if (::inflateInit(&stream_) != Z_OK) {
+    rennyLogError("Inflater", "inflateInit() failed.");
+    return;
+  }
+  ok_ = true;
+}
+
+
+Inflater::~Inflater() {
+  if (ok_) {
+    ::inflateEnd(&stream_);
+  }
+}
+
+
+size_t Inflater::Read(void* dest, size_t length) {
+  if (ok_ == false || end_ || length == 0) return 0;
+  stream_.next_out = static_cast<Bytef*>(dest);
+  stream_.avail_out = static_cast<uInt>(length);
+  while (stream_.avail_out > 0) {
+    const int ret = ::inflate(&stream_, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      end_ = true;
+      break;
+    }
+    if (ret != Z_OK) {
+      // Z_BUF_ERROR means truncated input; keep what has been inflated
+      if (ret != Z_BUF_ERROR) {
+        rennyLogError("Inflater", "inflate() failed. (%d)", ret);
+      }
+      end_ = true;
+      break;
+    }
+  }
+  return length - stream_.avail_out;
+}
+
+
+size_t Inflater::Skip(size_t length) {
+  uint8_t scratch[1024];
+  size_t skipped = 0;
+  while (skipped < length && end_ == false) {
+    const size_t n = length - skipped < sizeof(scratch) ? length - skipped : sizeof(scratch);
+    const size_t read = Read(scratch, n);
+    if (read == 0) break;
+    skipped += read;
+  }
+  return skipped;
+}
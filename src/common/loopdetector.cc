@@ -0,0 +1,156 @@
+#include "common/loopdetector.h"
+#include "common/debug.h"
+#include "common/hash.h"
+#include <cstdlib>
+
+
+namespace {
+
+const int kDefaultMinLoopLength = 20000;
+const int kDefaultSilenceLength = 5000;
+const int kDefaultSilenceThreshold = 8;   // about -72 dBFS
+
+const size_t kWindow = 8;         // events hashed to find a candidate
+const size_t kMaxCandidates = 16;
+const int kGapTolerance = 2;      // ms; sequencer ticks are not frame-aligned
+
+}   // namespace
+
+
+LoopDetector::LoopDetector(uint32_t sampling_rate)
+  : min_loop_length_(kDefaultMinLoopLength),
+    silence_length_(kDefaultSilenceLength),
+    silence_threshold_(kDefaultSilenceThreshold) {
+  Reset(sampling_rate);
+}
+
+
+void LoopDetector::Reset(uint32_t sampling_rate) {
+  rennyAssert(sampling_rate > 0);
+  sampling_rate_ = sampling_rate;
+  events_.clear();
+  windows_.clear();
+  candidates_.clear();
+  looped_ = false;
+  loop_start_ = loop_end_ = 0;
+  frame_count_ = 0;
+  quiet_frames_ = 0;
+  audible_ = false;
+  silent_ = false;
+  silence_start_ = 0;
+}
+
+
+uint64_t LoopDetector::FramesOf(int ms) const {
+  if (ms <= 0) return 0;
+  return static_cast<uint64_t>(ms) * sampling_rate_ / 1000;
+}
+
+
+uint64_t LoopDetector::WindowHash(size_t last) const {
+  uint64_t hash = Fnv1a::kOffsetBasis;
+  for (size_t i = last + 1 - kWindow; i <= last; ++i) {
+    hash = Fnv1a::AddWord(hash, events_[i].fingerprint);
+  }
+  return hash;
+}
+
+
+bool LoopDetector::Repeats(size_t i, size_t period) const {
+  const size_t j = i - period;
+  if (events_[i].fingerprint != events_[j].fingerprint) return false;
+  if (j == 0) return true;
+  const int64_t gap_i = events_[i].frame - events_[i - 1].frame;
+  const int64_t gap_j = events_[j].frame - events_[j - 1].frame;
+  return std::llabs(gap_i - gap_j) <= static_cast<int64_t>(FramesOf(kGapTolerance) + 1);
+}
+
+
+void LoopDetector::AddEvent(uint64_t frame, uint64_t fingerprint) {
+  if (looped_) return;
+  const Event event = { frame, fingerprint };
+  events_.push_back(event);
+  const size_t i = events_.size() - 1;
+
+  for (std::vector<Candidate>::iterator it = candidates_.begin(); it != candidates_.end(); ) {
+    if (Repeats(i, it->period) == false) {
+      it = candidates_.erase(it);
+      continue;
+    }
+    if (++it->matched >= it->period) {
+      Found(*it);
+      return;
+    }
+    ++it;
+  }
+
+  if (i + 1 < kWindow) return;
+  std::vector<size_t>& lasts = windows_[WindowHash(i)];
+  const uint64_t min_frames = FramesOf(min_loop_length_);
+  // the most recent occurrences first, so the shortest period wins
+  for (std::vector<size_t>::reverse_iterator it = lasts.rbegin(); it != lasts.rend(); ++it) {
+    if (candidates_.size() >= kMaxCandidates) break;
+    if (frame - events_[*it].frame < min_frames) continue;
+    const size_t period = i - *it;
+    bool known = false;
+    for (size_t k = 0; k < candidates_.size(); ++k) {
+      if (candidates_[k].period == period) known = true;
+    }
+    if (known) continue;
+    bool repeats = true;
+    for (size_t k = i + 1 - kWindow; repeats && k <= i; ++k) {
+      repeats = Repeats(k, period);
+    }
+    if (repeats == false) continue;
+    const Candidate candidate = { period, i + 1 - kWindow, kWindow };
+    if (candidate.matched >= period) {
+      Found(candidate);
+      return;
+    }
+    candidates_.push_back(candidate);
+  }
+  lasts.push_back(i);
+}
+
+
+void LoopDetector::Found(const Candidate& candidate) {
+  const size_t period = candidate.period;
+  size_t first = candidate.first;
+  while (first > period && Repeats(first - 1, period)) {
+    --first;
+  }
+  // the first event of the loop follows the intro, so only its gap differs
+  if (first > period && events_[first - 1].fingerprint == events_[first - 1 - period].fingerprint) {
+    --first;
+  }
+  looped_ = true;
+  loop_start_ = events_[first - period].frame;
+  loop_end_ = events_[first].frame;
+
+  rennyLogDebug("LoopDetector", "Found a loop of %d events. (frames %d - %d)",
+                static_cast<int>(period), static_cast<int>(loop_start_), static_cast<int>(loop_end_));
+  windows_.clear();
+  candidates_.clear();
+}
+
+
+void LoopDetector::AddFrames(const int16_t* interleaved, size_t frames) {
+  const uint64_t silence_frames = FramesOf(silence_length_);
+  for (size_t i = 0; i < frames; ++i, ++frame_count_) {
+    if (silent_) continue;
+    const int left = std::abs(static_cast<int>(interleaved[2 * i]));
+    const int right = std::abs(static_cast<int>(interleaved[2 * i + 1]));
+    if (silence_threshold_ < left || silence_threshold_ < right) {
+      audible_ = true;
+      quiet_frames_ = 0;
+      continue;
+    }
+    if (audible_ == false) continue;   // leading silence
+    if (quiet_frames_++ == 0) {
+      silence_start_ = frame_count_;
+    }
+    if (silence_frames <= quiet_frames_) {
+      silent_ = true;
+    }
+  }
+}
@@ -0,0 +1,77 @@
+#include "common/mappedfile.h"
+#include "common/debug.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RENNY_USE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#include <sys/stat.h>
+#endif
+
+
+MappedFile::MappedFile() : data_(nullptr), size_(0) {}
+
+
+MappedFile::~MappedFile() {
+  Unmap();
+}
+
+
+bool MappedFile::Map(int fd) {
+  Unmap();
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+    rennyLogError("MappedFile", "Failed to get the size of fd %d.", fd);
+    return false;
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+
+#ifdef RENNY_USE_MMAP
+  void* const p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) {
+    rennyLogError("MappedFile", "Failed to map fd %d. (size = %d)", fd, static_cast<int>(size));
+    return false;
+  }
+  data_ = static_cast<const uint8_t*>(p);
+#else
+  buffer_.reset(new uint8_t[size]);
+  size_t offset = 0;
+  ::_lseek(fd, 0, SEEK_SET);
+  while (offset < size) {
+    const int n = ::_read(fd, buffer_.get() + offset, static_cast<unsigned int>(size - offset));
+    if (n <= 0) {
+      rennyLogError("MappedFile", "Failed to read fd %d.", fd);
+      buffer_.reset();
+      return false;
+    }
+    offset += n;
+  }
+  data_ = buffer_.get();
+#endif
+  size_ = size;
+  return true;
+}
+
+
+void MappedFile::Unmap() {
+  if (data_ == nullptr) return;
+#ifdef RENNY_USE_MMAP
+  ::munmap(const_cast<uint8_t*>(data_), size_);
+#else
+  buffer_.reset();
+#endif
+  data_ = nullptr;
+  size_ = 0;
+}
+
+
+uint32_t MappedFile::GetLE32(size_t offset) const {
+  rennyAssert(Contains(offset, 4));
+  const uint8_t* p = data_ + offset;
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
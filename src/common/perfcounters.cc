@@ -0,0 +1,255 @@
+#include "common/perfcounters.h"
+#include "common/debug.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+
+namespace {
+
+const char* const kCounterNames[PerfCounters::kCounterCount] = {
+  "CPU instructions",
+  "CPU cycles",
+  "Interpreter",
+  "SPU step",
+  "Reverb mix",
+  "Device update",
+  "Device write",
+  "SPU queue wait",
+  "Voice ready wait",
+  "Decoded instruments",
+  "Decoded samples"
+};
+
+const char* const kGaugeNames[PerfCounters::kGaugeCount] = {
+  "SPU request queue",
+  "Decoding instruments",
+  "OpenAL buffers",
+  "Pooled tasks"
+};
+
+struct Slot {
+  std::atomic<uint64_t> values[PerfCounters::kCounterCount];
+  Slot() {
+    for (int i = 0; i < PerfCounters::kCounterCount; i++) {
+      values[i].store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<Slot*> slots;
+  uint64_t retired[PerfCounters::kCounterCount];
+  std::atomic<int64_t> gauges[PerfCounters::kGaugeCount];
+  std::atomic<int64_t> gauge_peaks[PerfCounters::kGaugeCount];
+  const uint64_t start_time;
+  Registry() : start_time(PerfCounters::Now()) {
+    std::fill(retired, retired + PerfCounters::kCounterCount, 0);
+    for (int i = 0; i < PerfCounters::kGaugeCount; i++) {
+      gauges[i].store(0, std::memory_order_relaxed);
+      gauge_peaks[i].store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+// Never destroyed: threads may exit after static destruction has begun.
+Registry& registry() {
+  static Registry* instance = new Registry;
+  return *instance;
+}
+
+class SlotOwner {
+public:
+  SlotOwner() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> locker(reg.mutex);
+    reg.slots.push_back(&slot_);
+  }
+  ~SlotOwner() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> locker(reg.mutex);
+    for (int i = 0; i < PerfCounters::kCounterCount; i++) {
+      reg.retired[i] += slot_.values[i].load(std::memory_order_relaxed);
+    }
+    reg.slots.erase(std::find(reg.slots.begin(), reg.slots.end(), &slot_));
+  }
+  Slot& slot() { return slot_; }
+
+private:
+  Slot slot_;
+};
+
+Slot& LocalSlot() {
+  static thread_local SlotOwner owner;
+  return owner.slot();
+}
+
+thread_local PerfTimer* current_timer = nullptr;
+
+std::string FormatTime(uint64_t ns) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.1f ms", ns / 1e6);
+  return buf;
+}
+
+std::string FormatCount(double n) {
+  char buf[32];
+  if (n >= 1e9) {
+    std::snprintf(buf, sizeof(buf), "%.2f G", n / 1e9);
+  } else if (n >= 1e6) {
+    std::snprintf(buf, sizeof(buf), "%.2f M", n / 1e6);
+  } else if (n >= 1e4) {
+    std::snprintf(buf, sizeof(buf), "%.1f k", n / 1e3);
+  } else {
+    std::snprintf(buf, sizeof(buf), "%.0f", n);
+  }
+  return buf;
+}
+
+}   // namespace
+
+
+void PerfCounters::Add(Counter counter, uint64_t n) {
+  rennyAssert(counter < kCounterCount);
+  // Only this thread writes the slot: a plain load and store, no lock.
+  std::atomic<uint64_t>& value = LocalSlot().values[counter];
+  value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+
+void PerfCounters::SetGauge(Gauge gauge, int64_t value) {
+  rennyAssert(gauge < kGaugeCount);
+  Registry& reg = registry();
+  reg.gauges[gauge].store(value, std::memory_order_relaxed);
+  int64_t peak = reg.gauge_peaks[gauge].load(std::memory_order_relaxed);
+  while (peak < value &&
+         reg.gauge_peaks[gauge].compare_exchange_weak(peak, value, std::memory_order_relaxed) == false) {
+  }
+}
+
+
+PerfCounters::Snapshot PerfCounters::Read() {
+  Snapshot snapshot;
+  Registry& reg = registry();
+  {
+    std::lock_guard<std::mutex> locker(reg.mutex);
+    for (int i = 0; i < kCounterCount; i++) {
+      uint64_t sum = reg.retired[i];
+      for (std::vector<Slot*>::const_iterator itr = reg.slots.begin(); itr != reg.slots.end(); ++itr) {
+        sum += (*itr)->values[i].load(std::memory_order_relaxed);
+      }
+      snapshot.counters[i] = sum;
+    }
+  }
+  for (int i = 0; i < kGaugeCount; i++) {
+    snapshot.gauges[i] = reg.gauges[i].load(std::memory_order_relaxed);
+    snapshot.gauge_peaks[i] = reg.gauge_peaks[i].load(std::memory_order_relaxed);
+  }
+  snapshot.time = Now();
+  return snapshot;
+}
+
+
+PerfCounters::Snapshot PerfCounters::Start() {
+  Snapshot snapshot;
+  std::fill(snapshot.counters, snapshot.counters + kCounterCount, 0);
+  std::fill(snapshot.gauges, snapshot.gauges + kGaugeCount, 0);
+  std::fill(snapshot.gauge_peaks, snapshot.gauge_peaks + kGaugeCount, 0);
+  snapshot.time = registry().start_time;
+  return snapshot;
+}
+
+
+std::vector<PerfCounters::Row> PerfCounters::Rows(const Snapshot& now, const Snapshot& since) {
+  std::vector<Row> rows;
+  const double seconds = (now.time - since.time) / 1e9;
+  for (int i = 0; i < kCounterCount; i++) {
+    const Counter counter = static_cast<Counter>(i);
+    const uint64_t delta = now.counters[i] - since.counters[i];
+    Row row;
+    row.name = CounterName(counter);
+    char buf[32];
+    if (IsTime(counter)) {
+      row.total = FormatTime(delta);
+      // share of wall time; may exceed 100% when several threads count
+      std::snprintf(buf, sizeof(buf), "%.1f %%", seconds > 0.0 ? delta / (seconds * 1e7) : 0.0);
+      row.rate = buf;
+    } else {
+      row.total = FormatCount(static_cast<double>(delta));
+      row.rate = FormatCount(seconds > 0.0 ? delta / seconds : 0.0) + "/s";
+    }
+    rows.push_back(row);
+  }
+  for (int i = 0; i < kGaugeCount; i++) {
+    Row row;
+    row.name = GaugeName(static_cast<Gauge>(i));
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(now.gauges[i]));
+    row.total = buf;
+    std::snprintf(buf, sizeof(buf), "peak %lld", static_cast<long long>(now.gauge_peaks[i]));
+    row.rate = buf;
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+
+std::string PerfCounters::Report(const Snapshot& now, const Snapshot& since) {
+  const std::vector<Row> rows = Rows(now, since);
+  std::string report;
+  char line[128];
+  std::snprintf(line, sizeof(line), " %-20s | %12s | %12s \n", "counter", "total", "rate");
+  report += line;
+  report += "----------------------|--------------|--------------\n";
+  for (std::vector<Row>::const_iterator itr = rows.begin(); itr != rows.end(); ++itr) {
+    std::snprintf(line, sizeof(line), " %-20s | %12s | %12s \n",
+                  itr->name.c_str(), itr->total.c_str(), itr->rate.c_str());
+    report += line;
+  }
+  std::snprintf(line, sizeof(line), "over %.2f s\n", (now.time - since.time) / 1e9);
+  report += line;
+  return report;
+}
+
+
+const char* PerfCounters::CounterName(Counter counter) {
+  rennyAssert(counter < kCounterCount);
+  return kCounterNames[counter];
+}
+
+
+const char* PerfCounters::GaugeName(Gauge gauge) {
+  rennyAssert(gauge < kGaugeCount);
+  return kGaugeNames[gauge];
+}
+
+
+bool PerfCounters::IsTime(Counter counter) {
+  return kInterpreterTime <= counter && counter <= kVoiceWaitTime;
+}
+
+
+uint64_t PerfCounters::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+PerfTimer::PerfTimer(PerfCounters::Counter counter)
+  : counter_(counter), parent_(current_timer), start_(PerfCounters::Now()), children_(0) {
+  current_timer = this;
+}
+
+
+PerfTimer::~PerfTimer() {
+  const uint64_t elapsed = PerfCounters::Now() - start_;
+  current_timer = parent_;
+  if (parent_ != nullptr) {
+    parent_->children_ += elapsed;
+  }
+  PerfCounters::Add(counter_, elapsed - std::min(elapsed, children_));
+}
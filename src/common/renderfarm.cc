@@ -0,0 +1,164 @@
+#include "common/renderfarm.h"
+#include "common/soundrenderer.h"
+#include "common/debug.h"
+#include "common/taskpool.h"
+#include "common/filepath.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+
+RenderFarm::RenderFarm(int worker_count)
+  : worker_count_(worker_count > 0 ? worker_count : TaskPool::Instance().worker_count()),
+    next_job_(0), elapsed_seconds_(0.0) {
+  SoundRenderer defaults;
+  default_length_ = defaults.default_length();
+  default_fade_ = defaults.default_fade();
+}
+
+
+void RenderFarm::AddJob(const std::string& src_path, const std::string& dest_path) {
+  Result result;
+  result.src_path = src_path;
+  result.dest_path = dest_path;
+  result.succeeded = false;
+  result.sampling_rate = 0;
+  result.frames = 0;
+  result.rendered_seconds = 0.0;
+  result.elapsed_seconds = 0.0;
+  result.realtime_ratio = 0.0;
+  result.pcm_hash = 0;
+  result.loop_start = -1.0;
+  result.loop_end = -1.0;
+  results_.push_back(result);
+}
+
+
+int RenderFarm::AddDirectory(const std::string& src_dir, const std::string& dest_dir) {
+  std::vector<std::string> files;
+  if (FilePath::IsDirectory(src_dir) == false || FilePath::ListFiles(src_dir, &files) == false) {
+    rennyLogError("RenderFarm", "'%s' is not a directory.", src_dir.c_str());
+    return 0;
+  }
+
+  int count = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    const std::string ext(FilePath::Extension(files[i]));
+    if (ext != "psf" && ext != "minipsf" && ext != "psf2" && ext != "minipsf2") {
+      continue;
+    }
+    std::string dest;
+    if (dest_dir.empty() == false) {
+      dest = FilePath::Join(dest_dir, FilePath::Name(files[i]) + ".wav");
+    }
+    AddJob(files[i], dest);
+    ++count;
+  }
+  return count;
+}
+
+
+void RenderFarm::RenderJobs() {
+  // one renderer, and so one emulator, per task at a time
+  SoundRenderer renderer;
+  renderer.set_default_length(default_length());
+  renderer.set_default_fade(default_fade());
+
+  size_t index;
+  while (NextJob(&index)) {
+    // each slot is owned by exactly one task until FinishJob()
+    Result& result = results_[index];
+    result.succeeded = renderer.Render(result.src_path, result.dest_path);
+    result.sampling_rate = renderer.sampling_rate();
+    result.frames = renderer.rendered_frames();
+    result.rendered_seconds = renderer.rendered_seconds();
+    result.elapsed_seconds = renderer.elapsed_seconds();
+    result.realtime_ratio = renderer.realtime_ratio();
+    result.pcm_hash = renderer.pcm_hash();
+    result.loop_start = renderer.loop_start();
+    result.loop_end = renderer.loop_end();
+    FinishJob(index);
+  }
+}
+
+
+bool RenderFarm::NextJob(size_t* index) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  if (next_job_ >= results_.size()) return false;
+  *index = next_job_++;
+  return true;
+}
+
+
+void RenderFarm::FinishJob(size_t index) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  OnTrackFinished(results_[index]);
+}
+
+
+bool RenderFarm::Run() {
+  next_job_ = 0;
+  elapsed_seconds_ = 0.0;
+  if (results_.empty()) return true;
+
+  const size_t task_count = std::min(static_cast<size_t>(worker_count_), results_.size());
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  {
+    // Wait() renders here, too, if a task has not been started by then
+    TaskGroup tasks(TaskPool::kPriorityAnalysis);
+    for (size_t i = 0; i < task_count; ++i) {
+      tasks.Run([this] { RenderJobs(); });
+    }
+    tasks.Wait();
+  }
+  elapsed_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  bool ret = true;
+  for (size_t i = 0; i < results_.size(); ++i) {
+    if (results_[i].succeeded == false) ret = false;
+  }
+  rennyLogInfo("RenderFarm", "Rendered %d tracks (%.1f sec) in %.2f sec on %d workers (%.1fx realtime)",
+               static_cast<int>(results_.size()), rendered_seconds(), elapsed_seconds_,
+               static_cast<int>(task_count), realtime_ratio());
+  return ret;
+}
+
+
+double RenderFarm::rendered_seconds() const {
+  double seconds = 0.0;
+  for (size_t i = 0; i < results_.size(); ++i) {
+    seconds += results_[i].rendered_seconds;
+  }
+  return seconds;
+}
+
+
+double RenderFarm::realtime_ratio() const {
+  if (elapsed_seconds_ <= 0.0) return 0.0;
+  return rendered_seconds() / elapsed_seconds_;
+}
+
+
+void ConsoleRenderFarm::OnTrackFinished(const Result& result) {
+  std::printf("%s %s: %.1f sec in %.2f sec (%.1fx realtime) hash %016llx",
+              result.succeeded ? "[ OK ]" : "[FAIL]",
+              result.src_path.c_str(),
+              result.rendered_seconds, result.elapsed_seconds, result.realtime_ratio,
+              static_cast<unsigned long long>(result.pcm_hash));
+  if (0.0 <= result.loop_start) {
+    std::printf(" loop %.2f-%.2f", result.loop_start, result.loop_end);
+  }
+  std::printf("\n");
+  std::fflush(stdout);
+}
+
+
+void ConsoleRenderFarm::PrintSummary() const {
+  int failed = 0;
+  for (size_t i = 0; i < results().size(); ++i) {
+    if (results()[i].succeeded == false) ++failed;
+  }
+  std::printf("%d tracks (%d failed): %.1f sec in %.2f sec on %d workers (%.1fx realtime)\n",
+              static_cast<int>(job_count()), failed, rendered_seconds(), elapsed_seconds(),
+              worker_count(), realtime_ratio());
+}
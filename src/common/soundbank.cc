@@ -65,12 +65,18 @@ InstrumentDataIterator Instrument::Iterator(bool is_loop) const {
 
 
 double Instrument::freq() const {
-  return freq_;
+  return freq_.load(std::memory_order_relaxed);
 }
 
 
 void Instrument::set_freq(double f) {
-  freq_ = f;
+  freq_.store(f, std::memory_order_relaxed);
+}
+
+
+double Instrument::FindFreq() {
+  const double f = freq();
+  return (0.0 < f) ? f : 0.0;
 }
 
 
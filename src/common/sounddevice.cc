@@ -1,17 +1,12 @@
 #include "common/SoundManager.h"
 #include "common/SoundFormat.h"
 #include "common/debug.h"
+#include "common/perfcounters.h"
 
 const int NUM_BUFFERS = 50;
 const int NSSIZE = 45;
 
 
-wxDEFINE_EVENT(wxEVT_NOTE_ON, wxCommandEvent);
-wxDEFINE_EVENT(wxEVT_NOTE_OFF, wxCommandEvent);
-wxDEFINE_EVENT(wxEVT_CHANGE_TONE_NUMBER, wxCommandEvent);
-wxDEFINE_EVENT(wxEVT_CHANGE_PITCH, wxCommandEvent);
-wxDEFINE_EVENT(wxEVT_CHANGE_VELOCITY, wxCommandEvent);
-
 wxDEFINE_EVENT(wxEVT_ADD_TONE, wxCommandEvent);
 wxDEFINE_EVENT(wxEVT_CHANGE_TONE, wxCommandEvent);
 wxDEFINE_EVENT(wxEVT_REMOVE_TONE, wxCommandEvent);
@@ -83,6 +78,7 @@ bool SoundDevice::IsPlaying() const {
 
 
 void SoundDevice::OnUpdate(const SoundBlock* block) {
+  PerfTimer timer(PerfCounters::kDeviceUpdateTime);
   auto length = block->sample_length();
   for (auto i = 0; i < length; ++i) {
     block->GetStereo16(i, &buffer_[bufferIndex_*2]);
@@ -184,7 +180,7 @@ wxThread::ExitCode WaveOutALThread::Entry() {
     command_queue_.Receive(msg);
     msg->Execute();
     delete msg;
-    if (WaveOutAL::device_ == 0) break;
+    if (sound_driver_->device_ == nullptr) break;
   } while (true);
 
   // sound_driver_->thread_ = 0;
@@ -198,21 +194,34 @@ wxThread::ExitCode WaveOutALThread::Entry() {
 ////////////////////////////////////////////////////////////////////////
 
 
-ALCdevice *WaveOutAL::device_ = nullptr;
-ALCcontext *WaveOutAL::context_ = nullptr;
-int WaveOutAL::source_number_ = 0;
-WaveOutALThread* WaveOutAL::thread_ = nullptr;
+namespace {
+
+// Bind the context to the calling thread only when the implementation
+// supports it; otherwise fall back to the process-wide binding.
+void MakeContextCurrent(ALCcontext* context) {
+  typedef ALCboolean (ALC_APIENTRY *SetThreadContextFunc)(ALCcontext*);
+  SetThreadContextFunc set_thread_context = nullptr;
+  if (alcIsExtensionPresent(nullptr, "ALC_EXT_thread_local_context")) {
+    set_thread_context = reinterpret_cast<SetThreadContextFunc>(alcGetProcAddress(nullptr, "alcSetThreadContext"));
+  }
+  if (set_thread_context != nullptr) {
+    set_thread_context(context);
+  } else {
+    alcMakeContextCurrent(context);
+  }
+}
+
+}   // namespace
 
 
 WaveOutAL::WaveOutAL()
-  : write_to_device_cond_(mutex_), write_to_device_cond2_(mutex2_),
+  : device_(nullptr), context_(nullptr), thread_(nullptr),
+    write_to_device_cond_(mutex_), write_to_device_cond2_(mutex2_),
     finished_writing_(false)
 {
-  if (thread_ == 0) {
-    thread_ = new WaveOutALThread(this);
-    thread_->Create();
-    thread_->Run();
-  }
+  thread_ = new WaveOutALThread(this);
+  thread_->Create();
+  thread_->Run();
   Init();
 }
 
@@ -230,11 +239,10 @@ void WaveOutAL::ThisThreadInit()
   if (device_ == nullptr) {
     device_ = alcOpenDevice(0);
     context_ = alcCreateContext(device_, 0);
-    alcMakeContextCurrent(context_);
+    MakeContextCurrent(context_);
   }
   // alGenSources(1, &source_);
   source_ = 0;
-  source_number_++;
   rennyLogDebug("WaveOutAL", "Initialized a sound device driver.");
 }
 
@@ -254,13 +262,12 @@ void WaveOutAL::ThisThreadShutdown()
     SoundDevice::Stop();
     ThisThreadStop();
   }
-  if (--source_number_ <= 0) {
-    alcMakeContextCurrent(0);
-    alcDestroyContext(context_);
-    alcCloseDevice(device_);
-    device_ = 0;  // WaveOutALThread will be destroyed
-    rennyLogDebug("WaveOutAL", "Closed the device driver.");
-  }
+  MakeContextCurrent(nullptr);
+  alcDestroyContext(context_);
+  alcCloseDevice(device_);
+  context_ = nullptr;
+  device_ = nullptr;  // WaveOutALThread will be destroyed
+  rennyLogDebug("WaveOutAL", "Closed the device driver.");
 }
 
 
@@ -309,6 +316,7 @@ void WaveOutAL::ThisThreadWriteToDevice()
     }
 
     alGetSourcei(source_, AL_BUFFERS_QUEUED, &n);
+    PerfCounters::SetGauge(PerfCounters::kOpenALBuffers, n < NUM_BUFFERS ? n + 1 : n);
     if (n < NUM_BUFFERS) {
       alGenBuffers(1, &buffer_);
     } else {
@@ -350,6 +358,7 @@ void WaveOutAL::WaitForWritingToDevice() {
 
 
 void WaveOutAL::WriteToDevice() {
+  PerfTimer timer(PerfCounters::kDeviceWriteTime);
   thread_->PostMessageQueue(new WriteToDeviceAL(this));
   WaitForWritingToDevice();
 }
@@ -1,7 +1,7 @@
 #include "common/SoundFormat.h"
-#include "common/SoundManager.h"
 #include "common/debug.h"
-#include <wx/thread.h>
+#include "common/loopdetector.h"
+#include <algorithm>
 
 /*
  * Type Conversion Functions
@@ -182,6 +182,10 @@ void SampleSequence::ClearData() {
   samples_.clear();
 }
 
+void SampleSequence::Truncate(size_t length) {
+  if (length < samples_.size()) samples_.resize(length);
+}
+
 void SampleSequence::volume(int seq_no, float* left, float* right) const {
   rennyAssert(seq_no < static_cast<int>(samples_.size()));
   const SampleEx& sample = samples_.at(seq_no);
@@ -285,6 +289,22 @@ void SoundBlock::GetStereo16(int seq_no, short* dest) const {
   dest[1] = CLIP16(r*32768);
 }
 
+void SoundBlock::GetStemStereo16(int stem, int seq_no, short* dest) const {
+  rennyAssert(stem < static_cast<int>(stem_count()));
+  float l, r;
+  if (stem < static_cast<int>(channel_count())) {
+    Ch(stem).Getf(seq_no, &l, &r);
+  } else {
+    float tmp_l, tmp_r;
+    ReverbCh(0).Getf(seq_no, &l, &r);
+    ReverbCh(1).Getf(seq_no, &tmp_l, &tmp_r);
+    l += tmp_l;
+    r += tmp_r;
+  }
+  dest[0] = CLIP16(l*32768);
+  dest[1] = CLIP16(r*32768);
+}
+
 void SoundBlock::Clear() {
   const unsigned int ch_count = channel_count();
   for (unsigned int i = 0; i < ch_count; ++i) {
@@ -296,7 +316,6 @@ void SoundBlock::Clear() {
 }
 
 void SoundBlock::Reset() {
-  output_ = nullptr;
   const unsigned int ch_count = channel_count();
   for (unsigned int i = 0; i < ch_count; ++i) {
     SampleSequence& s = Ch(i);
@@ -308,22 +327,12 @@ void SoundBlock::Reset() {
   rvb_sample_[1].ClearData();
 }
 
-
-
-SoundDevice* SoundBlock::output() {
-  return output_;
-}
-
-
-void SoundBlock::set_output(SoundDevice* output) {
-  output_ = output;
-}
-
-
-bool SoundBlock::NotifyDevice() {
-  if (output_ == nullptr) return false;
-  output_->OnUpdate(this);
-  return true;
+void SoundBlock::Truncate(size_t length) {
+  for (auto& s : samples_) {
+    s.Truncate(length);
+  }
+  rvb_sample_[0].Truncate(length);
+  rvb_sample_[1].Truncate(length);
 }
 
 
@@ -342,7 +351,7 @@ public:
   Sample& Ch(int ch) { return samples_.at(ch); }
 
 private:
-  wxVector<Sample16> samples_;
+  std::vector<Sample16> samples_;
 };
 
 
@@ -353,7 +362,7 @@ SoundInfo::~SoundInfo() {}
 
 void SoundInfo::set_tags(const Tag &tags) {
   for (Tag::const_iterator it = tags.begin(); it != tags.end(); ++it) {
-    const wxString& key = it->first;
+    const std::string& key = it->first;
     if (key == "title") {
       title_ = it->second;
     } else if (key == "artist") {
@@ -391,3 +400,59 @@ bool SoundData::Advance(SoundBlock *dest) {
   }
   return ret;
 }
+
+
+bool SoundData::OpenStream() {
+  if (streaming_) return true;
+  Synchronize();
+  stream_block_.Reset();
+  if (Open(&stream_block_) == false) return false;
+  stream_pos_ = 0;
+  streaming_ = true;
+  return true;
+}
+
+
+bool SoundData::CloseStream() {
+  if (streaming_ == false) return false;
+  streaming_ = false;
+  stream_block_.Clear();
+  stream_pos_ = 0;
+  return Close();
+}
+
+
+size_t SoundData::Render(int16_t* interleaved, size_t frames) {
+  return RenderStems(interleaved, nullptr, frames);
+}
+
+
+size_t SoundData::RenderStems(int16_t* interleaved, int16_t* stems, size_t frames) {
+  if (interleaved == nullptr) return 0;
+  const int stem_count = (stems != nullptr) ? stream_block_.stem_count() : 0;
+  size_t done = 0;
+  while (streaming_ && done < frames) {
+    size_t available = stream_block_.sample_length() - stream_pos_;
+    if (available == 0) {
+      stream_pos_ = 0;
+      if (Advance(&stream_block_) == false) break;
+      available = stream_block_.sample_length();
+      if (available == 0) break;
+    }
+    const size_t n = std::min(available, frames - done);
+    for (size_t i = 0; i < n; ++i, ++stream_pos_, ++done) {
+      stream_block_.GetStereo16(stream_pos_, interleaved + 2 * done);
+      for (int s = 0; s < stem_count; ++s) {
+        stream_block_.GetStemStereo16(s, stream_pos_, stems + 2 * (s * frames + done));
+      }
+    }
+  }
+  std::fill(interleaved + 2 * done, interleaved + 2 * frames, 0);
+  for (int s = 0; s < stem_count; ++s) {
+    std::fill(stems + 2 * (s * frames + done), stems + 2 * (s + 1) * frames, 0);
+  }
+  if (loop_detector_ != nullptr) {
+    loop_detector_->AddFrames(interleaved, done);
+  }
+  return done;
+}
@@ -1,50 +1,67 @@
 #include "common/SoundLoader.h"
 #include "common/debug.h"
-#include <wx/string.h>
-#include <wx/file.h>
+#include "psf/psfloader.h"
+#include "psf/psflog.h"
+#include <fcntl.h>
 #include <map>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 namespace {
-  typedef std::map<wxString, SoundLoader::InstanceFunc> InstanceFuncMap;
+  typedef std::map<std::string, SoundLoader::InstanceFunc> InstanceFuncMap;
   InstanceFuncMap instance_funcs_;
 }
 
 bool SoundLoader::RegisterInstanceFunc(InstanceFunc func, const char *signature) {
-  instance_funcs_[wxString(signature)] = func;
+  instance_funcs_[std::string(signature)] = func;
   return true;
 }
 
-#include "psf/psfloader.h"
-#include "vorbis/vorbis.h"
+namespace {
 
-SoundLoader* SoundLoader::Instance(const wxString &filename) {
+// Other formats, e.g. Ogg Vorbis, are registered by the application which links them.
+bool RegisterDefaultInstanceFuncs() {
+  SoundLoader::RegisterInstanceFunc((SoundLoader::InstanceFunc)&PSF1Loader::Instance, "PSF\x1");
+  SoundLoader::RegisterInstanceFunc((SoundLoader::InstanceFunc)&PSF2Loader::Instance, "PSF\x2");
+  SoundLoader::RegisterInstanceFunc((SoundLoader::InstanceFunc)&PSFLogLoader::Instance, "RSPL");
+  return true;
+}
 
-  static bool is_inited(false);
-  if (is_inited == false) {
+}   // namespace
 
-    RegisterInstanceFunc((InstanceFunc)&VorbisLoader::Instance, "OggS");
-    RegisterInstanceFunc((InstanceFunc)&PSF1Loader::Instance, "PSF\x1");
-    RegisterInstanceFunc((InstanceFunc)&PSF2Loader::Instance, "PSF\x2");
+SoundLoader* SoundLoader::Instance(const std::string &filename) {
 
-    is_inited = true;
-  }
+  // initialized exactly once even when render workers race to get here
+  static const bool is_inited = RegisterDefaultInstanceFuncs();
+  (void)is_inited;
 
-  wxFile file(filename, wxFile::read);
-  if (file.IsOpened() == false) {
+  const int fd = ::open(filename.c_str(), O_RDONLY | O_BINARY);
+  if (fd < 0) {
     return nullptr;
   }
 
   char buff[4];
-  file.Read(buff, 4);
-  const wxString signature(buff, 4);
+  if (::read(fd, buff, 4) != 4) {
+    rennyLogError("SoundLoader", "'%s' is too short.", filename.c_str());
+    ::close(fd);
+    return nullptr;
+  }
+  const std::string signature(buff, 4);
   InstanceFuncMap::iterator it = instance_funcs_.find(signature);
   if (it == instance_funcs_.end()) {
-    rennyLogError("SoundLoader", "Failed to generate a loader. (signature = %s)", static_cast<const char*>(signature));
-    file.Close();
+    rennyLogError("SoundLoader", "Failed to generate a loader. (signature = %s)", signature.c_str());
+    ::close(fd);
     return nullptr;
   }
 
-  int fd = file.Detach();
   return it->second(fd, filename);
 }
 
@@ -0,0 +1,295 @@
+#include "common/soundrenderer.h"
+#include "common/wavewriter.h"
+#include "common/SoundLoader.h"
+#include "common/SoundFormat.h"
+#include "common/loopdetector.h"
+#include "common/debug.h"
+#include "common/filepath.h"
+#include "common/hash.h"
+#include "common/stringformat.h"
+#include "psf/psx/profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <locale>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+
+namespace {
+
+const int kDefaultLength = 180000;  // 3 minutes
+const int kDefaultFade = 10000;
+const size_t kChunkFrames = 1024;
+
+inline size_t MillisecondsToFrames(int ms, uint32_t rate) {
+  if (ms <= 0) return 0;
+  return static_cast<size_t>(static_cast<uint64_t>(ms) * rate / 1000);
+}
+
+std::string StemPath(const std::string& dir, const std::string& src_path, int stem, int voice_count) {
+  const std::string name(FilePath::Name(src_path));
+  if (stem < voice_count) {
+    return FilePath::Join(dir, name + StringFormat(".voice%02d.wav", stem + 1));
+  }
+  return FilePath::Join(dir, name + ".reverb.wav");
+}
+
+double ElapsedSeconds(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline uint64_t HashFrame(uint64_t hash, const short* frame) {
+  hash = Fnv1a::Add16(hash, static_cast<uint16_t>(frame[0]));
+  return Fnv1a::Add16(hash, static_cast<uint16_t>(frame[1]));
+}
+
+}   // namespace
+
+
+SoundRenderer::SoundRenderer()
+  : default_length_(kDefaultLength), default_fade_(kDefaultFade), detect_end_(true),
+    fixed_length_(-1), profile_interval_(psx::mips::Profiler::kDefaultInterval),
+    sampling_rate_(0), rendered_frames_(0), total_frames_(0),
+    elapsed_seconds_(0.0), pcm_hash_(Fnv1a::kOffsetBasis),
+    loop_start_(-1), loop_end_(-1), ended_by_silence_(false) {}
+
+
+double SoundRenderer::rendered_seconds() const {
+  if (sampling_rate_ == 0) return 0.0;
+  return static_cast<double>(rendered_frames_) / sampling_rate_;
+}
+
+
+double SoundRenderer::loop_start() const {
+  if (loop_start_ < 0 || sampling_rate_ == 0) return -1.0;
+  return static_cast<double>(loop_start_) / sampling_rate_;
+}
+
+
+double SoundRenderer::loop_end() const {
+  if (loop_end_ < 0 || sampling_rate_ == 0) return -1.0;
+  return static_cast<double>(loop_end_) / sampling_rate_;
+}
+
+
+double SoundRenderer::realtime_ratio() const {
+  if (elapsed_seconds_ <= 0.0) return 0.0;
+  return rendered_seconds() / elapsed_seconds_;
+}
+
+
+int SoundRenderer::ParseTime(const std::string& str) {
+  const char* const kSpaces = " \t\r\n";
+  const size_t first = str.find_first_not_of(kSpaces);
+  if (first == std::string::npos) return -1;
+  std::string s(str, first, str.find_last_not_of(kSpaces) - first + 1);
+  std::replace(s.begin(), s.end(), ',', '.');
+
+  std::vector<std::string> fields;
+  for (size_t pos = 0; ; ) {
+    const size_t colon = s.find(':', pos);
+    fields.push_back(s.substr(pos, colon - pos));
+    if (colon == std::string::npos) break;
+    pos = colon + 1;
+  }
+  if (3 < fields.size()) return -1;
+
+  double seconds = 0.0;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    // in the C locale whatever the application has set
+    std::istringstream stream(fields[i]);
+    stream.imbue(std::locale::classic());
+    double v;
+    if (fields[i].empty() || !(stream >> v) || stream.peek() != EOF || v < 0.0) return -1;
+    seconds = seconds * 60.0 + v;
+  }
+  return static_cast<int>(seconds * 1000.0 + 0.5);
+}
+
+
+bool SoundRenderer::Render(const std::string& src_path, const std::string& dest_path) {
+
+  path_ = src_path;
+  sampling_rate_ = 0;
+  rendered_frames_ = 0;
+  total_frames_ = 0;
+  elapsed_seconds_ = 0.0;
+  pcm_hash_ = Fnv1a::kOffsetBasis;
+  loop_start_ = loop_end_ = -1;
+  ended_by_silence_ = false;
+
+  SoundLoader* loader = SoundLoader::Instance(src_path);
+  if (loader == nullptr) {
+    rennyLogError("SoundRenderer", "Failed to open '%s'.", src_path.c_str());
+    return false;
+  }
+
+  int length = -1, fade = -1;
+  const SoundInfo* info = loader->LoadInfo();
+  if (info != nullptr) {
+    length = ParseTime(info->length());
+    SoundInfo::Tag::const_iterator it = info->others().find("fade");
+    if (it != info->others().end()) {
+      fade = ParseTime(it->second);
+    }
+  }
+  if (0 <= fixed_length_) {
+    length = fixed_length_;
+    fade = 0;
+  }
+  const bool detects_end = detect_end_ && length < 0;
+  if (length < 0) {
+    length = default_length_;
+    if (fade < 0) fade = default_fade_;
+  } else if (fade < 0) {
+    fade = 0;
+  }
+
+  SoundData* sound = loader->LoadData();
+  if (sound == nullptr) {
+    rennyLogError("SoundRenderer", "Failed to load '%s'.", src_path.c_str());
+    delete loader;
+    return false;
+  }
+  sound->Repeat();
+  if (capture_path_.empty() == false && sound->StartCapture(capture_path_) == false) {
+    rennyLogWarning("SoundRenderer", "'%s' cannot be captured.", src_path.c_str());
+  }
+  if (profile_path_.empty() == false && sound->StartProfile(profile_path_, profile_interval_) == false) {
+    rennyLogWarning("SoundRenderer", "'%s' cannot be profiled.", src_path.c_str());
+  }
+  LoopDetector detector(sound->GetSamplingRate());
+  if (detects_end) {
+    sound->set_loop_detector(&detector);
+  }
+  if (sound->OpenStream() == false) {
+    delete sound;
+    delete loader;
+    return false;
+  }
+
+  sampling_rate_ = sound->GetSamplingRate();
+  size_t fade_start = MillisecondsToFrames(length, sampling_rate_);
+  total_frames_ = fade_start + MillisecondsToFrames(fade, sampling_rate_);
+
+  WaveWriter writer;
+  if (dest_path.empty() == false && writer.Open(dest_path, sampling_rate_, 2) == false) {
+    sound->CloseStream();
+    delete sound;
+    delete loader;
+    return false;
+  }
+
+  // one writer per voice plus the reverb bus, fed from the same pass
+  std::vector<std::unique_ptr<WaveWriter> > stem_writers;
+  std::vector<int16_t> stems;
+  if (stem_dir_.empty() == false) {
+    const int stem_count = sound->stem_count();
+    const int voice_count = sound->voice_count();
+    for (int i = 0; i < stem_count; ++i) {
+      stem_writers.emplace_back(new WaveWriter);
+      if (stem_writers.back()->Open(StemPath(stem_dir_, src_path, i, voice_count),
+                                    sampling_rate_, 2) == false) {
+        sound->CloseStream();
+        delete sound;
+        delete loader;
+        return false;
+      }
+    }
+    stems.resize(stem_count * kChunkFrames * 2);
+  }
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const size_t progress_interval = sampling_rate_;
+  float fade_frames = static_cast<float>(total_frames_ - fade_start);
+  bool ret = true;
+  int16_t chunk[kChunkFrames * 2];
+
+  while (ret && rendered_frames_ < total_frames_) {
+    const size_t requested = std::min(kChunkFrames, total_frames_ - rendered_frames_);
+    const size_t rendered = stems.empty() ? sound->Render(chunk, requested)
+                                          : sound->RenderStems(chunk, stems.data(), requested);
+    for (size_t i = 0; i < rendered; ++i) {
+      short* frame = chunk + 2 * i;
+      const size_t frame_index = rendered_frames_ + i;
+      if (fade_start <= frame_index) {
+        const float gain = (total_frames_ - frame_index) / fade_frames;
+        frame[0] = static_cast<short>(frame[0] * gain);
+        frame[1] = static_cast<short>(frame[1] * gain);
+        for (size_t s = 0; s < stem_writers.size(); ++s) {
+          short* stem_frame = stems.data() + 2 * (s * requested + i);
+          stem_frame[0] = static_cast<short>(stem_frame[0] * gain);
+          stem_frame[1] = static_cast<short>(stem_frame[1] * gain);
+        }
+      }
+      pcm_hash_ = HashFrame(pcm_hash_, frame);
+    }
+    if (writer.IsOpened() && writer.Write(chunk, rendered) == false) {
+      ret = false;
+    }
+    for (size_t s = 0; s < stem_writers.size(); ++s) {
+      if (stem_writers[s]->Write(stems.data() + 2 * s * requested, rendered) == false) {
+        ret = false;
+      }
+    }
+    const size_t prev_frames = rendered_frames_;
+    rendered_frames_ += rendered;
+    if (detects_end && detector.IsFinished() && loop_start_ < 0 && ended_by_silence_ == false) {
+      // the content has been covered: fade out a loop, cut off silence
+      size_t end = rendered_frames_;
+      if (detector.HasLooped()) {
+        loop_start_ = detector.loop_start();
+        loop_end_ = detector.loop_end();
+        end += MillisecondsToFrames(fade, sampling_rate_);
+      } else {
+        ended_by_silence_ = true;
+      }
+      if (end < total_frames_) {
+        fade_start = std::min(fade_start, rendered_frames_);
+        total_frames_ = end;
+        fade_frames = static_cast<float>(total_frames_ - fade_start);
+      }
+    }
+    if (prev_frames / progress_interval != rendered_frames_ / progress_interval) {
+      elapsed_seconds_ = ElapsedSeconds(start);
+      OnProgress(false);
+    }
+    if (rendered < requested) break;
+  }
+  elapsed_seconds_ = ElapsedSeconds(start);
+
+  if (writer.IsOpened() && writer.Close() == false) ret = false;
+  for (size_t s = 0; s < stem_writers.size(); ++s) {
+    if (stem_writers[s]->Close() == false) ret = false;
+  }
+  sound->CloseStream();
+  delete sound;
+  delete loader;  // only after the sound, which may still read its file
+
+  OnProgress(true);
+  rennyLogInfo("SoundRenderer", "Rendered '%s': %.1f sec in %.2f sec (%.1fx realtime)",
+               src_path.c_str(), rendered_seconds(), elapsed_seconds_, realtime_ratio());
+  if (0 <= loop_start_) {
+    rennyLogInfo("SoundRenderer", "'%s' loops from %.2f sec to %.2f sec.",
+                 src_path.c_str(), loop_start(), loop_end());
+  } else if (ended_by_silence_) {
+    rennyLogInfo("SoundRenderer", "'%s' fell silent at %.2f sec.",
+                 src_path.c_str(),
+                 static_cast<double>(detector.silence_start()) / sampling_rate_);
+  }
+  return ret;
+}
+
+
+void ConsoleSoundRenderer::OnProgress(bool finished) {
+  std::fprintf(stderr, "\r%s: %.1f / %.1f sec (%.1fx realtime)",
+               path().c_str(), rendered_seconds(),
+               sampling_rate() ? static_cast<double>(total_frames()) / sampling_rate() : 0.0,
+               realtime_ratio());
+  if (finished) {
+    std::fprintf(stderr, "\n");
+  }
+  std::fflush(stderr);
+}
@@ -0,0 +1,43 @@
+#include "common/stringformat.h"
+#include <cstdarg>
+#include <cstdio>
+
+
+namespace {
+
+void AppendFormatV(std::string* dest, const char* format, va_list arg) {
+  char buffer[256];
+  va_list arg_copy;
+  va_copy(arg_copy, arg);
+  const int len = std::vsnprintf(buffer, sizeof(buffer), format, arg_copy);
+  va_end(arg_copy);
+  if (len < 0) return;
+  if (static_cast<size_t>(len) < sizeof(buffer)) {
+    dest->append(buffer, len);
+    return;
+  }
+  const size_t offset = dest->size();
+  dest->resize(offset + len + 1);
+  std::vsnprintf(&(*dest)[offset], len + 1, format, arg);
+  dest->resize(offset + len);
+}
+
+}   // namespace
+
+
+std::string StringFormat(const char* format, ...) {
+  std::string ret;
+  va_list arg;
+  va_start(arg, format);
+  AppendFormatV(&ret, format, arg);
+  va_end(arg);
+  return ret;
+}
+
+
+void AppendFormat(std::string* dest, const char* format, ...) {
+  va_list arg;
+  va_start(arg, format);
+  AppendFormatV(dest, format, arg);
+  va_end(arg);
+}
@@ -0,0 +1,390 @@
+#include "common/tagindex.h"
+#include "common/mappedfile.h"
+#include "common/soundrenderer.h"
+#include "common/SoundFormat.h"
+#include "common/debug.h"
+#include "common/filepath.h"
+#include "common/stringformat.h"
+#include "psf/psfloader.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+
+namespace {
+
+const char kIndexHeader[] = "rennypsf-tags\t1";
+const size_t kFixedFields = 8;  // path, mtime, size, title, artist, game, length, fade
+
+void AppendField(std::string* line, const std::string& field) {
+  for (char c : field) {
+    switch (c) {
+    case '\\': line->append("\\\\"); break;
+    case '\t': line->append("\\t"); break;
+    case '\n': line->append("\\n"); break;
+    case '\r': line->append("\\r"); break;
+    default: line->push_back(c); break;
+    }
+  }
+}
+
+std::string UnescapeField(const char* begin, const char* end) {
+  std::string utf8;
+  utf8.reserve(end - begin);
+  for (const char* p = begin; p < end; ++p) {
+    if (*p != '\\' || p + 1 == end) {
+      utf8.push_back(*p);
+      continue;
+    }
+    switch (*++p) {
+    case 't': utf8.push_back('\t'); break;
+    case 'n': utf8.push_back('\n'); break;
+    case 'r': utf8.push_back('\r'); break;
+    default: utf8.push_back(*p); break;
+    }
+  }
+  return utf8;
+}
+
+
+bool ToInt64(const std::string& str, long long* value) {
+  if (str.empty()) return false;
+  char* end;
+  *value = std::strtoll(str.c_str(), &end, 10);
+  return *end == '\0';
+}
+
+
+std::string ToLower(const std::string& str) {
+  std::string lower(str);
+  for (char& c : lower) {
+    if ('A' <= c && c <= 'Z') c += 'a' - 'A';
+  }
+  return lower;
+}
+
+
+//! Maps path read-only; the file itself is closed again at once.
+bool MapFile(const std::string& path, MappedFile* map) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_BINARY);
+  if (fd < 0) return false;
+  const bool ret = map->Map(fd);
+  ::close(fd);
+  return ret;
+}
+
+}   // namespace
+
+
+////////////////////////////////////////////////////////////////////////
+// TagIndex
+////////////////////////////////////////////////////////////////////////
+
+
+bool TagIndex::GetFileStat(const std::string& path, int64_t* mtime, uint64_t* size) {
+  return FilePath::Stat(path, mtime, size);
+}
+
+
+bool TagIndex::ScanFile(const std::string& path, TrackTags* tags) {
+  rennyAssert(tags != nullptr);
+  MappedFile map;
+  if (MapFile(path, &map) == false) return false;
+  if (map.Contains(0, 16) == false || ::memcmp(map.data(), "PSF", 3) != 0) return false;
+
+  // only the header and the tags are touched; the program is never read
+  const uint64_t tag_ofs = 16ULL + map.GetLE32(4) + map.GetLE32(8);
+  if (GetFileStat(path, &tags->mtime, &tags->size) == false) return false;
+  tags->path = path;
+  tags->title.clear();
+  tags->artist.clear();
+  tags->game.clear();
+  tags->length_ms = -1;
+  tags->fade_ms = -1;
+  tags->libs.clear();
+  if (tag_ofs + 5 > map.size() || ::memcmp(map.data() + tag_ofs, "[TAG]", 5) != 0) {
+    return true;
+  }
+
+  SoundInfo::Tag tag;
+  const char* const tag_begin = reinterpret_cast<const char*>(map.data() + tag_ofs + 5);
+  const char* const tag_end = reinterpret_cast<const char*>(map.data() + map.size());
+  PSFLoader::ParseTags(tag_begin, tag_end, &tag);
+
+  std::string libs[9];
+  for (SoundInfo::Tag::const_iterator it = tag.begin(); it != tag.end(); ++it) {
+    const std::string key(ToLower(it->first));
+    if (key == "title") {
+      tags->title = it->second;
+    } else if (key == "artist") {
+      tags->artist = it->second;
+    } else if (key == "game") {
+      tags->game = it->second;
+    } else if (key == "length") {
+      tags->length_ms = SoundRenderer::ParseTime(it->second);
+    } else if (key == "fade") {
+      tags->fade_ms = SoundRenderer::ParseTime(it->second);
+    } else if (key == "_lib") {
+      libs[0] = it->second;
+    } else if (key.length() == 5 && key.compare(0, 4, "_lib") == 0) {
+      const int n = key[4] - '0';
+      if (2 <= n && n <= 9) {
+        libs[n - 1] = it->second;
+      }
+    }
+  }
+  for (int i = 0; i < 9 && libs[i].empty() == false; ++i) {
+    tags->libs.push_back(libs[i]);
+  }
+  return true;
+}
+
+
+bool TagIndex::Load(const std::string& index_path) {
+  MappedFile map;
+  if (MapFile(index_path, &map) == false) return false;
+
+  const char* p = reinterpret_cast<const char*>(map.data());
+  const char* const end = p + map.size();
+  const size_t header_len = sizeof(kIndexHeader) - 1;
+  if (map.size() < header_len || ::memcmp(p, kIndexHeader, header_len) != 0) {
+    rennyLogWarning("TagIndex", "'%s' is not a tag index.", index_path.c_str());
+    return false;
+  }
+
+  std::unordered_map<std::string, TrackTags> tracks;
+  std::vector<std::string> fields;
+  p = static_cast<const char*>(::memchr(p, '\n', end - p));
+  while (p != nullptr && ++p < end) {
+    const char* eol = static_cast<const char*>(::memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    fields.clear();
+    for (const char* q = p; q <= eol; ) {
+      const char* tab = static_cast<const char*>(::memchr(q, '\t', eol - q));
+      if (tab == nullptr) tab = eol;
+      fields.push_back(UnescapeField(q, tab));
+      q = tab + 1;
+    }
+    p = eol;
+    if (fields.size() < kFixedFields) continue;
+
+    TrackTags tags;
+    long long mtime, size, length, fade;
+    if (ToInt64(fields[1], &mtime) == false || ToInt64(fields[2], &size) == false ||
+        ToInt64(fields[6], &length) == false || ToInt64(fields[7], &fade) == false) {
+      continue;
+    }
+    tags.path = fields[0];
+    tags.mtime = mtime;
+    tags.size = size;
+    tags.title = fields[3];
+    tags.artist = fields[4];
+    tags.game = fields[5];
+    tags.length_ms = length;
+    tags.fade_ms = fade;
+    for (size_t i = kFixedFields; i < fields.size(); ++i) {
+      tags.libs.push_back(fields[i]);
+    }
+    tracks[tags.path] = tags;
+  }
+
+  std::lock_guard<std::mutex> locker(mutex_);
+  // entries scanned before Load() are newer
+  for (auto& track : tracks) {
+    tracks_.insert(track);
+  }
+  rennyLogInfo("TagIndex", "Loaded %d entries from '%s'.", static_cast<int>(tracks.size()),
+               index_path.c_str());
+  return true;
+}
+
+
+bool TagIndex::Save(const std::string& index_path) {
+  std::string text(kIndexHeader);
+  text.push_back('\n');
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    for (const auto& track : tracks_) {
+      const TrackTags& tags = track.second;
+      AppendField(&text, tags.path);
+      AppendFormat(&text, "\t%lld\t%llu\t", static_cast<long long>(tags.mtime),
+                   static_cast<unsigned long long>(tags.size));
+      AppendField(&text, tags.title);
+      text.push_back('\t');
+      AppendField(&text, tags.artist);
+      text.push_back('\t');
+      AppendField(&text, tags.game);
+      AppendFormat(&text, "\t%d\t%d", tags.length_ms, tags.fade_ms);
+      for (size_t i = 0; i < tags.libs.size(); ++i) {
+        text.push_back('\t');
+        AppendField(&text, tags.libs[i]);
+      }
+      text.push_back('\n');
+    }
+    modified_ = false;
+  }
+
+  const std::string dir(FilePath::Directory(index_path));
+  if (FilePath::MakeDirectories(dir) == false) {
+    rennyLogError("TagIndex", "Failed to create '%s'.", dir.c_str());
+    return false;
+  }
+  // replace the old index only once the new one is complete
+  const std::string tmp_path(index_path + ".tmp");
+  std::FILE* const file = std::fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    rennyLogError("TagIndex", "Failed to write '%s'.", tmp_path.c_str());
+    return false;
+  }
+  const bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+  if (std::fclose(file) != 0 || written == false) {
+    rennyLogError("TagIndex", "Failed to write '%s'.", tmp_path.c_str());
+    FilePath::Remove(tmp_path);
+    return false;
+  }
+  return FilePath::Rename(tmp_path, index_path);
+}
+
+
+bool TagIndex::IsModified() const {
+  std::lock_guard<std::mutex> locker(mutex_);
+  return modified_;
+}
+
+
+bool TagIndex::Find(const std::string& path, int64_t mtime, uint64_t size, TrackTags* tags) const {
+  std::lock_guard<std::mutex> locker(mutex_);
+  auto it = tracks_.find(path);
+  if (it == tracks_.end() || it->second.mtime != mtime || it->second.size != size) {
+    return false;
+  }
+  if (tags) *tags = it->second;
+  return true;
+}
+
+
+void TagIndex::Store(const TrackTags& tags) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  tracks_[tags.path] = tags;
+  modified_ = true;
+}
+
+
+size_t TagIndex::size() const {
+  std::lock_guard<std::mutex> locker(mutex_);
+  return tracks_.size();
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// TagScanner
+////////////////////////////////////////////////////////////////////////
+
+
+TagScanner::TagScanner(TagIndex* index, int worker_count)
+  : index_(index),
+    worker_count_(worker_count > 0 ? worker_count : TaskPool::Instance().worker_count()),
+    tasks_(TaskPool::kPriorityScan), running_workers_(0) {
+  rennyAssert(index != nullptr);
+}
+
+
+TagScanner::~TagScanner() {
+  Cancel();
+  Wait();
+}
+
+
+bool TagScanner::IsPSFFile(const std::string& path) {
+  const std::string ext(FilePath::Extension(path));
+  return ext == "psf" || ext == "minipsf" || ext == "psf2" || ext == "minipsf2";
+}
+
+
+void TagScanner::Add(const std::string& path) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  queue_.push_back(path);
+}
+
+
+int TagScanner::AddDirectory(const std::string& dir) {
+  std::vector<std::string> files;
+  FilePath::ListFiles(dir, &files, true);
+  int count = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (IsPSFFile(files[i]) == false) continue;
+    Add(files[i]);
+    ++count;
+  }
+  return count;
+}
+
+
+void TagScanner::Start() {
+  size_t task_count;
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    // a running worker checks the queue again before it exits
+    if (running_workers_ > 0 || queue_.empty()) return;
+    task_count = std::min(queue_.size(), static_cast<size_t>(worker_count_));
+    running_workers_ = static_cast<int>(task_count);
+  }
+  for (size_t i = 0; i < task_count; ++i) {
+    tasks_.Run([this] { Entry(); });
+  }
+}
+
+
+void TagScanner::Cancel() {
+  std::lock_guard<std::mutex> locker(mutex_);
+  queue_.clear();
+}
+
+
+void TagScanner::Wait() {
+  tasks_.Wait();
+}
+
+
+bool TagScanner::NextPath(std::string* path, bool* last) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  if (queue_.empty()) {
+    *last = (--running_workers_ == 0);
+    return false;
+  }
+  *path = queue_.front();
+  queue_.pop_front();
+  return true;
+}
+
+
+void TagScanner::Entry() {
+  std::string path;
+  bool last = false;
+  while (NextPath(&path, &last)) {
+    TrackTags tags;
+    int64_t mtime;
+    uint64_t size;
+    if (TagIndex::GetFileStat(path, &mtime, &size) == false) continue;
+    if (index_->Find(path, mtime, size, &tags) == false) {
+      if (TagIndex::ScanFile(path, &tags) == false) continue;
+      index_->Store(tags);
+    }
+    OnScanned(tags);
+  }
+  if (last) {
+    OnFinished();
+  }
+}
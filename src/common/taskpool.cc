@@ -0,0 +1,195 @@
+#include "common/taskpool.h"
+#include "common/debug.h"
+#include "common/perfcounters.h"
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+
+namespace {
+
+int requested_worker_count = 0;
+
+// index of the worker running on this thread, -1 on other threads
+thread_local int worker_index = -1;
+
+}   // namespace
+
+
+TaskPool& TaskPool::Instance() {
+  // Never destroyed: the workers run until the process exits.
+  static TaskPool* instance = nullptr;
+  static std::once_flag once;
+  std::call_once(once, [] {
+    int count = requested_worker_count;
+    if (count <= 0) {
+      const char* env = std::getenv("RENNYPSF_THREADS");
+      count = (env != nullptr) ? std::atoi(env) : 0;
+    }
+    if (count <= 0) {
+      count = std::max<int>(std::thread::hardware_concurrency(), 1);
+    }
+    instance = new TaskPool(count);
+  });
+  return *instance;
+}
+
+
+void TaskPool::SetWorkerCount(int count) {
+  requested_worker_count = count;
+}
+
+
+TaskPool::TaskPool(int worker_count)
+  : next_worker_(0), pending_(0), pending_playback_(0) {
+  rennyAssert(worker_count > 0);
+  for (int i = 0; i <= worker_count; i++) {
+    workers_.push_back(std::unique_ptr<Worker>(new Worker));
+  }
+  for (int i = 0; i <= worker_count; i++) {
+    std::thread(&TaskPool::Entry, this, i).detach();
+  }
+  rennyLogInfo("TaskPool", "Started %d workers and one for playback.", worker_count);
+}
+
+
+void TaskPool::Submit(Priority priority, const Task& task) {
+  rennyAssert(priority < kPriorityCount);
+  const int index = (worker_index >= 0) ? worker_index
+      : static_cast<int>(next_worker_++ % worker_count());
+  {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> locker(worker.mutex);
+    worker.tasks[priority].push_back(task);
+  }
+  int pending;
+  {
+    std::lock_guard<std::mutex> locker(sleep_mutex_);
+    pending = ++pending_;
+    if (priority == kPriorityPlayback) ++pending_playback_;
+  }
+  PerfCounters::SetGauge(PerfCounters::kPooledTasks, pending);
+  sleep_cond_.notify_one();
+  if (priority == kPriorityPlayback) playback_cond_.notify_one();
+}
+
+
+bool TaskPool::Pop(int index, int priority_count, Task* task, int* priority) {
+  const int count = static_cast<int>(workers_.size());
+  for (*priority = 0; *priority < priority_count; ++*priority) {
+    {
+      // the newest task of our own, which is likely still in the cache
+      Worker& worker = *workers_[index];
+      std::lock_guard<std::mutex> locker(worker.mutex);
+      std::deque<Task>& tasks = worker.tasks[*priority];
+      if (tasks.empty() == false) {
+        task->swap(tasks.back());
+        tasks.pop_back();
+        return true;
+      }
+    }
+    for (int i = 1; i < count; i++) {
+      // the oldest task of another worker
+      Worker& victim = *workers_[(index + i) % count];
+      std::lock_guard<std::mutex> locker(victim.mutex);
+      std::deque<Task>& tasks = victim.tasks[*priority];
+      if (tasks.empty() == false) {
+        task->swap(tasks.front());
+        tasks.pop_front();
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+void TaskPool::Entry(int index) {
+  worker_index = index;
+  const bool for_playback = (index == worker_count());
+  const int priority_count = for_playback ? kPriorityPlayback + 1 : kPriorityCount;
+  Task task;
+  int priority;
+  while (true) {
+    if (Pop(index, priority_count, &task, &priority)) {
+      int pending;
+      {
+        std::lock_guard<std::mutex> locker(sleep_mutex_);
+        pending = --pending_;
+        if (priority == kPriorityPlayback) --pending_playback_;
+      }
+      PerfCounters::SetGauge(PerfCounters::kPooledTasks, pending);
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> locker(sleep_mutex_);
+    // a task is pushed before pending_ is incremented, so none is missed
+    if (for_playback) {
+      playback_cond_.wait(locker, [this] { return pending_playback_ > 0; });
+    } else {
+      sleep_cond_.wait(locker, [this] { return pending_ > 0; });
+    }
+  }
+}
+
+
+
+struct TaskGroup::State {
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<TaskPool::Task> tasks;   // not started yet
+  int running;
+  State() : running(0) {}
+};
+
+
+TaskGroup::TaskGroup(TaskPool::Priority priority)
+  : priority_(priority), state_(std::make_shared<State>()) {}
+
+
+TaskGroup::~TaskGroup() {
+  Wait();
+}
+
+
+void TaskGroup::Run(const TaskPool::Task& task) {
+  {
+    std::lock_guard<std::mutex> locker(state_->mutex);
+    state_->tasks.push_back(task);
+  }
+  // the pool task only takes whichever task of the group is next
+  const std::shared_ptr<State> state(state_);
+  TaskPool::Instance().Submit(priority_, [state] { RunOne(state); });
+}
+
+
+bool TaskGroup::RunOne() {
+  return RunOne(state_);
+}
+
+
+bool TaskGroup::RunOne(const std::shared_ptr<State>& state) {
+  TaskPool::Task task;
+  {
+    std::lock_guard<std::mutex> locker(state->mutex);
+    if (state->tasks.empty()) return false;
+    task.swap(state->tasks.front());
+    state->tasks.pop_front();
+    ++state->running;
+  }
+  task();
+  {
+    std::lock_guard<std::mutex> locker(state->mutex);
+    --state->running;
+  }
+  state->cond.notify_all();
+  return true;
+}
+
+
+void TaskGroup::Wait() {
+  while (RunOne()) {}
+  std::unique_lock<std::mutex> locker(state_->mutex);
+  state_->cond.wait(locker, [this] { return state_->running == 0 && state_->tasks.empty(); });
+}
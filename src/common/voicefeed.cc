@@ -0,0 +1,160 @@
+#include "common/voicefeed.h"
+#include "common/SoundFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RENNY_LEVELMETER_SSE
+#endif
+
+
+const unsigned int VoiceSnapshot::kMaxVoices;
+
+
+namespace {
+
+static_assert(sizeof(SampleSequence::SampleEx) == 4 * sizeof(float),
+              "LevelMeter reads a SampleEx as four floats");
+
+//! Raises peak[] to the largest |left| and |right| and adds their squares to sum_squares[].
+void PeakAndSumSquares(const SampleSequence::SampleEx* samples, size_t frames,
+                       float peak[2], double sum_squares[2]) {
+  size_t i = 0;
+  float sums[2] = { 0.0f, 0.0f };
+#ifdef RENNY_LEVELMETER_SSE
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 peaks_l = _mm_set1_ps(peak[0]), peaks_r = _mm_set1_ps(peak[1]);
+  __m128 sums_l = _mm_setzero_ps(), sums_r = _mm_setzero_ps();
+  for (; i + 4 <= frames; i += 4) {
+    const float* const p = &samples[i].sample_;
+    __m128 sample = _mm_loadu_ps(p);
+    __m128 vol_left = _mm_loadu_ps(p + 4);
+    __m128 vol_right = _mm_loadu_ps(p + 8);
+    __m128 env = _mm_loadu_ps(p + 12);
+    // four samples, four left volumes, four right volumes; env is unused
+    _MM_TRANSPOSE4_PS(sample, vol_left, vol_right, env);
+    const __m128 left = _mm_mul_ps(sample, vol_left);
+    const __m128 right = _mm_mul_ps(sample, vol_right);
+    peaks_l = _mm_max_ps(peaks_l, _mm_andnot_ps(sign, left));
+    peaks_r = _mm_max_ps(peaks_r, _mm_andnot_ps(sign, right));
+    sums_l = _mm_add_ps(sums_l, _mm_mul_ps(left, left));
+    sums_r = _mm_add_ps(sums_r, _mm_mul_ps(right, right));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, peaks_l);
+  peak[0] = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+  _mm_storeu_ps(lanes, peaks_r);
+  peak[1] = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+  _mm_storeu_ps(lanes, sums_l);
+  sums[0] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  _mm_storeu_ps(lanes, sums_r);
+  sums[1] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+  for (; i < frames; i++) {
+    const float left = samples[i].sample_ * samples[i].vol_left_;
+    const float right = samples[i].sample_ * samples[i].vol_right_;
+    peak[0] = std::max(peak[0], std::fabs(left));
+    peak[1] = std::max(peak[1], std::fabs(right));
+    sums[0] += left * left;
+    sums[1] += right * right;
+  }
+  sum_squares[0] += sums[0];
+  sum_squares[1] += sums[1];
+}
+
+}   // namespace
+
+
+void LevelMeter::Add(const SampleSequence& seq, size_t frames) {
+  // a voice shorter than the block is silent for the rest of it
+  PeakAndSumSquares(seq.data(), std::min(seq.sample_length(), frames), peak_, sum_squares_);
+  frames_ += frames;
+}
+
+
+void LevelMeter::AddStereo16(const short* samples, size_t frames) {
+  int peaks[2] = { 0, 0 };
+  int64_t sums[2] = { 0, 0 };
+  for (size_t i = 0; i < frames; i++) {
+    for (int side = 0; side < 2; side++) {
+      const int x = samples[i * 2 + side];
+      peaks[side] = std::max(peaks[side], std::abs(x));
+      sums[side] += x * x;
+    }
+  }
+  for (int side = 0; side < 2; side++) {
+    peak_[side] = std::max(peak_[side], peaks[side] / 32768.0f);
+    sum_squares_[side] += sums[side] / (32768.0 * 32768.0);
+  }
+  frames_ += frames;
+}
+
+
+void LevelMeter::Clear() {
+  peak_[0] = peak_[1] = 0.0f;
+  sum_squares_[0] = sum_squares_[1] = 0.0;
+  frames_ = 0;
+}
+
+
+float LevelMeter::rms(int side) const {
+  if (frames_ == 0) return 0.0f;
+  return static_cast<float>(std::sqrt(sum_squares_[side] / frames_));
+}
+
+
+
+VoiceFeed& VoiceFeed::Instance() {
+  static VoiceFeed instance;
+  return instance;
+}
+
+
+bool VoiceFeed::Meter(const SoundBlock& block) {
+  const size_t frames = block.sample_length();
+  const unsigned int voice_count = std::min(block.channel_count(), VoiceSnapshot::kMaxVoices);
+  for (unsigned int i = 0; i < voice_count; i++) {
+    voice_meters_[i].Add(block.Ch(i), frames);
+  }
+
+  // what the sound device plays
+  mix_.resize(frames * 2);
+  for (size_t j = 0; j < frames; j++) {
+    block.GetStereo16(static_cast<int>(j), &mix_[j * 2]);
+  }
+  mix_meter_.AddStereo16(mix_.data(), frames);
+
+  frames_ += frames;
+  return frames_ >= kSnapshotFrames;
+}
+
+
+void VoiceFeed::Publish() {
+  VoiceSnapshot& snapshot = buffer_.back();
+  snapshot.block = block_++;
+  for (unsigned int i = 0; i < snapshot.voice_count; i++) {
+    const LevelMeter& meter = voice_meters_[i];
+    snapshot.voices[i].peak = std::max(meter.peak(0), meter.peak(1));
+    snapshot.voices[i].rms = std::sqrt(0.5f * (meter.rms(0) * meter.rms(0) + meter.rms(1) * meter.rms(1)));
+  }
+  for (int side = 0; side < 2; side++) {
+    snapshot.peak[side] = mix_meter_.peak(side);
+    snapshot.rms[side] = mix_meter_.rms(side);
+  }
+  buffer_.Publish();
+
+  for (unsigned int i = 0; i < VoiceSnapshot::kMaxVoices; i++) {
+    voice_meters_[i].Clear();
+  }
+  mix_meter_.Clear();
+  frames_ = 0;
+}
+
+
+bool VoiceFeed::Read(const VoiceSnapshot** snapshot) {
+  const bool updated = buffer_.Update();
+  *snapshot = &buffer_.front();
+  return updated;
+}
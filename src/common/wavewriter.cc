@@ -0,0 +1,133 @@
+#include "common/wavewriter.h"
+#include "common/debug.h"
+#include <cstring>
+
+
+namespace {
+
+const size_t kHeaderSize = 44;
+
+inline void PutLE16(unsigned char* p, uint16_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+inline void PutLE32(unsigned char* p, uint32_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+}   // namespace
+
+
+WaveWriter::WaveWriter(size_t buffer_frames)
+  : file_(nullptr), buffer_frames_(buffer_frames),
+    buffer_index_(0), frame_count_(0), sampling_rate_(44100), channel_count_(2) {
+  rennyAssert(buffer_frames > 0);
+}
+
+
+WaveWriter::~WaveWriter() {
+  if (IsOpened()) {
+    Close();
+  }
+}
+
+
+bool WaveWriter::IsOpened() const {
+  return file_ != nullptr;
+}
+
+
+bool WaveWriter::Open(const std::string& path, uint32_t sampling_rate, int channel_count) {
+  if (IsOpened()) {
+    Close();
+  }
+  if (channel_count <= 0 || sampling_rate == 0) {
+    rennyLogError("WaveWriter", "Invalid format. (rate = %d, channels = %d)", sampling_rate, channel_count);
+    return false;
+  }
+  file_ = std::fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    rennyLogError("WaveWriter", "Failed to create '%s'.", path.c_str());
+    return false;
+  }
+  sampling_rate_ = sampling_rate;
+  channel_count_ = channel_count;
+  frame_count_ = 0;
+  buffer_index_ = 0;
+  buffer_.reset(new short[buffer_frames_ * channel_count_]);
+
+  // reserve the header; the sizes are written on Close()
+  return WriteHeader();
+}
+
+
+bool WaveWriter::WriteHeader() {
+  const uint32_t block_size = channel_count_ * sizeof(short);
+  const uint32_t data_size = frame_count_ * block_size;
+
+  unsigned char header[kHeaderSize];
+  ::memcpy(header + 0, "RIFF", 4);
+  PutLE32(header + 4, data_size + kHeaderSize - 8);
+  ::memcpy(header + 8, "WAVE", 4);
+  ::memcpy(header + 12, "fmt ", 4);
+  PutLE32(header + 16, 16);
+  PutLE16(header + 20, 1);    // linear PCM
+  PutLE16(header + 22, channel_count_);
+  PutLE32(header + 24, sampling_rate_);
+  PutLE32(header + 28, sampling_rate_ * block_size);
+  PutLE16(header + 32, block_size);
+  PutLE16(header + 34, 16);
+  ::memcpy(header + 36, "data", 4);
+  PutLE32(header + 40, data_size);
+
+  return std::fwrite(header, 1, kHeaderSize, file_) == kHeaderSize;
+}
+
+
+bool WaveWriter::Write(const short* samples, size_t frame_count) {
+  if (IsOpened() == false) return false;
+  while (frame_count > 0) {
+    size_t n = buffer_frames_ - buffer_index_;
+    if (frame_count < n) n = frame_count;
+    ::memcpy(&buffer_[buffer_index_ * channel_count_], samples, n * channel_count_ * sizeof(short));
+    buffer_index_ += n;
+    frame_count_ += n;
+    samples += n * channel_count_;
+    frame_count -= n;
+    if (buffer_index_ == buffer_frames_ && Flush() == false) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool WaveWriter::Flush() {
+  if (buffer_index_ == 0) return true;
+  const size_t size = buffer_index_ * channel_count_ * sizeof(short);
+  buffer_index_ = 0;
+  if (std::fwrite(buffer_.get(), 1, size, file_) != size) {
+    rennyLogError("WaveWriter", "Failed to write %d bytes.", static_cast<int>(size));
+    return false;
+  }
+  return true;
+}
+
+
+bool WaveWriter::Close() {
+  if (IsOpened() == false) return false;
+  bool ret = Flush();
+  if (std::fseek(file_, 0, SEEK_SET) != 0 || WriteHeader() == false) {
+    ret = false;
+  }
+  if (std::fclose(file_) != 0) {
+    ret = false;
+  }
+  file_ = nullptr;
+  buffer_.reset();
+  return ret;
+}
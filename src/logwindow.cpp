@@ -0,0 +1,369 @@
+#include "logwindow.h"
+#include "common/debug.h"
+#include "common/perfcounters.h"
+#include <wx/string.h>
+#include <wx/weakref.h>
+#include <wx/file.h>
+#include <wx/frame.h>
+#include <wx/listctrl.h>
+#include <wx/timer.h>
+#include <wx/sizer.h>
+#include <wx/event.h>
+#include <wx/thread.h>
+#include <wx/utils.h>
+#include <wx/datetime.h>
+#include <vector>
+#include <deque>
+
+class RennyDebugListCtrl;
+class RennyStatsListCtrl;
+
+class RennyDebug {
+  
+protected:
+  RennyDebug(wxWindow* parent);
+  ~RennyDebug();
+  
+public:
+  static RennyDebug* Instance();
+  static void CreateWindow(wxWindow* parent);
+  static void DestroyWindow();
+
+  bool IsWindowCreated() const;
+  void ShowWindow();
+  void HideWindow();
+
+  void OnClose(wxCloseEvent& event);
+
+  enum LogLevel {
+    kLogLevelNone = 0,
+    kLogLevelDebug,
+    kLogLevelInfo,
+    kLogLevelNotice,
+    kLogLevelWarning,
+    kLogLevelError,
+    kLogLevelCritical,
+    kLogLevelAlert,
+    kLogLevelEmergency,
+    kLogLevelMax
+  };
+
+  //! Called by the log writer thread only.
+  void Log(LogLevel log_level, const wxString& instance_name, const wxString& msg,
+           const wxString& created_on);
+  //! The RennyLogSink of the core while the window exists.
+  static void LogSink(int level, const char* instance_name, const char* message, time_t created_on);
+
+private:
+  static RennyDebug* instance_;
+  wxFile log_file_;
+
+  wxWeakRef<wxFrame> frame_;
+  wxWeakRef<RennyDebugListCtrl> list_ctrl_;
+  wxWeakRef<RennyStatsListCtrl> stats_ctrl_;
+};
+
+namespace {
+
+const wxString str_log_levels[RennyDebug::kLogLevelMax] =
+    {"", "Debug", "Info", "Notice", "Warning",
+     "Error", "Critical", "Alert", "Emergency"};
+}
+
+
+class RennyDebugListCtrl : public wxListCtrl {
+
+public:
+  RennyDebugListCtrl(wxWindow* parent);
+
+  //! Called by the log writer thread; the item is shown by the next OnTimer().
+  void Log(const wxString& level, const wxString& instance, const wxString& msg, const wxString& created_on);
+
+protected:
+  enum Column {
+    kColumnLevel = 0,
+    kColumnInstance,
+    kColumnMessage,
+    kColumnCreatedOn
+  };
+
+  wxString OnGetItemText(long item, long column) const;
+  wxListItemAttr* OnGetItemAttr(long item) const;
+  void OnTimer(wxTimerEvent& event);
+
+private:
+  struct Item {
+    wxString level;
+    wxString instance;
+    wxString message;
+    wxString created_on;
+    Item(const wxString& lvl, const wxString& ins, const wxString& msg, const wxString& crtd_on)
+      : level(lvl), instance(ins), message(msg), created_on(crtd_on) {}
+  };
+  std::deque<Item> items_;       // GUI thread only
+  std::vector<Item> item_acc_;
+  std::vector<Item> pending_;    // logged but not shown yet
+  wxMutex mutex_;                // for pending_
+  wxTimer timer_;
+
+  mutable wxListItemAttr attr_debug_;
+  mutable wxListItemAttr attr_info_;
+  mutable wxListItemAttr attr_warning_;
+  mutable wxListItemAttr attr_error_;
+};
+
+
+RennyDebugListCtrl::RennyDebugListCtrl(wxWindow *parent)
+  : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL),
+    attr_debug_(wxColour(0, 0, 0), wxColour(0x80, 0x80, 0x80), wxFont()),
+    attr_info_(wxColour(0x00, 0x52, 0x9b), wxColour(0xbd, 0xe5, 0xf8), wxFont()),
+    attr_warning_(wxColour(0x9f, 0x60, 0x00), wxColour(0xfe, 0xef, 0xb3), wxFont()),
+    attr_error_(wxColour(0xb1, 0x00, 0x09), wxColour(0xfd, 0xe4, 0xe1), wxFont()),
+    timer_(this)
+{
+  InsertColumn(0, wxT("Log Level"), wxLIST_FORMAT_LEFT, 64);
+  InsertColumn(1, wxT("Instance"), wxLIST_FORMAT_LEFT, 144);
+  InsertColumn(2, wxT("Message"), wxLIST_FORMAT_LEFT, 628);
+  InsertColumn(3, wxT("Created On"), wxLIST_FORMAT_LEFT, 192);
+  Bind(wxEVT_TIMER, &RennyDebugListCtrl::OnTimer, this);
+  timer_.Start(100);
+}
+
+void RennyDebugListCtrl::Log(const wxString &level, const wxString &instance, const wxString &msg, const wxString &created_on) {
+  wxMutexLocker locker(mutex_);
+  pending_.push_back(Item(level, instance, msg, created_on));
+}
+
+void RennyDebugListCtrl::OnTimer(wxTimerEvent&) {
+  std::vector<Item> pending;
+  {
+    wxMutexLocker locker(mutex_);
+    pending.swap(pending_);
+  }
+  if (pending.empty()) return;
+  for (size_t i = 0; i < pending.size(); i++) {
+    items_.push_back(pending[i]);
+    if (items_.size() > 1000) {
+      item_acc_.push_back(items_.front());
+      items_.pop_front();
+    }
+  }
+  SetItemCount(items_.size());
+  Refresh();
+}
+
+wxString RennyDebugListCtrl::OnGetItemText(long item, long column) const {
+  switch (column) {
+  case kColumnLevel:
+    return items_.at(item).level;
+  case kColumnInstance:
+    return items_.at(item).instance;
+  case kColumnMessage:
+    return items_.at(item).message;
+  case kColumnCreatedOn:
+    return items_.at(item).created_on;
+  default:
+    return wxString("");
+  }
+}
+
+wxListItemAttr* RennyDebugListCtrl::OnGetItemAttr(long item) const {
+  const wxString& level = items_.at(item).level;
+  if (level == str_log_levels[RennyDebug::kLogLevelInfo]) {
+    return &attr_info_;
+  }
+  if (level == str_log_levels[RennyDebug::kLogLevelWarning]) {
+    return &attr_warning_;
+  }
+  if (level == str_log_levels[RennyDebug::kLogLevelError]) {
+    return &attr_error_;
+  }
+  return &attr_debug_;
+}
+
+
+/*!
+ * @class RennyStatsListCtrl
+ * @brief Shows PerfCounters next to the log, refreshed twice a second.
+ *
+ * Totals and rates are those of the last refresh interval.
+ */
+class RennyStatsListCtrl : public wxListCtrl {
+
+public:
+  RennyStatsListCtrl(wxWindow* parent);
+
+protected:
+  wxString OnGetItemText(long item, long column) const;
+  void OnTimer(wxTimerEvent& event);
+
+private:
+  wxTimer timer_;
+  PerfCounters::Snapshot last_;
+  std::vector<PerfCounters::Row> rows_;
+};
+
+
+RennyStatsListCtrl::RennyStatsListCtrl(wxWindow *parent)
+  : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxSize(336, -1), wxLC_REPORT | wxLC_VIRTUAL),
+    timer_(this), last_(PerfCounters::Read())
+{
+  InsertColumn(0, wxT("Counter"), wxLIST_FORMAT_LEFT, 144);
+  InsertColumn(1, wxT("Total"), wxLIST_FORMAT_RIGHT, 96);
+  InsertColumn(2, wxT("Rate"), wxLIST_FORMAT_RIGHT, 96);
+  Bind(wxEVT_TIMER, &RennyStatsListCtrl::OnTimer, this);
+  timer_.Start(500);
+}
+
+wxString RennyStatsListCtrl::OnGetItemText(long item, long column) const {
+  const PerfCounters::Row& row = rows_.at(item);
+  switch (column) {
+  case 0:
+    return wxString(row.name);
+  case 1:
+    return wxString(row.total);
+  case 2:
+    return wxString(row.rate);
+  default:
+    return wxString("");
+  }
+}
+
+void RennyStatsListCtrl::OnTimer(wxTimerEvent&) {
+  const PerfCounters::Snapshot now = PerfCounters::Read();
+  rows_ = PerfCounters::Rows(now, last_);
+  last_ = now;
+  SetItemCount(rows_.size());
+  Refresh();
+}
+
+
+RennyDebug::RennyDebug(wxWindow* parent)
+  : frame_(new wxFrame(parent, wxID_ANY, wxT("Renny Debug Window"), wxDefaultPosition, wxSize(1360, 768))),
+    log_file_("rennypsf_log.txt", wxFile::write) {
+
+  wxBoxSizer* horz_sizer = new wxBoxSizer(wxHORIZONTAL);
+
+  list_ctrl_ = new RennyDebugListCtrl(frame_);
+  horz_sizer->Add(list_ctrl_, 1, wxEXPAND);
+  stats_ctrl_ = new RennyStatsListCtrl(frame_);
+  horz_sizer->Add(stats_ctrl_, 0, wxEXPAND);
+  frame_->SetSizer(horz_sizer);
+
+  frame_->Bind(wxEVT_CLOSE_WINDOW, &RennyDebug::OnClose, this);
+}
+
+RennyDebug::~RennyDebug() {
+  if (instance_ != nullptr) {
+    delete instance_;
+  }
+  log_file_.Close();
+}
+
+RennyDebug* RennyDebug::instance_ = nullptr;
+
+RennyDebug* RennyDebug::Instance() {
+  return instance_;
+}
+
+void RennyDebug::CreateWindow(wxWindow* parent) {
+  if (instance_ == nullptr) {
+    instance_ = new RennyDebug(parent);
+  } else if (instance_->frame_ == nullptr) {
+    instance_->~RennyDebug();
+    instance_ = new(instance_) RennyDebug(parent);
+  }
+}
+
+void RennyDebug::DestroyWindow() {
+  if (instance_ != nullptr && instance_->frame_ != nullptr) {
+    instance_->frame_->Destroy();
+  }
+}
+
+bool RennyDebug::IsWindowCreated() const {
+  return frame_ != nullptr;
+}
+
+void RennyDebug::ShowWindow() {
+  if (frame_) {
+    frame_->Show(true);
+  }
+}
+
+void RennyDebug::HideWindow() {
+  if (frame_) {
+    frame_->Hide();
+  }
+}
+
+void RennyDebug::OnClose(wxCloseEvent &event) {
+  if (event.CanVeto() == false) {
+    frame_->Destroy();
+  } else {
+    frame_->Hide();
+  }
+}
+
+
+void RennyDebug::Log(LogLevel log_level, const wxString& instance_name, const wxString& msg,
+                     const wxString& created_on) {
+  rennyAssert(log_level < kLogLevelMax);
+  const wxString& str_log_level = str_log_levels[log_level];
+
+  wxString str_print;
+  str_print.sprintf(wxT("[%s] %s: %s"), str_log_level, instance_name, msg);
+
+  if (frame_ != nullptr && list_ctrl_ != nullptr) {
+    list_ctrl_->Log(str_log_level, instance_name, msg, created_on);
+  } else {
+    if (kLogLevelWarning <= log_level) {
+      wxMessageOutputStderr().Printf(str_print);
+    } else {
+      wxMessageOutputDebug().Printf(str_print);
+    }
+  }
+  if (log_file_.IsOpened()) {
+    log_file_.Write(str_print);
+    log_file_.Write(wxT("\n"));
+  }
+}
+
+
+static_assert(RENNY_LOG_LEVEL_DEBUG == RennyDebug::kLogLevelDebug &&
+              RENNY_LOG_LEVEL_INFO == RennyDebug::kLogLevelInfo &&
+              RENNY_LOG_LEVEL_WARNING == RennyDebug::kLogLevelWarning &&
+              RENNY_LOG_LEVEL_ERROR == RennyDebug::kLogLevelError,
+              "log levels must match RennyDebug::LogLevel");
+
+
+void RennyDebug::LogSink(int level, const char* instance_name, const char* message, time_t created_on) {
+  RennyDebug* instance = Instance();
+  if (instance != nullptr) {
+    instance->Log(static_cast<LogLevel>(level), wxString::FromUTF8(instance_name),
+                  wxString::FromUTF8(message), wxDateTime(created_on).Format());
+  }
+}
+
+
+extern "C" {
+
+void rennyCreateDebugWindow(wxWindow* parent) {
+  RennyDebug::CreateWindow(parent);
+  rennySetLogSink(&RennyDebug::LogSink);
+}
+
+void rennyDestroyDebugWindow() {
+  rennyFlushLog();
+  RennyDebug::DestroyWindow();
+}
+
+void rennyShowDebugWindow() {
+  RennyDebug::Instance()->ShowWindow();
+}
+
+void rennyHideDebugWindow() {
+  RennyDebug::Instance()->HideWindow();
+}
+
+}
@@ -1,17 +1,40 @@
 #include "psf/psf.h"
 #include "psf/psx/psx.h"
+#include "psf/psx/profiler.h"
 #include "psf/spu/spu.h"
+#include "psf/psflog.h"
 #include "common/debug.h"
+#include "common/perfcounters.h"
+#include "common/voicefeed.h"
 
-#include <wx/file.h>
-#include <wx/filename.h>
-#include <wx/wfstream.h>
-#include <wx/zstream.h>
-#include <wx/hashmap.h>
+#include <cstdio>
+
+
+namespace {
+
+//! Times a stretch of emulation and counts the instructions and cycles run.
+class EmulationScope {
+public:
+  explicit EmulationScope(psx::PSX* psx)
+    : psx_(psx), timer_(PerfCounters::kInterpreterTime),
+      instructions_(psx->R3000a().instruction_count()), cycles_(psx->RCnt().cycle32()) {}
+  ~EmulationScope() {
+    PerfCounters::Add(PerfCounters::kInstructions, psx_->R3000a().instruction_count() - instructions_);
+    PerfCounters::Add(PerfCounters::kCycles, psx_->RCnt().cycle32() - cycles_);
+  }
+
+private:
+  psx::PSX* const psx_;
+  PerfTimer timer_;
+  const uint64_t instructions_;
+  const unsigned int cycles_;
+};
+
+}   // namespace
 
 
 PSF::PSF(uint32_t version)
-  : psx_(new psx::PSX(version)) {
+  : psx_(new psx::PSX(version)), profile_interval_(psx::mips::Profiler::kDefaultInterval) {
 }
 
 
@@ -39,8 +62,6 @@ void PSF::Reset()
 }
 
 
-#include "app.h"
-
 // deprecated
 bool PSF::DoPlay()
 {
@@ -59,11 +80,29 @@ bool PSF::DoStop()
 }
 
 bool PSF::Open(SoundBlock* block) {
+  psx_->Spu().EnableAsync(IsSynchronized() == false);
   psx_->Reset();
   psx_->Bios().Init();
-  block->ChangeChannelCount(24); // TODO: 24 or 48
+  block->ChangeChannelCount(psx_->Spu().core_count() * 24);
+  for (unsigned int ch = 0; ch < block->channel_count(); ch++) {
+    block->Ch(ch).set_env_max(0x7fffffff);    // for PublishVoices()
+  }
   block->EnableReverb();
   psx_->Spu().set_output(block);
+  psx_->Spu().set_loop_detector(loop_detector_);
+  if (capture_path_.empty() == false) {
+    capture_.reset(new SPULogWriter);
+    if (capture_->Open(capture_path_, psx_->version(), psx_->Spu().GetCurrentSamplingRate())) {
+      psx_->Spu().set_log_writer(capture_.get());
+    } else {
+      capture_.reset();
+    }
+  }
+  if (profile_path_.empty() == false) {
+    profiler_.reset(new psx::mips::Profiler(psx_, profile_interval_));
+    profiler_->Attach();
+  }
+  EmulationScope scope(psx_);
   do {
     psx_->R3000a().Execute(&psx_->Interp(), false);
   } while (psx_->RCnt().cycle32() < (psx::PSXCLK / psx_->Spu().GetCurrentSamplingRate()));
@@ -71,17 +110,52 @@ bool PSF::Open(SoundBlock* block) {
 }
 
 bool PSF::Close() {
+  if (capture_ != nullptr) {
+    psx_->Spu().set_log_writer(nullptr);
+    capture_->Close(psx_->Spu().sample_count());
+    capture_.reset();
+  }
+  if (profiler_ != nullptr) {
+    profiler_->Detach();
+    const std::string report(profiler_->Report());
+    std::FILE* const fp = std::fopen(profile_path_.c_str(), "w");
+    bool written = (fp != nullptr && std::fwrite(report.data(), 1, report.size(), fp) == report.size());
+    if (fp != nullptr && std::fclose(fp) != 0) written = false;
+    if (written == false) {
+      rennyLogWarning("PSF", "Failed to write the profile to '%s'.", profile_path_.c_str());
+    }
+    profiler_.reset();
+  }
   psx_->Interp().Shutdown();
   psx_->Spu().Shutdown();
+  psx_->Spu().set_loop_detector(nullptr);
   psx_->Mem().Reset();
   return true;
 }
 
 bool PSF::DoAdvance(SoundBlock* dest) {
   psx_->Spu().set_output(dest);
+  EmulationScope scope(psx_);
   do {
     psx_->R3000a().Execute(&psx_->Interp(), false);
   } while (dest->sample_length() == 0);
+  if (voice_feed_ != nullptr && voice_feed_->Meter(*dest)) {
+    psx_->Spu().PublishVoices(*dest, voice_feed_);
+  }
+  return true;
+}
+
+bool PSF::StartCapture(const std::string& path) {
+  capture_path_ = path;
+  return true;
+}
+
+bool PSF::StartProfile(const std::string& path, unsigned int interval) {
+  if (interval == 0) {
+    return false;
+  }
+  profile_path_ = path;
+  profile_interval_ = interval;
   return true;
 }
 
@@ -108,6 +182,16 @@ void PSF1::PSXMemCpy(PSXAddr dest, void *src, int length) {
 }
 
 
+void* PSF1::PSXMemPtr(PSXAddr dest, uint32_t* available) {
+  return psx_->UserMemory(dest, available);
+}
+
+
+bool PSF1::PSXMapImage(int image_fd) {
+  return psx_->Mem().MapUserImage(image_fd);
+}
+
+
 
 PSF2::PSF2(PSF2File* psf2irx)
   : PSF(2) {
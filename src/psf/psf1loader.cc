@@ -1,27 +1,34 @@
 #include "psf/psfloader.h"
 #include "psf/psf.h"
 #include "common/debug.h"
-#include <wx/string.h>
-#include <wx/scopedarray.h>
-#include <wx/wfstream.h>
-#include <wx/txtstrm.h>
-#include <wx/zstream.h>
-#include <wx/filename.h>
-#include <wx/regex.h>
+#include "common/filepath.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
-PSFLoader::PSFLoader(int fd, const wxString &filename)
-  : file_(fd), path_(filename),
+
+PSFLoader::PSFLoader(int fd, const std::string &filename)
+  : fd_(fd), map_(new MappedFile), path_(filename),
     reserved_area_len_(0), binary_len_(0), binary_crc32_(0),
-    reserved_area_ofs_(0), binary_ofs_(0) {
+    reserved_area_ofs_(0), binary_ofs_(0), is_library_(false) {
 }
 
 
-wxFile& PSFLoader::file() {
-  return file_;
+PSFLoader::~PSFLoader() {
+  for (std::vector<PSFLoader*>::iterator it = psflibs_.begin(); it != psflibs_.end(); ++it) {
+    delete *it;
+  }
+  if (0 <= fd_) ::close(fd_);
 }
 
-const wxString& PSFLoader::path() const {
+
+const std::string& PSFLoader::path() const {
   return path_;
 }
 
@@ -46,63 +53,130 @@ uint32_t PSFLoader::binary_ofs() const {
 }
 
 
-wxVector<PSFLoader*>::iterator PSFLoader::psflib_begin() {
+std::vector<PSFLoader*>::iterator PSFLoader::psflib_begin() {
   return psflibs_.begin();
 }
 
-wxVector<PSFLoader*>::const_iterator PSFLoader::psflib_begin() const {
+std::vector<PSFLoader*>::const_iterator PSFLoader::psflib_begin() const {
   return psflibs_.begin();
 }
 
-wxVector<PSFLoader*>::const_iterator PSFLoader::psflib_end() const {
+std::vector<PSFLoader*>::const_iterator PSFLoader::psflib_end() const {
   return psflibs_.end();
 }
 
 
-SoundInfo* PSFLoader::LoadInfo() {
-  if (ref_info_ != nullptr) {
-    return ref_info_;
-  }
-
-  wxFileInputStream fs(file_);
-  fs.SeekI(4, wxFromStart);
-
-  fs.Read(&reserved_area_len_, 4);
-  fs.Read(&binary_len_, 4);
-  fs.Read(&binary_crc32_, 4);
-  reserved_area_ofs_ = fs.TellI();
-  fs.SeekI(reserved_area_len_, wxFromCurrent);
-  binary_ofs_ = fs.TellI();
-  fs.SeekI(binary_len_, wxFromCurrent);
-
-  SoundInfo* info = new SoundInfo();
-  if (fs.Eof() == false) {
-    char strTAG[5];
-    fs.Read(strTAG, 5);
-    if (::memcmp(strTAG, "[TAG]", 5) == 0) {  // strTAG == "[TAG]"
-      wxTextInputStream ts(fs, wxT("\n"));
-      wxRegEx re("^([^=\\s]+)\\s*=\\s*(.*)$");
-      rennyAssert(re.IsValid());
-      SoundInfo::Tag tag;
-      while (fs.Eof() == false) {
-        wxString process_text;
-        ts >> process_text;
-        while (re.Matches(process_text)) {
-          size_t start, len;
-          re.GetMatch(&start, &len, 0);
-          wxString k(re.GetMatch(process_text, 1));
-          wxString v(re.GetMatch(process_text, 2));
-          tag[k] = v;
-          rennyLogDebug("PSFLoader", "[TAG] %s = %s", (const char*)k, (const char*)v);
-
-          process_text = process_text.Mid(start + len);
-        }
+namespace {
+
+inline bool IsTagSpace(char c) {
+  return static_cast<unsigned char>(c) <= 0x20;
+}
+
+bool IsUTF8(const char* begin, const char* end) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(begin);
+  const unsigned char* const q = reinterpret_cast<const unsigned char*>(end);
+  while (p < q) {
+    int trail = 0;
+    if (*p < 0x80) trail = 0;
+    else if ((*p & 0xe0) == 0xc0 && 0xc2 <= *p) trail = 1;
+    else if ((*p & 0xf0) == 0xe0) trail = 2;
+    else if ((*p & 0xf8) == 0xf0 && *p <= 0xf4) trail = 3;
+    else return false;
+    if (q - p <= trail) return false;
+    for (int i = 1; i <= trail; i++) {
+      if ((p[i] & 0xc0) != 0x80) return false;
+    }
+    p += trail + 1;
+  }
+  return true;
+}
+
+// Tags are UTF-8 if they say so, and mostly ISO-8859-1 otherwise.
+std::string TagString(const char* begin, const char* end) {
+  if (IsUTF8(begin, end)) {
+    return std::string(begin, end);
+  }
+  std::string s;
+  s.reserve(2 * (end - begin));
+  for (const char* p = begin; p < end; ++p) {
+    const unsigned char c = *p;
+    if (c < 0x80) {
+      s.push_back(c);
+    } else {
+      s.push_back(0xc0 | (c >> 6));
+      s.push_back(0x80 | (c & 0x3f));
+    }
+  }
+  return s;
+}
+
+}   // namespace
+
+
+void PSFLoader::ParseTags(const char* begin, const char* end, SoundInfo::Tag* tag) {
+  rennyAssert(tag != nullptr);
+  const char* p = begin;
+  while (p < end) {
+    const char* eol = static_cast<const char*>(::memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    const char* eq = static_cast<const char*>(::memchr(p, '=', eol - p));
+    if (eq != nullptr) {
+      const char* key_begin = p;
+      const char* key_end = eq;
+      while (key_begin < key_end && IsTagSpace(*key_begin)) ++key_begin;
+      while (key_begin < key_end && IsTagSpace(key_end[-1])) --key_end;
+      const char* value_begin = eq + 1;
+      const char* value_end = eol;
+      while (value_begin < value_end && IsTagSpace(*value_begin)) ++value_begin;
+      while (value_begin < value_end && IsTagSpace(value_end[-1])) --value_end;
+      if (key_begin < key_end) {
+        const std::string k(TagString(key_begin, key_end));
+        const std::string v(TagString(value_begin, value_end));
+        (*tag)[k] = v;
+        rennyLogDebug("PSFLoader", "[TAG] %s = %s", k.c_str(), v.c_str());
       }
-      info->set_tags(tag);
     }
+    p = eol + 1;
+  }
+}
+
+
+SoundInfo* PSFLoader::LoadInfo() {
+  if (info_ != nullptr) {
+    return info_.get();
+  }
+
+  info_.reset(new SoundInfo());
+  SoundInfo* const info = info_.get();
+
+  if (map_->IsMapped() == false && map_->Map(fd_) == false) {
+    rennyLogError("PSFLoader", "Failed to map '%s'.", path_.c_str());
+    return info;
+  }
+  if (map_->Contains(0, 16) == false) {
+    rennyLogError("PSFLoader", "'%s' is too short.", path_.c_str());
+    return info;
+  }
+  reserved_area_len_ = map_->GetLE32(4);
+  binary_len_ = map_->GetLE32(8);
+  binary_crc32_ = map_->GetLE32(12);
+  reserved_area_ofs_ = 16;
+  binary_ofs_ = reserved_area_ofs_ + reserved_area_len_;
+  if (map_->Contains(reserved_area_ofs_, reserved_area_len_) == false ||
+      map_->Contains(binary_ofs_, binary_len_) == false) {
+    rennyLogError("PSFLoader", "'%s' is truncated.", path_.c_str());
+    return info;
+  }
+
+  const size_t tag_ofs = binary_ofs_ + binary_len_;
+  if (map_->Contains(tag_ofs, 5) && ::memcmp(map_->data() + tag_ofs, "[TAG]", 5) == 0) {
+    const char* const tag_begin = reinterpret_cast<const char*>(map_->data() + tag_ofs + 5);
+    const char* const tag_end = reinterpret_cast<const char*>(map_->data() + map_->size());
+    SoundInfo::Tag tag;
+    ParseTags(tag_begin, tag_end, &tag);
+    info->set_tags(tag);
   }
 
-  ref_info_ = info;
   return info;
 }
 
@@ -111,26 +185,24 @@ bool PSFLoader::LoadLibraries() {
 
   const SoundInfo::Tag& tags = LoadInfo()->others();
 
-  wxString directory, filename, ext;
-  wxFileName::SplitPath(path_, &directory, &filename, &ext);
+  const std::string directory(FilePath::Directory(path_));
 
   for (int i = 1; i < 10; i++) {
-    wxString _libN;
+    char _libN[8];
     if (i <= 1) {
-      _libN.assign("_lib");
+      std::strcpy(_libN, "_lib");
     } else {
-      _libN.sprintf("_lib%d", i);
+      std::snprintf(_libN, sizeof(_libN), "_lib%d", i);
     }
     SoundInfo::Tag::const_iterator it = tags.find(_libN);
     if (it == tags.end()) break;
 
-    wxString lib_filename(directory);
-    lib_filename.Append(wxFileName::GetPathSeparator());
-    lib_filename.Append(it->second);
+    const std::string lib_filename(FilePath::Join(directory, it->second));
 
     PSFLoader* loader = dynamic_cast<PSFLoader*>(SoundLoader::Instance(lib_filename));
     if (loader == nullptr) continue;
 
+    loader->is_library_ = true;
     psflibs_.push_back(loader);
   }
 
@@ -138,18 +210,18 @@ bool PSFLoader::LoadLibraries() {
 }
 
 
-PSF1Loader::PSF1Loader(int fd, const wxString &filename)
+PSF1Loader::PSF1Loader(int fd, const std::string &filename)
   : PSFLoader(fd, filename) {
 }
 
 
-PSF1Loader* PSF1Loader::Instance(int fd, const wxString &filename) {
+PSF1Loader* PSF1Loader::Instance(int fd, const std::string &filename) {
   return new PSF1Loader(fd, filename);
 }
 
 
 bool PSF1Loader::GetInitRegs(uint32_t *pc0, uint32_t *gp0, uint32_t *sp0) const {
-  const wxVector<PSFLoader*>::const_iterator it = psflib_begin();
+  const std::vector<PSFLoader*>::const_iterator it = psflib_begin();
   if (it != psflib_end()) {
     const PSF1Loader* const loader = dynamic_cast<PSF1Loader*>(*it);
     if (loader != nullptr) {
@@ -164,31 +236,71 @@ bool PSF1Loader::GetInitRegs(uint32_t *pc0, uint32_t *gp0, uint32_t *sp0) const
 }
 
 
-bool PSF1Loader::LoadEXE() {
+Inflater* PSF1Loader::OpenEXE(PSXEXEHeader* header) const {
+  if (binary_len() == 0 || map().Contains(binary_ofs(), binary_len()) == false) {
+    rennyLogError("PSF1Loader", "'%s' has no program.", path().c_str());
+    return nullptr;
+  }
+  std::unique_ptr<Inflater> inflater(new Inflater(map().data() + binary_ofs(), binary_len()));
+  if (inflater->Read(header, sizeof(PSXEXEHeader)) != sizeof(PSXEXEHeader)) {
+    rennyLogError("PSF1Loader", "Failed to inflate the header of '%s'.", path().c_str());
+    return nullptr;
+  }
+  if (::memcmp(header->signature, "PS-X EXE", 8) != 0) /* header.signature <> "PS-X EXE" */ {
+    const std::string str_sign(header->signature, 8);
+    rennyLogError("PSF1Loader", "Uncompressed binary is not PS-X EXE! (%s)", str_sign.c_str());
+    return nullptr;
+  }
+  inflater->Skip(0x800 - sizeof(PSXEXEHeader));
+  return inflater.release();
+}
 
-  wxFileInputStream fs(file());
-  fs.SeekI(binary_ofs());
-  wxZlibInputStream zlib_stream(fs);
 
-  wxScopedPtr<PSXEXEHeader> header(new PSXEXEHeader);
-  zlib_stream.Read(header.get(), sizeof(PSXEXEHeader));
-  zlib_stream.SeekI(0x800 - sizeof(PSXEXEHeader), wxFromCurrent);
+PSFLibraryCache::Image PSF1Loader::LoadImage() const {
+  PSFLibraryCache* const cache = PSFLibraryCache::GetInstance();
+  PSFLibraryCache::Image image(cache->Find(path(), binary_crc32()));
+  if (image != nullptr) {
+    return image;
+  }
 
-  if (::memcmp(header->signature, "PS-X EXE", 8) != 0) /* header.signature <> "PS-X EXE" */ {
-    const wxString str_sign(header->signature, 8);
-    rennyLogError("PSF1Loader", "Uncompressed binary is not PS-X EXE! (%s)", static_cast<const char*>(str_sign));
-    return false;
+  PSXEXEHeader header;
+  std::unique_ptr<Inflater> inflater(OpenEXE(&header));
+  if (inflater.get() == nullptr) {
+    return image;
   }
-  header.swap(header_);
+  const uint32_t text_ofs = header.text_addr & 0x1fffff;
+  const uint32_t text_size = std::min(header.text_size, 0x200000 - text_ofs);
+  std::vector<uint8_t> buffer(0x800 + text_size);
+  ::memcpy(buffer.data(), &header, sizeof(PSXEXEHeader));
+  buffer.resize(0x800 + inflater->Read(buffer.data() + 0x800, text_size));
+  return cache->Insert(path(), binary_crc32(), &buffer);
+}
 
-  wxScopedArray<char> text(new char[0x200000]);
-  zlib_stream.Read(text.get(), 0x200000);
-  text.swap(text_);
+
+bool PSF1Loader::LoadEXE() {
+
+  std::unique_ptr<PSXEXEHeader> header(new PSXEXEHeader);
+  if (is_library()) {
+    // libraries are shared by every track of a set, so inflate them once
+    PSFLibraryCache::Image image(LoadImage());
+    if (image == nullptr) {
+      return false;
+    }
+    ::memcpy(header.get(), image->data(), sizeof(PSXEXEHeader));
+    image_ = image;
+  } else {
+    std::unique_ptr<Inflater> text(OpenEXE(header.get()));
+    if (text.get() == nullptr) {
+      return false;
+    }
+    text.swap(text_);
+  }
+  header.swap(header_);
 
   LoadLibraries();
 
-  wxVector<PSFLoader*>::iterator lib_it = psflib_begin();
-  wxVector<PSFLoader*>::const_iterator lib_it_end = psflib_end();
+  std::vector<PSFLoader*>::iterator lib_it = psflib_begin();
+  std::vector<PSFLoader*>::const_iterator lib_it_end = psflib_end();
   for (; lib_it != lib_it_end; ++lib_it) {
     PSF1Loader* loader = dynamic_cast<PSF1Loader*>(*lib_it);
     if (loader != nullptr) {
@@ -202,16 +314,97 @@ bool PSF1Loader::LoadEXE() {
 
 
 bool PSF1Loader::LoadText(PSF1* p_psf) {
-  if (p_psf == nullptr || header_ == nullptr || text_ == nullptr) {
+  if (p_psf == nullptr || header_ == nullptr) {
     return false;
   }
+  uint8_t* const ram = static_cast<uint8_t*>(p_psf->PSXMemPtr(0, nullptr));
+
+  if (psflib_begin() != psflib_end()) {
+    const PSFLibraryCache::RAMImage image(LoadLibraryRAMImage());
+    if (image != nullptr && p_psf->PSXMapImage(image->fd())) {
+      // the libraries are in place; only the pages below get copied
+      return WriteOwnText(ram);
+    }
+  }
+  return WriteText(ram);
+}
+
+
+PSFLibraryCache::RAMImage PSF1Loader::LoadLibraryRAMImage() const {
+  std::string key("ram:");
+  AppendLibraryKeys(&key);
+
+  PSFLibraryCache* const cache = PSFLibraryCache::GetInstance();
+  PSFLibraryCache::RAMImage image(cache->FindRAMImage(key));
+  if (image != nullptr) {
+    return image;
+  }
+
+  std::vector<uint8_t> ram(psx::Memory::kUserMemorySize);
+  for (std::vector<PSFLoader*>::const_iterator it = psflib_begin(); it != psflib_end(); ++it) {
+    const PSF1Loader* const loader = dynamic_cast<const PSF1Loader*>(*it);
+    rennyAssert(loader != nullptr);
+    if (loader->WriteText(ram.data()) == false) {
+      return image;
+    }
+  }
+  image = PSFRAMImage::Create(ram.data(), ram.size());
+  if (image == nullptr) {
+    return image;
+  }
+  return cache->InsertRAMImage(key, image);
+}
+
+
+void PSF1Loader::AppendLibraryKeys(std::string* key) const {
+  for (std::vector<PSFLoader*>::const_iterator it = psflib_begin(); it != psflib_end(); ++it) {
+    const PSF1Loader* const loader = dynamic_cast<const PSF1Loader*>(*it);
+    rennyAssert(loader != nullptr);
+    loader->AppendLibraryKeys(key);
+    key->append(PSFLibraryCache::Key(loader->path(), loader->binary_crc32()));
+    key->push_back('|');
+  }
+}
+
 
-  for (wxVector<PSFLoader*>::iterator it = psflib_begin(); it != psflib_end(); ++it) {
-    PSF1Loader* const loader = dynamic_cast<PSF1Loader*>(*it);
+bool PSF1Loader::WriteText(uint8_t* ram) const {
+  for (std::vector<PSFLoader*>::const_iterator it = psflib_begin(); it != psflib_end(); ++it) {
+    const PSF1Loader* const loader = dynamic_cast<const PSF1Loader*>(*it);
     rennyAssert(loader != nullptr);
-    loader->LoadText(p_psf);
+    loader->WriteText(ram);
+  }
+  return WriteOwnText(ram);
+}
+
+
+bool PSF1Loader::WriteOwnText(uint8_t* ram) const {
+  if (header_ == nullptr) {
+    return false;
+  }
+  const uint32_t text_ofs = header_->text_addr & 0x1fffff;
+  uint8_t* const dest = ram + text_ofs;
+  const size_t available = psx::Memory::kUserMemorySize - text_ofs;
+
+  if (image_ != nullptr) {
+    const size_t length = std::min(available, image_->size() - 0x800);
+    ::memcpy(dest, image_->data() + 0x800, length);
+    return true;
+  }
+
+  std::unique_ptr<Inflater> text;
+  text.swap(text_);
+  if (text.get() == nullptr) {
+    // the stream has already been poured into another PSF1
+    PSXEXEHeader header;
+    text.reset(OpenEXE(&header));
+    if (text.get() == nullptr) return false;
+  }
+  const size_t length = std::min(static_cast<size_t>(header_->text_size), available);
+  const size_t inflated = text->Read(dest, length);
+  if (inflated < length) {
+    rennyLogWarning("PSF1Loader", "'%s' has only %d of %d bytes of text.",
+                    path().c_str(), static_cast<int>(inflated), static_cast<int>(length));
   }
-  p_psf->PSXMemCpy(header_->text_addr, text_.get(), header_->text_size);
   return true;
 }
 
@@ -219,22 +412,18 @@ bool PSF1Loader::LoadText(PSF1* p_psf) {
 PSF1* PSF1Loader::LoadDataEx() {
 
   LoadInfo();
-  if (ref_data_ != nullptr) {
-    // TODO: support reload
-    return ref_data_;
+  if (header_ == nullptr) {
+    // later PSF1s inflate the program again in LoadText()
+    LoadEXE();
   }
 
-  LoadEXE();
-
   uint32_t pc0(0), gp0(0), sp0(0);
   GetInitRegs(&pc0, &gp0, &sp0);
 
   PSF1* p_psf = new PSF1(pc0, gp0, sp0);
   LoadText(p_psf);
 
-  rennyLogDebug("PSF1Loader", "PSF File '%s' is loaded.", static_cast<const char*>(path()));
-
-  ref_data_ = p_psf;
+  rennyLogDebug("PSF1Loader", "PSF File '%s' is loaded.", path().c_str());
   return p_psf;
 }
 
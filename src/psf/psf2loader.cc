@@ -1,8 +1,29 @@
 #include "psf/psfloader.h"
 #include "psf/psf.h"
 #include "common/debug.h"
-#include <wx/wfstream.h>
-#include <wx/zstream.h>
+#include "common/taskpool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+
+
+namespace {
+
+bool EqualsNoCase(const std::string& lhs, const std::string& rhs) {
+  if (lhs.size() != rhs.size()) return false;
+  for (size_t i = 0; i < lhs.size(); i++) {
+    char l = lhs[i], r = rhs[i];
+    if ('A' <= l && l <= 'Z') l += 'a' - 'A';
+    if ('A' <= r && r <= 'Z') r += 'a' - 'A';
+    if (l != r) return false;
+  }
+  return true;
+}
+
+}   // namespace
+
 
 ////////////////////////////////////////////////////////////////////////
 /// PSF2 Entry Class
@@ -21,29 +42,38 @@ PSF2Directory* PSF2Entry::Parent() {
   return parent_;
 }
 
-const wxString& PSF2Entry::GetName() const {
+const std::string& PSF2Entry::GetName() const {
   return name_;
 }
 
-const wxString PSF2Entry::GetFullPath() const {
+const std::string PSF2Entry::GetFullPath() const {
   if (IsRoot()) return name_;
   return parent_->GetFullPath() + '/' + name_;
 }
 
 
-PSF2Entry* PSF2Entry::Find(const wxString &path, bool case_insensitive) {
+PSF2Entry* PSF2Entry::Find(const std::string &path, bool case_insensitive) {
+
+  if (case_insensitive && IsRoot()) {
+    const PSF2Directory* const root = directory();
+    if (root != nullptr && root->index_.empty() == false) {
+      auto it = root->index_.find(PSF2Directory::FoldPath(path));
+      return it != root->index_.end() ? it->second : nullptr;
+    }
+  }
 
-  wxString next;
-  wxString curr = path.BeforeFirst('/', &next);
+  const size_t slash = path.find('/');
+  const std::string curr(path.substr(0, slash));
+  const std::string next((slash != std::string::npos) ? path.substr(slash + 1) : std::string());
 
   if (IsFile() == true) {
     if (case_insensitive) {
-      if (curr.CmpNoCase(name_)) {
+      if (EqualsNoCase(curr, name_) == false) {
         return nullptr;
       }
       return this;
     }
-    if (curr.Cmp(name_)) {
+    if (curr != name_) {
       return nullptr;
     }
     return this;
@@ -51,10 +81,10 @@ PSF2Entry* PSF2Entry::Find(const wxString &path, bool case_insensitive) {
 
   if (IsRoot() == false) {
     if (case_insensitive) {
-      if (curr.CmpNoCase(name_)) {
+      if (EqualsNoCase(curr, name_) == false) {
         return nullptr;
       }
-    } else if (curr.Cmp(name_)) {
+    } else if (curr != name_) {
       return nullptr;
     }
     if (next.empty() == false) {
@@ -67,8 +97,8 @@ PSF2Entry* PSF2Entry::Find(const wxString &path, bool case_insensitive) {
     return nullptr;
   }
 
-  wxVector<PSF2Entry*>::iterator itr = dir->children_.begin();
-  const wxVector<PSF2Entry*>::iterator itrEnd = dir->children_.end();
+  std::vector<PSF2Entry*>::iterator itr = dir->children_.begin();
+  const std::vector<PSF2Entry*>::iterator itrEnd = dir->children_.end();
 
   while (itr != itrEnd) {
     PSF2Entry* ret;
@@ -99,19 +129,104 @@ PSF2Directory* PSF2Entry::GetRoot() {
 ////////////////////////////////////////////////////////////////////////
 
 
+namespace {
+
+// Files at least this large are inflated on several threads.
+const size_t kParallelInflateSize = 256 * 1024;
+
+// Each block of a PSF2 file is an independent zlib stream, and all but the
+// last one inflate to exactly block_size bytes.
+bool InflateBlocks(const MappedFile& map, size_t table_ofs, size_t block_size, std::vector<uint8_t>* dest) {
+  const size_t size = dest->size();
+  const size_t block_count = (size + block_size - 1) / block_size;
+  if (map.Contains(table_ofs, block_count * 4) == false) return false;
+
+  std::vector<size_t> offsets(block_count + 1);
+  offsets[0] = table_ofs + block_count * 4;
+  for (size_t i = 0; i < block_count; ++i) {
+    offsets[i + 1] = offsets[i] + map.GetLE32(table_ofs + i * 4);
+  }
+  if (map.Contains(offsets[0], offsets[block_count] - offsets[0]) == false) return false;
+
+  std::atomic<size_t> next_block(0);
+  std::atomic<bool> succeeded(true);
+  auto inflate_blocks = [&]() {
+    size_t i;
+    while ((i = next_block++) < block_count) {
+      const size_t expected = std::min(block_size, size - i * block_size);
+      uLongf length = expected;
+      const int ret = ::uncompress(dest->data() + i * block_size, &length,
+                                   map.data() + offsets[i], offsets[i + 1] - offsets[i]);
+      // a short block would leave the rest of it uninitialized
+      if (ret != Z_OK || length != expected) succeeded = false;
+    }
+  };
+
+  size_t task_count = 1;
+  if (kParallelInflateSize <= size) {
+    task_count = std::min<size_t>(block_count, TaskPool::Instance().worker_count() + 1);
+  }
+  TaskGroup tasks(TaskPool::kPriorityDecode);
+  for (size_t i = 1; i < task_count; ++i) {
+    tasks.Run(inflate_blocks);
+  }
+  inflate_blocks();
+  tasks.Wait();
+  return succeeded;
+}
+
+}   // namespace
+
+
 PSF2File::PSF2File(PSF2Directory *parent, const char *name)
-  : PSF2Entry(parent, name), data_(nullptr), size_(0) {}
+  : PSF2Entry(parent, name), size_(0), table_ofs_(0), block_size_(0) {}
+
 
+PSF2File::PSF2File(PSF2Directory *parent, const char *name,
+                   const std::shared_ptr<const MappedFile>& map, size_t table_ofs,
+                   size_t size, size_t block_size, const std::string& cache_key)
+  : PSF2Entry(parent, name), size_(size), map_(map),
+    table_ofs_(table_ofs), block_size_(block_size), cache_key_(cache_key) {}
 
-PSF2File::PSF2File(PSF2Directory *parent, const char *name, wxScopedArray<unsigned char>& data, int size)
-  : PSF2Entry(parent, name), data_(nullptr) {
-  data_.swap(data);
-  size_ = size;
+
+bool PSF2File::Load() const {
+  if (data_ != nullptr) return true;
+
+  PSFLibraryCache* const cache = PSFLibraryCache::GetInstance();
+  if (cache_key_.empty() == false) {
+    data_ = cache->Find(cache_key_);
+    if (data_ != nullptr) {
+      map_.reset();
+      return true;
+    }
+  }
+
+  std::vector<uint8_t> data(size_);
+  bool ret = true;
+  if (size_ > 0) {
+    if (map_ == nullptr || block_size_ == 0 || InflateBlocks(*map_, table_ofs_, block_size_, &data) == false) {
+      rennyLogError("PSF2File", "Failed to inflate psf2:%s", GetFullPath().c_str());
+      ret = false;
+    } else {
+      rennyLogDebug("PSF2File", "Loaded psf2:%s (file size: %d)",
+                    GetFullPath().c_str(), static_cast<int>(size_));
+    }
+  }
+  map_.reset();
+
+  if (ret && cache_key_.empty() == false) {
+    data_ = cache->Insert(cache_key_, &data);
+  } else {
+    // a broken file reads as zeros rather than failing on every access
+    data_.reset(new std::vector<uint8_t>(std::move(data)));
+  }
+  return ret;
 }
 
 
 const unsigned char* PSF2File::GetData() const {
-  return data_.get();
+  Load();
+  return data_->data();
 }
 
 
@@ -142,67 +257,71 @@ PSF2Directory::~PSF2Directory() {
 void PSF2Directory::AddEntry(PSF2Entry *entry) {
   if (entry->IsRoot()) return;
   children_.push_back(entry);
+  GetRoot()->index_.clear();
 }
 
 
-bool PSF2Directory::LoadFile(wxFileInputStream *stream, const char *filename, int uncompressed_size, int block_size) {
-
-  const int X = (uncompressed_size + block_size - 1) / block_size;
-
-  wxVector<int> usizes;
-  usizes.reserve(X);
-  int reserve_size = 0;
-  for (auto i = 0; i < X; ++i) {
-    int tmp;
-    stream->Read(&tmp, 4);
-    usizes.push_back(tmp);
-    reserve_size += tmp;
+std::string PSF2Directory::FoldPath(const std::string& path) {
+  std::string folded;
+  folded.reserve(path.size());
+  for (char c : path) {
+    if (c == '\\') c = '/';
+    if (c == '/' && (folded.empty() || folded.back() == '/')) continue;
+    if ('A' <= c && c <= 'Z') c += 'a' - 'A';
+    folded.push_back(c);
   }
+  if (folded.empty() == false && folded.back() == '/') folded.pop_back();
+  return folded;
+}
 
-  wxScopedArray<unsigned char> uncompressed_data(new unsigned char[reserve_size]);
-  int uncomp_offset = 0;
-  for (auto& usize : usizes) {
-    wxZlibInputStream zlib_stream(*stream);
-    zlib_stream.Read(&uncompressed_data[uncomp_offset], usize);
-    uncomp_offset += zlib_stream.LastRead();
-  }
-  uncompressed_size = uncomp_offset;
 
-  PSF2File* entry = new PSF2File(this, filename, uncompressed_data, uncompressed_size);
-  AddEntry(entry);
+void PSF2Directory::BuildIndex() {
+  rennyAssert(IsRoot());
+  index_.clear();
+  IndexEntries(std::string(), this);
+  rennyLogDebug("PSF2Directory", "Indexed %d entries.", static_cast<int>(index_.size()));
+}
 
-  rennyLogDebug("PSF2Directory", "Loaded psf2:%s (file size: %d)",
-                static_cast<const char*>(entry->GetFullPath()), uncompressed_size);
 
-  return true;
+void PSF2Directory::IndexEntries(const std::string& prefix, PSF2Directory* dir) {
+  for (PSF2Entry* const entry : dir->children_) {
+    const std::string path(prefix + FoldPath(entry->GetName()));
+    // the first entry wins, as it did when the tree was searched in order
+    index_.insert(std::make_pair(path, entry));
+    if (entry->directory() != nullptr) {
+      IndexEntries(path + "/", entry->directory());
+    }
+  }
 }
 
 
-bool PSF2Directory::LoadEntries(wxFileInputStream *stream, wxFileOffset offset) {
+bool PSF2Directory::LoadEntries(const std::shared_ptr<const MappedFile>& map, size_t base_ofs, size_t offset,
+                                const std::string& cache_prefix) {
 
-  rennyAssert(stream != nullptr);
-  const wxFileOffset base_offset = stream->TellI();
-  stream->SeekI(offset, wxFromCurrent);
-
-  int entry_num;
-  stream->Read(&entry_num, 4);
+  rennyAssert(map != nullptr);
+  const size_t kRecordSize = 48;
+  size_t ofs = base_ofs + offset;
+  if (map->Contains(ofs, 4) == false) {
+    rennyLogError("PSF2Directory", "The directory at 0x%x is out of the file.", static_cast<int>(ofs));
+    return false;
+  }
+  const uint32_t entry_num = map->GetLE32(ofs);
+  ofs += 4;
+  if (map->Contains(ofs, static_cast<size_t>(entry_num) * kRecordSize) == false) {
+    rennyLogError("PSF2Directory", "The directory at 0x%x is truncated.", static_cast<int>(ofs));
+    return false;
+  }
 
-  for (int i = 0; i < entry_num; i++) {
+  const std::string dir_path(GetFullPath());
+  for (uint32_t i = 0; i < entry_num; i++, ofs += kRecordSize) {
 
     char filename[37];
-    stream->Read(filename, 36);
+    ::memcpy(filename, map->data() + ofs, 36);
     filename[36] = '\0';
 
-    int child_offset;
-    stream->Read(&child_offset, 4);
-
-    int uncompressed_size;
-    stream->Read(&uncompressed_size, 4);
-
-    int block_size;
-    stream->Read(&block_size, 4);
-
-    const wxFileOffset curr_offset = stream->TellI();
+    const uint32_t child_offset = map->GetLE32(ofs + 36);
+    const uint32_t uncompressed_size = map->GetLE32(ofs + 40);
+    const uint32_t block_size = map->GetLE32(ofs + 44);
 
     if (uncompressed_size == 0 && block_size == 0) {
       if (child_offset == 0) {
@@ -211,18 +330,20 @@ bool PSF2Directory::LoadEntries(wxFileInputStream *stream, wxFileOffset offset)
         continue;
       }
       PSF2Directory* const entry = new PSF2Directory(this, filename);
-      stream->SeekI(base_offset, wxFromStart);
-      entry->LoadEntries(stream, child_offset);
-      stream->SeekI(curr_offset, wxFromStart);
+      entry->LoadEntries(map, base_ofs, child_offset, cache_prefix);
       AddEntry(entry);
       continue;
     }
-    stream->SeekI(base_offset + child_offset, wxFromStart);
-    LoadFile(stream, filename, uncompressed_size, block_size);
-    stream->SeekI(curr_offset, wxFromStart);
+
+    std::string cache_key;
+    if (cache_prefix.empty() == false) {
+      cache_key = cache_prefix + ":" + dir_path + "/" + filename;
+    }
+    PSF2File* const entry = new PSF2File(this, filename, map, base_ofs + child_offset,
+                                         uncompressed_size, block_size, cache_key);
+    AddEntry(entry);
   }
 
-  stream->SeekI(base_offset, wxFromStart);
   return true;
 }
 
@@ -232,42 +353,51 @@ bool PSF2Directory::LoadEntries(wxFileInputStream *stream, wxFileOffset offset)
 ////////////////////////////////////////////////////////////////////////
 
 
-PSF2Loader::PSF2Loader(int fd, const wxString &filename)
+PSF2Loader::PSF2Loader(int fd, const std::string &filename)
   : PSFLoader(fd, filename) {
 }
 
-PSF2Loader* PSF2Loader::Instance(int fd, const wxString &filename) {
+PSF2Loader* PSF2Loader::Instance(int fd, const std::string &filename) {
   return new PSF2Loader(fd, filename);
 }
 
 
+std::string PSF2Loader::CacheKey() const {
+  // PSF2 files have no program, so identify them by their filesystem
+  const uint32_t crc = ::crc32(0, map().data() + reserved_area_ofs(), reserved_area_len());
+  return PSFLibraryCache::Key(path(), crc);
+}
+
+
 bool PSF2Loader::LoadPSF2Entries(PSF2Directory *root) {
 
   rennyAssert(root->IsRoot());
-
-  wxFileInputStream stream(file());
-  stream.SeekI(reserved_area_ofs(), wxFromStart);
-  return root->LoadEntries(&stream, 0);
+  if (map().Contains(reserved_area_ofs(), reserved_area_len()) == false || reserved_area_len() < 4) {
+    rennyLogError("PSF2Loader", "'%s' has no filesystem.", path().c_str());
+    return false;
+  }
+  // only files of libraries are worth sharing between tracks
+  const std::string cache_prefix(is_library() ? CacheKey() : std::string());
+  return root->LoadEntries(shared_map(), reserved_area_ofs(), 0, cache_prefix);
 }
 
 
 PSF2* PSF2Loader::LoadDataEx() {
 
   LoadInfo();
-  if (ref_data_ != nullptr) {
-    // TODO: support reload
-    return ref_data_;
-  }
 
   PSF2Directory* root = new PSF2Directory(nullptr, "/");
   if (LoadPSF2Entries(root) == false) {
     return nullptr;
   }
 
-  LoadLibraries();
+  if (psflib_begin() == psflib_end()) {
+    // a later PSF2 gets a new tree of the same libraries
+    LoadLibraries();
+  }
 
-  wxVector<PSFLoader*>::iterator it = psflib_begin();
-  const wxVector<PSFLoader*>::const_iterator it_end = psflib_end();
+  std::vector<PSFLoader*>::iterator it = psflib_begin();
+  const std::vector<PSFLoader*>::const_iterator it_end = psflib_end();
   for (; it != it_end; ++it) {
     PSF2Loader* const loader = dynamic_cast<PSF2Loader*>(*it);
     if (loader != nullptr) {
@@ -276,7 +406,9 @@ PSF2* PSF2Loader::LoadDataEx() {
     }
   }
 
-  PSF2Entry* irx_entry = root->Find(wxT("psf2.irx"));
+  root->BuildIndex();
+
+  PSF2Entry* irx_entry = root->Find("psf2.irx");
   if (irx_entry == nullptr) {
     rennyLogError("PSF2Loader", "psf2.irx is not found.");
     return nullptr;
@@ -293,7 +425,6 @@ PSF2* PSF2Loader::LoadDataEx() {
     return nullptr;
   }
 
-  ref_data_ = p_psf;
   return p_psf;
 }
 
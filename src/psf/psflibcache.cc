@@ -0,0 +1,217 @@
+#include "psf/psflibcache.h"
+#include "common/debug.h"
+#include "common/filepath.h"
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PSF_USE_SHARED_RAM 1
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+#ifdef PSF_USE_SHARED_RAM
+int CreateSharedFile() {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+  const int fd = ::memfd_create("rennypsf-ram", MFD_CLOEXEC);
+  if (0 <= fd) return fd;
+#endif
+  char path[] = "/tmp/rennypsf-ram-XXXXXX";
+  const int tmp_fd = ::mkstemp(path);
+  if (0 <= tmp_fd) ::unlink(path);
+  return tmp_fd;
+}
+#endif
+
+}   // namespace
+
+
+std::shared_ptr<const PSFRAMImage> PSFRAMImage::Create(const uint8_t* ram, size_t size) {
+#ifdef PSF_USE_SHARED_RAM
+  const int fd = CreateSharedFile();
+  if (fd < 0) {
+    rennyLogWarning("PSFRAMImage", "Failed to create a shared-memory file.");
+    return std::shared_ptr<const PSFRAMImage>();
+  }
+  size_t written = 0;
+  while (written < size) {
+    const ssize_t n = ::write(fd, ram + written, size - written);
+    if (n <= 0) {
+      rennyLogWarning("PSFRAMImage", "Failed to write the RAM image.");
+      ::close(fd);
+      return std::shared_ptr<const PSFRAMImage>();
+    }
+    written += n;
+  }
+  return std::shared_ptr<const PSFRAMImage>(new PSFRAMImage(fd, size));
+#else
+  (void)ram;
+  (void)size;
+  return std::shared_ptr<const PSFRAMImage>();
+#endif
+}
+
+
+PSFRAMImage::~PSFRAMImage() {
+#ifdef PSF_USE_SHARED_RAM
+  // mappings made from the file stay valid after it is closed
+  ::close(fd_);
+#endif
+}
+
+
+PSFLibraryCache* PSFLibraryCache::GetInstance() {
+  static PSFLibraryCache instance;
+  return &instance;
+}
+
+
+PSFLibraryCache::PSFLibraryCache()
+  : budget_(kDefaultBudget), used_bytes_(0), hits_(0), misses_(0) {}
+
+
+std::string PSFLibraryCache::Key(const std::string& path, uint32_t crc32) {
+  char crc[16];
+  std::snprintf(crc, sizeof(crc), "#%08x", crc32);
+  return FilePath::Absolute(path) + crc;
+}
+
+
+PSFLibraryCache::Entry* PSFLibraryCache::Lookup(const std::string& key) {
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return &*it->second;
+}
+
+
+bool PSFLibraryCache::Store(const Entry& entry) {
+  if (budget_ < entry.size) {
+    return false;
+  }
+  Evict(budget_ - entry.size);
+  lru_.push_front(entry);
+  index_[entry.key] = lru_.begin();
+  used_bytes_ += entry.size;
+  rennyLogDebug("PSFLibraryCache", "Cached '%s' (%d bytes, %d bytes in use)",
+                entry.key.c_str(), static_cast<int>(entry.size), static_cast<int>(used_bytes_));
+  return true;
+}
+
+
+PSFLibraryCache::Image PSFLibraryCache::Find(const std::string& path, uint32_t crc32) {
+  return Find(Key(path, crc32));
+}
+
+
+PSFLibraryCache::Image PSFLibraryCache::Insert(const std::string& path, uint32_t crc32,
+                                               std::vector<uint8_t>* image) {
+  return Insert(Key(path, crc32), image);
+}
+
+
+PSFLibraryCache::Image PSFLibraryCache::Find(const std::string& key) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  const Entry* const entry = Lookup(key);
+  return entry ? entry->image : Image();
+}
+
+
+PSFLibraryCache::Image PSFLibraryCache::Insert(const std::string& key, std::vector<uint8_t>* image) {
+  rennyAssert(image != nullptr);
+  Entry entry;
+  entry.key = key;
+  entry.image.reset(new std::vector<uint8_t>(std::move(*image)));
+  entry.size = entry.image->size();
+
+  std::lock_guard<std::mutex> locker(mutex_);
+  auto it = index_.find(entry.key);
+  if (it != index_.end() && it->second->image != nullptr) {
+    // another loader has inflated the same library meanwhile
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->image;
+  }
+  Store(entry);
+  return entry.image;
+}
+
+
+PSFLibraryCache::RAMImage PSFLibraryCache::FindRAMImage(const std::string& key) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  const Entry* const entry = Lookup(key);
+  return entry ? entry->ram_image : RAMImage();
+}
+
+
+PSFLibraryCache::RAMImage PSFLibraryCache::InsertRAMImage(const std::string& key,
+                                                          const RAMImage& image) {
+  rennyAssert(image != nullptr);
+  std::lock_guard<std::mutex> locker(mutex_);
+  auto it = index_.find(key);
+  if (it != index_.end() && it->second->ram_image != nullptr) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->ram_image;
+  }
+  Entry entry;
+  entry.key = key;
+  entry.ram_image = image;
+  entry.size = image->size();
+  Store(entry);
+  return image;
+}
+
+
+void PSFLibraryCache::Evict(size_t budget) {
+  while (budget < used_bytes_ && lru_.empty() == false) {
+    const Entry& entry = lru_.back();
+    used_bytes_ -= entry.size;
+    index_.erase(entry.key);
+    lru_.pop_back();
+  }
+}
+
+
+void PSFLibraryCache::Clear() {
+  std::lock_guard<std::mutex> locker(mutex_);
+  lru_.clear();
+  index_.clear();
+  used_bytes_ = 0;
+}
+
+
+size_t PSFLibraryCache::budget() const {
+  std::lock_guard<std::mutex> locker(mutex_);
+  return budget_;
+}
+
+
+void PSFLibraryCache::set_budget(size_t bytes) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  budget_ = bytes;
+  Evict(budget_);
+}
+
+
+size_t PSFLibraryCache::used_bytes() const {
+  std::lock_guard<std::mutex> locker(mutex_);
+  return used_bytes_;
+}
+
+
+size_t PSFLibraryCache::hits() const {
+  std::lock_guard<std::mutex> locker(mutex_);
+  return hits_;
+}
+
+
+size_t PSFLibraryCache::misses() const {
+  std::lock_guard<std::mutex> locker(mutex_);
+  return misses_;
+}
@@ -0,0 +1,332 @@
+#include "psf/psflog.h"
+#include "psf/psx/psx.h"
+#include "psf/spu/spu.h"
+#include "common/debug.h"
+#include "common/filepath.h"
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+const char kSignature[4] = { 'R', 'S', 'P', 'L' };
+const uint8_t kVersion = 1;
+const size_t kFlushSize = 0x10000;
+
+enum {
+  kOpEnd = 0x00,
+  kOpWait = 0x01,
+  kOpWrite = 0x02,
+  kOpDMA = 0x03,
+  kOpStep = 0x04
+};
+
+// where replayed DMA data is staged in guest RAM
+const psx::PSXAddr kDMAStagingAddr = 0;
+
+inline uint32_t GetLE32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+}   // namespace
+
+
+////////////////////////////////////////////////////////////////////////
+// SPULogWriter
+////////////////////////////////////////////////////////////////////////
+
+SPULogWriter::SPULogWriter() : file_(nullptr), frame_(0), failed_(false) {}
+
+
+SPULogWriter::~SPULogWriter() {
+  if (IsOpened()) {
+    Close(frame_);
+  }
+}
+
+
+bool SPULogWriter::Open(const std::string& path, int version, uint32_t sampling_rate) {
+  if (IsOpened()) {
+    Close(frame_);
+  }
+  file_ = std::fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    rennyLogError("SPULogWriter", "Failed to create '%s'.", path.c_str());
+    return false;
+  }
+  buffer_.clear();
+  buffer_.reserve(kFlushSize + 0x1000);
+  frame_ = 0;
+  failed_ = false;
+
+  for (int i = 0; i < 4; i++) {
+    Put8(static_cast<uint8_t>(kSignature[i]));
+  }
+  Put8(kVersion);
+  Put8(static_cast<uint8_t>(version));
+  Put16(0);
+  Put16(sampling_rate & 0xffff);
+  Put16(sampling_rate >> 16);
+  Put16(0);   // the frame count is written on Close()
+  Put16(0);
+  return true;
+}
+
+
+bool SPULogWriter::Close(uint64_t frame_count) {
+  if (IsOpened() == false) return false;
+  Wait(frame_count);
+  Put8(kOpEnd);
+  bool ret = Flush();
+
+  uint8_t count[4];
+  const uint32_t frames = static_cast<uint32_t>(frame_count);
+  for (int i = 0; i < 4; ++i) {
+    count[i] = (frames >> (8 * i)) & 0xff;
+  }
+  if (std::fseek(file_, 12, SEEK_SET) != 0 || std::fwrite(count, 1, 4, file_) != 4) {
+    ret = false;
+  }
+  if (std::fclose(file_) != 0) {
+    ret = false;
+  }
+  file_ = nullptr;
+  buffer_.clear();
+  if (ret == false || failed_) {
+    rennyLogError("SPULogWriter", "Failed to write the SPU log.");
+    return false;
+  }
+  return true;
+}
+
+
+void SPULogWriter::Put16(uint16_t v) {
+  buffer_.push_back(v & 0xff);
+  buffer_.push_back(v >> 8);
+}
+
+
+void SPULogWriter::PutVarint(uint64_t v) {
+  while (0x80 <= v) {
+    buffer_.push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  buffer_.push_back(static_cast<uint8_t>(v));
+}
+
+
+bool SPULogWriter::Flush() {
+  if (buffer_.empty()) return true;
+  const size_t size = buffer_.size();
+  if (std::fwrite(buffer_.data(), 1, size, file_) != size) {
+    failed_ = true;
+  }
+  buffer_.clear();
+  return failed_ == false;
+}
+
+
+void SPULogWriter::Wait(uint64_t frame) {
+  if (frame <= frame_) return;
+  Put8(kOpWait);
+  PutVarint(frame - frame_);
+  frame_ = frame;
+}
+
+
+void SPULogWriter::WriteRegister(uint64_t frame, uint32_t reg, uint16_t value) {
+  if (IsOpened() == false) return;
+  Wait(frame);
+  Put8(kOpWrite);
+  Put16(reg & 0xffff);
+  Put16(value);
+  if (kFlushSize <= buffer_.size()) Flush();
+}
+
+
+void SPULogWriter::WriteDMA(uint64_t frame, int core, const void* data, uint32_t size) {
+  if (IsOpened() == false) return;
+  Wait(frame);
+  Put8(kOpDMA);
+  Put8(static_cast<uint8_t>(core));
+  PutVarint(size);
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  buffer_.insert(buffer_.end(), p, p + size);
+  if (kFlushSize <= buffer_.size()) Flush();
+}
+
+
+void SPULogWriter::Step(uint64_t frame, int step_count) {
+  if (IsOpened() == false || step_count <= 0) return;
+  Wait(frame);
+  Put8(kOpStep);
+  PutVarint(step_count);
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// PSFLog
+////////////////////////////////////////////////////////////////////////
+
+PSFLog::PSFLog(const std::shared_ptr<const MappedFile>& map, uint32_t version,
+               uint32_t sampling_rate, uint32_t frame_count)
+  : PSF(version), map_(map), capture_rate_(sampling_rate), frame_count_(frame_count),
+    read_pos_(kHeaderSize), event_frame_(0), output_frames_(0), ended_(false) {
+  infoLoaded_ = true;
+}
+
+
+unsigned int PSFLog::GetSamplingRate() const {
+  return psx_->Spu().GetCurrentSamplingRate();
+}
+
+
+bool PSFLog::Open(SoundBlock* block) {
+  // there is no CPU to run, so the SPU always runs on the caller's thread
+  psx_->Spu().EnableAsync(false);
+  psx_->Reset();
+  block->ChangeChannelCount(psx_->Spu().core_count() * 24);
+  block->EnableReverb();
+  psx_->Spu().set_output(block);
+  psx_->Spu().set_loop_detector(loop_detector_);
+  read_pos_ = kHeaderSize;
+  event_frame_ = 0;
+  output_frames_ = 0;
+  ended_ = false;
+  return true;
+}
+
+
+bool PSFLog::Close() {
+  psx_->Spu().Shutdown();
+  psx_->Spu().set_loop_detector(nullptr);
+  psx_->Mem().Reset();
+  return true;
+}
+
+
+bool PSFLog::GetVarint(uint64_t* v) {
+  *v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (map_->size() <= read_pos_) return false;
+    const uint8_t byte = map_->data()[read_pos_++];
+    *v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+
+bool PSFLog::ApplyNext() {
+  if (map_->size() <= read_pos_) return false;
+  const uint8_t* const data = map_->data();
+  SPU::SPUBase& spu = psx_->Spu();
+  uint64_t v;
+
+  switch (data[read_pos_++]) {
+  case kOpEnd:
+    return false;
+  case kOpWait:
+    if (GetVarint(&v) == false) break;
+    event_frame_ += v;
+    return true;
+  case kOpWrite:
+    if (map_->Contains(read_pos_, 4) == false) break;
+    spu.WriteRegister(0x1f800000 | data[read_pos_] | (data[read_pos_ + 1] << 8),
+                      data[read_pos_ + 2] | (data[read_pos_ + 3] << 8));
+    read_pos_ += 4;
+    return true;
+  case kOpDMA: {
+    if (map_->Contains(read_pos_, 1) == false) break;
+    const int core = data[read_pos_++];
+    if (GetVarint(&v) == false || map_->Contains(read_pos_, v) == false) break;
+    if (static_cast<int>(spu.core_count()) <= core || psx::Memory::kUserMemorySize < v) break;
+    const uint32_t size = static_cast<uint32_t>(v);
+    psx_->Memcpy(kDMAStagingAddr, data + read_pos_, size);
+    read_pos_ += size;
+    if (core == 0) {
+      spu.WriteDMA4Memory(kDMAStagingAddr, size);
+    } else {
+      spu.WriteDMA7Memory(kDMAStagingAddr, size);
+    }
+    return true;
+  }
+  case kOpStep:
+    if (GetVarint(&v) == false) break;
+    spu.Advance(static_cast<int>(v));
+    return true;
+  default:
+    break;
+  }
+  rennyLogError("PSFLog", "Broken SPU log at offset %d.", static_cast<int>(read_pos_));
+  return false;
+}
+
+
+bool PSFLog::DoAdvance(SoundBlock* dest) {
+  SPU::SPUBase& spu = psx_->Spu();
+  spu.set_output(dest);
+  const uint64_t rate = spu.GetCurrentSamplingRate();
+  // apply what was written before this frame, in recorded time
+  while (ended_ == false && event_frame_ * rate <= output_frames_ * capture_rate_) {
+    if (ApplyNext() == false) ended_ = true;
+  }
+  if (frame_count_ * rate <= output_frames_ * capture_rate_) return false;
+  spu.GetSync(dest);
+  ++output_frames_;
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// PSFLogLoader
+////////////////////////////////////////////////////////////////////////
+
+PSFLogLoader::PSFLogLoader(int fd, const std::string& filename)
+  : fd_(fd), path_(filename), map_(new MappedFile) {}
+
+
+PSFLogLoader::~PSFLogLoader() {
+  if (0 <= fd_) ::close(fd_);
+}
+
+
+PSFLogLoader* PSFLogLoader::Instance(int fd, const std::string& filename) {
+  PSFLogLoader* loader = new PSFLogLoader(fd, filename);
+  MappedFile& map = *loader->map_;
+  if (map.Map(fd) == false || map.Contains(0, PSFLog::kHeaderSize) == false
+      || ::memcmp(map.data(), kSignature, 4) != 0 || map.data()[4] != kVersion
+      || map.data()[5] < 1 || 2 < map.data()[5] || GetLE32(map.data() + 8) == 0) {
+    rennyLogError("PSFLogLoader", "'%s' is not an SPU log.", filename.c_str());
+    delete loader;
+    return nullptr;
+  }
+  return loader;
+}
+
+
+SoundInfo* PSFLogLoader::LoadInfo() {
+  if (info_ == nullptr) {
+    info_.reset(new SoundInfo());
+    info_->set_title(FilePath::Name(path_));
+    const uint8_t* header = map_->data();
+    const uint32_t rate = GetLE32(header + 8);
+    const uint32_t frames = GetLE32(header + 12);
+    char length[32];
+    std::snprintf(length, sizeof(length), "%u.%03u", frames / rate,
+                  static_cast<unsigned int>(static_cast<uint64_t>(frames % rate) * 1000 / rate));
+    info_->set_length(length);
+  }
+  return info_.get();
+}
+
+
+SoundData* PSFLogLoader::LoadData() {
+  const uint8_t* header = map_->data();
+  return new PSFLog(map_, header[5], GetLE32(header + 8), GetLE32(header + 12));
+}
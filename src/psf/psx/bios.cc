@@ -619,12 +619,10 @@ void (BIOS::*BIOS::biosA0[256])() = {};
 void (BIOS::*BIOS::biosB0[256])() = {};
 void (BIOS::*BIOS::biosC0[256])() = {};
 
-void BIOS::Init()
+// The dispatch tables are shared by every PSX instance, so they are built
+// once instead of being rewritten while another instance runs.
+bool BIOS::InitTables()
 {
-  heap_addr = 0;
-  CurThread = 0;
-  jmp_int = nullptr;
-
   for (int i = 0; i < 256; i++) {
     biosA0[i] = &BIOS::nop;
     biosB0[i] = &BIOS::nop;
@@ -698,6 +696,18 @@ void BIOS::Init()
   biosC0[0x03] = &BIOS::SysDeqIntRP;
   biosC0[0x0a] = &BIOS::ChangeClearRCnt;
 
+  return true;
+}
+
+void BIOS::Init()
+{
+  heap_addr = 0;
+  CurThread = 0;
+  jmp_int = nullptr;
+
+  static const bool tables_initialized = InitTables();
+  (void)tables_initialized;
+
   u32 base = 0x1000;
   u32 size = sizeof(EvCB) * 32;
   events_base_ = static_cast<EvCB*>(psxRptr(base));
@@ -1,8 +1,10 @@
 #include "psf/psx/disassembler.h"
 #include "psf/psx/psx.h"
 #include "psf/psx/r3000a.h"
-#include <wx/sstream.h>
-#include <wx/wfstream.h>
+#include "common/debug.h"
+#include "common/stringformat.h"
+#include <algorithm>
+#include <cstdlib>
 
 // memo: display as follows
 // mov  sp, [eax+4]
@@ -12,56 +14,55 @@ namespace {
 
 // const uint32_t& PC = regs_->PC;
 
-const wxChar strSPECIAL[] = wxT("_SPECIAL");
-const wxChar strBCOND[] = wxT("_BCOND");
-const wxChar strUNKNOWN[] = wxT("_unk");
+const char strSPECIAL[] = "_SPECIAL";
+const char strBCOND[] = "_BCOND";
+const char strUNKNOWN[] = "_unk";
 
-const wxChar *opcodeLowerList[64] = {
-    strSPECIAL, strBCOND, wxT("j"), wxT("jal"), wxT("beq"), wxT("bne"), wxT("blez"), wxT("bgtz"),
-    wxT("addi"), wxT("addiu"), wxT("slti"), wxT("sltiu"), wxT("andi"), wxT("ori"), wxT("xori"), wxT("lui"),
-    wxT("cop0"), wxT("cop1"), wxT("cop2"), wxT("cop3"), strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
+const char *opcodeLowerList[64] = {
+    strSPECIAL, strBCOND, "j", "jal", "beq", "bne", "blez", "bgtz",
+    "addi", "addiu", "slti", "sltiu", "andi", "ori", "xori", "lui",
+    "cop0", "cop1", "cop2", "cop3", strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
     strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
-    wxT("lb"), wxT("lh"), wxT("lwl"), wxT("lw"), wxT("lbu"), wxT("lhu"), wxT("lwr"), strUNKNOWN,
-    wxT("sb"), wxT("sh"), wxT("swl"), wxT("sw"), strUNKNOWN, strUNKNOWN, wxT("swr"), strUNKNOWN,
-    wxT("lwc0"), wxT("lwc1"), wxT("lwc2"), wxT("lwc3"), strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
-    wxT("swc0"), wxT("swc1"), wxT("swc2"), wxT("swc3"), strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN
+    "lb", "lh", "lwl", "lw", "lbu", "lhu", "lwr", strUNKNOWN,
+    "sb", "sh", "swl", "sw", strUNKNOWN, strUNKNOWN, "swr", strUNKNOWN,
+    "lwc0", "lwc1", "lwc2", "lwc3", strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
+    "swc0", "swc1", "swc2", "swc3", strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN
 };
 
-const wxChar *specialLowerList[64] = {
-    wxT("sll"), strUNKNOWN, wxT("srl"), wxT("sra"), wxT("sllv"), strUNKNOWN, wxT("srlv"), wxT("srav"),
-    wxT("jr"), wxT("jalr"), strUNKNOWN, strUNKNOWN, wxT("syscall"), wxT("break"), strUNKNOWN, strUNKNOWN,
-    wxT("mfhi"), wxT("mthi"), wxT("mflo"), wxT("mtlo"), strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
-    wxT("mult"), wxT("multu"), wxT("div"), wxT("divu"), strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
-    wxT("add"), wxT("addu"), wxT("sub"), wxT("subu"), wxT("and"), wxT("or"), wxT("xor"), wxT("nor"),
-    strUNKNOWN, strUNKNOWN, wxT("slt"), wxT("sltu"), strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
+const char *specialLowerList[64] = {
+    "sll", strUNKNOWN, "srl", "sra", "sllv", strUNKNOWN, "srlv", "srav",
+    "jr", "jalr", strUNKNOWN, strUNKNOWN, "syscall", "break", strUNKNOWN, strUNKNOWN,
+    "mfhi", "mthi", "mflo", "mtlo", strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
+    "mult", "multu", "div", "divu", strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
+    "add", "addu", "sub", "subu", "and", "or", "xor", "nor",
+    strUNKNOWN, strUNKNOWN, "slt", "sltu", strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
     strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
     strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN
 };
 
-const wxChar *bcondLowerList[32] = {
-    wxT("bltz"), wxT("bgez"), wxT("bltzl"), wxT("bgezl"), strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
-    wxT("tgei"), wxT("tgeiu"), wxT("tlti"), wxT("tltiu"), wxT("teqi"), wxT("tnei"), strUNKNOWN, strUNKNOWN,
-    wxT("bltzal"), wxT("bgezal"), wxT("bltzall"), wxT("bgezall"), strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
-    wxT("mtsab"), wxT("mtsah"), strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN
+const char *bcondLowerList[32] = {
+    "bltz", "bgez", "bltzl", "bgezl", strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
+    "tgei", "tgeiu", "tlti", "tltiu", "teqi", "tnei", strUNKNOWN, strUNKNOWN,
+    "bltzal", "bgezal", "bltzall", "bgezall", strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN,
+    "mtsab", "mtsah", strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN
 };
 
 /*
-const wxChar *copzLowerList[16] = {
-    wxT("mfc"), strUNKNOWN, wxT("cfc"), strUNKNOWN, wxT("mtc"), strUNKNOWN, wxT("ctc"), strUNKNOWN,
-    wxT("bcc"), strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN
+const char *copzLowerList[16] = {
+    "mfc", strUNKNOWN, "cfc", strUNKNOWN, "mtc", strUNKNOWN, "ctc", strUNKNOWN,
+    "bcc", strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN, strUNKNOWN
 };
 */
 
-const wxChar *regNames[] = {
-    wxT("zr"), wxT("at"), wxT("v0"), wxT("v1"), wxT("a0"), wxT("a1"), wxT("a2"), wxT("a3"),
-    wxT("t0"), wxT("t1"), wxT("t2"), wxT("t3"), wxT("t4"), wxT("t5"), wxT("t6"), wxT("t7"),
-    wxT("s0"), wxT("s1"), wxT("s2"), wxT("s3"), wxT("s4"), wxT("s5"), wxT("s6"), wxT("s7"),
-    wxT("t8"), wxT("t9"), wxT("k0"), wxT("k1"), wxT("gp"), wxT("sp"), wxT("fp"), wxT("ra"),
-    wxT("hi"), wxT("lo"), wxT("pc")
+const char *regNames[] = {
+    "zr", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra",
+    "hi", "lo", "pc"
 };
 
 
-
 }   // namespace
 
 
@@ -76,10 +77,9 @@ bool Disassembler::parseNop(u32)
 
 bool Disassembler::parseLoad(u32 code)
 {
-    wxString strRt = regNames[Rt(code)];
+    const std::string strRt(regNames[Rt(code)]);
     operands.push_back(strRt);
-    wxString addr;
-    addr.Printf(wxT("0x%04x($%s)"), Imm(code), regNames[Rs(code)]);
+    const std::string addr(StringFormat("0x%04x($%s)", Imm(code), regNames[Rs(code)]));
     operands.push_back(addr);
     changedRegisters.insert(strRt);
     return true;
@@ -87,25 +87,22 @@ bool Disassembler::parseLoad(u32 code)
 
 bool Disassembler::parseStore(u32 code)
 {
-    wxString strRt = regNames[Rt(code)];
+    const std::string strRt(regNames[Rt(code)]);
     operands.push_back(strRt);
-    wxString addr;
-    addr.Printf(wxT("0x%04x($%s)"), Imm(code), regNames[Rs(code)]);
+    const std::string addr(StringFormat("0x%04x($%s)", Imm(code), regNames[Rs(code)]));
     operands.push_back(addr);
 
-    wxString dest_addr;
-    dest_addr.Printf(wxT("0x%08x"), Imm(code) + RsVal(regs_->GPR, code));
+    const std::string dest_addr(StringFormat("0x%08x", Imm(code) + RsVal(regs_->GPR, code)));
     changedRegisters.insert(dest_addr);
     return true;
 }
 
 bool Disassembler::parseALUI(u32 code)
 {
-    wxString strRt = regNames[Rt(code)];
+    const std::string strRt(regNames[Rt(code)]);
     operands.push_back(strRt);
     operands.push_back(regNames[Rs(code)]);
-    wxString imm;
-    imm.Printf(wxT("0x%04x"), Imm(code));
+    const std::string imm(StringFormat("0x%04x", Imm(code)));
     operands.push_back(imm);
     changedRegisters.insert(strRt);
     return true;
@@ -113,7 +110,7 @@ bool Disassembler::parseALUI(u32 code)
 
 bool Disassembler::parse3OpReg(u32 code)
 {
-    wxString strRd = regNames[Rd(code)];
+    const std::string strRd(regNames[Rd(code)]);
     operands.push_back(strRd);
     operands.push_back(regNames[Rs(code)]);
     operands.push_back(regNames[Rt(code)]);
@@ -123,11 +120,10 @@ bool Disassembler::parse3OpReg(u32 code)
 
 bool Disassembler::parseShift(u32 code)
 {
-    wxString strRd = regNames[Rd(code)];
+    const std::string strRd(regNames[Rd(code)]);
     operands.push_back(strRd);
     operands.push_back(regNames[Rt(code)]);
-    wxString strShift;
-    strShift.Printf(wxT("0x%x"), Shamt(code));
+    const std::string strShift(StringFormat("0x%x", Shamt(code)));
     operands.push_back(strShift);
     changedRegisters.insert(strRd);
     return true;
@@ -135,7 +131,7 @@ bool Disassembler::parseShift(u32 code)
 
 bool Disassembler::parseShiftVar(u32 code)
 {
-    wxString strRd = regNames[Rd(code)];
+    const std::string strRd(regNames[Rd(code)]);
     operands.push_back(strRd);
     operands.push_back(regNames[Rt(code)]);
     operands.push_back(regNames[Rs(code)]);
@@ -154,7 +150,7 @@ bool Disassembler::parseMulDiv(u32 code)
 
 bool Disassembler::parseHILO(u32 code)
 {
-    wxString strRd = regNames[Rd(code)];
+    const std::string strRd(regNames[Rd(code)]);
     operands.push_back(strRd);
     operands.push_back(strRd);
     return true;
@@ -162,8 +158,7 @@ bool Disassembler::parseHILO(u32 code)
 
 bool Disassembler::parseJ(u32 code)
 {
-    wxString addr;
-    addr.Printf(wxT("0x%08x"), Target(code) << 2 | ((regs_->PC-4) & 0xf0000000));
+    const std::string addr(StringFormat("0x%08x", Target(code) << 2 | ((pc0 + 4) & 0xf0000000)));
     operands.push_back(addr);
     changedRegisters.insert(regNames[GPR_PC]);
     return true;
@@ -186,7 +181,7 @@ bool Disassembler::parseJR(u32 code)
 bool Disassembler::parseJALR(u32 code)
 {
     bool ret = parseJR(code);
-    wxString strRd = regNames[Rd(code)];
+    const std::string strRd(regNames[Rd(code)]);
     operands.push_back(strRd);
     changedRegisters.insert(strRd);
     return ret;
@@ -194,11 +189,10 @@ bool Disassembler::parseJALR(u32 code)
 
 bool Disassembler::parseBranch(u32 code)
 {
-    wxString strRs = regNames[Rs(code)];
-    wxString strRt = regNames[Rt(code)];
-    u32 addr = (regs_->PC-4) + (Imm(code) << 2);
-    wxString strAddr;
-    strAddr.Printf(wxT("0x%08x"), addr);
+    const std::string strRs(regNames[Rs(code)]);
+    const std::string strRt(regNames[Rt(code)]);
+    u32 addr = pc0 + 4 + (Imm(code) << 2);
+    const std::string strAddr(StringFormat("0x%08x", addr));
     operands.push_back(strRs);
     operands.push_back(strRt);
     operands.push_back(strAddr);
@@ -208,10 +202,9 @@ bool Disassembler::parseBranch(u32 code)
 
 bool Disassembler::parseBranchZ(u32 code)
 {
-    wxString strRs = regNames[Rs(code)];
-    u32 addr = (regs_->PC-4) + (Imm(code) << 2);
-    wxString strAddr;
-    strAddr.Printf(wxT("0x%08x"), addr);
+    const std::string strRs(regNames[Rs(code)]);
+    u32 addr = pc0 + 4 + (Imm(code) << 2);
+    const std::string strAddr(StringFormat("0x%08x", addr));
     operands.push_back(strRs);
     operands.push_back(strAddr);
     changedRegisters.insert(regNames[GPR_PC]);
@@ -251,7 +244,10 @@ bool Disassembler::parseSpecial(u32 code)
 
 bool Disassembler::parseBcond(u32 code)
 {
-    opcodeName = bcondLowerList[Funct(code)];
+    opcodeName = bcondLowerList[Rt(code)];
+    if ((Rt(code) & 0x0e) == 0) {   // bltz, bgez, bltzal, bgezal
+        return (Rt(code) & 0x10) ? parseBranchZAL(code) : parseBranchZ(code);
+    }
     return true;
 }
 
@@ -269,7 +265,7 @@ bool (Disassembler::*const Disassembler::OPCODES[64])(u32) = {
 
 
 Disassembler::Disassembler(PSX* composite)
-  : UserMemoryAccessor(composite), regs_(&composite->R3000ARegs())
+  : UserMemoryAccessor(composite), regs_(&composite->R3000ARegs()), output_to_(nullptr)
 {
   operands.reserve(4);
 }
@@ -278,7 +274,12 @@ Disassembler::Disassembler(PSX* composite)
 
 bool Disassembler::Parse(u32 code)
 {
-  pc0 = regs_->PC - 4;
+  return Parse(code, regs_->PC - 4);
+}
+
+bool Disassembler::Parse(u32 code, u32 pc)
+{
+  pc0 = pc;
   code_ = code;
   operands.clear();
   // changedRegisters.clear();
@@ -297,63 +298,61 @@ bool Disassembler::Parse(u32 code)
   return (this->*OPCODES[Opcode(code)])(code);
 }
 
-void Disassembler::PrintCode(wxOutputStream* out)
+std::string Disassembler::FormatCode()
 {
-  wxString addr;
-  addr.Printf(wxT("%08X:  "), regs_->PC-4);
-  wxStringOutputStream ss;
-  ss.Write(addr, addr.size());
+  std::string ss(StringFormat("%08X:  ", pc0));
   if (opcodeName == strUNKNOWN) {
-    wxString str_opcode;
-    str_opcode.Printf(wxT("(0x%02x, 0x%02x)"), Opcode(code_),
-                      (code_ == 0x01) ? Rt(code_) : Funct(code_));
-    opcodeName.Append(str_opcode);
+    opcodeName.append(StringFormat("(0x%02x, 0x%02x)", Opcode(code_),
+                                   (code_ == 0x01) ? Rt(code_) : Funct(code_)));
   }
-  ss.Write(opcodeName, opcodeName.size());
-  ss.Write("        ", std::min<unsigned int>(8 - opcodeName.size(), 8));
-  for (wxVector<wxString>::const_iterator it = operands.begin(), it_end = operands.end(); it != it_end; ++it) {
+  ss.append(opcodeName);
+  ss.append(std::min<unsigned int>(8 - opcodeName.size(), 8), ' ');
+  for (std::vector<std::string>::const_iterator it = operands.begin(), it_end = operands.end(); it != it_end; ++it) {
     if (it != operands.begin()) {
-      ss.Write(", ", 2);
+      ss.append(", ");
     }
-    ss.Write(*it, it->size());
+    ss.append(*it);
   }
+  return ss;
+}
+
+void Disassembler::PrintCode(std::FILE* out)
+{
   if (out) {
-    wxString str = ss.GetString();
-    str.Append("\n");
-    out->Write(str.c_str().AsChar(), str.size());
+    std::fprintf(out, "%s\n", FormatCode().c_str());
   } else {
-    wxMessageOutputDebug().Printf(ss.GetString());
+    rennyLogDebug("Disassembler", "%s", FormatCode().c_str());
   }
 }
 
-void Disassembler::PrintChangedRegisters(wxOutputStream* out)
+std::string Disassembler::Disassemble(u32 addr)
+{
+  // keep what a running trace has yet to print
+  const std::set<std::string> changed_registers(changedRegisters);
+  Parse(psxMu32val(addr), addr);
+  changedRegisters = changed_registers;
+  return FormatCode();
+}
+
+void Disassembler::PrintChangedRegisters(std::FILE* out)
 {
   for (auto& it : changedRegisters) {
-    wxStringOutputStream ss;
-    ss.Write("$", 1);
-    ss.Write(it, it.size());
-    ss.Write(" := ", 4);
-    wxString strAddr;
-    if (it[0] == _T('0') && it[1] == _T('x')) {
-      unsigned long addr;
-      it.ToULong(&addr);  // warning: this code may be wrong
-      strAddr.Printf(wxT("0x%08x"), psxMu32val(addr));
-      ss.Write(strAddr, strAddr.size());
+    std::string ss("$" + it + " := ");
+    if (it[0] == '0' && it[1] == 'x') {
+      const u32 addr = std::strtoul(it.c_str(), nullptr, 16);
+      ss.append(StringFormat("0x%08x", psxMu32val(addr)));
     } else {
       for (int i = 0; i < 35; i++) {
-        if (it.Cmp(regNames[i]) == 0) {
-          strAddr.Printf(wxT("0x%08x"), regs_->GPR(i));
-          ss.Write(strAddr, strAddr.size());
+        if (it == regNames[i]) {
+          ss.append(StringFormat("0x%08x", regs_->GPR(i)));
           break;
         }
       }
     }
     if (out) {
-      wxString str = ss.GetString();
-      str.Append("\n");
-      out->Write(str.c_str().AsChar(), str.size());
+      std::fprintf(out, "%s\n", ss.c_str());
     } else {
-      wxMessageOutputDebug().Printf(ss.GetString());
+      rennyLogDebug("Disassembler", "%s", ss.c_str());
     }
   }
   changedRegisters.clear();
@@ -361,52 +360,55 @@ void Disassembler::PrintChangedRegisters(wxOutputStream* out)
 
 
 void Disassembler::StartOutputToFile() {
-  output_to_.Open("assembled.txt", wxFile::write);
+  StopOutputToFile();
+  output_to_ = std::fopen("assembled.txt", "w");
 }
 
 bool Disassembler::OutputCodeToFile() {
-  if (output_to_.IsOpened() == false) return false;
+  if (output_to_ == nullptr) return false;
   Parse(psxMu32val(regs_->PC - 4));
-  wxFileOutputStream os(output_to_);
-  PrintCode(&os);
+  PrintCode(output_to_);
   return true;
 }
 
 bool Disassembler::OutputChangeRegistersToFile() {
-  if (output_to_.IsOpened() == false) return false;
-  wxFileOutputStream os(output_to_);
-  PrintChangedRegisters(&os);
+  if (output_to_ == nullptr) return false;
+  PrintChangedRegisters(output_to_);
   return true;
 }
 
-bool Disassembler::OutputStringToFile(const wxString& str) {
-  if (output_to_.IsOpened() == false) return false;
-  output_to_.Write(str + '\n');
+bool Disassembler::OutputStringToFile(const std::string& str) {
+  if (output_to_ == nullptr) return false;
+  std::fprintf(output_to_, "%s\n", str.c_str());
   return true;
 }
 
 void Disassembler::StopOutputToFile() {
-  output_to_.Close();
+  if (output_to_ == nullptr) return;
+  std::fclose(output_to_);
+  output_to_ = nullptr;
 }
 
 
 void Disassembler::DumpRegisters()
 {
-    wxString line;
-  line.Printf(wxT("%s=0x%08x "), regNames[GPR_PC], regs_->PC);
+  std::string line(StringFormat("%s=0x%08x ", regNames[GPR_PC], regs_->PC));
   for (int i = 1; i < 34; i++) {
-    line.Printf(wxT("%s%s=0x%08x "), line.c_str(), regNames[i], regs_->GPR(i));
+    line.append(StringFormat("%s=0x%08x ", regNames[i], regs_->GPR(i)));
     if (i % 4 == 3) {
-      wxMessageOutputDebug().Printf(line);
-      line.Clear();
+      rennyLogDebug("Disassembler", "%s", line.c_str());
+      line.clear();
     }
   }
-  wxMessageOutputDebug().Printf(line);
-  line.Clear();
+  rennyLogDebug("Disassembler", "%s", line.c_str());
 
-  line.Printf(wxT("epc=0x%08x cause=0x%08x status=0x%08x"), regs_->CP0.EPC, regs_->CP0.CAUSE, regs_->CP0.SR);
-  wxMessageOutputDebug().Printf(line);
-  line.Clear();
+  rennyLogDebug("Disassembler", "epc=0x%08x cause=0x%08x status=0x%08x",
+                regs_->CP0.EPC, regs_->CP0.CAUSE, regs_->CP0.SR);
+}
+
+Disassembler::~Disassembler()
+{
+  StopOutputToFile();
 }
 
 }   // namespace mips
@@ -3,6 +3,7 @@
 #include "psf/psx/rcnt.h"
 #include "psf/psx/dma.h"
 #include "psf/spu/spu.h"
+#include <cstring>
 
 namespace psx {
 
@@ -48,6 +49,7 @@ HardwareRegisterAccessor::HardwareRegisterAccessor(PSX* psx)
 HardwareRegisters::HardwareRegisters(PSX* composite)
   : Component(composite), IRQAccessor(this), version_(composite->version()) {
   ::memset(hw_regs_, 0, 0x3000);
+  BuildDispatchTable();
 }
 
 ////////////////////////////////////////////////////////////////
@@ -94,64 +96,196 @@ void HardwareRegisters::WriteRcnt(int index, int offset, T value) {
 ////////////////////////////////////////////////////////////////
 
 template<typename T>
-inline T HardwareRegisters::ReadSPURegister(PSXAddr addr) const {
+T HardwareRegisters::ReadSPURegister(PSXAddr addr) const {
   return static_cast<T>(Spu().ReadRegister(addr));
 }
 
 template<>
-inline u32 HardwareRegisters::ReadSPURegister(PSXAddr addr) const {
+u32 HardwareRegisters::ReadSPURegister(PSXAddr addr) const {
   return Spu().ReadRegister(addr) | (Spu().ReadRegister(addr + 2) << 16);
 }
 
 template<typename T>
-inline void HardwareRegisters::WriteSPURegister(PSXAddr addr, T value) {
+void HardwareRegisters::WriteSPURegister(PSXAddr addr, T value) {
   Spu().WriteRegister(addr, static_cast<u16>(value));
 }
 
 template<>
-inline void HardwareRegisters::WriteSPURegister(PSXAddr addr, u32 value) {
+void HardwareRegisters::WriteSPURegister(PSXAddr addr, u32 value) {
   Spu().WriteRegister(addr, static_cast<u16>(value & 0xffff));
   Spu().WriteRegister(addr + 2, static_cast<u16>(value >> 16));
 }
 
 ////////////////////////////////////////////////////////////////
-// common accessors
+// register handlers
 ////////////////////////////////////////////////////////////////
 
 template<typename T>
-inline T HardwareRegisters::Read(PSXAddr addr) const {
-  if ((addr & 0xffffffc0) == 0x1f801100 ||
-      (addr & 0xffffffc0) == 0x1f801480) { // root counters
-    return ReadRcnt<T>((addr & 0x00000030) >> 4, (addr & 0xf) >> 2);
+T HardwareRegisters::ReadDefault(PSXAddr addr) const {
+  if ((addr & 0xfffff800) == 0x1f900000 || (addr & 0xfffff800) == 0xbf900000) {
+    rennyLogWarning("PSXHardware", "SPU2read is not implemented.");
   }
-  switch (addr) {
-  case 0x1f801070:
-    return static_cast<T>(irq());
-  case 0x1f801074:
-    return static_cast<T>(irq_mask());
-  case 0x1f8010c8:
-    rennyLogWarning("PSXHardware", "ReadDMA(core0) is not implemented.");
-    return 0;
-  case 0x1f8010f4:  // DICR
-    return const_cast<HardwareRegisters*>(this)->Dma().DICR;
-  case 0x1f801450:
-    return (version_ == 0) ? 8 : 0;
-  case 0x1f801548:
-    rennyLogWarning("PSXHardware", "ReadDMA(core1) is not implemented.");
-    return 0;
-  default:
-    break;
+  rennyAssert((addr & 0x3fff) < 0x3000);
+  return *reinterpret_cast<const T*>(hw_regs_ + (addr & 0x3fff));
+}
+
+template<typename T>
+void HardwareRegisters::WriteDefault(PSXAddr addr, T value) {
+  if ((addr & 0xfffffff1) == 0xbf8010c0) {
+    rennyLogWarning("PSXHardware", "SPU2writeDMA4 is not implemented.");
   }
-  if ((addr & 0xfffffe00) == 0x1f801c00) {    // SPU
-    return ReadSPURegister<T>(addr);
+  if ((addr & 0xfffffff0) == 0xbf801500) {
+    rennyLogWarning("PSXHardware", "SPU2writeDMA7 is not implemented.");
   }
   if ((addr & 0xfffff800) == 0x1f900000 || (addr & 0xfffff800) == 0xbf900000) {
-    rennyLogWarning("PSXHardware", "SPU2read is not implemented.");
+    rennyLogWarning("PSXHardware", "SPU2write is not implemented.");
   }
   rennyAssert((addr & 0x3fff) < 0x3000);
-  return *reinterpret_cast<const T*>(hw_regs_ + (addr & 0x3fff));
+  *reinterpret_cast<T*>(hw_regs_ + (addr & 0x3fff)) = BFLIP<T>(value);
+}
+
+template<typename T>
+T HardwareRegisters::ReadRcnt(PSXAddr addr) const {
+  return ReadRcnt<T>((addr & 0x00000030) >> 4, (addr & 0xf) >> 2);
+}
+
+template<typename T>
+void HardwareRegisters::WriteRcnt(PSXAddr addr, T value) {
+  WriteRcnt<T>((addr & 0x00000030) >> 4, (addr & 0xf) >> 2, value);
+}
+
+template<typename T>
+T HardwareRegisters::ReadIrqData(PSXAddr /*addr*/) const {
+  return static_cast<T>(irq());
+}
+
+template<typename T>
+void HardwareRegisters::WriteIrqData(PSXAddr /*addr*/, T value) {
+  set_irq<T>(value);
+}
+
+template<typename T>
+T HardwareRegisters::ReadIrqMask(PSXAddr /*addr*/) const {
+  return static_cast<T>(irq_mask());
+}
+
+template<typename T>
+void HardwareRegisters::WriteIrqMask(PSXAddr /*addr*/, T value) {
+  set_irq_mask(static_cast<u32>(value));  // WARNING
+}
+
+template<typename T>
+T HardwareRegisters::ReadDMA4(PSXAddr /*addr*/) const {
+  rennyLogWarning("PSXHardware", "ReadDMA(core0) is not implemented.");
+  return 0;
+}
+
+template<typename T>
+void HardwareRegisters::WriteDMA4(PSXAddr /*addr*/, T value) {
+  Dma().Write(4, value);
+}
+
+template<typename T>
+T HardwareRegisters::ReadDICR(PSXAddr /*addr*/) const {
+  return const_cast<HardwareRegisters*>(this)->Dma().DICR;
+}
+
+template<typename T>
+void HardwareRegisters::WriteDICR(PSXAddr /*addr*/, T value) {
+  u32 tmp = (~value) & BFLIP32(Dma().DICR);
+  Dma().DICR = BFLIP32(((tmp ^ value) & 0xffffff) ^ tmp);
+}
+
+template<typename T>
+T HardwareRegisters::ReadPortStatus(PSXAddr /*addr*/) const {
+  return (version_ == 0) ? 8 : 0;
+}
+
+template<typename T>
+T HardwareRegisters::ReadDMA7(PSXAddr /*addr*/) const {
+  rennyLogWarning("PSXHardware", "ReadDMA(core1) is not implemented.");
+  return 0;
+}
+
+template<typename T>
+void HardwareRegisters::WriteDMA7(PSXAddr /*addr*/, T /*value*/) {
+  rennyLogWarning("PSXHardware", "WriteDMA(core1) is not implemented.");
+}
+
+////////////////////////////////////////////////////////////////
+// dispatch tables
+////////////////////////////////////////////////////////////////
+
+template<typename T>
+struct HardwareRegisters::Handlers {
+  typedef T (HardwareRegisters::*ReadFunc)(PSXAddr) const;
+  typedef void (HardwareRegisters::*WriteFunc)(PSXAddr, T);
+  static const ReadFunc kRead[kHandlerCount];
+  static const WriteFunc kWrite[kHandlerCount];
+};
+
+// in the order of HardwareRegisters::Handler
+template<typename T>
+const typename HardwareRegisters::Handlers<T>::ReadFunc HardwareRegisters::Handlers<T>::kRead[] = {
+  &HardwareRegisters::ReadDefault<T>,
+  &HardwareRegisters::ReadRcnt<T>,
+  &HardwareRegisters::ReadIrqData<T>,
+  &HardwareRegisters::ReadIrqMask<T>,
+  &HardwareRegisters::ReadDMA4<T>,
+  &HardwareRegisters::ReadDICR<T>,
+  &HardwareRegisters::ReadPortStatus<T>,
+  &HardwareRegisters::ReadDMA7<T>,
+  &HardwareRegisters::ReadSPURegister<T>
+};
+
+template<typename T>
+const typename HardwareRegisters::Handlers<T>::WriteFunc HardwareRegisters::Handlers<T>::kWrite[] = {
+  &HardwareRegisters::WriteDefault<T>,
+  &HardwareRegisters::WriteRcnt<T>,
+  &HardwareRegisters::WriteIrqData<T>,
+  &HardwareRegisters::WriteIrqMask<T>,
+  &HardwareRegisters::WriteDMA4<T>,
+  &HardwareRegisters::WriteDICR<T>,
+  &HardwareRegisters::WriteDefault<T>,   // the port status is read-only
+  &HardwareRegisters::WriteDMA7<T>,
+  &HardwareRegisters::WriteSPURegister<T>
+};
+
+void HardwareRegisters::SetHandler(PSXAddr begin, PSXAddr end, Handler handler) {
+  rennyAssert(kDispatchBase <= begin && begin < end && end <= kDispatchBase + kDispatchSize);
+  ::memset(dispatch_ + (begin - kDispatchBase), handler, end - begin);
 }
 
+void HardwareRegisters::BuildDispatchTable() {
+  ::memset(dispatch_, kDefault, kDispatchSize);
+  SetHandler(0x1f801070, 0x1f801071, kIrqData);
+  SetHandler(0x1f801074, 0x1f801075, kIrqMask);
+  SetHandler(0x1f8010c8, 0x1f8010c9, kDMA4);
+  SetHandler(0x1f8010f4, 0x1f8010f5, kDICR);   // DICR
+  SetHandler(0x1f801100, 0x1f801140, kRcnt);   // root counters 0-2
+  SetHandler(0x1f801450, 0x1f801451, kPortStatus);
+  SetHandler(0x1f801c00, 0x1f801e00, kSPU);
+  if (version_ == 2) {
+    SetHandler(0x1f801480, 0x1f8014c0, kRcnt); // root counters 3-5 of the IOP
+    SetHandler(0x1f801548, 0x1f801549, kDMA7);
+  }
+}
+
+////////////////////////////////////////////////////////////////
+// common accessors
+////////////////////////////////////////////////////////////////
+
+template<typename T>
+T HardwareRegisters::Read(PSXAddr addr) const {
+  const u32 offset = addr - kDispatchBase;
+  const int handler = (offset < kDispatchSize) ? dispatch_[offset] : static_cast<int>(kDefault);
+  return (this->*Handlers<T>::kRead[handler])(addr);
+}
+
+template u8 HardwareRegisters::Read<u8>(PSXAddr addr) const;
+template u16 HardwareRegisters::Read<u16>(PSXAddr addr) const;
+template u32 HardwareRegisters::Read<u32>(PSXAddr addr) const;
+
 u8 HardwareRegisters::Read8(PSXAddr addr) const {
   return Read<u8>(addr);
 }
@@ -165,50 +299,16 @@ u32 HardwareRegisters::Read32(PSXAddr addr) const {
 }
 
 template<typename T>
-inline void HardwareRegisters::Write(PSXAddr addr, T value) {
-  if ((addr & 0xffffffc0) == 0x1f801100 ||
-      (addr & 0xffffffc0) == 0x1f801480) { // root counters
-    WriteRcnt<T>((addr & 0x00000030) >> 4, (addr & 0xf) >> 2,
-                 static_cast<T>(value));
-    return;
-  }
-  switch (addr) {
-  case 0x1f801070:
-    set_irq<T>(value);
-    return;
-  case 0x1f801074:
-    set_irq_mask(static_cast<u32>(value));  // WARNING
-    return;
-  case 0x1f8010c8:
-    Dma().Write(4, static_cast<T>(value));
-    return;
-  case 0x1f8010f4:  // DICR
-    do {
-      u32 tmp = (~value) & BFLIP32(Dma().DICR);
-      Dma().DICR = BFLIP32(((tmp ^ value) & 0xffffff) ^ tmp);
-    } while (false);
-    return;
-  case 0x1f801548:
-    rennyLogWarning("PSXHardware", "WriteDMA(core1) is not implemented.");
-    return;
-  }
-  if ((addr & 0xfffffe00) == 0x1f801c00) {    // SPU
-    WriteSPURegister(addr, value);
-    return;
-  }
-  if ((addr & 0xfffffff1) == 0xbf8010c0) {
-    rennyLogWarning("PSXHardware", "SPU2writeDMA4 is not implemented.");
-  }
-  if ((addr & 0xfffffff0) == 0xbf801500) {
-    rennyLogWarning("PSXHardware", "SPU2writeDMA7 is not implemented.");
-  }
-  if ((addr & 0xfffff800) == 0x1f900000 || (addr & 0xfffff800) == 0xbf900000) {
-    rennyLogWarning("PSXHardware", "SPU2write is not implemented.");
-  }
-  rennyAssert((addr & 0x3fff) < 0x3000);
-  *reinterpret_cast<T*>(hw_regs_ + (addr & 0x3fff)) = BFLIP<T>(value);
+void HardwareRegisters::Write(PSXAddr addr, T value) {
+  const u32 offset = addr - kDispatchBase;
+  const int handler = (offset < kDispatchSize) ? dispatch_[offset] : static_cast<int>(kDefault);
+  (this->*Handlers<T>::kWrite[handler])(addr, value);
 }
 
+template void HardwareRegisters::Write<u8>(PSXAddr addr, u8 value);
+template void HardwareRegisters::Write<u16>(PSXAddr addr, u16 value);
+template void HardwareRegisters::Write<u32>(PSXAddr addr, u32 value);
+
 void HardwareRegisters::Write8(PSXAddr addr, u8 value) {
   Write<u8>(addr, value);
 }
@@ -7,6 +7,7 @@
 
 #include "common/SoundFormat.h"
 #include "common/debug.h"
+#include "common/perfcounters.h"
 
 namespace psx {
 namespace mips {
@@ -687,8 +688,10 @@ void Interpreter::J(u32 code) {
 
 // Jump And Link
 void Interpreter::JAL(u32 code) {
+  const u32 target = (Target(code) << 2) | (GPR(GPR_PC)/*+4*/ & 0xf0000000);
   SetGPR(GPR_RA, GPR(GPR_PC) + 4);
-  doBranch((Target(code) << 2) | (GPR(GPR_PC)/*+4*/ & 0xf0000000));
+  cpu_.NotifyCall(target);
+  doBranch(target);
 }
 
 // Jump Register
@@ -702,7 +705,9 @@ void Interpreter::JALR(u32 code) {
   if (rd != 0) {
     SetGPR(rd, GPR(GPR_PC) + 4);
   }
-  doBranch(RsVal(GPR(), code));
+  const u32 target = RsVal(GPR(), code);
+  cpu_.NotifyCall(target);
+  doBranch(target);
 }
 
 
@@ -753,6 +758,7 @@ void Interpreter::BLTZAL(u32 code) {
   if (static_cast<int32_t>(RsVal(GPR(), code)) < 0) {
     u32 pc = GPR(GPR_PC);
     SetGPR(GPR_RA, pc + 4);
+    cpu_.NotifyCall(pc + (Imm(code) << 2));
     doBranch(pc + (Imm(code) << 2));
   }
 }
@@ -762,6 +768,7 @@ void Interpreter::BGEZAL(u32 code) {
   if (static_cast<int32_t>(RsVal(GPR(), code)) >= 0) {
     u32 pc = GPR(GPR_PC);
     SetGPR(GPR_RA, pc + 4);
+    cpu_.NotifyCall(pc + (Imm(code) << 2));
     doBranch(pc + (Imm(code) << 2));
   }
 }
@@ -1070,6 +1077,7 @@ void Interpreter::ExecuteOnce()
 
 // called from BIOS::Softcall()
 void Interpreter::ExecuteBlock() {
+  PerfTimer timer(PerfCounters::kInterpreterTime);
   cpu_.doingBranch = false;
   do {
     ExecuteOnce();
@@ -1078,6 +1086,7 @@ void Interpreter::ExecuteBlock() {
 
 // deprecated
 uint32_t Interpreter::Execute(uint32_t cycles) {
+  PerfTimer timer(PerfCounters::kInterpreterTime);
   const uint32_t cycle_start = cpu_.cycle32();
   const uint64_t cycle_end = static_cast<uint64_t>(cpu_.cycle32()) + cycles;
   while (cpu_.cycle32() < cycle_end) {
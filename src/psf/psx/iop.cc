@@ -2,9 +2,8 @@
 #include "psf/psx/r3000a.h"
 #include "psf/psf.h"
 #include "common/debug.h"
+#include "common/stringformat.h"
 #include <cstring>
-#include <wx/vector.h>
-#include <wx/regex.h>
 
 // for debug
 #include <sstream>
@@ -13,7 +12,7 @@
 
 namespace psx {
 
-void IOP::RegisterInternalLibrary(const wxString& name, InternalLibraryCallback callback) {
+void IOP::RegisterInternalLibrary(const std::string& name, InternalLibraryCallback callback) {
   internal_lib_map_[name] = callback;
 }
 
@@ -26,13 +25,13 @@ IOP::IOP(PSX* psx) :
 #ifndef NDEBUG
   rennyAssert(p_disasm_ != nullptr);
 #endif
-  RegisterInternalLibrary(wxString("stdio\0\0\0", 8), &IOP::stdio);
-  RegisterInternalLibrary(wxString("sysclib\0", 8), &IOP::sysclib);
-  RegisterInternalLibrary(wxString("intrman\0", 8), &IOP::intrman);
-  RegisterInternalLibrary(wxString("loadcore", 8), &IOP::loadcore);
-  RegisterInternalLibrary(wxString("sysmem\0\0", 8), &IOP::sysmem);
-  RegisterInternalLibrary(wxString("modload\0", 8), &IOP::modload);
-  RegisterInternalLibrary(wxString("ioman\0\0\0", 8), &IOP::ioman);
+  RegisterInternalLibrary(std::string("stdio\0\0\0", 8), &IOP::stdio);
+  RegisterInternalLibrary(std::string("sysclib\0", 8), &IOP::sysclib);
+  RegisterInternalLibrary(std::string("intrman\0", 8), &IOP::intrman);
+  RegisterInternalLibrary(std::string("loadcore", 8), &IOP::loadcore);
+  RegisterInternalLibrary(std::string("sysmem\0\0", 8), &IOP::sysmem);
+  RegisterInternalLibrary(std::string("modload\0", 8), &IOP::modload);
+  RegisterInternalLibrary(std::string("ioman\0\0\0", 8), &IOP::ioman);
 }
 
 IOP::~IOP() {
@@ -61,7 +60,7 @@ unsigned int IOP::LoadELF(PSF2File* psf2irx) {
   if (psf2irx == nullptr) {
     return 0xffffffff;
   }
-  const char* irx_name = static_cast<const char*>(psf2irx->GetName());
+  const char* irx_name = psf2irx->GetName().c_str();
   const unsigned char* data = psf2irx->GetData();
 
   if (load_addr_ & 3) {
@@ -71,7 +70,7 @@ unsigned int IOP::LoadELF(PSF2File* psf2irx) {
 
   if ((data[0] != 0x7f) || (data[1] != 'E') ||
       (data[2] != 'L') || (data[3] != 'F') ) {
-    rennyLogError("PSF2", "%s is not ELF file.", static_cast<const char*>(psf2irx->GetName()));
+    rennyLogError("PSF2", "%s is not ELF file.", psf2irx->GetName().c_str());
     return 0xffffffff;
   }
 
@@ -83,6 +82,7 @@ unsigned int IOP::LoadELF(PSF2File* psf2irx) {
 
   uint32_t shent = shoff;
   uint32_t totallen = 0;
+  uint32_t hi16offs = 0, hi16target = 0;  // pending HI16 relocation
 
   for (unsigned int i = 0; i < shnum; i++) {
     uint32_t type = *(reinterpret_cast<const unsigned int*>(data + shent + 4));
@@ -119,7 +119,6 @@ unsigned int IOP::LoadELF(PSF2File* psf2irx) {
     case 9:
       for (unsigned int rec = 0; rec < (size/8); rec++) {
         uint32_t offs, info, target, temp, val, vallo;
-        static uint32_t hi16offs = 0, hi16target = 0;
 
         offs = *(reinterpret_cast<const unsigned int*>(data + offset + (rec*8)));
         info = *(reinterpret_cast<const unsigned int*>(data + offset + (rec*8) + 4));
@@ -187,64 +186,58 @@ unsigned int IOP::LoadELF(PSF2File* psf2irx) {
 
 
 
-const wxString IOP::sprintf(const wxString& format, uint32_t param1, uint32_t param2, uint32_t param3) const {
-
-  wxRegEx re_esc("\\x1b");
-  wxRegEx re_isnum("%[0-9.]*[xXdDcCuU]");
-  wxRegEx re_isstr("%s");
-
-  /*
-  if (re_esc.IsValid() == false) {
-    rennyLogError("IOP_sprintf", "ESC RegEx is invalid.");
-    return wxString("");
-  } else if (re_isnum.IsValid() == false) {
-    rennyLogError("IOP_sprintf", "IsNum RegEx is invalid.");
-    return wxString("");
-  } else if (re_isstr.IsValid() == false) {
-    rennyLogError("IOP_sprintf", "IsStr RegEx is invalid.");
-    return wxString("");
-  }
-  */
-
-  wxString msg(format);
-  re_esc.ReplaceAll(&msg, wxT("[ESC]"));
-
+std::string IOP::sprintf(const char* format, uint32_t param1, uint32_t param2, uint32_t param3) const {
   const uint32_t params[3] = { param1, param2, param3 };
-
-  wxVector<uint32_t> printf_params;
-  for (int i = 0; i < 3; i++) {
-    size_t start, len;
-    size_t idx_isnum = 0xffffffff, idx_isstr = 0xffffffff;
-    size_t len_isnum = 0;
-    if (re_isnum.Matches(msg)) {
-      re_isnum.GetMatch(&start, &len, 0);
-      // rennyLogDebug("IOP_sprintf", "Number is matched @ %d", start);
-      idx_isnum = start;
-      len_isnum = len;
+  int param_index = 0;
+
+  std::string msg;
+  const char* p = format;
+  while (*p != '\0') {
+    if (*p == '\x1b') {
+      msg.append("[ESC]");
+      p++;
+      continue;
     }
-    if (re_isstr.Matches(msg)) {
-      re_isstr.GetMatch(&start, &len, 0);
-      // rennyLogDebug("IOP_sprintf", "String is matched @ %d", start);
-      idx_isstr = start;
+    if (*p != '%') {
+      msg.push_back(*p++);
+      continue;
     }
-    if (idx_isnum < idx_isstr) {
-      printf_params.push_back(params[i]);
-    } else if (idx_isstr < idx_isnum) {
-      const wxString str_param(const_cast<IOP*>(this)->psxMu8ptr(params[i]));
-      // rennyLogDebug("IOP_sprintf", "String parameter (%d): %s", i, static_cast<const char*>(str_param));
-      re_isstr.ReplaceFirst(&msg, str_param);
-      // rennyLogDebug("IOP_sprintf", static_cast<const char*>(msg));
-      // wxMessageOutputDebug().Output(msg);
-    } else {
+    if (p[1] == '%') {
+      msg.push_back('%');
+      p += 2;
+      continue;
+    }
+    // a conversion takes the next parameter, or 0 after the third one
+    const uint32_t param = (param_index < 3) ? params[param_index] : 0;
+    if (p[1] == 's') {
+      if (param_index < 3) {
+        msg.append(const_cast<IOP*>(this)->psxMs8ptr(param));
+      }
+      param_index++;
+      p += 2;
+      continue;
+    }
+    const char* q = p + 1;
+    while (('0' <= *q && *q <= '9') || *q == '.') q++;
+    char conversion = *q;
+    switch (conversion) {
+    case 'D': case 'U': case 'C':
+      conversion += 'a' - 'A';
+      // fall through
+    case 'x': case 'X': case 'd': case 'u': case 'c':
+      {
+        std::string spec(p, q);
+        spec.push_back(conversion);
+        AppendFormat(&msg, spec.c_str(), param);
+        param_index++;
+        p = q + 1;
+      }
+      break;
+    default:
+      msg.push_back(*p++);
       break;
     }
   }
-
-  for (size_t i = printf_params.size(); i < 3; i++) {
-    printf_params.push_back(0);
-  }
-
-  msg.Printf(msg, printf_params[0], printf_params[1], printf_params[2]);
   return msg;
 }
 
@@ -262,8 +255,8 @@ bool IOP::stdio(uint32_t call_num) {
   switch (call_num) {
   case 4: // printf
     do {
-      wxString out = sprintf(psxMs8ptr(a0), a1, a2, a3);
-      rennyLogInfo("IOP::stdio(printf)", static_cast<const char*>(out));
+      const std::string out(sprintf(psxMs8ptr(a0), a1, a2, a3));
+      rennyLogInfo("IOP::stdio(printf)", "%s", out.c_str());
     } while (false);
     return true;
   default:
@@ -298,9 +291,9 @@ bool IOP::sysclib(uint32_t call_num) {
     return true;
   case 19:	// sprintf
     {
-      wxString out = IOP::sprintf(wxString(psxMs8ptr(a1)), a2, a3, 0);
-      rennyLogDebug("IOP::sysclib(sprintf)", static_cast<const char*>(out));
-      Psx().Memcpy(a0, static_cast<const char*>(out), out.length());
+      const std::string out(IOP::sprintf(psxMs8ptr(a1), a2, a3, 0));
+      rennyLogDebug("IOP::sysclib(sprintf)", "%s", out.c_str());
+      Psx().Memcpy(a0, out.c_str(), out.length());
     }
     return true;
   case 23:	// strcpy
@@ -412,10 +405,10 @@ bool IOP::loadcore(uint32_t call_num) {
       rennyLogDebug("IOP::loadcore", "RegisterLibraryEntries(%08x)", a0);
       if (psxMu32val(a0) == BFLIP32(0x41c00000)) {
         a0 += 12;  // skip '0x41c00000', zero and version
-        lib_entries_.push_back(ExternalLibEntry(wxString(psxMs8ptr(a0), 8),
+        lib_entries_.push_back(ExternalLibEntry(std::string(psxMs8ptr(a0), 8),
                                                 a0 + 8));
         rennyLogDebug("IOP::loadcore", "Library name is '%s'",
-                      static_cast<const char*>(lib_entries_.rbegin()->name_));
+                      lib_entries_.rbegin()->name_.c_str());
         R3000ARegs().GPR.V0 = 0;
         return true;
       } else {
@@ -476,9 +469,8 @@ bool IOP::sysmem(uint32_t call_num) {
 
   case 14:  // Kprintf
     {
-      wxString out = IOP::sprintf(wxString(psxMs8ptr(a0) + (a0 & 3)), a1, a2, a3);
-      out.Replace(wxT("\x1b"), wxT("]"));
-      rennyLogDebug("IOP::sysmem", "KTTY: %s", static_cast<const char*>(out));
+      const std::string out(IOP::sprintf(psxMs8ptr(a0) + (a0 & 3), a1, a2, a3));
+      rennyLogDebug("IOP::sysmem", "KTTY: %s", out.c_str());
     }
     return true;
 
@@ -498,8 +490,7 @@ bool IOP::modload(uint32_t call_num) {
   switch (call_num) {    
   case 7:	// LoadStartModule
     {
-      wxString module_name = psxMs8ptr(a0 + 8); // len("aofile:/") == 8
-      // wxString str1 = psxMs8ptr(a2);
+      const std::string module_name(psxMs8ptr(a0 + 8)); // len("aofile:/") == 8
 
       uint32_t new_alloc_addr = load_addr_;
       if (new_alloc_addr & 0xf) {
@@ -549,8 +540,7 @@ bool IOP::modload(uint32_t call_num) {
           }
           ss << ")";
           rennyLogDebug("IOP::modload", "LoadStartModule: %s %s",
-                        static_cast<const char*>(module_name),
-                        static_cast<const char*>(ss.str().c_str()));
+                        module_name.c_str(), ss.str().c_str());
 
           R3000ARegs().GPR.A0 = numargs;
           R3000ARegs().GPR.A1 = 0x80000000 | new_alloc_addr;
@@ -558,9 +548,7 @@ bool IOP::modload(uint32_t call_num) {
           R3000ARegs().PC = start/* - 4*/;
           R3000a().LeaveRAAlone();
 #ifndef NDEBUG
-          wxString disasm_out;
-          disasm_out.sprintf("PC := 0x%08X", start);
-          p_disasm_->OutputStringToFile(disasm_out);
+          p_disasm_->OutputStringToFile(StringFormat("PC := 0x%08X", start));
 #endif
         }
       }
@@ -601,17 +589,17 @@ bool IOP::ioman(uint32_t call_num) {
         handle = files_.size() - 1;
       }
 
-      wxString filename(psxMs8ptr(a0));
-      filename = filename.Mid(filename.find_first_of(":/") + 2, wxString::npos);
+      std::string filename(psxMs8ptr(a0));
+      filename.erase(0, filename.find_first_of(":/") + 2);
       PSF2File* file = dynamic_cast<PSF2File*>(const_cast<PSF2Directory*>(root_)->Find(filename));
 
       if (file == nullptr) {
-        rennyLogError("IOP::ioman(open)", "Cannot open a file '%s'", static_cast<const char*>(filename));
+        rennyLogError("IOP::ioman(open)", "Cannot open a file '%s'", filename.c_str());
         R3000ARegs().GPR.V0 = 0xffffffff;
         return false;
       }
 
-      rennyLogDebug("IOP::ioman(open)", "Open a file '%s'", static_cast<const char*>(filename));
+      rennyLogDebug("IOP::ioman(open)", "Open a file '%s'", filename.c_str());
       files_[handle].file = file;
       files_[handle].pos = 0;
       R3000ARegs().GPR.V0 = handle;
@@ -702,7 +690,7 @@ bool IOP::ioman(uint32_t call_num) {
 }
 
 
-IOP::InternalLibraryCallback IOP::GetInternalLibraryCallback(const wxString& name) {
+IOP::InternalLibraryCallback IOP::GetInternalLibraryCallback(const std::string& name) {
   auto it = internal_lib_map_.find(name);
   if (it == internal_lib_map_.end()) {
     return nullptr;
@@ -711,16 +699,16 @@ IOP::InternalLibraryCallback IOP::GetInternalLibraryCallback(const wxString& nam
 }
 
 
-bool IOP::CallExternalLibrary(const wxString& name, uint32_t call_num) {
+bool IOP::CallExternalLibrary(const std::string& name, uint32_t call_num) {
   for (const auto& lib_entry : lib_entries_) {
-    if (lib_entry.name_.IsSameAs(name, 8)) {
+    if (lib_entry.name_ == name) {
       R3000ARegs().PC = psxMu32val(lib_entry.dispatch_ + call_num * 4) /* - 4 */;
       R3000a().LeaveRAAlone();
       return true;
     }
   }
   rennyLogError("IOP", "Unhandled service %d for module %s.",
-                call_num, static_cast<const char*>(name));
+                call_num, name.c_str());
   return false;
 }
 
@@ -739,14 +727,12 @@ bool IOP::Call(PSXAddr pc, uint32_t call_num) {
 
   scan += 12;	// skip '0x41e00000', zero and version
 
-  const wxString module_name(reinterpret_cast<const char*>(psxMu32ptr(scan)), 8);
+  const std::string module_name(reinterpret_cast<const char*>(psxMu32ptr(scan)), 8);
 
   // rennyLogDebug("IOP(Debug)", "module_name: %s (length = %ld)",
   //              static_cast<const char*>(module_name), module_name.length());
 #ifndef NDEBUG
-  wxString str_callinfo("IOP: call ");
-  str_callinfo.Append(module_name);
-  p_disasm_->OutputStringToFile(str_callinfo);
+  p_disasm_->OutputStringToFile("IOP: call " + module_name);
 #endif
   InternalLibraryCallback internal_lib_cb = GetInternalLibraryCallback(module_name);
   if (internal_lib_cb) {
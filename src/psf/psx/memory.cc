@@ -5,8 +5,41 @@
 #include "psf/psx/hardware.h"
 #include "common/debug.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define PSX_USE_MMAP 1
+#include <sys/mman.h>
+#endif
+
 namespace psx {
 
+namespace {
+
+// Maps fd privately at addr, or fresh zero pages if fd < 0.
+// A null addr lets the kernel choose the address.
+u8* MapUser(u8* addr, int fd) {
+#ifdef PSX_USE_MMAP
+  int flags = MAP_PRIVATE;
+  if (addr != nullptr) flags |= MAP_FIXED;
+  if (fd < 0) flags |= MAP_ANONYMOUS;
+  void* const p = ::mmap(addr, Memory::kUserMemorySize, PROT_READ | PROT_WRITE, flags, fd, 0);
+  if (p == MAP_FAILED) return nullptr;
+  return static_cast<u8*>(p);
+#else
+  if (addr != nullptr || 0 <= fd) return nullptr;
+  return new u8[Memory::kUserMemorySize]();
+#endif
+}
+
+void UnmapUser(u8* addr) {
+#ifdef PSX_USE_MMAP
+  ::munmap(addr, Memory::kUserMemorySize);
+#else
+  delete [] addr;
+#endif
+}
+
+}   // namespace
+
 ////////////////////////////////////////////////////////////////////////
 // UserMemoryAccessor constructor/destructor definitions
 ////////////////////////////////////////////////////////////////////////
@@ -40,16 +73,22 @@ MemoryAccessor::MemoryAccessor(PSX *psx)
 ////////////////////////////////////////////////////////////////////////
 
 Memory::Memory(int version, HardwareRegisters* hw_regs)
-  : version_(version), hw_regs_(*hw_regs), psxH_(hw_regs) {
+  : mem_user_(MapUser(nullptr, -1)),
+    version_(version), hw_regs_(*hw_regs), psxH_(hw_regs) {
   rennyAssert(&hw_regs_ != nullptr);
+  rennyAssert(mem_user_ != nullptr);
   ::memset(segment_LUT_, 0, 0x10000);
-  ::memset(mem_user_, 0, 0x200000);
   ::memset(mem_parallel_port_, 0, 0x10000);
   ::memset(mem_bios_, 0, 0x80000);
   Init();
 }
 
 
+Memory::~Memory() {
+  UnmapUser(mem_user_);
+}
+
+
 void Memory::Init()
 {
   if (segment_LUT_[0x0000] != 0) return;
@@ -74,7 +113,10 @@ void Memory::Init()
 
 void Memory::Reset()
 {
-  ::memset(mem_user_, 0, sizeof (mem_user_));
+  // drop the pages instead of dirtying all of them
+  if (MapUser(mem_user_, -1) == nullptr) {
+    ::memset(mem_user_, 0, kUserMemorySize);
+  }
   ::memset(mem_parallel_port_, 0, sizeof (mem_parallel_port_));
   rennyLogDebug("PSXMemory", "Reset memory.");
 }
@@ -235,4 +277,22 @@ void Memory::Set(PSXAddr addr, int data, int length) {
   ::memset(reinterpret_cast<s8*>(&mem_user_[addr & 0x7fffff]), data, length);
 }
 
+
+u8* Memory::UserMemory(PSXAddr addr, u32* available) {
+  const u32 offset = addr & 0x1fffff;
+  if (available) *available = kUserMemorySize - offset;
+  return mem_user_ + offset;
+}
+
+
+bool Memory::MapUserImage(int image_fd) {
+  if (image_fd < 0) return false;
+  if (MapUser(mem_user_, image_fd) == nullptr) {
+    rennyLogWarning("PSXMemory", "Failed to map the RAM image (fd = %d).", image_fd);
+    return false;
+  }
+  rennyLogDebug("PSXMemory", "Mapped the RAM image (fd = %d).", image_fd);
+  return true;
+}
+
 }   // namespace psx
@@ -0,0 +1,313 @@
+#include "psf/psx/profiler.h"
+#include "psf/psx/psx.h"
+#include "psf/psx/r3000a.h"
+#include "psf/psx/disassembler.h"
+#include "common/debug.h"
+#include "common/stringformat.h"
+#include <algorithm>
+#include <set>
+
+
+namespace {
+
+const u32 kMaxBlockLength = 64;     // instructions
+const u32 kMaxLoopLength = 1024;
+const u32 kMaxIdleLoopLength = 8;
+const u32 kMaxPrintedLines = 24;
+const double kHLECandidateShare = 0.02;
+const uint64_t kHLECandidateCalls = 16;
+
+//! Jumps and branches, each followed by a delay slot.
+bool IsControlTransfer(u32 code) {
+  using namespace psx::mips;
+  switch (Opcode(code)) {
+  case 0x00:
+    return Funct(code) == 0x08 || Funct(code) == 0x09;  // jr, jalr
+  case 0x01:
+    return (Rt(code) & 0x0e) == 0;    // bltz, bgez, bltzal, bgezal
+  case 0x02: case 0x03: case 0x04: case 0x05: case 0x06: case 0x07:
+    return true;
+  default:
+    return false;
+  }
+}
+
+//! The target of a branch or j/jal at pc; false for jr/jalr.
+bool DirectTarget(u32 code, u32 pc, u32* target) {
+  using namespace psx::mips;
+  switch (Opcode(code)) {
+  case 0x00:
+    return false;
+  case 0x02: case 0x03:
+    *target = (Target(code) << 2) | ((pc + 4) & 0xf0000000);
+    return true;
+  default:
+    *target = pc + 4 + (Imm(code) << 2);
+    return true;
+  }
+}
+
+bool IsStore(u32 code) {
+  const u32 op = psx::mips::Opcode(code);
+  return (0x28 <= op && op <= 0x2e) || (0x38 <= op && op <= 0x3b);
+}
+
+bool IsCall(u32 code) {
+  using namespace psx::mips;
+  switch (Opcode(code)) {
+  case 0x00:
+    return Funct(code) == 0x09;
+  case 0x01:
+    return (Rt(code) & 0x10) != 0;
+  case 0x03:
+    return true;
+  default:
+    return false;
+  }
+}
+
+double Percent(uint64_t n, uint64_t total) {
+  return total ? 100.0 * n / total : 0.0;
+}
+
+template<typename T>
+bool MoreSamples(const T& a, const T& b) {
+  return a.samples > b.samples;
+}
+
+}   // namespace
+
+
+namespace psx {
+namespace mips {
+
+Profiler::Profiler(PSX* psx, u32 interval)
+  : UserMemoryAccessor(psx), psx_(psx), interval_(interval),
+    countdown_(interval), last_cycle_(0), sample_count_(0) {
+  rennyAssert(interval_ > 0);
+}
+
+
+Profiler::~Profiler() {
+  Detach();
+}
+
+
+void Profiler::Attach() {
+  last_cycle_ = psx_->R3000a().cycle32();
+  countdown_ = interval_;
+  psx_->R3000a().SetProfiler(this);
+}
+
+
+void Profiler::Detach() {
+  if (psx_->R3000a().profiler() == this) {
+    psx_->R3000a().SetProfiler(nullptr);
+  }
+}
+
+
+void Profiler::Clear() {
+  histogram_.clear();
+  functions_.clear();
+  sample_count_ = 0;
+}
+
+
+void Profiler::Sample(u32 pc, u32 elapsed) {
+  if (static_cast<int32_t>(elapsed) < 0) {
+    // the root counters were reset
+    countdown_ = interval_;
+    return;
+  }
+  const u32 extra = elapsed - countdown_;
+  const u32 weight = 1 + extra / interval_;
+  countdown_ = interval_ - extra % interval_;
+  histogram_[pc] += weight;
+  sample_count_ += weight;
+}
+
+
+void Profiler::Call(u32 target) {
+  ++functions_[target];
+}
+
+
+u32 Profiler::FunctionOf(u32 pc) const {
+  std::map<u32, uint64_t>::const_iterator itr = functions_.upper_bound(pc);
+  if (itr == functions_.begin()) return 0;
+  return (--itr)->first;
+}
+
+
+u32 Profiler::BlockStart(u32 pc) {
+  u32 addr = pc;
+  for (u32 i = 0; i < kMaxBlockLength; i++) {
+    if (functions_.count(addr) || IsControlTransfer(Code(addr - 8))) break;
+    addr -= 4;
+  }
+  return addr;
+}
+
+
+u32 Profiler::BlockEnd(u32 start) {
+  u32 addr = start;
+  for (u32 i = 0; i < kMaxBlockLength; i++, addr += 4) {
+    if (IsControlTransfer(Code(addr))) return addr + 8;
+  }
+  return addr;
+}
+
+
+uint64_t Profiler::SamplesIn(u32 start, u32 end) const {
+  uint64_t samples = 0;
+  for (u32 addr = start; addr < end; addr += 4) {
+    std::unordered_map<u32, uint64_t>::const_iterator itr = histogram_.find(addr);
+    if (itr != histogram_.end()) {
+      samples += itr->second;
+    }
+  }
+  return samples;
+}
+
+
+bool Profiler::IsIdleLoop(u32 start, u32 end) {
+  if ((end - start) / 4 > kMaxIdleLoopLength) return false;
+  for (u32 addr = start; addr < end; addr += 4) {
+    const u32 code = Code(addr);
+    if (IsStore(code) || IsCall(code)) return false;
+  }
+  return true;
+}
+
+
+void Profiler::FindBlocks(std::vector<Block>* blocks) {
+  std::map<u32, Block> found;
+  for (std::unordered_map<u32, uint64_t>::const_iterator itr = histogram_.begin();
+       itr != histogram_.end(); ++itr) {
+    const u32 start = BlockStart(itr->first);
+    std::map<u32, Block>::iterator block = found.find(start);
+    if (block == found.end()) {
+      const Block new_block = { start, BlockEnd(start), 0 };
+      block = found.insert(std::make_pair(start, new_block)).first;
+    }
+    block->second.samples += itr->second;
+  }
+  blocks->clear();
+  for (std::map<u32, Block>::const_iterator itr = found.begin(); itr != found.end(); ++itr) {
+    blocks->push_back(itr->second);
+  }
+  std::sort(blocks->begin(), blocks->end(), MoreSamples<Block>);
+}
+
+
+void Profiler::FindLoops(const std::vector<Block>& blocks, std::vector<Loop>* loops) {
+  std::set<uint64_t> seen;
+  loops->clear();
+  for (std::vector<Block>::const_iterator itr = blocks.begin(); itr != blocks.end(); ++itr) {
+    const u32 branch = itr->end - 8;
+    u32 target;
+    if (IsControlTransfer(Code(branch)) == false || IsCall(Code(branch)) ||
+        DirectTarget(Code(branch), branch, &target) == false) continue;
+    if (branch < target || (branch - target) / 4 >= kMaxLoopLength) continue;
+    if (seen.insert(static_cast<uint64_t>(target) << 32 | branch).second == false) continue;
+    const Loop loop = { target, itr->end, SamplesIn(target, itr->end),
+                        IsIdleLoop(target, itr->end) };
+    loops->push_back(loop);
+  }
+  std::sort(loops->begin(), loops->end(), MoreSamples<Loop>);
+}
+
+
+void Profiler::AppendCode(std::string* report, u32 start, u32 end) {
+  Disassembler& disasm = psx_->Disasm();
+  u32 lines = 0;
+  for (u32 addr = start; addr < end; addr += 4) {
+    if (++lines > kMaxPrintedLines) {
+      report->append("            ...\n");
+      break;
+    }
+    const uint64_t samples = SamplesIn(addr, addr + 4);
+    if (samples) {
+      AppendFormat(report, "    %6.2f%%  ", Percent(samples, sample_count_));
+    } else {
+      report->append("             ");
+    }
+    report->append(disasm.Disassemble(addr));
+    report->append("\n");
+  }
+}
+
+
+std::string Profiler::Report(int top) {
+  std::string report(StringFormat("%llu samples, one every %u cycles\n",
+                                  static_cast<unsigned long long>(sample_count_), interval_));
+  if (sample_count_ == 0) return report;
+
+  // functions
+  std::map<u32, uint64_t> function_samples;
+  for (std::unordered_map<u32, uint64_t>::const_iterator itr = histogram_.begin();
+       itr != histogram_.end(); ++itr) {
+    function_samples[FunctionOf(itr->first)] += itr->second;
+  }
+  std::vector<std::pair<uint64_t, u32> > functions;
+  for (std::map<u32, uint64_t>::const_iterator itr = function_samples.begin();
+       itr != function_samples.end(); ++itr) {
+    functions.push_back(std::make_pair(itr->second, itr->first));
+  }
+  std::sort(functions.rbegin(), functions.rend());
+
+  report.append("\nFunctions (entered by jump-and-link)\n");
+  report.append("  entry          samples        %      calls\n");
+  for (int i = 0; i < top && i < static_cast<int>(functions.size()); i++) {
+    const u32 entry = functions[i].second;
+    const uint64_t calls = entry ? functions_[entry] : 0;
+    const std::string name = entry ? StringFormat("0x%08x", entry) : std::string("(no call)");
+    AppendFormat(&report, "  %-10s  %10llu  %6.2f%%  %9llu\n", name.c_str(),
+                 static_cast<unsigned long long>(functions[i].first),
+                 Percent(functions[i].first, sample_count_),
+                 static_cast<unsigned long long>(calls));
+  }
+
+  // basic blocks
+  std::vector<Block> blocks;
+  FindBlocks(&blocks);
+  report.append("\nBasic blocks\n");
+  for (int i = 0; i < top && i < static_cast<int>(blocks.size()); i++) {
+    const Block& block = blocks[i];
+    AppendFormat(&report, "  0x%08x-0x%08x  %6.2f%%  in 0x%08x\n",
+                 block.start, block.end, Percent(block.samples, sample_count_),
+                 FunctionOf(block.start));
+    AppendCode(&report, block.start, block.end);
+  }
+
+  // loops
+  std::vector<Loop> loops;
+  FindLoops(blocks, &loops);
+  report.append("\nLoops\n");
+  for (int i = 0; i < top && i < static_cast<int>(loops.size()); i++) {
+    const Loop& loop = loops[i];
+    AppendFormat(&report, "  0x%08x-0x%08x  %6.2f%%%s\n",
+                 loop.start, loop.end, Percent(loop.samples, sample_count_),
+                 loop.idle ? "  idle" : "");
+    AppendCode(&report, loop.start, loop.end);
+  }
+
+  // functions worth replacing with native code
+  report.append("\nHLE candidates\n");
+  for (std::vector<std::pair<uint64_t, u32> >::const_iterator itr = functions.begin();
+       itr != functions.end(); ++itr) {
+    const u32 entry = itr->second;
+    if (entry == 0 || itr->first < kHLECandidateShare * sample_count_) continue;
+    const uint64_t calls = functions_[entry];
+    if (calls < kHLECandidateCalls) continue;
+    AppendFormat(&report, "  0x%08x  %6.2f%%  %llu calls, %.0f cycles per call\n",
+                 entry, Percent(itr->first, sample_count_),
+                 static_cast<unsigned long long>(calls),
+                 static_cast<double>(itr->first) * interval_ / calls);
+  }
+  return report;
+}
+
+}   // namespace mips
+}   // namespace psx
@@ -143,6 +143,10 @@ void PSX::Memset(PSXAddr dest, int data, int length) {
   Mem().Set(dest, data, length);
 }
 
+u8* PSX::UserMemory(PSXAddr dest, u32* available) {
+  return mem_.UserMemory(dest, available);
+}
+
 
 uint32_t PSX::GetSamplingRate() const {
   return spu_.GetCurrentSamplingRate();
@@ -5,6 +5,7 @@
 #include "psf/psx/rcnt.h"
 #include "psf/psx/disassembler.h"
 #include "psf/psx/interpreter.h"
+#include "psf/psx/profiler.h"
 #include "psf/spu/spu.h"
 #include "common/SoundFormat.h"
 
@@ -125,7 +126,7 @@ Processor::Processor(PSX* psx)
     MemoryAccessor(psx),
     IRQAccessor(psx),
     Regs(), GPR(Regs.GPR),
-    p_rcnt_(nullptr), p_bios_(nullptr) {
+    p_rcnt_(nullptr), p_bios_(nullptr), instruction_count_(0), profiler_(nullptr) {
 
   inDelaySlot = false;
   doingBranch = false;
@@ -175,6 +176,14 @@ void Processor::SetBIOSReferent(BIOS* p_bios) {
   p_bios_ = p_bios;
 }
 
+void Processor::SetProfiler(Profiler* profiler) {
+  profiler_ = profiler;
+}
+
+void Processor::ProfileCall(u32 target) {
+  profiler_->Call(target);
+}
+
 void Processor::Reset()
 {
   ResetRegisters();
@@ -191,6 +200,7 @@ unsigned int Processor::cycle32() const {
 }
 
 void Processor::IncreaseCycle() {
+  ++instruction_count_;
   p_rcnt_->IncreaseCycle();
 }
 
@@ -409,7 +419,13 @@ void Processor::Execute(Interpreter* interp, bool in_softcall) {
     doingBranch = false;
   }
   do {
-    interp->ExecuteOnce();
+    if (profiler_ == nullptr) {
+      interp->ExecuteOnce();
+    } else {
+      const u32 pc = Regs.PC;
+      interp->ExecuteOnce();
+      profiler_->Tick(pc, cycle32());
+    }
   } while (in_softcall && doingBranch == false);
 }
 
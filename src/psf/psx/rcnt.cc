@@ -249,7 +249,7 @@ int RootCounterManager::SPURun() {
       ret = Spu().Advance(step_count);
     } else {
       for (uint32_t i = 0; i < step_count; ++i) {
-        ret = Spu().GetAsync(nullptr);
+        ret = (Spu().*Spu().Get)(nullptr);
         if (ret == false) break;
       }
     }
@@ -291,9 +291,10 @@ EnvelopeActive::EnvelopeActive() : State(EnvelopeOff::Instance()) {
 }
 
 
-void SPUVoice::InitADSR()
+namespace {
+
+bool BuildRateTable()
 {
-  // initialize RateTable
   // RateTable + 32 = { 4, 5, 6, 7, 8, 10, 12, 14, 16, 20, 24, 28, 32, ...}
   ::memset(rateTable, 0, sizeof(uint32_t) * 32);
   uint32_t r = 3, rs = 1, rd = 0;
@@ -310,6 +311,18 @@ void SPUVoice::InitADSR()
     }
     rateTable[i] = r;
   }
+  return true;
+}
+
+}   // namespace
+
+
+void SPUVoice::InitADSR()
+{
+  // rateTable is shared by every SPU instance; build it only once so that
+  // an SPU initialized on another thread never rewrites it while in use.
+  static const bool initialized = BuildRateTable();
+  (void)initialized;
 }
 
 
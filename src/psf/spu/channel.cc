@@ -2,8 +2,10 @@
 #include "psf/spu/spu.h"
 
 #include "common/SoundFormat.h"
-#include "common/SoundManager.h"
 #include "common/debug.h"
+#include "common/hash.h"
+#include "common/perfcounters.h"
+#include <chrono>
 
 
 namespace {
@@ -27,11 +29,15 @@ SPUVoice::SPUVoice()
 SPUVoice::SPUVoice(SPUCore* p_core)
   : p_core_(p_core),
     lpcm_buffer_l(45), lpcm_buffer_r(45),
-    pInterpolation(new GaussianInterpolation),
-    is_ready_(false), ready_cond_(ready_mutex_) {
-  tone = nullptr;
-  is_on_ = false;
-}
+    iSBPos(0), pInterpolation(new GaussianInterpolation),
+    sval(0), tone(nullptr), addr(0),
+    hasReverb(false), iActFreq(0), iUsedFreq(0), Pitch(0.0),
+    iLeftVolume(0), isLeftSweep(false), isLeftExpSlope(false), isLeftDecreased(false),
+    addrExternalLoop(0), useExternalLoop(false),
+    iRightVolume(0), isRightSweep(false), isRightExpSlope(false), isRightDecreased(false),
+    iRawPitch(0), bRVBActive(false), iRVBOffset(0), iRVBRepeat(0),
+    bNoise(false), bFMod(0), iRVBNum(0), iOldNoise(0),
+    is_ready_(false), is_on_(false), env_(0) {}
 
 SPUVoice::SPUVoice(const SPUVoice &info)
   : SPUVoice(info.p_core_) {}
@@ -46,74 +52,21 @@ SPUBase* SPUVoice::p_spu() { return p_core_->p_spu(); }
 const SPUBase* SPUVoice::p_spu() const { return p_core_->p_spu(); }
 
 void SPUVoice::SetReady() const {
-  ready_mutex_.Lock();
+  std::lock_guard<std::mutex> locker(ready_mutex_);
   is_ready_ = true;
-  ready_cond_.Broadcast();
-  ready_mutex_.Unlock();
+  ready_cond_.notify_all();
 }
 
 void SPUVoice::SetUnready() const {
-  ready_mutex_.Lock();
+  std::lock_guard<std::mutex> locker(ready_mutex_);
   is_ready_ = false;
-  ready_cond_.Broadcast();
-  ready_mutex_.Unlock();
-}
-
-
-void SPUVoice::NotifyOnNoteOn() const {
-/*
-  NoteInfo note;
-  note.ch = ch;
-  note.is_on = true;
-  note.tone_number_ = tone->GetAddr();
-  note.pitch = Pitch;
-  note.rate = iActFreq;
-  note.velocity = ADSRX.EnvelopeVol / 1024.0;
-
-  Spu().sound_driver_->OnNoteOn(note);
-  */
+  ready_cond_.notify_all();
 }
 
 
-void SPUVoice::NotifyOnNoteOff() const {
-/*
-  NoteInfo note;
-  note.ch = ch;
-  note.is_on = false;
-  note.tone_number_ = -1;
-  note.pitch = 0.0;
-  note.rate = 0;
-  // note.velocity = ADSRX.EnvelopeVol / 1024.0;
-
-  Spu().sound_driver_->OnNoteOff(note);
-  */
-}
-
-
-void SPUVoice::NotifyOnChangePitch() const {
-/*
-  NoteInfo note;
-  note.ch = ch;
-  note.is_on = is_on_;
-  note.tone_number_ = -1;
-  note.pitch = Pitch;
-  note.rate = iActFreq;
-  note.velocity = static_cast<float>(ADSRX.EnvelopeVol) / 1024.0;
-
-  Spu().sound_driver_->OnChangePitch(note);
-  */
-}
-
-void SPUVoice::NotifyOnChangeVelocity() const {
-/*
-  NoteInfo note;
-  note.ch = ch;
-  note.is_on = is_on_;
-  note.tone_number_ = -1;
-  note.velocity = static_cast<float>(ADSRX.EnvelopeVol) / 1024.0;
-
-  // Spu().sound_driver_->OnChangeVelocity(event);
-  */
+void SPUVoice::UpdatePitch() {
+  const double freq = (tone != nullptr) ? tone->FindFreq() : 0.0;
+  Pitch = (1.0 <= freq) ? (freq * iRawPitch) / 0x1000 : 0.0;
 }
 
 
@@ -133,6 +86,7 @@ void SPUVoice::StartSound()
     tone = p_inst;
   }
   itrTone = p_inst->Iterator(true);
+  UpdatePitch();
 
   pInterpolation->Start();
 
@@ -149,8 +103,6 @@ void SPUVoice::StartSound()
   }
   p_spu()->PutRequest(req);
 
-  NotifyOnNoteOn();
-
   // TODO: Change newChannelFlags
 }
 
@@ -204,12 +156,8 @@ void SPUVoice::Advance() {
   }
 
   // sval = (MixADSR() * fa) / 1023;
-  int prev_envvol = ADSR.envelope_volume();
   int curr_envvol = AdvanceEnvelope();
   sval = (curr_envvol * fa) / 1023;
-  if (prev_envvol != curr_envvol) {
-    NotifyOnChangeVelocity();
-  }
 
   if (bFMod == 2) {
     // TODO: FM
@@ -228,15 +176,18 @@ void SPUVoice::Advance() {
 bool SPUVoice::Get(SampleSequence* dest) const {
   if (dest == nullptr) return false;
 
-  ready_mutex_.Lock();
-  while (is_ready_ == false) {
-    if (ready_cond_.WaitTimeout(1000000) == wxCOND_TIMEOUT) {
-      ready_mutex_.Unlock();
-      rennyLogWarning("SPUVoice", "Get() is timeout.");
-      return false;
+  {
+    std::unique_lock<std::mutex> locker(ready_mutex_);
+    if (is_ready_ == false) {
+      PerfTimer timer(PerfCounters::kVoiceWaitTime);
+      if (ready_cond_.wait_for(locker, std::chrono::seconds(1000),
+                               [this]{ return is_ready_; }) == false) {
+        locker.unlock();
+        rennyLogWarning("SPUVoice", "Get() is timeout.");
+        return false;
+      }
     }
   }
-  ready_mutex_.Unlock();
 
   const float fvol_left  = static_cast<float>(iLeftVolume) / 0x4000;
   const float fvol_right = static_cast<float>(iRightVolume) / 0x4000;
@@ -282,11 +233,22 @@ bool SPUCoreVoiceManager::ExistsNew() const {
 
 void SPUCoreVoiceManager::SoundNew(uint32_t flags, int start) {
   rennyAssert(start < 32);
+  if (flags == 0) return;
   new_flags_ |= flags << start;
+  SPUBase* const p_spu = p_core_->p_spu();
+  // what the sequencer asked for, for loop detection
+  uint64_t fingerprint = Fnv1a::Add32(Fnv1a::kOffsetBasis, static_cast<uint32_t>(p_core_ - &p_spu->core(0)));
   for (int i = start; flags != 0; ++i, flags >>= 1) {
     if ((flags & 1) == 0) continue;
-    VoiceRef(i).StartSound();
+    SPUVoice& voice = VoiceRef(i);
+    fingerprint = Fnv1a::Add32(fingerprint, i);
+    fingerprint = Fnv1a::Add32(fingerprint, voice.addr);
+    fingerprint = Fnv1a::Add32(fingerprint, voice.iRawPitch);
+    fingerprint = Fnv1a::Add32(fingerprint, voice.iLeftVolume);
+    fingerprint = Fnv1a::Add32(fingerprint, voice.iRightVolume);
+    voice.StartSound();
   }
+  p_spu->NotifyOnKeyOn(fingerprint);
 }
 
 void SPUCoreVoiceManager::VoiceOff(uint32_t flags, int start) {
@@ -2,6 +2,7 @@
 #include "psf/psx/psx.h"
 #include "psf/psx/memory.h"
 #include "common/debug.h"
+#include "psf/psflog.h"
 #include <cstring>
 
 
@@ -62,6 +63,11 @@ void SPUCore::WriteDMAMemory(PSXAddr psx_addr, uint32_t size) {
   SPUAddr spu_addr = addr_;
   uint16_t* p_psx_mem16 = p_spu_->psxMu16ptr(psx_addr);
   unsigned int kMemorySize = p_spu_->memory_size();
+  SPULogWriter* const log_writer = p_spu_->log_writer();
+  if (log_writer != nullptr) {
+    log_writer->WriteDMA(p_spu_->sample_count(), static_cast<int>(this - &p_spu_->core(0)),
+                         p_psx_mem16, size);
+  }
 #ifdef MSB_FIRST
   for (uint32_t i = 0; i < size; i += 2) {
     p_spu_->mem16_ref(spu_addr) = *p_psx_mem16++;
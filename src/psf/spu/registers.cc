@@ -1,4 +1,5 @@
 #include "psf/spu/spu.h"
+#include "psf/psflog.h"
 #include "common/debug.h"
 
 
@@ -201,11 +202,9 @@ uint16_t read1daa(const SPUBase& spu)
   return spu.core(0).ctrl_;
 }
 
-static unsigned short var_1dac = 0x4;
-
-uint16_t read1dac(const SPUBase& /*spu*/)
+uint16_t read1dac(const SPUBase& spu)
 {
-  return var_1dac;
+  return spu.core(0).transfer_ctrl_;
 }
 
 uint16_t read1dae(const SPUBase& spu)
@@ -323,22 +322,12 @@ void write1xx2(SPUVoice& channelInfo, uint16_t volume)
 void write1xx4(SPUVoice& channelInfo, uint16_t val)
 {
   int NP = (val > 0x3fff) ? 0x3fff : val;
-  if (channelInfo.iRawPitch != NP) {
-    channelInfo.iRawPitch = NP;
-    channelInfo.NotifyOnChangePitch();
-  }
+  channelInfo.iRawPitch = NP;
   const uint32_t sampling_rate = channelInfo.p_spu()->GetCurrentSamplingRate();
   NP = sampling_rate * NP / 0x1000;
   if (NP < 1) NP = 1;
   channelInfo.iActFreq = NP;
-  if (channelInfo.tone != nullptr) {
-    const double freq = channelInfo.tone->freq();
-    if (1.0 <= freq) {
-      channelInfo.Pitch = (freq * channelInfo.iRawPitch) / 0x1000;
-    } else {
-      channelInfo.Pitch = 0.0;
-    }
-  }
+  channelInfo.UpdatePitch();
 }
 
 // Set start address of Sound
@@ -353,7 +342,7 @@ void write1xx6(SPUVoice& channelInfo, uint16_t val)
   if (spu_inst == 0) {
     spu_inst = new SPUInstrument_New(Spu, id << 3, channelInfo.addrExternalLoop);
     Spu.soundbank().set_instrument(spu_inst);
-    wxMessageOutputDebug().Printf(wxT("SPU: created a new instrument. (id = %d)"), inst->id());
+    rennyLogDebug("SPU", "Created a new instrument. (id = %d)", spu_inst->id());
   }
   channelInfo.tone = spu_inst;
 */
@@ -585,10 +574,10 @@ void write1daa(SPUBase* spu, uint16_t val)
   core.ctrl_ = val;
 }
 
-// Set var_1dac
-void write1dac(SPUBase* /*spu*/, uint16_t val)
+// Set SPU RAM transfer control
+void write1dac(SPUBase* spu, uint16_t val)
 {
-  var_1dac = val;
+  spu->core(0).transfer_ctrl_ = val;
 }
 
 // Set SPU status
@@ -632,6 +621,10 @@ void SPUBase::WriteRegister(uint32_t reg, uint16_t val)
 {
   rennyAssert((reg & 0xfffffe00) == 0x1f801c00);
 
+  if (log_writer_ != nullptr) {
+    log_writer_->WriteRegister(sample_count_, reg, val);
+  }
+
   // wxCriticalSectionLocker csLocker(csDMAWritable_);
 
   // wxMessageOutputDebug().Printf("SPUwriteRegister at 0x%08x", reg);
@@ -51,6 +51,8 @@ void REVERBInfo::Reset() {
   iLastRVBRight = 0;
   iRVBLeft = 0;
   iRVBRight = 0;
+  output_left_ = 0;
+  output_right_ = 0;
 
   dbpos_ = 0;
 
@@ -62,7 +64,7 @@ void REVERBInfo::Reset() {
 
 
 void REVERBInfo::ClearReverb() {
-  if (sReverbStart == 0) {
+  if (sReverbStart == nullptr) {
     InitReverb();
     return;
   }
@@ -200,7 +202,6 @@ int REVERBInfo::GetBuffer(int ofs) const
   }
   while (ofs < iStartAddr) {
     ofs = 0x3ffff - (iStartAddr - ofs);
-    wxMessageOutputDebug().Printf(wxT("w"));
   }
   // return (int)*(p+ofs);
   // wxMessageOutputDebug().Printf(wxT("ofs = %d"), ofs*2);
@@ -1,9 +1,11 @@
 #include "psf/spu/soundbank.h"
 #include "psf/spu/spu.h"
+#include "psf/spu/spectrum.h"
 #include "psf/psx/psx.h"
-#include "common/SoundManager.h"
 #include "common/debug.h"
+#include "common/perfcounters.h"
 
+#include <atomic>
 #include <cmath>
 #include <stdexcept>
 
@@ -338,142 +340,6 @@ SamplingToneIterator& SamplingToneIterator::operator +=(int n) {
 }
 
 
-////////////////////////////////////////////////////////////////////////
-// Fourier Transformer
-////////////////////////////////////////////////////////////////////////
-
-
-FourierTransformer::FourierTransformer()
-{
-  thread_ = 0;
-  mutexQueue_ = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
-  condQueue_ = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
-  requiresShutdown_ = false;
-}
-
-
-FourierTransformer::~FourierTransformer()
-{
-  if (thread_) {
-    requiresShutdown_ = true;
-    pthread_cond_broadcast(&condQueue_);
-    pthread_join(thread_, 0);
-  }
-}
-
-
-void FourierTransformer::PostTransform(SPUInstrument* tone, int sampling_rate)
-{
-  if (0.0 < tone->GetFreq()) return;
-
-  pthread_mutex_lock(&mutexQueue_);
-  queue_.push_back(tone);
-  sampling_rate_ = sampling_rate;
-  pthread_cond_broadcast(&condQueue_);
-  pthread_mutex_unlock(&mutexQueue_);
-  if (thread_ == 0) {
-    pthread_create(&thread_, 0, mainLoop, this);
-  }
-  // wxMessageOutputDebug().Printf(wxT("Post FFT (offset = %d)"), tone->GetAddr());
-}
-
-
-extern "C" void cdft(int, int, double *, int *, double *);
-
-void* FourierTransformer::mainLoop(void *param)
-{
-  FourierTransformer *ft = (FourierTransformer*)param;
-  SPUInstrument* tone = 0;
-
-  double* a = 0;
-  int* ip = 0;
-  double* w = 0;
-  int np = 0;
-
-  do {
-    do {
-      pthread_mutex_lock(&ft->mutexQueue_);
-      if (ft->queue_.empty()) {
-        pthread_mutex_unlock(&ft->mutexQueue_);
-        break;
-      }
-      tone = ft->queue_.front();
-      ft->queue_.pop_front();
-      pthread_mutex_unlock(&ft->mutexQueue_);
-
-      // const int32_t *p = tone->GetData();
-      int len = tone->GetLength();
-      int n = (int) pow( 2.0, ceil(log(len) / log(2.0)) );
-
-      if (np < n) {
-        if (np) {
-          delete [] w;
-          delete [] ip;
-          delete [] a;
-        }
-        np = n;
-        a = new double[np*2];
-        ip = new int[2+(int)sqrt(np)];
-        w = new double[np];
-        ip[0] = 0;
-      }
-
-      SamplingToneIterator itr = tone->Iterator(nullptr);
-      int i = 0;
-      while (i < n) {
-        // a[i] = (double)tone->At(dn+i);
-        if (itr.HasNext() == false) break;
-        a[i++] = (double)itr.Next();
-      }
-      if (i < n) n >>= 1;
-
-      cdft(n, -1, a, ip, w);
-
-      double valMax = 0.0;
-      int indexMax = 0;
-      for (int i = 0; i < n/4; i++) {
-        const double re = a[2*i];
-        const double im = a[2*i+1];
-        const double val = re*re + im*im;
-        if (valMax < val) {
-          valMax = val;
-          indexMax = i;
-        }
-      }
-
-      while (0 < indexMax) {
-        const int n = indexMax / 2;
-        const double re = a[2*n];
-        const double im = a[2*n+1];
-        const double val = re*re + im*im;
-        if (val <= 63*valMax/64) break;
-        valMax = val;
-        indexMax = n;
-      }
-
-      double freq = static_cast<double>(ft->sampling_rate_) * indexMax / n;
-      tone->SetFreq(freq);
-      tone->soundbank().NotifyOnModify(tone);
-      // wxMessageOutputDebug().Printf(wxT("Finished FFT (offset = %d, freq = %d)"), tone->GetAddr(), indexMax);
-    } while (true);
-
-    if (ft->requiresShutdown_) break;
-
-    pthread_mutex_lock(&ft->mutexQueue_);
-    pthread_cond_wait(&ft->condQueue_, &ft->mutexQueue_);
-    pthread_mutex_unlock(&ft->mutexQueue_);
-
-  } while (ft->requiresShutdown_ == false);
-
-  if (np) {
-    delete [] w;
-    delete [] ip;
-    delete [] a;
-  }
-
-  return 0;
-}
-
 #endif
 
 SoundBank::SoundBank(SPUBase *pSPU) : pSPU_(pSPU)
@@ -599,16 +465,6 @@ void SoundBank::FourierTransform(SPUInstrument *tone)
 }
 #endif
 
-void SoundBank::AddListener(wxEvtHandler* listener)
-{
-  listeners_.insert(listener);
-}
-
-void SoundBank::RemoveListener(wxEvtHandler* listener)
-{
-  listeners_.erase(listener);
-}
-
 #if 0
 void SoundBank::OnMuteTone(wxCommandEvent& event) {
   const int id = event.GetInt();
@@ -631,10 +487,36 @@ void SoundBank::OnUnmuteTone(wxCommandEvent& event) {
 
 
 PCM_Converter::PCM_Converter(SPUInstrument_New* p_inst, uint8_t *p_adpcm)
-  : wxThread(wxTHREAD_JOINABLE), p_inst_(p_inst), p_adpcm_(p_adpcm) {}
+  : p_inst_(p_inst), p_adpcm_(p_adpcm), task_(TaskPool::kPriorityDecode) {}
+
+
+PCM_Converter::~PCM_Converter() {
+  Wait();
+}
 
 
-wxThread::ExitCode PCM_Converter::Entry() {
+namespace {
+std::atomic<int> decoding_count(0);
+}
+
+
+void PCM_Converter::Run() {
+  PerfCounters::SetGauge(PerfCounters::kDecodingInstruments, ++decoding_count);
+  task_.Run([this] { Entry(); });
+}
+
+
+void PCM_Converter::Help() {
+  task_.RunOne();
+}
+
+
+void PCM_Converter::Wait() {
+  task_.Wait();
+}
+
+
+void PCM_Converter::Entry() {
 
   static const int xa_adpcm_table[5][2] = {
     {   0,   0 },
@@ -657,13 +539,13 @@ wxThread::ExitCode PCM_Converter::Entry() {
   int d, s, fa;
 
   unsigned int& read_size = p_inst_->read_size_;
-  wxMutex& read_mutex = p_inst_->read_mutex_;
-  wxCondition& read_cond = p_inst_->read_cond_;
+  std::mutex& read_mutex = p_inst_->read_mutex_;
+  std::condition_variable& read_cond = p_inst_->read_cond_;
 
   // wxMessageOutputDebug().Printf(wxT("Read instrument data. (addr = %d, ext_loop_addr = %d, p_adpcm = %p)"),
   //                               addr, ext_loop_addr, p_adpcm);
 
-  while (TestDestroy() == false) {
+  while (true) {
 
     if (read_size >= p_inst_->length_) {
       rennyLogWarning("SPU_PCMConverter", "Memory is over. (id = %d)", p_inst_->id());
@@ -697,10 +579,11 @@ wxThread::ExitCode PCM_Converter::Entry() {
       p_inst_->data_.push_back(fa);
     }
 
-    read_mutex.Lock();
-    read_size += 28;
-    read_cond.Broadcast();
-    read_mutex.Unlock();
+    {
+      std::lock_guard<std::mutex> locker(read_mutex);
+      read_size += 28;
+      read_cond.notify_all();
+    }
 
     if ( flags & 4 ) continue;
     if ( flags & 1 ) {
@@ -712,15 +595,15 @@ wxThread::ExitCode PCM_Converter::Entry() {
       }
     }
   }
-  return 0;
-}
 
+  const uint64_t fingerprint = SpectrumCache::Fingerprint(p_inst_->data_, p_inst_->loop_);
+  SpectrumCache::Instance().Post(p_inst_->id(), fingerprint, p_inst_->data_, p_inst_->loop_,
+                                 p_inst_->spu_.GetDefaultSamplingRate());
+  p_inst_->fingerprint_.store(fingerprint, std::memory_order_release);
 
-void PCM_Converter::OnExit() {  
-/*
-  wxMessageOutputDebug().Printf(wxT("Finished creating instrument data. (id = %d, read_size = %d)"),
-                                p_inst_->id(), p_inst_->read_size_);
-*/
+  PerfCounters::Add(PerfCounters::kDecodedInstruments, 1);
+  PerfCounters::Add(PerfCounters::kDecodedSamples, read_size);
+  PerfCounters::SetGauge(PerfCounters::kDecodingInstruments, --decoding_count);
 }
 
 
@@ -774,20 +657,19 @@ void SPUInstrument_New::Init() {
   MeasureLength();
   data_.reserve(length_);
   thread_ = new PCM_Converter(this, spu_.GetSoundBuffer() + addr_);
-  thread_->Create();
   thread_->Run();
 }
 
 
 void SPUInstrument_New::Reset() {
   if (thread_) {
-    if (thread_->IsRunning()) {
-      thread_->Wait();
-    }
+    thread_->Wait();
     delete thread_;
     thread_ = 0;
   }
   read_size_ = 0;
+  fingerprint_ = 0;
+  set_freq(0.0);
   data_.clear();
   length_ = 0;
   loop_ = -1;
@@ -796,7 +678,7 @@ void SPUInstrument_New::Reset() {
 
 SPUInstrument_New::SPUInstrument_New(const SPUBase& spu, SPUAddr addr, SPUAddr loop)
   : spu_(spu), addr_(addr), data_(0), length_(0), loop_(-1), external_loop_addr_(loop),
-    read_size_(0), thread_(0), read_mutex_(), read_cond_(read_mutex_) {
+    read_size_(0), thread_(0), fingerprint_(0) {
   Init();
 }
 
@@ -813,10 +695,13 @@ int SPUInstrument_New::id() const {
 
 int SPUInstrument_New::at(int i) const {
   if (static_cast<int>(length()) <= i) return kInvalidData;
-  wxMutexLocker locker(read_mutex_);
-  while (static_cast<int>(read_size_) <= i) {
-    read_cond_.Wait();
+  std::unique_lock<std::mutex> locker(read_mutex_);
+  if (static_cast<int>(read_size_) <= i && thread_ != nullptr) {
+    locker.unlock();
+    thread_->Help();
+    locker.lock();
   }
+  read_cond_.wait(locker, [this, i]{ return i < static_cast<int>(read_size_); });
   return data_.at(i);
 }
 
@@ -853,4 +738,21 @@ int SPUInstrument_New::CalculateId(SPUAddr addr, SPUAddr external_loop) {
   return ((addr >> 4) << 16) + (external_loop >> 4);
 }
 
+
+double SPUInstrument_New::FindFreq() {
+  const double cached = freq();
+  if (cached != 0.0) return (0.0 < cached) ? cached : 0.0;
+  const uint64_t fingerprint = fingerprint_.load(std::memory_order_acquire);
+  double f;
+  if (fingerprint == 0 || SpectrumCache::Instance().Find(id(), fingerprint, &f) == false) {
+    return 0.0;
+  }
+  if (f < 1.0) {
+    set_freq(-1.0);   // analyzed, but without a pitch
+    return 0.0;
+  }
+  set_freq(f);
+  return f;
+}
+
 }   // namespace SPU
@@ -0,0 +1,164 @@
+#include "psf/spu/spectrum.h"
+#include "common/debug.h"
+#include "common/hash.h"
+#include "common/taskpool.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+extern "C" void rdft(int, int, double *, int *, double *);
+
+
+namespace SPU {
+
+
+const unsigned int SpectrumCache::kMinLength;
+const unsigned int SpectrumCache::kMaxLength;
+
+
+SpectrumCache& SpectrumCache::Instance() {
+  // Never destroyed: a batch may still be running when the process exits.
+  static SpectrumCache* instance = nullptr;
+  static std::once_flag once;
+  std::call_once(once, [] { instance = new SpectrumCache; });
+  return *instance;
+}
+
+
+uint64_t SpectrumCache::Fingerprint(const std::vector<int>& pcm, int loop) {
+  uint64_t hash = Fnv1a::AddWord(Fnv1a::kOffsetBasis, static_cast<uint32_t>(loop));
+  for (int s : pcm) {
+    hash = Fnv1a::AddWord(hash, static_cast<uint32_t>(s));
+  }
+  return (hash != 0) ? hash : 1;
+}
+
+
+void SpectrumCache::Post(int id, uint64_t fingerprint, const std::vector<int>& pcm, int loop, int sampling_rate) {
+  const unsigned int length = pcm.size();
+  const bool is_loop = (0 <= loop && loop < static_cast<int>(length));
+  unsigned int n = 0;
+  if (kMinLength <= length || (is_loop && 0 < length)) {
+    // a looped instrument is repeated to the full length
+    const unsigned int limit = is_loop ? kMaxLength : std::min(length, kMaxLength);
+    for (n = kMinLength; n * 2 <= limit; n *= 2) {}
+  }
+
+  std::lock_guard<std::mutex> locker(mutex_);
+  Entry& entry = entries_[id];
+  if (entry.fingerprint == fingerprint) return;
+  entry.fingerprint = fingerprint;
+  entry.freq = 0.0;
+  entry.is_done = (n == 0);
+  if (n == 0) return;
+
+  Job job;
+  job.id = id;
+  job.fingerprint = fingerprint;
+  job.pcm = pcm;
+  job.loop = is_loop ? loop : -1;
+  job.sampling_rate = sampling_rate;
+  job.n = n;
+  pending_.push_back(std::move(job));
+  if (scheduled_) return;
+  scheduled_ = true;
+  TaskPool::Instance().Submit(TaskPool::kPriorityAnalysis, [this] { RunBatches(); });
+}
+
+
+bool SpectrumCache::Find(int id, uint64_t fingerprint, double* freq) const {
+  std::lock_guard<std::mutex> locker(mutex_);
+  std::unordered_map<int, Entry>::const_iterator itr = entries_.find(id);
+  if (itr == entries_.end()) return false;
+  const Entry& entry = itr->second;
+  if (entry.fingerprint != fingerprint || entry.is_done == false) return false;
+  *freq = entry.freq;
+  return true;
+}
+
+
+void SpectrumCache::RunBatches() {
+  std::vector<double> a, w;
+  std::vector<int> ip;
+  while (true) {
+    std::vector<Job> batch;
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      if (pending_.empty()) {
+        scheduled_ = false;
+        return;
+      }
+      batch.swap(pending_);
+    }
+
+    // The table made for the longest transform serves the shorter ones,
+    // but growing it afterwards would overwrite a part of it.
+    std::sort(batch.begin(), batch.end(), [](const Job& lhs, const Job& rhs) { return lhs.n > rhs.n; });
+    const unsigned int n_max = batch.front().n;
+    if (a.size() < n_max) {
+      a.resize(n_max);
+      w.resize(n_max / 2);
+      ip.assign(3 + static_cast<int>(std::sqrt(n_max / 2.0)), 0);
+    }
+
+    for (const Job& job : batch) {
+      {
+        // skip PCM which has been replaced since
+        std::lock_guard<std::mutex> locker(mutex_);
+        if (entries_[job.id].fingerprint != job.fingerprint) continue;
+      }
+      const double freq = Analyze(job, a.data(), ip.data(), w.data());
+      std::lock_guard<std::mutex> locker(mutex_);
+      Entry& entry = entries_[job.id];
+      if (entry.fingerprint != job.fingerprint) continue;
+      entry.freq = freq;
+      entry.is_done = true;
+    }
+    rennyLogDebug("SpectrumCache", "Analyzed %d instruments.", static_cast<int>(batch.size()));
+  }
+}
+
+
+double SpectrumCache::Analyze(const Job& job, double* a, int* ip, double* w) {
+  const int n = job.n;
+  const int length = job.pcm.size();
+  const double pi = std::acos(-1.0);
+  int j = 0;
+  for (int i = 0; i < n; i++) {
+    if (length <= j) j = job.loop;
+    // Hann window
+    a[i] = job.pcm[j++] * (0.5 - 0.5 * std::cos(2.0 * pi * i / n));
+  }
+
+  rdft(n, 1, a, ip, w);
+
+  // a[2k], a[2k+1] are the real and imaginary parts of bin k (0 < k < n/2)
+  double val_max = 0.0;
+  int index_max = 0;
+  for (int k = 1; k < n / 4; k++) {
+    const double re = a[2*k];
+    const double im = a[2*k+1];
+    const double val = re*re + im*im;
+    if (val_max < val) {
+      val_max = val;
+      index_max = k;
+    }
+  }
+
+  // prefer the fundamental if it is nearly as strong as an overtone
+  while (1 < index_max) {
+    const int k = index_max / 2;
+    const double re = a[2*k];
+    const double im = a[2*k+1];
+    const double val = re*re + im*im;
+    if (val <= 63*val_max/64) break;
+    val_max = val;
+    index_max = k;
+  }
+
+  return static_cast<double>(job.sampling_rate) * index_max / n;
+}
+
+
+}   // namespace SPU
@@ -1,11 +1,15 @@
 #include "psf/spu/spu.h"
 #include "psf/psx/psx.h"
 #include "common/debug.h"
-#include <wx/hashmap.h>
+#include "common/loopdetector.h"
+#include "common/perfcounters.h"
+#include "common/voicefeed.h"
+#include "psf/psflog.h"
+#include <algorithm>
 #include <cstring>
+#include <chrono>
 
 #include "psf/psx/hardware.h"
-#include "common/SoundManager.h"
 
 
 namespace {
@@ -16,15 +20,10 @@ inline int32_t CLIP(int32_t x) {
   return x;
 }
 */
-int32_t poo;
 
 }   // namespace
 
 
-wxDEFINE_EVENT(wxEVENT_SPU_CHANNEL_CHANGE_LOOP, wxCommandEvent);
-
-
-
 namespace SPU {
 
 
@@ -33,17 +32,12 @@ namespace SPU {
 ////////////////////////////////////////////////////////////////////////
 
 
-namespace {
-WX_DECLARE_HASH_MAP(long, SPURequest*, wxIntegerHash, wxIntegerEqual, RequestMap);
-}
-
-
-const SPURequest* SPUStepRequest::CreateRequest(int step_count) {
-  static RequestMap pool(1);
-  RequestMap::const_iterator itr = pool.find(step_count);
+const SPURequest* SPUStepRequest::CreateRequest(SPUBase* p_spu, int step_count) {
+  SPUStepRequestPool& pool = p_spu->step_requests_;
+  SPUStepRequestPool::const_iterator itr = pool.find(step_count);
   if (itr == pool.end()) {
     SPURequest* req = new SPUStepRequest(step_count);
-    pool.insert(RequestMap::value_type(step_count, req));
+    pool.insert(SPUStepRequestPool::value_type(step_count, req));
     return req;
   }
   return itr->second;
@@ -51,6 +45,7 @@ const SPURequest* SPUStepRequest::CreateRequest(int step_count) {
 
 
 void SPUStepRequest::Execute(SPUBase* p_spu) const {
+  PerfTimer timer(PerfCounters::kSPUStepTime);
   int step = step_count_;
   while (step--) {
     const int core_count = p_spu->core_count();
@@ -66,6 +61,7 @@ void SPUStepRequest::Execute(SPUBase* p_spu) const {
           rvb.StoreReverb(ch);
         }
       }
+      PerfTimer rvb_timer(PerfCounters::kReverbTime);
       rvb.Mix();
     }
   }
@@ -73,12 +69,11 @@ void SPUStepRequest::Execute(SPUBase* p_spu) const {
 
 
 const SPURequest* SPUNoteOnRequest::CreateRequest(SPUVoice* p_voice) {
-  static RequestMap pool(1);
-  int pool_index = reinterpret_cast<long>(p_voice);  // WARNING
-  RequestMap::const_iterator itr = pool.find(pool_index);
+  SPUVoiceRequestPool& pool = p_voice->p_spu()->note_on_requests_;
+  SPUVoiceRequestPool::const_iterator itr = pool.find(p_voice);
   if (itr == pool.end()) {
     SPURequest* req = new SPUNoteOnRequest(p_voice);
-    pool.insert(RequestMap::value_type(pool_index, req));
+    pool.insert(SPUVoiceRequestPool::value_type(p_voice, req));
     return req;
   }
   return itr->second;
@@ -92,12 +87,11 @@ void SPUNoteOnRequest::Execute(SPUBase*) const {
 
 
 const SPURequest* SPUNoteOffRequest::CreateRequest(SPUVoice* p_voice) {
-  static RequestMap pool(1);
-  int pool_index = reinterpret_cast<long>(p_voice);  // WARNING
-  RequestMap::const_iterator itr = pool.find(pool_index);
+  SPUVoiceRequestPool& pool = p_voice->p_spu()->note_off_requests_;
+  SPUVoiceRequestPool::const_iterator itr = pool.find(p_voice);
   if (itr == pool.end()) {
     SPURequest* req = new SPUNoteOffRequest(p_voice);
-    pool.insert(RequestMap::value_type(pool_index, req));
+    pool.insert(SPUVoiceRequestPool::value_type(p_voice, req));
     return req;
   }
   return itr->second;
@@ -109,12 +103,11 @@ void SPUNoteOffRequest::Execute(SPUBase*) const {
 
 
 const SPURequest* SPUSetOffsetRequest::CreateRequest(SPUVoice* p_voice) {
-  static RequestMap pool(1);
-  int pool_index = reinterpret_cast<long>(p_voice);  // WARNING
-  RequestMap::const_iterator itr = pool.find(pool_index);
+  SPUVoiceRequestPool& pool = p_voice->p_spu()->set_offset_requests_;
+  SPUVoiceRequestPool::const_iterator itr = pool.find(p_voice);
   if (itr == pool.end()) {
     SPURequest* req = new SPUSetOffsetRequest(p_voice);
-    pool.insert(RequestMap::value_type(pool_index, req));
+    pool.insert(SPUVoiceRequestPool::value_type(p_voice, req));
     return req;
   }
   return itr->second;
@@ -131,11 +124,11 @@ void SPUSetOffsetRequest::Execute(SPUBase*) const {
 ////////////////////////////////////////////////////////////////////////
 
 SPUCore::SPUCore()
-  : p_spu_(nullptr), voice_manager_(this, 0),
+  : p_spu_(nullptr), voice_manager_(this, 0), transfer_ctrl_(0x4),
     dma_delay_(0), dma_callback_routine_(0), dma_flag_(0) {}
 
 SPUCore::SPUCore(SPUBase* spu)
-  : p_spu_(spu), voice_manager_(this, 24),
+  : p_spu_(spu), voice_manager_(this, 24), transfer_ctrl_(0x4),
     dma_delay_(0), dma_callback_routine_(0), dma_flag_(0) {
   rennyAssert(spu != nullptr);
 }
@@ -187,6 +180,24 @@ SPUBase::SPUBase(psx::PSX* composite)
 }
 
 
+SPUBase::~SPUBase() {
+  if (thread_ != nullptr) {
+    Close();  // the thread may still refer to the pooled requests
+  }
+  for (SPUStepRequestPool::iterator itr = step_requests_.begin(); itr != step_requests_.end(); ++itr) {
+    delete itr->second;
+  }
+  SPUVoiceRequestPool* const voice_pools[] = {
+    &note_on_requests_, &note_off_requests_, &set_offset_requests_
+  };
+  for (SPUVoiceRequestPool* pool : voice_pools) {
+    for (SPUVoiceRequestPool::iterator itr = pool->begin(); itr != pool->end(); ++itr) {
+      delete itr->second;
+    }
+  }
+}
+
+
 uint32_t SPUBase::GetDefaultSamplingRate() const {
   return default_sampling_rate_;
 }
@@ -229,6 +240,13 @@ void SPUBase::NotifyOnChangeLoopIndex(SPUVoice* /*pChannel*/) const
 }
 
 
+void SPUBase::NotifyOnKeyOn(uint64_t fingerprint) const {
+  if (loop_detector_ != nullptr) {
+    loop_detector_->AddEvent(sample_count_, fingerprint);
+  }
+}
+
+
 /*
 void SPUBase::ChangeProcessState(ProcessState state, int ch) {
   pthread_mutex_lock(&process_mutex_);
@@ -247,8 +265,11 @@ void SPUBase::ChangeProcessState(ProcessState state, int ch) {
 
 
 bool SPUBase::Advance(int step_count) {
-  const SPURequest* req = SPUStepRequest::CreateRequest(step_count);
-  thread_->PutRequest(req);
+  if (log_writer_ != nullptr) {
+    log_writer_->Step(sample_count_, step_count);
+  }
+  const SPURequest* req = SPUStepRequest::CreateRequest(this, step_count);
+  PutRequest(req);
   return true;
 }
 
@@ -262,56 +283,79 @@ void SPUBase::NotifyObservers() {
 
 
 bool SPUBase::IsAsync() const {
-  return thread_ != nullptr;
+  return Get == &SPUBase::GetAsync;
 }
 
-/*
-bool SPUBase::GetSync(SoundBlock* dest) {
-
-  const wxVector<SPUCore>::iterator core_it_end = cores_.end();
-  for (wxVector<SPUCore>::iterator core_it = cores_.begin(); core_it != core_it_end; ++core_it) {
+// Must be called before Open(): the synchronous mode runs every request
+// on the caller's thread and does not create an SPUThread.
+void SPUBase::EnableAsync(bool enable) {
+  if (IsAsync() == enable) return;
+  rennyAssert(thread_ == nullptr);
+  Get = enable ? &SPUBase::GetAsync : &SPUBase::GetSync;
+}
 
-    for (unsigned int j = 0; j < 24; j++) {
-      SPUVoice& ch = core_it->Voice(j);
-      ch.Step();
-      ch.Get(&dest->Ch(j));
-    }
 
-    for (unsigned int j = 0; j < 24; j++) {
-      SPUVoice& ch = core_it->Voice(j);
-      if (ch.bRVBActive == true) {
-        Reverb().StoreReverb(ch);
-      }
+void SPUBase::GetVoices(SoundBlock* dest) {
+  // the voices of core c go to channels c * 24 to c * 24 + 23
+  for (unsigned int c = 0; c < cores_.size(); c++) {
+    for (unsigned int i = 0; i < 24; i++) {
+      SPUVoice& ch = cores_[c].Voice(i);
+      ch.Get(&dest->Ch(c * 24 + i));
     }
-    Reverb().Mix();
-
-    Sample& rvb_left = dest->ReverbCh(0);
-    Sample& rvb_right = dest->ReverbCh(1);
-    rvb_left.Set16(Reverb().GetLeft());
-    rvb_right.Set16(Reverb().GetRight());
   }
+  SampleSequence& rvb_left = dest->ReverbCh(0);
+  SampleSequence& rvb_right = dest->ReverbCh(1);
+  rvb_left.Push16i(Reverb().GetLeft());
+  rvb_right.Push16i(Reverb().GetRight());
+}
 
+bool SPUBase::GetSync(SoundBlock* dest) {
+  if (dest == nullptr) { dest = out_; }
+  if (dest == nullptr) return false;
+  GetVoices(dest);
+  SPUStepRequest::CreateRequest(this, 1)->Execute(this);
+  ++sample_count_;
   return true;
 }
-*/
 
 bool SPUBase::GetAsync(SoundBlock* dest) {
   if (thread_ == 0 || thread_->IsRunning() == false) return false;
   if (dest == nullptr) { dest = out_; }
   // thread_->WaitForLastStep();
-  for (auto& core : cores_) {
-    for (unsigned int i = 0; i < 24; i++) {
-      SPUVoice& ch = core.Voice(i);
-      ch.Get(&dest->Ch(i));
+  GetVoices(dest);
+  thread_->PutRequest(SPUStepRequest::CreateRequest(this, 1));
+  ++sample_count_;
+  return true;
+}
+
+
+void SPUBase::PublishVoices(const SoundBlock& block, VoiceFeed* feed) {
+  VoiceSnapshot& snapshot = feed->Write();
+  snapshot.voice_count = std::min<unsigned int>(
+      std::min<unsigned int>(core_count() * 24, block.channel_count()), VoiceSnapshot::kMaxVoices);
+  for (unsigned int i = 0; i < snapshot.voice_count; i++) {
+    // The SPU thread may be rendering the next sample already, so the
+    // envelope and volumes come from the block. Pitch and instrument are
+    // only changed by register writes, on this thread.
+    SPUVoice& voice = Voice(i);
+    if (voice.Pitch == 0.0) {
+      voice.UpdatePitch();    // the instrument may have been analyzed since
     }
-    SampleSequence& rvb_left = dest->ReverbCh(0);
-    SampleSequence& rvb_right = dest->ReverbCh(1);
-    rvb_left.Push16i(Reverb().GetLeft());
-    rvb_right.Push16i(Reverb().GetRight());
-    const SPURequest* req = SPUStepRequest::CreateRequest(1);
-    thread_->PutRequest(req);
+    const SampleSequence& seq = block.Ch(i);
+    VoiceState& state = snapshot.voices[i];
+    state.envelope = 0.0f;
+    state.volume_left = state.volume_right = 0.0f;
+    if (seq.sample_length() > 0) {
+      const int last = static_cast<int>(seq.sample_length()) - 1;
+      state.envelope = static_cast<float>(seq.GetEnv(last)) / 0x7fffffff;
+      seq.volume(last, &state.volume_left, &state.volume_right);
+    }
+    state.on = state.envelope > 0.0f;
+    state.pitch = static_cast<float>(voice.Pitch);
+    state.rate = voice.iActFreq;
+    state.instrument = (voice.tone != nullptr) ? voice.tone->id() : -1;
   }
-  return true;
+  feed->Publish();
 }
 
 
@@ -387,35 +431,66 @@ void SPUBase::RemoveStreams()
 
 
 void SPUBase::PutRequest(const SPURequest *req) {
-  if (thread_ == nullptr) return;
+  if (thread_ == nullptr) {
+    if (req != nullptr && IsAsync() == false) {
+      req->Execute(this);
+    }
+    return;
+  }
   thread_->PutRequest(req);
 }
 
 
 SPUThread::SPUThread(SPUBase *pSPU)
-  : wxThread(wxTHREAD_JOINABLE), pSPU_(pSPU), queue_cond_(queue_mutex_)
+  : pSPU_(pSPU), is_running_(false)
 {
 }
 
 
+SPUThread::~SPUThread() {
+  Wait();
+}
+
+
+void SPUThread::Run() {
+  rennyAssert(thread_.joinable() == false);
+  is_running_ = true;
+  thread_ = std::thread(&SPUThread::Entry, this);
+}
+
+
+void SPUThread::Wait() {
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+
 void SPUThread::PutRequest(const SPURequest *req) {
-  wxMutexLocker locker(queue_mutex_);
+  std::unique_lock<std::mutex> locker(queue_mutex_, std::try_to_lock);
+  if (locker.owns_lock() == false) {
+    PerfTimer timer(PerfCounters::kSPUQueueWaitTime);
+    locker.lock();
+  }
   req_queue_.push_back(req);
-  queue_cond_.Broadcast();
+  PerfCounters::SetGauge(PerfCounters::kSPURequestQueue, req_queue_.size());
+  queue_cond_.notify_all();
 }
 
 
 void SPUThread::WaitForLastStep() {
-  wxMutexLocker locker(queue_mutex_);
+  std::unique_lock<std::mutex> locker(queue_mutex_);
+  if (req_queue_.empty()) return;
+  PerfTimer timer(PerfCounters::kSPUQueueWaitTime);
   while (req_queue_.empty() == false) {
-    if (queue_cond_.WaitTimeout(1000) == wxCOND_TIMEOUT) {
+    if (queue_cond_.wait_for(locker, std::chrono::seconds(1)) == std::cv_status::timeout) {
       rennyLogWarning("SPUThread", "WaitForLastStep(): waiting time is out.");
     }
   }
 }
 
 
-wxThread::ExitCode SPUThread::Entry()
+void SPUThread::Entry()
 {
   rennyAssert(pSPU_ != 0);
   SPUBase* p_spu = pSPU_;
@@ -430,31 +505,28 @@ wxThread::ExitCode SPUThread::Entry()
   rennyLogDebug("SPUThread", "Started SPU thread.");
 
   do {
-    queue_mutex_.Lock();
-    while (req_queue_.empty()) {
-      queue_cond_.Wait();
+    const SPURequest* p_req;
+    {
+      std::unique_lock<std::mutex> locker(queue_mutex_);
+      queue_cond_.wait(locker, [this]{ return req_queue_.empty() == false; });
+      p_req = req_queue_.front();
     }
-    queue_mutex_.Unlock();
 
-    const SPURequest* const p_req = req_queue_.front();
     if (p_req == nullptr) {
-      queue_mutex_.Lock();
+      std::lock_guard<std::mutex> locker(queue_mutex_);
       req_queue_.pop_front();
-      queue_cond_.Broadcast();
-      queue_mutex_.Unlock();
-      return 0;
+      queue_cond_.notify_all();
+      break;
     }
     p_req->Execute(p_spu);
 
-    queue_mutex_.Lock();
+    std::lock_guard<std::mutex> locker(queue_mutex_);
     req_queue_.pop_front();
-    queue_cond_.Broadcast();
-    queue_mutex_.Unlock();
+    PerfCounters::SetGauge(PerfCounters::kSPURequestQueue, req_queue_.size());
+    queue_cond_.notify_all();
   } while (true);
-}
 
-
-void SPUThread::OnExit() {
+  is_running_ = false;
   rennyLogDebug("SPUThread", "Terminated SPU thread.");
 }
 
@@ -465,6 +537,8 @@ void SPUBase::Init()
   SPUVoice::InitADSR();
 
   thread_ = 0;
+  loop_detector_ = nullptr;
+  log_writer_ = nullptr;
 
   rennyLogDebug("SPU", "Initialized SPU.");
 }
@@ -478,14 +552,12 @@ void SPUBase::Open()
   m_pMixIrq = 0;
 
   ns = 0;
+  sample_count_ = 0;
 
   SetupStreams();
 
-  poo = 0;
-
-  if (thread_ == 0) {
+  if (thread_ == 0 && IsAsync()) {
     thread_ = new SPUThread(this);
-    thread_->Create();
     thread_->Run();
     rennyLogDebug("SPU", "Create a thread.");
   }
@@ -495,8 +567,10 @@ void SPUBase::Open()
 
 void SPUBase::Close()
 {
-  if (thread_ != 0 && thread_->IsRunning()) {
-    thread_->PutRequest(nullptr);
+  if (thread_ != 0) {
+    if (thread_->IsRunning()) {
+      thread_->PutRequest(nullptr);
+    }
     thread_->Wait();
     delete thread_;
     thread_ = 0;
@@ -2,6 +2,7 @@
 #include "common/debug.h"
 #include <vorbis/vorbisfile.h>
 #include <stdint.h>
+#include <cstdlib>
 
 namespace {
 
@@ -53,7 +54,7 @@ ov_callbacks VorbisLoader::oc_ = {
 };
 
 
-VorbisLoader::VorbisLoader(int fd, const wxString& filename)
+VorbisLoader::VorbisLoader(int fd, const std::string& filename)
   : file_(fd), path_(filename), loop_start_(-1), loop_length_(0) {
     
   vf_tmp_ = new OggVorbis_File();
@@ -83,21 +84,22 @@ VorbisLoader::~VorbisLoader() {
 }
 
 
-VorbisLoader* VorbisLoader::Instance(int fd, const wxString& filename) {
+VorbisLoader* VorbisLoader::Instance(int fd, const std::string& filename) {
   return new VorbisLoader(fd, filename);
 }
 
 
 SoundInfo* VorbisLoader::LoadInfo() {
 
-  if (ref_info_ != nullptr) {
-    return ref_info_;
+  if (info_ != nullptr) {
+    return info_.get();
   }
+  if (vf_tmp_ == nullptr) return nullptr;
   
   vorbis_comment* vc = ov_comment(vf_tmp_, -1);
   if (vc == nullptr) return nullptr;
   
-  SoundInfo* info = new SoundInfo();
+  std::unique_ptr<SoundInfo> info(new SoundInfo());
   char* comment;
   comment = vorbis_comment_query(vc, "TITLE", 0);
   if (comment) {
@@ -109,35 +111,35 @@ SoundInfo* VorbisLoader::LoadInfo() {
   }
   comment = vorbis_comment_query(vc, "LOOPSTART", 0);
   if (comment) {
-    wxString(comment).ToLong(&loop_start_);
+    loop_start_ = std::strtol(comment, nullptr, 10);
     // rennyLogDebug("VorbisLoader", "LOOPSTART = %d", loop_start_);
   } else {
     loop_start_ = -1L;
   }
   comment = vorbis_comment_query(vc, "LOOPLENGTH", 0);
   if (comment) {
-    wxString(comment).ToLong(&loop_length_);
+    loop_length_ = std::strtol(comment, nullptr, 10);
     // rennyLogDebug("VorbisLoader", "LOOPLENGTH = %d", loop_length_);
   } else {
     loop_length_ = 0L;
   }
   
-  ref_info_ = info;
-  return info;
+  info_ = std::move(info);
+  return info_.get();
 }
 
 
 Vorbis* VorbisLoader::LoadDataEx() {
   
   LoadInfo();
-  if (ref_data_ != nullptr) {
-    return ref_data_;
+  if (vf_tmp_ == nullptr) {
+    // the stream has been handed over already
+    rennyLogError("VorbisLoader", "'%s' can be loaded only once.", path_.c_str());
+    return nullptr;
   }
   
   Vorbis* vorbis = new Vorbis(vf_tmp_, loop_start_, loop_length_);
-  if (vorbis) vf_tmp_ = nullptr;
-
-  ref_data_ = vorbis;
+  vf_tmp_ = nullptr;
   return vorbis;
 }
 
@@ -115,7 +115,12 @@ void WavetableList::OnModify(ToneInfo* tone)
   strLoop << loop;
   wxListCtrl::SetItem(itemId, COLUMN_INDEX_LOOP, strLoop);
 
-  float freq = tone->pitch;
+  // the pitch found by the spectrum analysis, as the soundbank command shows it
+  double freq = 0.0;
+  const wxSharedPtr<SoundData>& sound = wxGetApp().GetPlayingSound();
+  if (sound.get() != nullptr) {
+    freq = sound->soundbank().instrument(tone->number).FindFreq();
+  }
   if (freq >= 1.0) {
     wxString strFreq;
     strFreq << freq;
@@ -0,0 +1,511 @@
+/*
+ * rennypsf_bench: micro-benchmarks of the emulator's hot kernels, and
+ * end-to-end runs of synthetic songs (see synthpsf.h).
+ *
+ *   rennypsf_bench [--filter <substring>] [--min-time <ms>] [--json <file>]
+ *   rennypsf_bench --write-psf <dir>
+ *
+ * Every benchmark is calibrated until one run takes at least --min-time
+ * (200 ms by default) and then run five times; the median is reported in
+ * ns per operation, together with operations per second. The "pipeline/"
+ * benchmarks load a synthetic PSF1 through SoundLoader and PSF1Loader and
+ * pull it with SoundData::Render(), so the CPU, the hardware registers,
+ * DMA and the SPU all run as in playback; they also report how many times
+ * faster than real time that is. --json writes the same results to a file
+ * ("-" for stdout) so that runs can be compared. --write-psf only writes
+ * the synthetic songs, e.g. to listen to them.
+ */
+#include "psf/psx/psx.h"
+#include "psf/psx/memory.h"
+#include "psf/psx/r3000a.h"
+#include "psf/psx/interpreter.h"
+#include "psf/spu/spu.h"
+#include "psf/spu/channel.h"
+#include "psf/spu/interpolation.h"
+#include "psf/spu/reverb.h"
+#include "psf/spu/soundbank.h"
+#include "common/SoundFormat.h"
+#include "common/SoundLoader.h"
+#include "common/debug.h"
+#include "common/filepath.h"
+#include "synthpsf.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace psx;
+using namespace psx::mips;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////
+// harness
+////////////////////////////////////////////////////////////////////////
+
+struct Result {
+  std::string name;
+  std::string unit;       // what one operation is
+  uint64_t iterations;    // operations per run
+  double ns_per_op;       // median of the runs
+  double min_ns_per_op;
+  double realtime;        // audio seconds per second, or 0
+};
+
+const int kRuns = 5;
+
+double g_min_time = 0.2;  // seconds
+const char* g_filter = nullptr;
+std::vector<Result> g_results;
+
+// body(n) performs n operations and returns how many it actually did.
+typedef std::function<uint64_t(uint64_t)> Body;
+
+double Measure(const Body& body, uint64_t n, uint64_t* done) {
+  const auto start = std::chrono::steady_clock::now();
+  *done = body(n);
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+// A non-zero sampling_rate makes one operation a frame of audio at that rate.
+void Run(const char* name, const char* unit, const Body& body, uint32_t sampling_rate = 0) {
+  if (g_filter != nullptr && std::strstr(name, g_filter) == nullptr) return;
+
+  uint64_t n = 1, done = 0;
+  for (;;) {
+    const double t = Measure(body, n, &done);
+    if (g_min_time <= t || (1ULL << 40) <= n) break;
+    // aim a bit over the minimum time to avoid another round
+    const double scale = (t <= 0.0) ? 100.0 : std::min(100.0, 1.2 * g_min_time / t);
+    n = std::max(n + 1, static_cast<uint64_t>(n * scale));
+  }
+
+  std::vector<double> ns;
+  for (int i = 0; i < kRuns; ++i) {
+    const double t = Measure(body, n, &done);
+    ns.push_back(t * 1e9 / std::max<uint64_t>(done, 1));
+  }
+  std::sort(ns.begin(), ns.end());
+
+  const double realtime = (sampling_rate == 0) ? 0.0 : 1e9 / ns[kRuns / 2] / sampling_rate;
+  Result result = { name, unit, done, ns[kRuns / 2], ns[0], realtime };
+  g_results.push_back(result);
+  std::printf("%-32s %12.2f ns/%-12s %14.0f %s/s", name, result.ns_per_op, unit,
+              1e9 / result.ns_per_op, unit);
+  if (0.0 < realtime) {
+    std::printf(" %10.1fx realtime", realtime);
+  }
+  std::printf("\n");
+  std::fflush(stdout);
+}
+
+bool WriteJSON(const char* path) {
+  FILE* fp = (std::strcmp(path, "-") == 0) ? stdout : std::fopen(path, "w");
+  if (fp == nullptr) {
+    std::fprintf(stderr, "Failed to open '%s'.\n", path);
+    return false;
+  }
+  std::fprintf(fp, "{\n  \"min_time_ms\": %d,\n  \"runs\": %d,\n  \"benchmarks\": [\n",
+               static_cast<int>(g_min_time * 1000), kRuns);
+  for (size_t i = 0; i < g_results.size(); ++i) {
+    const Result& r = g_results[i];
+    std::fprintf(fp, "    { \"name\": \"%s\", \"unit\": \"%s\", \"iterations\": %llu, "
+                 "\"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, \"ops_per_sec\": %.1f",
+                 r.name.c_str(), r.unit.c_str(), static_cast<unsigned long long>(r.iterations),
+                 r.ns_per_op, r.min_ns_per_op, 1e9 / r.ns_per_op);
+    if (0.0 < r.realtime) {
+      std::fprintf(fp, ", \"realtime\": %.2f", r.realtime);
+    }
+    std::fprintf(fp, " }%s\n", (i + 1 < g_results.size()) ? "," : "");
+  }
+  std::fprintf(fp, "  ]\n}\n");
+  if (fp != stdout) std::fclose(fp);
+  return true;
+}
+
+// keeps results alive without volatile stores in the loops
+uint64_t g_sink;
+
+////////////////////////////////////////////////////////////////////////
+// interpreter
+////////////////////////////////////////////////////////////////////////
+
+const PSXAddr kCodeAddr = 0x80010000;
+const PSXAddr kDataAddr = 0x80100000;
+
+// Write a loop body followed by a jump back to its top and point PC at it.
+void LoadLoop(PSX* psx, const std::vector<u32>& body) {
+  UserMemoryAccessor psxM(&psx->Mem());
+  PSXAddr addr = kCodeAddr;
+  for (size_t i = 0; i < body.size(); ++i, addr += 4) {
+    psxM.psxMu32ref(addr) = body[i];
+  }
+  const s32 back = -static_cast<s32>(body.size()) - 1;
+  psxM.psxMu32ref(addr) = EncodeI(OPCODE_BEQ, GPR_ZR, GPR_ZR, back);
+  psxM.psxMu32ref(addr + 4) = 0;  // delay slot
+  GeneralPurposeRegisters& GPR = psx->R3000a().Regs.GPR;
+  GPR(GPR_PC) = kCodeAddr;
+  GPR(GPR_A0) = kDataAddr;
+  GPR(GPR_T0) = 0x12345678;
+  GPR(GPR_T1) = 0x9abcdef0;
+  GPR(GPR_T2) = 3;
+}
+
+std::vector<u32> ALUMix() {
+  std::vector<u32> code;
+  for (int i = 0; i < 4; ++i) {
+    code.push_back(EncodeR(OPCODE_SPECIAL, GPR_T0, GPR_T1, GPR_T3, 0, SPECIAL_ADDU));
+    code.push_back(EncodeR(OPCODE_SPECIAL, GPR_T3, GPR_T0, GPR_T4, 0, SPECIAL_XOR));
+    code.push_back(EncodeR(OPCODE_SPECIAL, 0, GPR_T4, GPR_T5, 3, SPECIAL_SLL));
+    code.push_back(EncodeR(OPCODE_SPECIAL, GPR_T5, GPR_T1, GPR_T6, 0, SPECIAL_OR));
+    code.push_back(EncodeI(OPCODE_ADDIU, GPR_T6, GPR_T1, 0x1234));
+    code.push_back(EncodeI(OPCODE_ANDI, GPR_T3, GPR_T7, 0xff0f));
+    code.push_back(EncodeR(OPCODE_SPECIAL, GPR_T7, GPR_T2, GPR_T0, 0, SPECIAL_SLTU));
+    code.push_back(EncodeR(OPCODE_SPECIAL, GPR_T1, GPR_T0, GPR_T0, 0, SPECIAL_SUBU));
+  }
+  return code;
+}
+
+std::vector<u32> LoadStoreMix() {
+  std::vector<u32> code;
+  for (int i = 0; i < 4; ++i) {
+    code.push_back(EncodeI(OPCODE_LW, GPR_A0, GPR_T3, 4 * i));
+    code.push_back(EncodeI(OPCODE_SW, GPR_A0, GPR_T0, 64 + 4 * i));
+    code.push_back(EncodeI(OPCODE_LHU, GPR_A0, GPR_T4, 2 * i));
+    code.push_back(EncodeI(OPCODE_SH, GPR_A0, GPR_T1, 128 + 2 * i));
+    code.push_back(EncodeI(OPCODE_LBU, GPR_A0, GPR_T5, i));
+    code.push_back(EncodeI(OPCODE_SB, GPR_A0, GPR_T3, 192 + i));
+    code.push_back(EncodeR(OPCODE_SPECIAL, GPR_T3, GPR_T4, GPR_T6, 0, SPECIAL_ADDU));
+    code.push_back(EncodeI(OPCODE_LW, GPR_A0, GPR_T7, 64 + 4 * i));
+  }
+  return code;
+}
+
+std::vector<u32> BranchMix() {
+  std::vector<u32> code;
+  for (int i = 0; i < 4; ++i) {
+    // taken forward over one instruction, then not taken
+    code.push_back(EncodeI(OPCODE_BNE, GPR_T0, GPR_ZR, 2));
+    code.push_back(EncodeI(OPCODE_ADDIU, GPR_T3, GPR_T3, 1));
+    code.push_back(EncodeI(OPCODE_ADDIU, GPR_T4, GPR_T4, 1));   // skipped
+    code.push_back(EncodeI(OPCODE_BEQ, GPR_T0, GPR_ZR, 2));
+    code.push_back(0);
+    code.push_back(EncodeI(OPCODE_BGTZ, GPR_T2, GPR_ZR, 1));
+    code.push_back(EncodeR(OPCODE_SPECIAL, GPR_T3, GPR_T2, GPR_T5, 0, SPECIAL_SLT));
+  }
+  return code;
+}
+
+void BenchInterpreter(const char* name, const std::vector<u32>& code) {
+  PSX psx(1);
+  psx.Spu().EnableAsync(false);
+  psx.Reset();
+  LoadLoop(&psx, code);
+  Run(name, "insn", [&psx](uint64_t n) -> uint64_t {
+    uint64_t done = 0;
+    while (done < n) {
+      const uint32_t cycles = static_cast<uint32_t>(std::min<uint64_t>(n - done, 1 << 20));
+      done += psx.Interp().Execute(cycles);
+    }
+    return done;
+  });
+  psx.Spu().Shutdown();
+}
+
+////////////////////////////////////////////////////////////////////////
+// memory
+////////////////////////////////////////////////////////////////////////
+
+void BenchMemory() {
+  PSX psx(1);
+  psx.Spu().EnableAsync(false);
+  psx.Reset();
+  Memory& mem = psx.Mem();
+
+  Run("memory/read32/ram", "access", [&mem](uint64_t n) -> uint64_t {
+    u32 sum = 0;
+    for (uint64_t i = 0; i < n; ++i) sum += mem.Read32(kDataAddr + ((i * 4) & 0xfffc));
+    g_sink += sum;
+    return n;
+  });
+  Run("memory/write32/ram", "access", [&mem](uint64_t n) -> uint64_t {
+    for (uint64_t i = 0; i < n; ++i) mem.Write32(kDataAddr + ((i * 4) & 0xfffc), static_cast<u32>(i));
+    return n;
+  });
+  Run("memory/read32/scratchpad", "access", [&mem](uint64_t n) -> uint64_t {
+    u32 sum = 0;
+    for (uint64_t i = 0; i < n; ++i) sum += mem.Read32(0x1f800000 + ((i * 4) & 0x3fc));
+    g_sink += sum;
+    return n;
+  });
+  Run("memory/read32/bios", "access", [&mem](uint64_t n) -> uint64_t {
+    u32 sum = 0;
+    for (uint64_t i = 0; i < n; ++i) sum += mem.Read32(0xbfc00000 + ((i * 4) & 0xfffc));
+    g_sink += sum;
+    return n;
+  });
+  Run("memory/read32/irq", "access", [&mem](uint64_t n) -> uint64_t {
+    u32 sum = 0;
+    for (uint64_t i = 0; i < n; ++i) sum += mem.Read32(0x1f801070);
+    g_sink += sum;
+    return n;
+  });
+  Run("memory/read16/rcnt", "access", [&mem](uint64_t n) -> uint64_t {
+    u32 sum = 0;
+    for (uint64_t i = 0; i < n; ++i) sum += mem.Read16(0x1f801100 + ((i & 3) << 4));
+    g_sink += sum;
+    return n;
+  });
+  Run("memory/write16/spu_voice", "access", [&mem](uint64_t n) -> uint64_t {
+    // volume registers of voices 0-15; no key-on involved
+    for (uint64_t i = 0; i < n; ++i) mem.Write16(0x1f801c00 + ((i & 15) << 4), static_cast<u16>(i & 0x3fff));
+    return n;
+  });
+  psx.Spu().Shutdown();
+}
+
+////////////////////////////////////////////////////////////////////////
+// SPU kernels
+////////////////////////////////////////////////////////////////////////
+
+const SPU::SPUAddr kSampleAddr = 0x1000;
+const int kSampleBlocks = 1024;
+
+void BenchADPCM() {
+  PSX psx(1);
+  psx.Spu().EnableAsync(false);
+  psx.Reset();
+  SPU::SPUBase& spu = psx.Spu();
+
+  uint8_t* p = spu.GetSoundBuffer() + kSampleAddr;
+  uint32_t seed = 1;
+  for (int i = 0; i < kSampleBlocks; ++i, p += 16) {
+    p[0] = static_cast<uint8_t>(((i % 5) << 4) | (i % 12));  // filter, shift
+    p[1] = (i + 1 == kSampleBlocks) ? 1 : 0;                 // end
+    for (int j = 2; j < 16; ++j) {
+      seed = seed * 1103515245 + 12345;
+      p[j] = static_cast<uint8_t>(seed >> 16);
+    }
+  }
+
+  Run("spu/adpcm_decode", "block", [&spu](uint64_t n) -> uint64_t {
+    uint64_t done = 0;
+    while (done < n) {
+      SPU::SPUInstrument_New inst(spu, kSampleAddr, kSampleAddr);
+      g_sink += inst.at(inst.length() - 1);   // waits for PCM_Converter
+      done += kSampleBlocks;
+    }
+    return done;
+  });
+  spu.Shutdown();
+}
+
+void BenchInterpolation(const char* name, SPU::InterpolationBase* interp) {
+  // the voice loop of SPUVoice::Get() without the ADPCM source
+  interp->SetSinc(0x1234);
+  interp->Start();
+  Run(name, "sample", [interp](uint64_t n) -> uint64_t {
+    int src = 0, sum = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+      while (interp->GetSincPosition() >= 0x10000) {
+        src = (src * 75 + 74) & 0xffff;
+        interp->StoreValue(src - 0x8000);
+        interp->SubSincPosition(0x10000);
+      }
+      sum += interp->GetValue();
+      interp->AdvanceSincPosition();
+    }
+    g_sink += sum;
+    return n;
+  });
+}
+
+void BenchADSR() {
+  PSX psx(1);
+  psx.Spu().EnableAsync(false);
+  psx.Reset();
+  SPU::SPUVoice& voice = psx.Spu().Voice(0);
+  psx.Spu().WriteRegister(0x1f801c08, 0x2088);  // ADSR1: attack 0x20, decay 8, sustain 8
+  psx.Spu().WriteRegister(0x1f801c0a, 0xd030);  // ADSR2: exp. decreasing sustain, exp. release
+  voice.ADSR.Set(voice.ADSRX);
+
+  Run("spu/adsr_advance", "sample", [&voice](uint64_t n) -> uint64_t {
+    int sum = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+      sum += voice.AdvanceEnvelope();
+      if ((i & 0x3fff) == 0x3fff) voice.ADSR.Release();
+      if (voice.ADSR.IsOff()) voice.ADSR.Set(voice.ADSRX);
+    }
+    g_sink += sum;
+    return n;
+  });
+  psx.Spu().Shutdown();
+}
+
+// "Room" of the PS1 reverb presets
+const uint16_t kRoomPreset[32] = {
+  0x007d, 0x005b, 0x6d80, 0x54b8, 0xbed0, 0x0000, 0x0000, 0xba80,
+  0x5800, 0x5300, 0x04d6, 0x0333, 0x03f0, 0x0227, 0x0374, 0x01ef,
+  0x0334, 0x01b5, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+  0x0000, 0x0000, 0x01b4, 0x0136, 0x00b8, 0x005c, 0x8000, 0x8000
+};
+
+void BenchReverb() {
+  PSX psx(1);
+  psx.Spu().EnableAsync(false);
+  psx.Reset();
+  SPU::SPUBase& spu = psx.Spu();
+  for (int i = 0; i < 32; ++i) {
+    spu.WriteRegister(0x1f801dc0 + 2 * i, kRoomPreset[i]);
+  }
+  spu.WriteRegister(0x1f801da2, 0xfb28);  // work area of 0x26c0 bytes
+  spu.WriteRegister(0x1f801d84, 0x3fff);  // reverb depth
+  spu.WriteRegister(0x1f801d86, 0x3fff);
+  spu.WriteRegister(0x1f801daa, 0xc080);  // SPU on, reverb master enable
+
+  SPU::REVERBInfo& reverb = spu.Reverb();
+  Run("spu/neil_reverb_mix", "sample", [&reverb](uint64_t n) -> uint64_t {
+    int sum = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+      reverb.sReverbStart[0] = reverb.sReverbStart[2] = static_cast<int>(i & 0x7fff) - 0x4000;
+      reverb.sReverbStart[1] = reverb.sReverbStart[3] = 0x4000 - static_cast<int>(i & 0x7fff);
+      reverb.Mix();
+      sum += reverb.GetLeft() + reverb.GetRight();
+    }
+    g_sink += sum;
+    return n;
+  });
+  spu.Shutdown();
+}
+
+void BenchGetStereo16() {
+  const int kLength = 1024;
+  SoundBlock block(24);
+  block.EnableReverb();
+  for (int ch = 0; ch < 24; ++ch) {
+    block.Ch(ch).set_volume(0.5f, 0.25f);
+    for (int i = 0; i < kLength; ++i) block.Ch(ch).Push16i((i * (ch + 1) * 97) & 0x7fff);
+  }
+  for (int ch = 0; ch < 2; ++ch) {
+    for (int i = 0; i < kLength; ++i) block.ReverbCh(ch).Push16i((i * 31) & 0x3fff);
+  }
+
+  Run("soundblock/get_stereo16", "frame", [&block](uint64_t n) -> uint64_t {
+    short frame[2];
+    int sum = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+      block.GetStereo16(static_cast<int>(i % kLength), frame);
+      sum += frame[0] + frame[1];
+    }
+    g_sink += sum;
+    return n;
+  });
+}
+
+////////////////////////////////////////////////////////////////////////
+// whole pipeline
+////////////////////////////////////////////////////////////////////////
+
+std::string SongPath(const std::string& dir, const synthpsf::SynthPattern& pattern) {
+  return FilePath::Join(dir, std::string("synth_") + pattern.name + ".psf");
+}
+
+bool WriteSongs(const std::string& dir) {
+  for (int i = 0; i < synthpsf::pattern_count(); ++i) {
+    const synthpsf::SynthPattern& pattern = synthpsf::patterns()[i];
+    const std::string path(SongPath(dir, pattern));
+    if (synthpsf::WriteSong(pattern, path) == false) {
+      std::fprintf(stderr, "Failed to write '%s'.\n", path.c_str());
+      return false;
+    }
+    std::printf("%s\n", path.c_str());
+  }
+  return true;
+}
+
+void BenchPipeline(const synthpsf::SynthPattern& pattern) {
+  const std::string name = std::string("pipeline/") + pattern.name;
+  if (g_filter != nullptr && std::strstr(name.c_str(), g_filter) == nullptr) return;
+
+  const std::string path(SongPath(FilePath::TempDirectory(), pattern));
+  if (synthpsf::WriteSong(pattern, path) == false) {
+    std::fprintf(stderr, "%s: failed to write '%s'.\n", name.c_str(), path.c_str());
+    return;
+  }
+  SoundLoader* loader = SoundLoader::Instance(path);
+  SoundData* sound = (loader != nullptr) ? loader->LoadData() : nullptr;
+  if (sound != nullptr && sound->OpenStream()) {
+    // the drivers loop forever, so every run keeps pulling the same song
+    Run(name.c_str(), "frame", [sound](uint64_t n) -> uint64_t {
+      int16_t chunk[1024 * 2];
+      uint64_t done = 0;
+      while (done < n) {
+        const size_t rendered = sound->Render(chunk, static_cast<size_t>(std::min<uint64_t>(n - done, 1024)));
+        if (rendered == 0) break;
+        g_sink += static_cast<uint16_t>(chunk[0]);
+        done += rendered;
+      }
+      return done;
+    }, sound->GetSamplingRate());
+    sound->CloseStream();
+  } else {
+    std::fprintf(stderr, "%s: failed to open '%s'.\n", name.c_str(), path.c_str());
+  }
+  delete sound;
+  delete loader;
+  FilePath::Remove(path);
+}
+
+}   // namespace
+
+
+int main(int argc, char** argv) {
+  rennySetLogSink(&rennyStderrLogSink);
+
+  const char* json_path = nullptr;
+  const char* psf_dir = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      g_filter = argv[++i];
+    } else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+      g_min_time = std::atoi(argv[++i]) / 1000.0;
+    } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--write-psf") == 0 && i + 1 < argc) {
+      psf_dir = argv[++i];
+    } else {
+      std::fprintf(stderr, "usage: %s [--filter <substring>] [--min-time <ms>] [--json <file>]\n"
+                   "       %s --write-psf <dir>\n", argv[0], argv[0]);
+      return 2;
+    }
+  }
+
+  if (psf_dir != nullptr) {
+    return WriteSongs(psf_dir) ? 0 : 1;
+  }
+
+  BenchInterpreter("interpreter/alu", ALUMix());
+  BenchInterpreter("interpreter/load_store", LoadStoreMix());
+  BenchInterpreter("interpreter/branch", BranchMix());
+  BenchMemory();
+  BenchADPCM();
+  SPU::GaussianInterpolation gauss;
+  BenchInterpolation("spu/interpolation/gaussian", &gauss);
+  SPU::CubicInterpolation cubic;
+  BenchInterpolation("spu/interpolation/cubic", &cubic);
+  BenchADSR();
+  BenchReverb();
+  BenchGetStereo16();
+
+  for (int i = 0; i < synthpsf::pattern_count(); ++i) {
+    BenchPipeline(synthpsf::patterns()[i]);
+  }
+
+  if (json_path != nullptr && WriteJSON(json_path) == false) return 1;
+  return (g_sink == 0x5a5a5a5a5a5a5a5aULL) ? 3 : 0;
+}
@@ -0,0 +1,369 @@
+/*
+ * rennypsf_golden: render regression test.
+ *
+ *   rennypsf_golden [--golden <file>] [--history <file>] [--seconds <n>]
+ *                   [--threshold <percent>] [--update] [--strict-timing]
+ *                   [<sound file or directory>...]
+ *
+ * The synthetic songs of synthpsf.h, the files given and those in the
+ * directory $RENNYPSF_GOLDEN_DIR are rendered for --seconds (10 by default)
+ * on the caller's thread, and the 64-bit FNV-1a hash (common/hash.h) of
+ * each output, SoundRenderer::pcm_hash(), is compared with the golden file:
+ *
+ *   # comment
+ *   <hash in hex> <seconds> <track>
+ *
+ * Tracks are "synth/<pattern>" or the file names. A changed hash, or a
+ * track without a golden hash for its length, fails the test. --update
+ * writes the current hashes into the golden file instead, keeping those of
+ * tracks which were not rendered.
+ *
+ * Every run is appended to the --history file, a JSON array with a line per
+ * run, and each track is compared with its fastest render among the last
+ * five runs of the same length: one slower by more than --threshold
+ * percent (20 by default) is flagged, and fails the test with
+ * --strict-timing. Timings depend on the machine, so keep one history file
+ * per machine.
+ */
+#include "common/soundrenderer.h"
+#include "common/debug.h"
+#include "common/filepath.h"
+#include "synthpsf.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+const size_t kHistoryWindow = 5;
+
+struct Track {
+  std::string name;
+  std::string path;
+  bool temporary;   // a synthetic song written for this run
+
+  std::string hash;
+  double wall;        // seconds
+  double realtime;
+  bool rendered;
+};
+
+// golden hashes by "<seconds> <track>"
+typedef std::map<std::string, std::string> GoldenMap;
+
+std::string GoldenKey(int seconds, const std::string& name) {
+  std::ostringstream key;
+  key << seconds << ' ' << name;
+  return key.str();
+}
+
+bool LoadGolden(const std::string& path, GoldenMap* golden) {
+  std::ifstream in(path.c_str());
+  if (in.is_open() == false) return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    std::string hash, name;
+    int seconds;
+    if ((fields >> hash >> seconds).fail()) continue;
+    std::getline(fields >> std::ws, name);
+    if (name.empty()) continue;
+    (*golden)[GoldenKey(seconds, name)] = hash;
+  }
+  return true;
+}
+
+bool SaveGolden(const std::string& path, const GoldenMap& golden) {
+  std::ofstream out(path.c_str());
+  if (out.is_open() == false) return false;
+  out << "# rennypsf_golden: <FNV-1a hash of the PCM> <seconds> <track>\n"
+      << "# Seed or refresh with: rennypsf_golden --golden test/golden.txt --update\n";
+  for (GoldenMap::const_iterator it = golden.begin(); it != golden.end(); ++it) {
+    const size_t space = it->first.find(' ');
+    out << it->second << ' ' << it->first.substr(0, space) << ' '
+        << it->first.substr(space + 1) << '\n';
+  }
+  return out.good();
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream in(path.c_str(), std::ios::binary);
+  std::ostringstream content;
+  content << in.rdbuf();
+  return content.str();
+}
+
+// The fastest wall time of each track among the last runs of the same length.
+std::map<std::string, double> LoadBaseline(const std::string& history, int seconds) {
+  std::vector<std::string> runs;
+  std::istringstream lines(history);
+  std::string line;
+  char key[32];
+  std::snprintf(key, sizeof(key), "\"seconds\": %d,", seconds);
+  while (std::getline(lines, line)) {
+    if (line.find(key) != std::string::npos) runs.push_back(line);
+  }
+
+  std::map<std::string, double> baseline;
+  const size_t first = (runs.size() < kHistoryWindow) ? 0 : runs.size() - kHistoryWindow;
+  for (size_t i = first; i < runs.size(); ++i) {
+    const std::string& run = runs[i];
+    static const char kName[] = "{ \"name\": \"";
+    static const char kWall[] = "\"wall\": ";
+    for (size_t pos = run.find(kName); pos != std::string::npos; pos = run.find(kName, pos)) {
+      pos += sizeof(kName) - 1;
+      const size_t name_end = run.find('"', pos);
+      const size_t wall = run.find(kWall, name_end);
+      if (name_end == std::string::npos || wall == std::string::npos) break;
+      const std::string name = run.substr(pos, name_end - pos);
+      const double t = std::strtod(run.c_str() + wall + sizeof(kWall) - 1, nullptr);
+      std::map<std::string, double>::iterator it = baseline.find(name);
+      if (it == baseline.end()) {
+        baseline[name] = t;
+      } else {
+        it->second = std::min(it->second, t);
+      }
+    }
+  }
+  return baseline;
+}
+
+std::string HostName() {
+#if defined(__unix__) || defined(__APPLE__)
+  char name[256];
+  if (::gethostname(name, sizeof(name)) == 0) {
+    name[sizeof(name) - 1] = '\0';
+    return name;
+  }
+#else
+  const char* const name = std::getenv("COMPUTERNAME");
+  if (name != nullptr) return name;
+#endif
+  return std::string();
+}
+
+//! The local time in ISO 8601, e.g. "2024-01-31T12:34:56".
+std::string ISOTime() {
+  const std::time_t now = std::time(nullptr);
+  char str[32];
+  if (std::strftime(str, sizeof(str), "%Y-%m-%dT%H:%M:%S", std::localtime(&now)) == 0) {
+    return std::string();
+  }
+  return str;
+}
+
+std::string JSONString(const std::string& s) {
+  std::string escaped;
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\') escaped.push_back('\\');
+    escaped.push_back(s[i]);
+  }
+  return escaped;
+}
+
+bool AppendHistory(const std::string& path, int seconds, const std::vector<Track>& tracks) {
+  std::ostringstream run;
+  run << "{ \"time\": \"" << ISOTime()
+      << "\", \"host\": \"" << JSONString(HostName())
+      << "\", \"seconds\": " << seconds << ", \"tracks\": [";
+  bool first = true;
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    const Track& track = tracks[i];
+    if (track.rendered == false) continue;
+    char numbers[96];
+    std::snprintf(numbers, sizeof(numbers), "\"wall\": %.4f, \"realtime\": %.2f",
+                  track.wall, track.realtime);
+    run << (first ? " " : ", ") << "{ \"name\": \"" << JSONString(track.name)
+        << "\", \"hash\": \"" << track.hash << "\", " << numbers << " }";
+    first = false;
+  }
+  run << " ] }";
+
+  // keep the file a JSON array with one run per line
+  std::string content = ReadFile(path);
+  const size_t end = content.find_last_not_of(" \t\r\n");
+  if (end != std::string::npos && content[end] == ']') {
+    content.erase(end);
+    content.append(",\n");
+  } else {
+    content = "[\n";
+  }
+  content.append(run.str());
+  content.append("\n]\n");
+
+  std::ofstream out(path.c_str(), std::ios::binary);
+  out << content;
+  return out.good();
+}
+
+void AddFile(const std::string& path, std::vector<Track>* tracks) {
+  Track track = { FilePath::FullName(path), path, false,
+                  std::string(), 0.0, 0.0, false };
+  tracks->push_back(track);
+}
+
+void AddPath(const std::string& path, std::vector<Track>* tracks) {
+  if (FilePath::IsDirectory(path) == false) {
+    AddFile(path, tracks);
+    return;
+  }
+  std::vector<std::string> files;
+  FilePath::ListFiles(path, &files);
+  for (size_t i = 0; i < files.size(); ++i) {
+    const std::string ext(FilePath::Extension(files[i]));
+    if (ext == "psf" || ext == "minipsf" || ext == "psf2" || ext == "minipsf2") {
+      AddFile(files[i], tracks);
+    }
+  }
+}
+
+int Usage(const char* program) {
+  std::fprintf(stderr,
+               "usage: %s [--golden <file>] [--history <file>] [--seconds <n>]\n"
+               "          [--threshold <percent>] [--update] [--strict-timing]\n"
+               "          [<sound file or directory>...]\n", program);
+  return 2;
+}
+
+}   // namespace
+
+
+int main(int argc, char** argv) {
+  rennySetLogSink(&rennyStderrLogSink);
+
+  std::string golden_path("golden.txt");
+  std::string history_path;
+  int seconds = 10;
+  double threshold = 20.0;
+  bool update = false;
+  bool strict_timing = false;
+  std::vector<const char*> inputs;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+      golden_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+      history_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = std::atoi(argv[++i]);
+      if (seconds <= 0) return Usage(argv[0]);
+    } else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--update") == 0) {
+      update = true;
+    } else if (std::strcmp(argv[i], "--strict-timing") == 0) {
+      strict_timing = true;
+    } else if (argv[i][0] == '-') {
+      return Usage(argv[0]);
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+
+  std::vector<Track> tracks;
+  for (int i = 0; i < synthpsf::pattern_count(); ++i) {
+    const synthpsf::SynthPattern& pattern = synthpsf::patterns()[i];
+    const std::string path(FilePath::Join(FilePath::TempDirectory(),
+                                          std::string("golden_synth_") + pattern.name + ".psf"));
+    Track track = { std::string("synth/") + pattern.name, path, true, std::string(), 0.0, 0.0, false };
+    if (synthpsf::WriteSong(pattern, path) == false) {
+      std::fprintf(stderr, "Failed to write '%s'.\n", path.c_str());
+    }
+    tracks.push_back(track);
+  }
+  const char* const user_dir = std::getenv("RENNYPSF_GOLDEN_DIR");
+  if (user_dir != nullptr && user_dir[0] != '\0') {
+    AddPath(user_dir, &tracks);
+  }
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    AddPath(inputs[i], &tracks);
+  }
+
+  GoldenMap golden;
+  if (LoadGolden(golden_path, &golden) == false && update == false) {
+    std::fprintf(stderr, "No golden file '%s'; every track is missing.\n", golden_path.c_str());
+  }
+  std::map<std::string, double> baseline;
+  if (history_path.empty() == false) {
+    baseline = LoadBaseline(ReadFile(history_path), seconds);
+  }
+
+  int changed = 0, failed = 0, slower = 0, missing = 0;
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    Track& track = tracks[i];
+    SoundRenderer renderer;
+    renderer.set_fixed_length(seconds * 1000);
+    if (renderer.Render(track.path, std::string()) &&
+        renderer.total_frames() != 0 && renderer.rendered_frames() == renderer.total_frames()) {
+      char hash[17];
+      std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(renderer.pcm_hash()));
+      track.hash = hash;
+      track.wall = renderer.elapsed_seconds();
+      track.realtime = renderer.realtime_ratio();
+      track.rendered = true;
+    }
+    if (track.temporary) FilePath::Remove(track.path);
+
+    const char* status;
+    if (track.rendered == false) {
+      status = "FAILED";
+      ++failed;
+    } else {
+      const std::string key = GoldenKey(seconds, track.name);
+      GoldenMap::iterator it = golden.find(key);
+      if (it == golden.end()) {
+        status = update ? "new" : "MISSING";
+        ++missing;
+      } else if (it->second != track.hash) {
+        status = "CHANGED";
+        ++changed;
+      } else {
+        status = "ok";
+      }
+      if (update) golden[key] = track.hash;
+    }
+
+    std::printf("%-8s %-32s %16s %8.3f s %8.1fx", status, track.name.c_str(),
+                track.hash.c_str(), track.wall, track.realtime);
+    std::map<std::string, double>::const_iterator base = baseline.find(track.name);
+    if (track.rendered && base != baseline.end() && 0.0 < base->second) {
+      const double change = (track.wall / base->second - 1.0) * 100.0;
+      std::printf(" %+6.1f%%", change);
+      if (threshold < change) {
+        std::printf(" SLOWER");
+        ++slower;
+      }
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+  }
+
+  if (update && SaveGolden(golden_path, golden) == false) {
+    std::fprintf(stderr, "Failed to write '%s'.\n", golden_path.c_str());
+    ++failed;
+  }
+  if (history_path.empty() == false && AppendHistory(history_path, seconds, tracks) == false) {
+    std::fprintf(stderr, "Failed to write '%s'.\n", history_path.c_str());
+  }
+
+  std::printf("%d tracks: %d changed, %d failed, %d missing, %d slower than %.0f%%%s\n",
+              static_cast<int>(tracks.size()), changed, failed, missing, slower, threshold,
+              update ? " (golden hashes updated)" : "");
+  if (failed != 0) return 1;
+  if ((changed != 0 || missing != 0) && update == false) return 1;
+  if (slower != 0 && strict_timing) return 1;
+  return 0;
+}
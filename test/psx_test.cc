@@ -1,7 +1,21 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include "psf/psx/psx.h"
 #include "psf/psx/rcnt.h"
+#include "psf/psx/hardware.h"
 #include "psf/psx/interpreter.h"
+#include "common/soundrenderer.h"
+#include "common/loopdetector.h"
+#include "common/filepath.h"
+#include "common/voicefeed.h"
+#include "common/taskpool.h"
+#include "common/perfcounters.h"
+#include "synthpsf.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using namespace psx;
 using namespace psx::mips;
@@ -619,8 +633,506 @@ protected:
   }
 };
 
+////////////////////////////////////////////////////////////////////////
+/// \brief The SPU Log Test class
+////////////////////////////////////////////////////////////////////////
+
+class SPULogTest : public CPPUNIT_NS::TestFixture {
+
+  CPPUNIT_TEST_SUITE(SPULogTest);
+  CPPUNIT_TEST(dma_upload_test);
+  CPPUNIT_TEST(reverb_test);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+
+protected:
+  // Render a synthetic song while capturing it, replay the capture, and
+  // compare the PCM of both.
+  void RoundTrip(const char* name) {
+    const synthpsf::SynthPattern* pattern = synthpsf::FindPattern(name);
+    CPPUNIT_ASSERT(pattern != nullptr);
+    const std::string dir(FilePath::TempDirectory());
+    const std::string song_path(FilePath::Join(dir, std::string("psx_test_") + name + ".psf"));
+    const std::string log_path(FilePath::Join(dir, std::string("psx_test_") + name + ".spulog"));
+    CPPUNIT_ASSERT(synthpsf::WriteSong(*pattern, song_path));
+
+    SoundRenderer original;
+    original.set_fixed_length(2000);
+    original.set_capture_path(log_path);
+    const bool captured = original.Render(song_path, std::string());
+    SoundRenderer replay;
+    replay.set_fixed_length(2000);
+    const bool replayed = captured && replay.Render(log_path, std::string());
+    FilePath::Remove(song_path);
+    FilePath::Remove(log_path);
+
+    CPPUNIT_ASSERT(captured);
+    CPPUNIT_ASSERT(replayed);
+    CPPUNIT_ASSERT(original.rendered_frames() > 0);
+    CPPUNIT_ASSERT_EQUAL(original.rendered_frames(), replay.rendered_frames());
+    CPPUNIT_ASSERT_EQUAL(original.pcm_hash(), replay.pcm_hash());
+  }
+
+  void dma_upload_test() {
+    RoundTrip("dma_upload");
+  }
+
+  void reverb_test() {
+    RoundTrip("reverb");
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+/// \brief The Loop Detector Test class
+////////////////////////////////////////////////////////////////////////
+
+class LoopDetectorTest : public CPPUNIT_NS::TestFixture {
+
+  CPPUNIT_TEST_SUITE(LoopDetectorTest);
+  CPPUNIT_TEST(loop_test);
+  CPPUNIT_TEST(changed_loop_test);
+  CPPUNIT_TEST(silence_test);
+  CPPUNIT_TEST_SUITE_END();
+
+  static const uint32_t kRate = 44100;
+  static const int kIntroEvents = 5;
+  static const int kLoopEvents = 12;
+
+protected:
+  LoopDetector detector;
+
+  // A synthetic sequence: an intro, then a phrase of kLoopEvents key-ons
+  // which is played again and again. The gaps alternate between one and
+  // three seconds, so a period is 24 seconds, longer than the default
+  // minimum loop length. Returns the frame after the last event.
+  uint64_t Play(int repeats, int changed_event = -1) {
+    uint64_t frame = 0;
+    for (int i = 0; i < kIntroEvents; i++) {
+      detector.AddEvent(frame, 1000 + i);
+      frame += kRate / 2;
+    }
+    for (int r = 0; r < repeats; r++) {
+      for (int i = 0; i < kLoopEvents; i++) {
+        const int index = r * kLoopEvents + i;
+        // one frame of jitter, as sequencer ticks are not frame-aligned
+        detector.AddEvent(frame + (index & 1), (index == changed_event) ? 9999 : i);
+        frame += (i % 2 == 0) ? kRate : 3 * kRate;
+      }
+    }
+    return frame;
+  }
+
+public:
+  LoopDetectorTest() : detector(kRate) {}
+
+  void setUp() {
+    detector.Reset(kRate);
+  }
+
+  void tearDown() {}
+
+protected:
+  void loop_test() {
+    const uint64_t intro_frames = kIntroEvents * (kRate / 2);
+    const uint64_t period_frames = (kLoopEvents / 2) * 4 * kRate;
+    Play(1);
+    CPPUNIT_ASSERT(detector.HasLooped() == false);
+    detector.Reset(kRate);
+    Play(3);
+    CPPUNIT_ASSERT(detector.HasLooped());
+    CPPUNIT_ASSERT(detector.IsSilent() == false);
+    CPPUNIT_ASSERT_EQUAL(intro_frames, detector.loop_start());
+    CPPUNIT_ASSERT_EQUAL(intro_frames + period_frames, detector.loop_end());
+  }
+
+  void changed_loop_test() {
+    // a note of the second pass differs, so only the second and third passes repeat
+    Play(3, kLoopEvents + 3);
+    CPPUNIT_ASSERT(detector.HasLooped() == false);
+    detector.Reset(kRate);
+    Play(4, kLoopEvents + 3);
+    CPPUNIT_ASSERT(detector.HasLooped());
+    const uint64_t period_frames = (kLoopEvents / 2) * 4 * kRate;
+    CPPUNIT_ASSERT_EQUAL(period_frames, detector.loop_end() - detector.loop_start());
+    CPPUNIT_ASSERT(kIntroEvents * (kRate / 2) + period_frames <= detector.loop_start());
+  }
+
+  void silence_test() {
+    std::vector<int16_t> frames(2 * kRate, 0);
+    detector.AddFrames(frames.data(), kRate);   // leading silence does not count
+    CPPUNIT_ASSERT(detector.IsSilent() == false);
+    for (size_t i = 0; i < frames.size(); i++) {
+      frames[i] = (i & 2) ? 1000 : -1000;
+    }
+    detector.AddFrames(frames.data(), kRate / 2);
+    std::fill(frames.begin(), frames.end(), 0);
+    detector.AddFrames(frames.data(), kRate);
+    detector.AddFrames(frames.data(), kRate);
+    detector.AddFrames(frames.data(), kRate);
+    detector.AddFrames(frames.data(), kRate);
+    CPPUNIT_ASSERT(detector.IsSilent() == false);
+    detector.AddFrames(frames.data(), kRate);
+    CPPUNIT_ASSERT(detector.IsSilent());
+    CPPUNIT_ASSERT(detector.HasLooped() == false);
+    CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(kRate + kRate / 2), detector.silence_start());
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+/// \brief The Triple Buffer Test class
+////////////////////////////////////////////////////////////////////////
+
+class TripleBufferTest : public CPPUNIT_NS::TestFixture {
+
+  CPPUNIT_TEST_SUITE(TripleBufferTest);
+  CPPUNIT_TEST(publish_test);
+  CPPUNIT_TEST(skip_test);
+  CPPUNIT_TEST(thread_test);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+
+protected:
+  void publish_test() {
+    TripleBuffer<int> buffer;
+    CPPUNIT_ASSERT(buffer.Update() == false);   // nothing published yet
+    CPPUNIT_ASSERT_EQUAL(0, buffer.front());
+
+    buffer.back() = 1;
+    CPPUNIT_ASSERT(buffer.Update() == false);   // written, but not published
+    buffer.Publish();
+    CPPUNIT_ASSERT(&buffer.back() != &buffer.front());
+    CPPUNIT_ASSERT(buffer.Update());
+    CPPUNIT_ASSERT_EQUAL(1, buffer.front());
+    CPPUNIT_ASSERT(&buffer.back() != &buffer.front());
+
+    // the reader keeps its value until the next Publish()
+    buffer.back() = 2;
+    CPPUNIT_ASSERT(buffer.Update() == false);
+    CPPUNIT_ASSERT_EQUAL(1, buffer.front());
+    buffer.Publish();
+    CPPUNIT_ASSERT(buffer.Update());
+    CPPUNIT_ASSERT_EQUAL(2, buffer.front());
+    CPPUNIT_ASSERT(buffer.Update() == false);
+    CPPUNIT_ASSERT_EQUAL(2, buffer.front());
+  }
+
+  void skip_test() {
+    TripleBuffer<int> buffer;
+    for (int i = 1; i <= 5; i++) {
+      buffer.back() = i;
+      buffer.Publish();
+      CPPUNIT_ASSERT(&buffer.back() != &buffer.front());
+    }
+    // a slow reader gets the newest value only
+    CPPUNIT_ASSERT(buffer.Update());
+    CPPUNIT_ASSERT_EQUAL(5, buffer.front());
+    CPPUNIT_ASSERT(buffer.Update() == false);
+
+    buffer.back() = 6;
+    buffer.Publish();
+    buffer.back() = 7;      // overwrites a buffer the reader cannot see
+    CPPUNIT_ASSERT(buffer.Update());
+    CPPUNIT_ASSERT_EQUAL(6, buffer.front());
+  }
+
+  void thread_test() {
+    // the reader never sees a torn value nor goes back in time
+    struct Value { int a, b; };
+    TripleBuffer<Value> buffer;
+    const int count = 100000;
+    std::thread writer([&buffer] {
+      for (int i = 1; i <= count; i++) {
+        buffer.back().a = i;
+        buffer.back().b = -i;
+        buffer.Publish();
+      }
+    });
+    int last = 0;
+    bool is_torn = false, is_back = false;
+    while (last < count) {
+      if (buffer.Update() == false) continue;
+      const Value& value = buffer.front();
+      if (value.a != -value.b) is_torn = true;
+      if (value.a <= last) is_back = true;
+      last = value.a;
+    }
+    writer.join();
+    CPPUNIT_ASSERT(is_torn == false);
+    CPPUNIT_ASSERT(is_back == false);
+    CPPUNIT_ASSERT(buffer.Update() == false);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+/// \brief The Hardware Dispatch Test class
+////////////////////////////////////////////////////////////////////////
+
+class HardwareDispatchTest : public CPPUNIT_NS::TestFixture {
+
+  CPPUNIT_TEST_SUITE(HardwareDispatchTest);
+  CPPUNIT_TEST(ps1_test);
+  CPPUNIT_TEST(ps2_test);
+  CPPUNIT_TEST(plain_register_test);
+  CPPUNIT_TEST_SUITE_END();
+
+  typedef HardwareRegisters::Handler Handler;
+
+public:
+  void setUp() {}
+  void tearDown() {}
+
+protected:
+  // The handler the range checks and the switch of Read() and Write()
+  // chose before the dispatch table replaced them.
+  static Handler SwitchHandler(PSXAddr addr, bool is_write) {
+    if ((addr & 0xffffffc0) == 0x1f801100 ||
+        (addr & 0xffffffc0) == 0x1f801480) {
+      return HardwareRegisters::kRcnt;
+    }
+    switch (addr) {
+    case 0x1f801070: return HardwareRegisters::kIrqData;
+    case 0x1f801074: return HardwareRegisters::kIrqMask;
+    case 0x1f8010c8: return HardwareRegisters::kDMA4;
+    case 0x1f8010f4: return HardwareRegisters::kDICR;
+    case 0x1f801450: return is_write ? HardwareRegisters::kDefault : HardwareRegisters::kPortStatus;
+    case 0x1f801548: return HardwareRegisters::kDMA7;
+    default: break;
+    }
+    if ((addr & 0xfffffe00) == 0x1f801c00) return HardwareRegisters::kSPU;
+    return HardwareRegisters::kDefault;
+  }
+
+  // The handler the table dispatches to, mapped through the write table
+  // like Write() does: the port status is written as a plain register.
+  static Handler TableHandler(const HardwareRegisters& hw, PSXAddr addr, bool is_write) {
+    const Handler handler = hw.handler(addr);
+    if (is_write && handler == HardwareRegisters::kPortStatus) return HardwareRegisters::kDefault;
+    return handler;
+  }
+
+  // Compare every address of the table; returns the number of differences
+  // other than the IOP-only registers, which are counted in *iop.
+  static int CountDifferences(const HardwareRegisters& hw, int* iop) {
+    int diff = 0;
+    *iop = 0;
+    for (u32 i = 0; i < HardwareRegisters::kDispatchSize; i++) {
+      const PSXAddr addr = HardwareRegisters::kDispatchBase + i;
+      const bool is_iop = (addr & 0xffffffc0) == 0x1f801480 || addr == 0x1f801548;
+      for (int is_write = 0; is_write < 2; is_write++) {
+        if (TableHandler(hw, addr, is_write != 0) == SwitchHandler(addr, is_write != 0)) continue;
+        if (is_iop) {
+          (*iop)++;
+        } else {
+          diff++;
+        }
+      }
+    }
+    return diff;
+  }
+
+  void ps1_test() {
+    PSX psx(1);
+    int iop = 0;
+    CPPUNIT_ASSERT_EQUAL(0, CountDifferences(psx.HwRegs(), &iop));
+    // the root counters 3-5 and the core 1 DMA are plain registers on PS1
+    CPPUNIT_ASSERT_EQUAL(2 * (0x40 + 1), iop);
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(HardwareRegisters::kDefault),
+                         static_cast<int>(TableHandler(psx.HwRegs(), 0x1f801480, false)));
+  }
+
+  void ps2_test() {
+    PSX psx(2);
+    int iop = 0;
+    CPPUNIT_ASSERT_EQUAL(0, CountDifferences(psx.HwRegs(), &iop));
+    CPPUNIT_ASSERT_EQUAL(0, iop);
+  }
+
+  void plain_register_test() {
+    PSX psx(1);
+    HardwareRegisters& hw = psx.HwRegs();
+    hw.Write32(0x1f801010, 0x12345678);
+    CPPUNIT_ASSERT_EQUAL((u32)0x12345678, hw.Read32(0x1f801010));
+    CPPUNIT_ASSERT_EQUAL((u16)0x1234, hw.Read16(0x1f801012));
+    CPPUNIT_ASSERT_EQUAL((u8)0x56, hw.Read8(0x1f801011));
+    hw.Write16(0x1f801480, 0xabcd);
+    CPPUNIT_ASSERT_EQUAL((u16)0xabcd, hw.Read16(0x1f801480));
+    hw.Write32(0x1f801074, 0x0000ffff);
+    CPPUNIT_ASSERT_EQUAL((u32)0x0000ffff, hw.Read32(0x1f801074));
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+/// \brief The Task Group Test class
+////////////////////////////////////////////////////////////////////////
+
+class TaskGroupTest : public CPPUNIT_NS::TestFixture {
+
+  CPPUNIT_TEST_SUITE(TaskGroupTest);
+  CPPUNIT_TEST(inline_test);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+
+protected:
+  // Keeps every worker which takes kPriorityDecode busy until Release().
+  class Blocker {
+  public:
+    Blocker() : started_(0), finished_(0), released_(false) {
+      TaskPool& pool = TaskPool::Instance();
+      for (int i = 0; i < pool.worker_count(); i++) {
+        pool.Submit(TaskPool::kPriorityDecode, [this] {
+          std::unique_lock<std::mutex> locker(mutex_);
+          ++started_;
+          cond_.notify_all();
+          cond_.wait(locker, [this] { return released_; });
+          ++finished_;
+          cond_.notify_all();
+        });
+      }
+      std::unique_lock<std::mutex> locker(mutex_);
+      cond_.wait(locker, [this, &pool] { return started_ == pool.worker_count(); });
+    }
+
+    ~Blocker() {
+      std::unique_lock<std::mutex> locker(mutex_);
+      released_ = true;
+      cond_.notify_all();
+      cond_.wait(locker, [this] { return finished_ == started_; });
+    }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    int started_;
+    int finished_;
+    bool released_;
+  };
+
+  void inline_test() {
+    const int count = 8;
+    std::vector<std::thread::id> ids(count);
+    {
+      Blocker blocker;
+      TaskGroup group(TaskPool::kPriorityDecode);
+      for (int i = 0; i < count; i++) {
+        group.Run([&ids, i] { ids[i] = std::this_thread::get_id(); });
+      }
+      // no worker is free, so Wait() runs all of them here
+      group.Wait();
+      CPPUNIT_ASSERT(group.RunOne() == false);
+    }
+    for (int i = 0; i < count; i++) {
+      CPPUNIT_ASSERT(ids[i] == std::this_thread::get_id());
+    }
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+/// \brief The Performance Counters Test class
+////////////////////////////////////////////////////////////////////////
+
+class PerfCountersTest : public CPPUNIT_NS::TestFixture {
+
+  CPPUNIT_TEST_SUITE(PerfCountersTest);
+  CPPUNIT_TEST(add_test);
+  CPPUNIT_TEST(gauge_test);
+  CPPUNIT_TEST(rows_test);
+  CPPUNIT_TEST(timer_test);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+
+protected:
+  void add_test() {
+    const PerfCounters::Snapshot before = PerfCounters::Read();
+    PerfCounters::Add(PerfCounters::kDecodedSamples, 100);
+    PerfCounters::Add(PerfCounters::kDecodedSamples, 23);
+    // the slot of a thread which has exited is kept in the totals
+    std::thread thread([] { PerfCounters::Add(PerfCounters::kDecodedSamples, 1000); });
+    thread.join();
+    const PerfCounters::Snapshot after = PerfCounters::Read();
+    CPPUNIT_ASSERT_EQUAL((uint64_t)1123,
+                         after.counters[PerfCounters::kDecodedSamples] - before.counters[PerfCounters::kDecodedSamples]);
+    CPPUNIT_ASSERT(before.time <= after.time);
+  }
+
+  void gauge_test() {
+    PerfCounters::SetGauge(PerfCounters::kOpenALBuffers, 1000000);
+    PerfCounters::SetGauge(PerfCounters::kOpenALBuffers, 3);
+    const PerfCounters::Snapshot now = PerfCounters::Read();
+    CPPUNIT_ASSERT_EQUAL((int64_t)3, now.gauges[PerfCounters::kOpenALBuffers]);
+    CPPUNIT_ASSERT_EQUAL((int64_t)1000000, now.gauge_peaks[PerfCounters::kOpenALBuffers]);
+  }
+
+  void rows_test() {
+    PerfCounters::Snapshot since = PerfCounters::Start();
+    since.time = 1000000000ULL;
+    PerfCounters::Snapshot now = since;
+    now.time = since.time + 2000000000ULL;
+    now.counters[PerfCounters::kDecodedSamples] = 3000000;
+    now.counters[PerfCounters::kInterpreterTime] = 500000000;
+    now.gauges[PerfCounters::kSPURequestQueue] = 2;
+    now.gauge_peaks[PerfCounters::kSPURequestQueue] = 7;
+
+    const std::vector<PerfCounters::Row> rows = PerfCounters::Rows(now, since);
+    CPPUNIT_ASSERT_EQUAL((size_t)(PerfCounters::kCounterCount + PerfCounters::kGaugeCount), rows.size());
+    const PerfCounters::Row& samples = rows[PerfCounters::kDecodedSamples];
+    CPPUNIT_ASSERT_EQUAL(std::string("Decoded samples"), samples.name);
+    CPPUNIT_ASSERT_EQUAL(std::string("3.00 M"), samples.total);
+    CPPUNIT_ASSERT_EQUAL(std::string("1.50 M/s"), samples.rate);
+    const PerfCounters::Row& interpreter = rows[PerfCounters::kInterpreterTime];
+    CPPUNIT_ASSERT_EQUAL(std::string("500.0 ms"), interpreter.total);
+    CPPUNIT_ASSERT_EQUAL(std::string("25.0 %"), interpreter.rate);
+    const PerfCounters::Row& queue = rows[PerfCounters::kCounterCount + PerfCounters::kSPURequestQueue];
+    CPPUNIT_ASSERT_EQUAL(std::string("SPU request queue"), queue.name);
+    CPPUNIT_ASSERT_EQUAL(std::string("2"), queue.total);
+    CPPUNIT_ASSERT_EQUAL(std::string("peak 7"), queue.rate);
+  }
+
+  void timer_test() {
+    // nested timers count self time, so the two add up to the outer scope
+    const PerfCounters::Snapshot before = PerfCounters::Read();
+    uint64_t elapsed = 0;
+    std::thread thread([&elapsed] {
+      const uint64_t start = PerfCounters::Now();
+      {
+        PerfTimer outer(PerfCounters::kInterpreterTime);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        {
+          PerfTimer inner(PerfCounters::kSPUStepTime);
+          std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+      }
+      elapsed = PerfCounters::Now() - start;
+    });
+    thread.join();
+    const PerfCounters::Snapshot after = PerfCounters::Read();
+    const uint64_t outer = after.counters[PerfCounters::kInterpreterTime] - before.counters[PerfCounters::kInterpreterTime];
+    const uint64_t inner = after.counters[PerfCounters::kSPUStepTime] - before.counters[PerfCounters::kSPUStepTime];
+    CPPUNIT_ASSERT(5000000 <= outer);
+    CPPUNIT_ASSERT(5000000 <= inner);
+    CPPUNIT_ASSERT(outer + inner <= elapsed);
+  }
+};
+
 CPPUNIT_TEST_SUITE_REGISTRATION(InterpreterTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(RcntTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(SPULogTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(LoopDetectorTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(TripleBufferTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(HardwareDispatchTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(TaskGroupTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(PerfCountersTest);
 
 
 #include <cppunit/BriefTestProgressListener.h>
@@ -0,0 +1,522 @@
+#include "synthpsf.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace psx;
+using namespace psx::mips;
+
+
+namespace synthpsf {
+
+////////////////////////////////////////////////////////////////////////
+// SynthAssembler
+////////////////////////////////////////////////////////////////////////
+
+SynthAssembler::SynthAssembler(uint32_t origin) : origin_(origin) {}
+
+void SynthAssembler::LUI(uint32_t rt, uint16_t imm) {
+  Emit(EncodeI(OPCODE_LUI, GPR_ZR, rt, imm));
+}
+
+void SynthAssembler::ORI(uint32_t rt, uint32_t rs, uint16_t imm) {
+  Emit(EncodeI(OPCODE_ORI, rs, rt, imm));
+}
+
+void SynthAssembler::ANDI(uint32_t rt, uint32_t rs, uint16_t imm) {
+  Emit(EncodeI(OPCODE_ANDI, rs, rt, imm));
+}
+
+void SynthAssembler::ADDIU(uint32_t rt, uint32_t rs, int16_t imm) {
+  Emit(EncodeI(OPCODE_ADDIU, rs, rt, imm));
+}
+
+void SynthAssembler::ADDU(uint32_t rd, uint32_t rs, uint32_t rt) {
+  Emit(EncodeR(OPCODE_SPECIAL, rs, rt, rd, 0, SPECIAL_ADDU));
+}
+
+void SynthAssembler::OR(uint32_t rd, uint32_t rs, uint32_t rt) {
+  Emit(EncodeR(OPCODE_SPECIAL, rs, rt, rd, 0, SPECIAL_OR));
+}
+
+void SynthAssembler::SLL(uint32_t rd, uint32_t rt, uint32_t sa) {
+  Emit(EncodeR(OPCODE_SPECIAL, 0, rt, rd, sa, SPECIAL_SLL));
+}
+
+void SynthAssembler::LW(uint32_t rt, int16_t offset, uint32_t base) {
+  Emit(EncodeI(OPCODE_LW, base, rt, offset));
+}
+
+void SynthAssembler::LHU(uint32_t rt, int16_t offset, uint32_t base) {
+  Emit(EncodeI(OPCODE_LHU, base, rt, offset));
+}
+
+void SynthAssembler::SW(uint32_t rt, int16_t offset, uint32_t base) {
+  Emit(EncodeI(OPCODE_SW, base, rt, offset));
+}
+
+void SynthAssembler::SH(uint32_t rt, int16_t offset, uint32_t base) {
+  Emit(EncodeI(OPCODE_SH, base, rt, offset));
+}
+
+void SynthAssembler::JR(uint32_t rs) {
+  Emit(EncodeR(OPCODE_SPECIAL, rs, 0, 0, 0, SPECIAL_JR));
+}
+
+void SynthAssembler::LI(uint32_t rt, uint32_t value) {
+  if ((value >> 16) == 0) {
+    ORI(rt, GPR_ZR, value & 0xffff);
+    return;
+  }
+  LUI(rt, value >> 16);
+  if (value & 0xffff) {
+    ORI(rt, rt, value & 0xffff);
+  }
+}
+
+SynthAssembler::Label SynthAssembler::NewLabel() {
+  labels_.push_back(-1);
+  return static_cast<Label>(labels_.size() - 1);
+}
+
+void SynthAssembler::Bind(Label label) {
+  labels_[label] = static_cast<int64_t>(code_.size());
+}
+
+void SynthAssembler::BEQ(uint32_t rs, uint32_t rt, Label label) {
+  Fixup fixup = { code_.size(), label, kBranch };
+  fixups_.push_back(fixup);
+  Emit(EncodeI(OPCODE_BEQ, rs, rt, 0));
+}
+
+void SynthAssembler::BNE(uint32_t rs, uint32_t rt, Label label) {
+  Fixup fixup = { code_.size(), label, kBranch };
+  fixups_.push_back(fixup);
+  Emit(EncodeI(OPCODE_BNE, rs, rt, 0));
+}
+
+void SynthAssembler::J(Label label) {
+  Fixup fixup = { code_.size(), label, kJump };
+  fixups_.push_back(fixup);
+  Emit(EncodeJ(OPCODE_J, 0));
+}
+
+void SynthAssembler::JAL(Label label) {
+  Fixup fixup = { code_.size(), label, kJump };
+  fixups_.push_back(fixup);
+  Emit(EncodeJ(OPCODE_JAL, 0));
+}
+
+bool SynthAssembler::Finish() {
+  for (size_t i = 0; i < fixups_.size(); ++i) {
+    const Fixup& fixup = fixups_[i];
+    const int64_t target = labels_[fixup.label];
+    if (target < 0) return false;
+    uint32_t& ins = code_[fixup.index];
+    if (fixup.type == kBranch) {
+      // relative to the delay slot
+      const int64_t offset = target - static_cast<int64_t>(fixup.index) - 1;
+      if (offset < -0x8000 || 0x7fff < offset) return false;
+      ins = (ins & 0xffff0000) | (static_cast<uint32_t>(offset) & 0xffff);
+    } else {
+      const uint32_t addr = origin_ + 4 * static_cast<uint32_t>(target);
+      ins = EncodeJ(ins >> 26, addr >> 2);
+    }
+  }
+  fixups_.clear();
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// Patterns
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const SynthPattern kPatterns[] = {
+  // every voice restarted on every VSync
+  { "keyon_storm", 24, 1, false, false, 30 },
+  // the sample bank uploaded again before every step
+  { "dma_upload", 8, 2, true, false, 30 },
+  // long notes on every voice through the reverb
+  { "reverb", 24, 30, false, true, 30 },
+  // a typical song: 8 voices, a step every 6 VSyncs, reverb
+  { "sequencer", 8, 6, false, true, 30 }
+};
+
+}   // namespace
+
+const SynthPattern* patterns() {
+  return kPatterns;
+}
+
+int pattern_count() {
+  return static_cast<int>(sizeof(kPatterns) / sizeof(kPatterns[0]));
+}
+
+const SynthPattern* FindPattern(const char* name) {
+  for (int i = 0; i < pattern_count(); ++i) {
+    if (std::strcmp(kPatterns[i].name, name) == 0) return &kPatterns[i];
+  }
+  return nullptr;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// PS-X EXE and PSF1
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+inline void PutLE32(uint8_t* p, uint32_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = v >> 24;
+}
+
+}   // namespace
+
+std::vector<uint8_t> BuildPSXEXE(uint32_t pc0, uint32_t sp0, uint32_t text_addr,
+                                 const std::vector<uint8_t>& text) {
+  // the text section is padded to whole 2 KB sectors
+  const size_t text_size = (text.size() + 0x7ff) & ~static_cast<size_t>(0x7ff);
+  std::vector<uint8_t> exe(0x800 + text_size);
+  std::memcpy(exe.data(), "PS-X EXE", 8);
+  PutLE32(&exe[0x10], pc0);
+  PutLE32(&exe[0x18], text_addr);
+  PutLE32(&exe[0x1c], static_cast<uint32_t>(text_size));
+  PutLE32(&exe[0x30], sp0);
+  static const char kMarker[] = "Sony Computer Entertainment Inc. for North America area";
+  std::memcpy(&exe[0x4c], kMarker, sizeof(kMarker) - 1);
+  std::copy(text.begin(), text.end(), exe.begin() + 0x800);
+  return exe;
+}
+
+std::vector<uint8_t> BuildPSF1(const std::vector<uint8_t>& exe, const std::string& tags) {
+  uLongf compressed_size = compressBound(exe.size());
+  std::vector<uint8_t> psf(16 + compressed_size);
+  if (compress2(&psf[16], &compressed_size, exe.data(), exe.size(), Z_BEST_COMPRESSION) != Z_OK) {
+    return std::vector<uint8_t>();
+  }
+  psf.resize(16 + compressed_size);
+  std::memcpy(psf.data(), "PSF\x01", 4);
+  PutLE32(&psf[4], 0);  // no reserved area
+  PutLE32(&psf[8], static_cast<uint32_t>(compressed_size));
+  PutLE32(&psf[12], static_cast<uint32_t>(crc32(0, &psf[16], compressed_size)));
+  if (tags.empty() == false) {
+    static const char kTagMarker[] = "[TAG]";
+    psf.insert(psf.end(), kTagMarker, kTagMarker + 5);
+    psf.insert(psf.end(), tags.begin(), tags.end());
+  }
+  return psf;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// Songs
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// guest memory map of a song
+const uint32_t kCodeAddr = 0x80010000;
+const uint32_t kPitchTableAddr = 0x80018000;
+const uint32_t kStartTableAddr = 0x80018040;
+const uint32_t kBankAddr = 0x80020000;
+const uint32_t kStackAddr = 0x801ffff0;
+
+// the sample bank: 8 instruments of 64 ADPCM blocks, at 0x1000 of SPU RAM
+const int kInstruments = 8;
+const int kBlocksPerInstrument = 64;
+const int kLoopBlock = 32;
+const int kSamplesPerBlock = 28;
+const int kPeriod = 56;   // samples; two blocks, so that the loop is seamless
+const uint32_t kBankSize = kInstruments * kBlocksPerInstrument * 16;
+const uint32_t kSPUBankAddr = 0x1000;
+
+const double kPi = 3.14159265358979323846;
+
+const int kScaleLength = 16;
+// semitones from the pitch 0x1000, where a period of 56 samples is 787.5 Hz
+const int kScale[kScaleLength] = {
+  -24, -20, -17, -15, -12, -8, -5, -3, 0, -3, -5, -8, -12, -15, -17, -20
+};
+
+// "Room" of the PS1 reverb presets, for 0x1f801dc0-0x1f801dff
+const uint16_t kRoomPreset[32] = {
+  0x007d, 0x005b, 0x6d80, 0x54b8, 0xbed0, 0x0000, 0x0000, 0xba80,
+  0x5800, 0x5300, 0x04d6, 0x0333, 0x03f0, 0x0227, 0x0374, 0x01ef,
+  0x0334, 0x01b5, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+  0x0000, 0x0000, 0x01b4, 0x0136, 0x00b8, 0x005c, 0x8000, 0x8000
+};
+
+// hardware registers, relative to 0x1f800000 in s0
+const int16_t kIStat = 0x1070;
+const int16_t kIMask = 0x1074;
+const int16_t kDMA4MADR = 0x10c0;
+const int16_t kDMA4BCR = 0x10c4;
+const int16_t kDMA4CHCR = 0x10c8;
+const int16_t kDPCR = 0x10f0;
+const int16_t kVoice = 0x1c00;
+const int16_t kMainVolume = 0x1d80;
+const int16_t kReverbVolume = 0x1d84;
+const int16_t kKeyOn = 0x1d88;
+const int16_t kKeyOff = 0x1d8c;
+const int16_t kReverbOn = 0x1d98;
+const int16_t kReverbBase = 0x1da2;
+const int16_t kTransferAddr = 0x1da6;
+const int16_t kControl = 0x1daa;
+const int16_t kReverbConfig = 0x1dc0;
+
+int16_t Sample(int instrument, int n, uint32_t* seed) {
+  const double phase = static_cast<double>(n % kPeriod) / kPeriod;
+  double v;
+  switch (instrument % 4) {
+  case 0:  v = std::sin(2.0 * kPi * phase); break;
+  case 1:  v = 2.0 * phase - 1.0; break;
+  case 2:  v = (phase < ((instrument < 4) ? 0.5 : 0.25)) ? 1.0 : -1.0; break;
+  default: v = (phase < 0.5) ? 4.0 * phase - 1.0 : 3.0 - 4.0 * phase; break;
+  }
+  v *= 0x3000;
+  // a noisy attack which fades out before the loop
+  const int attack = kLoopBlock * kSamplesPerBlock;
+  if (n < attack) {
+    *seed = *seed * 1103515245 + 12345;
+    const int noise = static_cast<int>((*seed >> 16) & 0x7fff) - 0x4000;
+    v += noise * 0.5 * (attack - n) / attack;
+  }
+  return static_cast<int16_t>(std::max(-32768.0, std::min(32767.0, v)));
+}
+
+// Encode with filter 0 only, choosing the finest shift for each block.
+void EncodeBlock(const int16_t* samples, uint8_t flags, uint8_t* block) {
+  int peak = 0;
+  for (int i = 0; i < kSamplesPerBlock; ++i) {
+    peak = std::max(peak, std::abs(static_cast<int>(samples[i])));
+  }
+  int shift = 0;
+  for (int s = 12; 0 <= s; --s) {
+    const int scale = 1 << (12 - s);
+    if ((peak + scale / 2) / scale <= 7) {
+      shift = s;
+      break;
+    }
+  }
+  const int scale = 1 << (12 - shift);
+  block[0] = static_cast<uint8_t>(shift);
+  block[1] = flags;
+  for (int i = 0; i < kSamplesPerBlock; i += 2) {
+    int nibble[2];
+    for (int j = 0; j < 2; ++j) {
+      const int x = samples[i + j];
+      const int q = (x < 0) ? -((-x + scale / 2) / scale) : (x + scale / 2) / scale;
+      nibble[j] = std::max(-8, std::min(7, q)) & 0xf;
+    }
+    block[2 + i / 2] = static_cast<uint8_t>(nibble[0] | (nibble[1] << 4));
+  }
+}
+
+std::vector<uint8_t> BuildBank() {
+  std::vector<uint8_t> bank(kBankSize);
+  uint8_t* p = bank.data();
+  uint32_t seed = 1;
+  int16_t samples[kSamplesPerBlock];
+  for (int inst = 0; inst < kInstruments; ++inst) {
+    for (int b = 0; b < kBlocksPerInstrument; ++b, p += 16) {
+      for (int i = 0; i < kSamplesPerBlock; ++i) {
+        samples[i] = Sample(inst, b * kSamplesPerBlock + i, &seed);
+      }
+      uint8_t flags = 0;
+      if (b == kLoopBlock) flags = 0x06;                         // loop start
+      if (b == kBlocksPerInstrument - 1) flags = 0x03;           // end, repeat
+      EncodeBlock(samples, flags, p);
+    }
+  }
+  return bank;
+}
+
+inline uint16_t Pitch(int semitones) {
+  return static_cast<uint16_t>(std::lround(0x1000 * std::pow(2.0, semitones / 12.0)));
+}
+
+void PutLE16(std::vector<uint8_t>* text, uint32_t offset, uint16_t v) {
+  (*text)[offset] = v & 0xff;
+  (*text)[offset + 1] = v >> 8;
+}
+
+/*
+ * s0  0x1f800000, the base of the hardware registers
+ * s1  step count * 2, the index into the tables
+ * s2  VSyncs left until the next step
+ * s3  pitch table
+ * s4  start address table
+ */
+bool AssembleDriver(const SynthPattern& pattern, SynthAssembler* a) {
+  const uint32_t voice_mask = (pattern.voices < 24) ? ((1u << pattern.voices) - 1) : 0xffffff;
+  SynthAssembler::Label upload = a->NewLabel();
+  SynthAssembler::Label main_loop = a->NewLabel();
+  SynthAssembler::Label wait_vsync = a->NewLabel();
+
+  a->LUI(GPR_S0, 0x1f80);
+  a->LI(GPR_S3, kPitchTableAddr);
+  a->LI(GPR_S4, kStartTableAddr);
+
+  // enable DMA4, turn the SPU on and upload the sample bank
+  a->LW(GPR_T0, kDPCR, GPR_S0);
+  a->LUI(GPR_T1, 0x0008);
+  a->OR(GPR_T0, GPR_T0, GPR_T1);
+  a->SW(GPR_T0, kDPCR, GPR_S0);
+  a->LI(GPR_T0, pattern.reverb ? 0xc0a0 : 0xc020);  // on, unmuted, DMA write
+  a->SH(GPR_T0, kControl, GPR_S0);
+  a->LI(GPR_T0, 0x3fff);
+  a->SH(GPR_T0, kMainVolume, GPR_S0);
+  a->SH(GPR_T0, kMainVolume + 2, GPR_S0);
+  a->JAL(upload);
+  a->NOP();
+
+  if (pattern.reverb) {
+    for (int i = 0; i < 32; ++i) {
+      a->LI(GPR_T0, kRoomPreset[i]);
+      a->SH(GPR_T0, kReverbConfig + 2 * i, GPR_S0);
+    }
+    a->LI(GPR_T0, 0xfb28);  // work area of 0x26c0 bytes at the end of SPU RAM
+    a->SH(GPR_T0, kReverbBase, GPR_S0);
+    a->LI(GPR_T0, 0x2000);
+    a->SH(GPR_T0, kReverbVolume, GPR_S0);
+    a->SH(GPR_T0, kReverbVolume + 2, GPR_S0);
+    a->LI(GPR_T0, voice_mask & 0xffff);
+    a->SH(GPR_T0, kReverbOn, GPR_S0);
+    a->LI(GPR_T0, voice_mask >> 16);
+    a->SH(GPR_T0, kReverbOn + 2, GPR_S0);
+  }
+
+  for (int v = 0; v < pattern.voices; ++v) {
+    const int16_t base = kVoice + 16 * v;
+    const int pan = (v * 5) % 8;
+    a->LI(GPR_T0, 0x0200 + 0x80 * pan);
+    a->SH(GPR_T0, base + 0x0, GPR_S0);
+    a->LI(GPR_T0, 0x0200 + 0x80 * (7 - pan));
+    a->SH(GPR_T0, base + 0x2, GPR_S0);
+    a->LI(GPR_T0, 0x0a8a);  // ADSR1: linear attack 0x0a, decay 8, sustain level 0xa
+    a->SH(GPR_T0, base + 0x8, GPR_S0);
+    a->LI(GPR_T0, 0x5fc8);  // ADSR2: held sustain, linear release 8
+    a->SH(GPR_T0, base + 0xa, GPR_S0);
+  }
+
+  // VSync is polled in I_STAT; the interrupt itself stays disabled in SR
+  a->ORI(GPR_T0, GPR_ZR, 0x0001);
+  a->SW(GPR_T0, kIMask, GPR_S0);
+  a->SW(GPR_ZR, kIStat, GPR_S0);
+  a->ORI(GPR_S1, GPR_ZR, 0);
+  a->ORI(GPR_S2, GPR_ZR, 1);
+
+  a->Bind(main_loop);
+  a->Bind(wait_vsync);
+  a->LW(GPR_T0, kIStat, GPR_S0);
+  a->NOP();
+  a->ANDI(GPR_T0, GPR_T0, 0x0001);
+  a->BEQ(GPR_T0, GPR_ZR, wait_vsync);
+  a->NOP();
+  a->SW(GPR_ZR, kIStat, GPR_S0);
+  a->ADDIU(GPR_S2, GPR_S2, -1);
+  a->BNE(GPR_S2, GPR_ZR, main_loop);
+  a->NOP();
+  a->ORI(GPR_S2, GPR_ZR, pattern.ticks_per_step);
+
+  if (pattern.upload_each_step) {
+    a->JAL(upload);
+    a->NOP();
+  }
+
+  a->LI(GPR_T0, voice_mask & 0xffff);
+  a->SH(GPR_T0, kKeyOff, GPR_S0);
+  a->LI(GPR_T0, voice_mask >> 16);
+  a->SH(GPR_T0, kKeyOff + 2, GPR_S0);
+
+  for (int v = 0; v < pattern.voices; ++v) {
+    const int16_t base = kVoice + 16 * v;
+    // pitch[(step + 3v) % 16]
+    a->ADDIU(GPR_T1, GPR_S1, 6 * v);
+    a->ANDI(GPR_T1, GPR_T1, 2 * kScaleLength - 2);
+    a->ADDU(GPR_T1, GPR_T1, GPR_S3);
+    a->LHU(GPR_T2, 0, GPR_T1);
+    a->NOP();
+    a->SH(GPR_T2, base + 0x4, GPR_S0);
+    // instrument[(step + v) % 8]
+    a->ADDIU(GPR_T1, GPR_S1, 2 * v);
+    a->ANDI(GPR_T1, GPR_T1, 2 * kInstruments - 2);
+    a->ADDU(GPR_T1, GPR_T1, GPR_S4);
+    a->LHU(GPR_T2, 0, GPR_T1);
+    a->NOP();
+    a->SH(GPR_T2, base + 0x6, GPR_S0);
+  }
+
+  a->LI(GPR_T0, voice_mask & 0xffff);
+  a->SH(GPR_T0, kKeyOn, GPR_S0);
+  a->LI(GPR_T0, voice_mask >> 16);
+  a->SH(GPR_T0, kKeyOn + 2, GPR_S0);
+  a->ADDIU(GPR_S1, GPR_S1, 2);
+  a->J(main_loop);
+  a->NOP();
+
+  // DMA the sample bank into SPU RAM in blocks of 16 words
+  a->Bind(upload);
+  a->LI(GPR_T0, kSPUBankAddr >> 3);
+  a->SH(GPR_T0, kTransferAddr, GPR_S0);
+  a->LI(GPR_T0, kBankAddr);
+  a->SW(GPR_T0, kDMA4MADR, GPR_S0);
+  a->LI(GPR_T0, ((kBankSize / 64) << 16) | 16);
+  a->SW(GPR_T0, kDMA4BCR, GPR_S0);
+  a->LI(GPR_T0, 0x01000201);
+  a->SW(GPR_T0, kDMA4CHCR, GPR_S0);
+  a->JR(GPR_RA);
+  a->NOP();
+
+  return a->Finish();
+}
+
+}   // namespace
+
+std::vector<uint8_t> BuildSong(const SynthPattern& pattern) {
+  SynthAssembler a(kCodeAddr);
+  if (AssembleDriver(pattern, &a) == false || kPitchTableAddr < a.here()) {
+    return std::vector<uint8_t>();
+  }
+
+  std::vector<uint8_t> text(kBankAddr - kCodeAddr + kBankSize);
+  const std::vector<uint32_t>& code = a.code();
+  for (size_t i = 0; i < code.size(); ++i) {
+    PutLE32(&text[4 * i], code[i]);
+  }
+  for (int i = 0; i < kScaleLength; ++i) {
+    PutLE16(&text, kPitchTableAddr - kCodeAddr + 2 * i, Pitch(kScale[i]));
+  }
+  for (int i = 0; i < kInstruments; ++i) {
+    PutLE16(&text, kStartTableAddr - kCodeAddr + 2 * i,
+            (kSPUBankAddr + i * kBlocksPerInstrument * 16) >> 3);
+  }
+  const std::vector<uint8_t> bank(BuildBank());
+  std::copy(bank.begin(), bank.end(), text.begin() + (kBankAddr - kCodeAddr));
+
+  char tags[256];
+  std::snprintf(tags, sizeof(tags),
+                "\ntitle=synthetic %s\nartist=rennypsf\nlength=%d\nfade=0\n",
+                pattern.name, pattern.seconds);
+  return BuildPSF1(BuildPSXEXE(kCodeAddr, kStackAddr, kCodeAddr, text), tags);
+}
+
+bool WriteSong(const SynthPattern& pattern, const std::string& path) {
+  const std::vector<uint8_t> psf(BuildSong(pattern));
+  if (psf.empty()) return false;
+  FILE* fp = std::fopen(path.c_str(), "wb");
+  if (fp == nullptr) return false;
+  const bool ret = std::fwrite(psf.data(), 1, psf.size(), fp) == psf.size();
+  return (std::fclose(fp) == 0) && ret;
+}
+
+}   // namespace synthpsf
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "psf/psx/r3000a.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+/*
+ * Synthetic PSF1 files for benchmarks and regression tests.
+ *
+ * Commercial rips cannot be shipped with the sources, so these files are
+ * built from scratch: a small driver program, assembled by SynthAssembler,
+ * drives the SPU the way game sound drivers do, and is wrapped into a
+ * PS-X EXE and then a PSF1 which PSF1Loader loads like any other.
+ */
+namespace synthpsf {
+
+/*!
+ * @class SynthAssembler
+ * @brief Assembles R3000A code at a fixed address.
+ *
+ * Instructions are encoded with psx::mips::EncodeI/R/J as in psx_test.cc.
+ * Branches and jumps take labels which may be bound after their use;
+ * Finish() resolves them. Branch delay slots are not filled automatically.
+ */
+class SynthAssembler {
+public:
+  typedef int Label;
+
+  explicit SynthAssembler(uint32_t origin);
+
+  uint32_t origin() const { return origin_; }
+  //! Address of the next instruction.
+  uint32_t here() const { return origin_ + 4 * static_cast<uint32_t>(code_.size()); }
+  const std::vector<uint32_t>& code() const { return code_; }
+
+  void Emit(uint32_t ins) { code_.push_back(ins); }
+
+  void NOP() { Emit(0); }
+  void LUI(uint32_t rt, uint16_t imm);
+  void ORI(uint32_t rt, uint32_t rs, uint16_t imm);
+  void ANDI(uint32_t rt, uint32_t rs, uint16_t imm);
+  void ADDIU(uint32_t rt, uint32_t rs, int16_t imm);
+  void ADDU(uint32_t rd, uint32_t rs, uint32_t rt);
+  void OR(uint32_t rd, uint32_t rs, uint32_t rt);
+  void SLL(uint32_t rd, uint32_t rt, uint32_t sa);
+  void LW(uint32_t rt, int16_t offset, uint32_t base);
+  void LHU(uint32_t rt, int16_t offset, uint32_t base);
+  void SW(uint32_t rt, int16_t offset, uint32_t base);
+  void SH(uint32_t rt, int16_t offset, uint32_t base);
+  void JR(uint32_t rs);
+  //! Load a 32-bit constant in one or two instructions.
+  void LI(uint32_t rt, uint32_t value);
+
+  Label NewLabel();
+  void Bind(Label label);
+  void BEQ(uint32_t rs, uint32_t rt, Label label);
+  void BNE(uint32_t rs, uint32_t rt, Label label);
+  void J(Label label);
+  void JAL(Label label);
+
+  //! Resolve the labels; false if one is unbound or out of reach.
+  bool Finish();
+
+private:
+  enum FixupType { kBranch, kJump };
+  struct Fixup {
+    size_t index;
+    Label label;
+    FixupType type;
+  };
+
+  const uint32_t origin_;
+  std::vector<uint32_t> code_;
+  std::vector<int64_t> labels_;   // instruction index, or -1 if unbound
+  std::vector<Fixup> fixups_;
+};
+
+
+/*!
+ * @brief What a synthetic song does to the SPU.
+ *
+ * Every ticks_per_step VSyncs the driver keys off and keys on voices
+ * 0 to voices-1 again, each with the next pitch of a scale and the next
+ * of eight instruments of its sample bank.
+ */
+struct SynthPattern {
+  const char* name;
+  int voices;
+  int ticks_per_step;
+  bool upload_each_step;  // DMA the whole sample bank again on every step
+  bool reverb;            // "Room" reverb on every voice
+  int seconds;            // 'length' tag
+};
+
+//! The built-in patterns, pattern_count() of them.
+const SynthPattern* patterns();
+int pattern_count();
+const SynthPattern* FindPattern(const char* name);
+
+//! Wrap a text section into a PS-X EXE.
+std::vector<uint8_t> BuildPSXEXE(uint32_t pc0, uint32_t sp0, uint32_t text_addr,
+                                 const std::vector<uint8_t>& text);
+//! Compress a PS-X EXE into a PSF1 with the given "[TAG]" lines.
+std::vector<uint8_t> BuildPSF1(const std::vector<uint8_t>& exe, const std::string& tags);
+
+//! The whole PSF1 of a pattern, or an empty vector if it fails to build.
+std::vector<uint8_t> BuildSong(const SynthPattern& pattern);
+bool WriteSong(const SynthPattern& pattern, const std::string& path);
+
+}   // namespace synthpsf